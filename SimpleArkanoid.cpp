@@ -9,9 +9,66 @@
 #include <cassert>
 #include <type_traits>
 #include <functional>
+#include <tuple>
+#include <numeric>
+#include <limits>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <iterator>
+#include <fstream>
+#include <sstream>
+#include <ctime>
+#include <csignal>
+#include <optional>
+#include <future>
+#include <memory_resource>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define ARKANOID_MMAP
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define ARKANOID_PERF_EVENTS
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ARKANOID_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ARKANOID_NEON
+#endif
 
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
+#include <SFML/Audio.hpp>
+#include <SFML/Network.hpp>
+
+#include <SFML/OpenGL.hpp>
+#ifdef _WIN32
+#define ARKANOID_GLAPI __stdcall
+#else
+#define ARKANOID_GLAPI
+#endif
 
 using namespace std;
 using namespace sf;
@@ -21,30 +78,455 @@ using FrameTime = float;
 constexpr int windowWidth{800}, windowHeight{600};
 constexpr float ballRadius{10.0f}, ballVelocity{0.5f};
 constexpr float paddleWidth{60.0f}, paddleHeight{20.0f}, paddleVelocity{0.6f};
+// Pixels per millisecond squared the paddle speeds up and slows down at,
+// full speed in 60 ms. 0 for a paddle that is at full speed right away.
+constexpr float paddleAcceleration{0.01f};
+// Stick positions closer to the center than this are read as centered.
+constexpr float joystickDeadZone{0.15f};
 
 // Bricks
 constexpr float blockWidth{60.f}, blockHeight{20.f};
 constexpr int countBlockX{11}, countBlockY{4};
 
+// Powerups
+constexpr float powerupWidth{24.f}, powerupHeight{12.f}, powerupVelocity{0.2f};
+
 // Frametime calculations
 constexpr float ftStep{1.f}, ftSlice{1.f};
+// Most logic steps a frame runs, the time of any more is dropped.
+constexpr int maxFrameSteps{100};
+
+// The memory tracker replaces the allocation operators anyway, so it
+// counts the allocations too.
+#if defined(ARKANOID_MEMORY_TRACKING) && !defined(ARKANOID_COUNT_ALLOCATIONS)
+#define ARKANOID_COUNT_ALLOCATIONS
+#endif
+
+// With ARKANOID_COUNT_ALLOCATIONS every heap allocation goes through the
+// operators below, so benchmarks can report how many allocations an
+// operation does, and how many bytes it asked for. Other builds keep the
+// standard operators and both counts stay at 0.
+#ifdef ARKANOID_COUNT_ALLOCATIONS
+constexpr bool countingAllocations{true};
+#else
+constexpr bool countingAllocations{false};
+#endif
+std::atomic<std::size_t> allocationCount{0}, allocatedBytes{0};
+
+#ifdef ARKANOID_MEMORY_TRACKING
+// What the memory is allocated for. A `MemoryScope` sets the tag of the
+// allocations its thread makes while it lives.
+enum MemoryTag : std::uint8_t
+{
+    MOther,
+    MEntities,
+    MComponents,
+    MRender,
+    MCallbacks,
+    MCount
+};
+
+constexpr const char *memoryTagNames[MCount]{"other", "entities", "components", "render", "callbacks"};
+
+struct MemoryCounters
+{
+    std::atomic<std::size_t> live{0}, peak{0}, allocations{0};
+};
+
+std::array<MemoryCounters, MCount> memoryCounters;
+thread_local MemoryTag memoryTag{MOther};
+
+// Written in front of every block, so `delete` knows what to take off.
+// It keeps the alignment `malloc` gives the block.
+union MemoryHeader
+{
+    struct
+    {
+        std::size_t size;
+        MemoryTag tag;
+    } block;
+    std::max_align_t alignment;
+};
+
+class MemoryScope
+{
+  private:
+    MemoryTag previous;
+
+  public:
+    MemoryScope(MemoryTag mTag) noexcept : previous{memoryTag} { memoryTag = mTag; }
+    ~MemoryScope() { memoryTag = previous; }
+};
+
+void *allocateMemory(std::size_t mSize) noexcept
+{
+    auto header(static_cast<MemoryHeader *>(std::malloc(sizeof(MemoryHeader) + mSize)));
+    if (header == nullptr)
+        return nullptr;
+
+    header->block.size = mSize;
+    header->block.tag = memoryTag;
+
+    auto &counters(memoryCounters[memoryTag]);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto live(counters.live.fetch_add(mSize, std::memory_order_relaxed) + mSize);
+    auto peak(counters.peak.load(std::memory_order_relaxed));
+    while (live > peak && !counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        ;
+
+    return header + 1;
+}
+
+void freeMemory(void *mMemory) noexcept
+{
+    if (mMemory == nullptr)
+        return;
+
+    auto header(static_cast<MemoryHeader *>(mMemory) - 1);
+    memoryCounters[header->block.tag].live.fetch_sub(header->block.size, std::memory_order_relaxed);
+    std::free(header);
+}
+
+void printMemoryUsage(std::ostream &mStream)
+{
+    for (auto i(0u); i < MCount; ++i)
+        mStream << memoryTagNames[i] << ": " << memoryCounters[i].live.load() << " bytes live, "
+                << memoryCounters[i].peak.load() << " peak, " << memoryCounters[i].allocations.load()
+                << " allocations" << '\n';
+}
+#else
+// Tags are only kept by the memory tracker.
+enum MemoryTag : std::uint8_t
+{
+    MOther,
+    MEntities,
+    MComponents,
+    MRender,
+    MCallbacks
+};
+
+struct MemoryScope
+{
+    MemoryScope(MemoryTag) noexcept {}
+};
+
+void *allocateMemory(std::size_t mSize) noexcept
+{
+    return std::malloc(mSize != 0 ? mSize : 1);
+}
+
+void freeMemory(void *mMemory) noexcept
+{
+    std::free(mMemory);
+}
+#endif
+
+#ifdef ARKANOID_COUNT_ALLOCATIONS
+void *operator new(std::size_t mSize)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(mSize, std::memory_order_relaxed);
+
+    if (void *memory = allocateMemory(mSize))
+        return memory;
+
+    throw std::bad_alloc{};
+}
+
+// The standard library may not implement the other forms through the one
+// above, and a block it got from `malloc` can't go to `freeMemory`.
+void *operator new(std::size_t mSize, const std::nothrow_t &) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(mSize, std::memory_order_relaxed);
+
+    return allocateMemory(mSize);
+}
+
+void *operator new[](std::size_t mSize)
+{
+    return operator new(mSize);
+}
+
+void *operator new[](std::size_t mSize, const std::nothrow_t &mTag) noexcept
+{
+    return operator new(mSize, mTag);
+}
+
+void operator delete(void *mMemory) noexcept
+{
+    freeMemory(mMemory);
+}
+
+void operator delete(void *mMemory, const std::nothrow_t &) noexcept
+{
+    freeMemory(mMemory);
+}
+
+// The size is in the header of the tracked blocks, it isn't needed.
+void operator delete(void *mMemory, std::size_t) noexcept
+{
+    freeMemory(mMemory);
+}
+
+void operator delete[](void *mMemory) noexcept
+{
+    freeMemory(mMemory);
+}
+
+void operator delete[](void *mMemory, const std::nothrow_t &) noexcept
+{
+    freeMemory(mMemory);
+}
+
+void operator delete[](void *mMemory, std::size_t) noexcept
+{
+    freeMemory(mMemory);
+}
+#endif
 
 namespace CompositionArkanoid
 {
+// 16.16 fixed-point number. Every operation is integer arithmetic, so the
+// results are the same bit for bit whatever the compiler, its floating
+// point flags or the hardware. Positions fit as long as they stay within
+// +-32767 pixels.
+class Fixed
+{
+  private:
+    std::int32_t raw{0};
+
+  public:
+    static constexpr int fractionBits{16};
+    static constexpr std::int32_t one{1 << fractionBits};
+    static constexpr std::int32_t highestRaw{std::numeric_limits<std::int32_t>::max()};
+
+    constexpr Fixed() = default;
+    // Rounded to the nearest step, scaling by a power of two is exact.
+    explicit Fixed(float mValue) : raw{static_cast<std::int32_t>(std::lround(mValue * one))} {}
+    explicit Fixed(int mValue) : raw{mValue * one} {}
+
+    static Fixed fromRaw(std::int32_t mRaw) noexcept
+    {
+        Fixed fixed;
+        fixed.raw = mRaw;
+        return fixed;
+    }
+
+    std::int32_t getRaw() const noexcept { return raw; }
+    explicit operator float() const noexcept { return static_cast<float>(raw) / one; }
+
+    Fixed operator-() const noexcept { return fromRaw(-raw); }
+    Fixed &operator+=(Fixed mOther) noexcept { raw += mOther.raw; return *this; }
+    Fixed &operator-=(Fixed mOther) noexcept { raw -= mOther.raw; return *this; }
+
+    // Products and quotients go through 64 bits, then round to nearest.
+    Fixed &operator*=(Fixed mOther) noexcept
+    {
+        raw = static_cast<std::int32_t>((std::int64_t{raw} * mOther.raw + (one / 2)) >> fractionBits);
+        return *this;
+    }
+
+    // Saturated instead of overflowing, e.g. for the times of impact of
+    // the sweeps that divide by tiny movements.
+    Fixed &operator/=(Fixed mOther) noexcept
+    {
+        const std::int64_t quotient{(std::int64_t{raw} * one) / mOther.raw}, limit{highestRaw};
+        raw = static_cast<std::int32_t>(std::max(std::min(quotient, limit), -limit));
+        return *this;
+    }
+
+    friend Fixed operator+(Fixed mA, Fixed mB) noexcept { return mA += mB; }
+    friend Fixed operator-(Fixed mA, Fixed mB) noexcept { return mA -= mB; }
+    friend Fixed operator*(Fixed mA, Fixed mB) noexcept { return mA *= mB; }
+    friend Fixed operator/(Fixed mA, Fixed mB) noexcept { return mA /= mB; }
+
+    friend bool operator==(Fixed mA, Fixed mB) noexcept { return mA.raw == mB.raw; }
+    friend bool operator!=(Fixed mA, Fixed mB) noexcept { return mA.raw != mB.raw; }
+    friend bool operator<(Fixed mA, Fixed mB) noexcept { return mA.raw < mB.raw; }
+    friend bool operator>(Fixed mA, Fixed mB) noexcept { return mA.raw > mB.raw; }
+    friend bool operator<=(Fixed mA, Fixed mB) noexcept { return mA.raw <= mB.raw; }
+    friend bool operator>=(Fixed mA, Fixed mB) noexcept { return mA.raw >= mB.raw; }
+};
+
+// The maths the simulation needs, for both kinds of scalars. For floats
+// they are the standard functions, so float builds are unchanged.
+inline float absolute(float mValue) noexcept { return std::abs(mValue); }
+inline Fixed absolute(Fixed mValue) noexcept { return mValue < Fixed{} ? -mValue : mValue; }
+
+inline float squareRoot(float mValue) noexcept { return std::sqrt(mValue); }
+
+inline float sine(float mAngle) noexcept { return std::sin(mAngle); }
+inline float cosine(float mAngle) noexcept { return std::cos(mAngle); }
+
+// Taylor series around 0, within a few steps of a 16.16 number for angles
+// from -pi to pi, the range is first brought back there.
+inline Fixed sine(Fixed mAngle) noexcept
+{
+    const Fixed pi(3.14159265f), tau(6.28318531f);
+    while (mAngle > pi)
+        mAngle -= tau;
+    while (mAngle < -pi)
+        mAngle += tau;
+
+    const Fixed square{mAngle * mAngle};
+    Fixed term{mAngle}, sum{mAngle};
+    for (int i{1}; i <= 8; ++i)
+    {
+        term = -term * square / Fixed{(2 * i) * (2 * i + 1)};
+        sum += term;
+    }
+
+    return sum;
+}
+
+inline Fixed cosine(Fixed mAngle) noexcept
+{
+    return sine(mAngle + Fixed(1.57079633f));
+}
+
+// Larger than any time or distance, infinity for floats.
+template <typename TScalar>
+TScalar highest() noexcept
+{
+    return std::numeric_limits<TScalar>::infinity();
+}
+
+template <>
+inline Fixed highest<Fixed>() noexcept
+{
+    return Fixed::fromRaw(Fixed::highestRaw);
+}
+
+// Integer square root of the raw value shifted by the fraction bits: the
+// estimate from a double is exact enough to only be off by one, and the
+// correction is integer again.
+inline Fixed squareRoot(Fixed mValue) noexcept
+{
+    if (mValue.getRaw() <= 0)
+        return Fixed{};
+
+    const std::uint64_t square{static_cast<std::uint64_t>(mValue.getRaw()) << Fixed::fractionBits};
+    auto root(static_cast<std::uint64_t>(std::sqrt(static_cast<double>(square))));
+    while (root * root > square)
+        --root;
+    while ((root + 1) * (root + 1) <= square)
+        ++root;
+
+    return Fixed::fromRaw(static_cast<std::int32_t>(root));
+}
+
+// What positions and velocities are made of. Floats by default, 16.16
+// fixed-point numbers with ARKANOID_FIXED_POINT, for replays and network
+// games that have to simulate the same on every machine.
+#ifdef ARKANOID_FIXED_POINT
+using PhysicsScalar = Fixed;
+#else
+using PhysicsScalar = float;
+#endif
+using PhysicsVector = sf::Vector2<PhysicsScalar>;
+
+// Between the simulation and everything else (drawing, the grids, the
+// network), that keep working with floats.
+inline float toFloat(float mValue) noexcept { return mValue; }
+inline float toFloat(Fixed mValue) noexcept { return static_cast<float>(mValue); }
+inline const Vector2f &toVector2f(const Vector2f &mVector) noexcept { return mVector; }
+inline Vector2f toVector2f(const sf::Vector2<Fixed> &mVector) noexcept { return Vector2f{mVector}; }
+
+template <typename TScalar>
+sf::Vector2<TScalar> fromVector2f(const Vector2f &mVector) noexcept
+{
+    return sf::Vector2<TScalar>{mVector};
+}
+
 struct Component;
 class Entity;
 struct Manager;
 struct Game;
 
+struct CPosition;
+struct CPhysics;
+struct CCircle;
+struct CRectangle;
+struct CPaddleControl;
+struct CBrick;
+struct CSprite;
+struct CPowerup;
+struct CAutopilot;
+
 using ComponentID = std::size_t;
 using Group = std::size_t;
 
+template <typename... Ts>
+struct TypeList
+{
+    static constexpr std::size_t size{sizeof...(Ts)};
+};
+
+// Position of T inside a TypeList.
+template <typename T, typename TList>
+struct IndexOf;
+
+template <typename T, typename... Ts>
+struct IndexOf<T, TypeList<T, Ts...>> : std::integral_constant<std::size_t, 0>
+{
+};
+
+template <typename T, typename TFirst, typename... Ts>
+struct IndexOf<T, TypeList<TFirst, Ts...>>
+    : std::integral_constant<std::size_t, 1 + IndexOf<T, TypeList<Ts...>>::value>
+{
+};
+
+template <typename T, typename TList>
+struct Contains;
+
+template <typename T, typename... Ts>
+struct Contains<T, TypeList<Ts...>> : std::bool_constant<(std::is_same_v<T, Ts> || ...)>
+{
+};
+
+// Every component type of the game. Building with
+// ARKANOID_STATIC_COMPONENT_IDS makes the ID of a component its position in
+// this list, known at compile time, and sizes the component bitset and
+// arrays to the number of components. Without it, IDs are handed out at
+// runtime the first time each type is used.
+using ComponentList =
+    TypeList<CPosition, CPhysics, CCircle, CRectangle, CPaddleControl, CBrick, CSprite, CPowerup, CAutopilot>;
+
+#ifdef ARKANOID_STATIC_COMPONENT_IDS
+template <typename T>
+constexpr ComponentID getComponentTypeID() noexcept
+{
+    static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
+    static_assert(Contains<T, ComponentList>::value, "T must be part of ComponentList");
+    return IndexOf<T, ComponentList>::value;
+}
+
+constexpr std::size_t maxComponents{ComponentList::size};
+#else
+// Max number of componets, ARKANOID_MAX_COMPONENTS changes it.
+#ifndef ARKANOID_MAX_COMPONENTS
+#define ARKANOID_MAX_COMPONENTS 32
+#endif
+constexpr std::size_t maxComponents{ARKANOID_MAX_COMPONENTS};
+
 namespace Internal
 {
+// Types can be used for the first time on several threads at once, the
+// counter is atomic so they still get different IDs. An ID past the
+// bitset would silently corrupt every entity, so it stops the game.
 inline ComponentID getUniqueComponentID() noexcept
 {
-    static ComponentID lastID{0u};
-    return lastID++;
+    static std::atomic<ComponentID> lastID{0u};
+    const auto id(lastID.fetch_add(1, std::memory_order_relaxed));
+    if (id >= maxComponents)
+    {
+        cerr << "Too many component types, maxComponents is " << maxComponents << endl;
+        std::abort();
+    }
+
+    return id;
 }
 } // namespace Internal
 
@@ -53,580 +535,16743 @@ inline ComponentID getComponentTypeID() noexcept
 {
     // Make sure this function is only called with types that inherit from `Component`.
     static_assert(std::is_base_of<Component, T>::value, "T must inherit from Component");
-    static ComponentID typeID{Internal::getUniqueComponentID()};
+    // Initialized once, by the first thread that gets here.
+    static const ComponentID typeID{Internal::getUniqueComponentID()};
     return typeID;
 }
-
-// Max number of componets
-constexpr std::size_t maxComponents{32};
+#endif
 
 // Define a bitset for out components
 using ComponentBitset = std::bitset<maxComponents>;
 
-// And also define an array for them.
-using ComponentArray = std::array<Component *, maxComponents>;
+// Components live in per-type pools, so entities only keep the index
+// of each component inside the pool of its type.
+using ComponentIndex = std::uint32_t;
+constexpr ComponentIndex invalidComponentIndex{std::numeric_limits<ComponentIndex>::max()};
 
-constexpr std::size_t maxGroups{32};
+// Max number of groups, ARKANOID_MAX_GROUPS changes it.
+#ifndef ARKANOID_MAX_GROUPS
+#define ARKANOID_MAX_GROUPS 32
+#endif
+constexpr std::size_t maxGroups{ARKANOID_MAX_GROUPS};
 using GroupBitset = std::bitset<maxGroups>;
 
-struct Component
+// Which groups collide with which: every group is a layer, and its mask
+// has the bits of the groups it collides with. Pairs always collide both
+// ways. The collision code asks it before testing two groups against
+// each other, so a group only pays for the pairs that matter, and adding
+// one is a line of `enable` instead of another loop.
+class CollisionMatrix
 {
-    // Pointer to parent entity
-    Entity *entity;
+  private:
+    std::array<GroupBitset, maxGroups> masks;
 
-    virtual void init() {}
-    virtual void update(float mFT) {}
-    virtual void draw() {}
+  public:
+    void enable(std::size_t mGroupA, std::size_t mGroupB) noexcept
+    {
+        masks[mGroupA].set(mGroupB);
+        masks[mGroupB].set(mGroupA);
+    }
 
-    virtual ~Component() {}
-};
+    void disable(std::size_t mGroupA, std::size_t mGroupB) noexcept
+    {
+        masks[mGroupA].reset(mGroupB);
+        masks[mGroupB].reset(mGroupA);
+    }
 
-class Entity
-{
-  private:
-    Manager &manager;
-    // Used to know if the entity is aliver or not
-    bool alive{true};
+    bool test(std::size_t mGroupA, std::size_t mGroupB) const noexcept { return masks[mGroupA][mGroupB]; }
 
-    // Here we store components to allow polymorphism
-    std::vector<std::unique_ptr<Component>> components;
+    // Whether an entity in the groups `mGroupsA` collides with one in
+    // `mGroupsB`, for entities in several groups.
+    bool test(const GroupBitset &mGroupsA, const GroupBitset &mGroupsB) const noexcept
+    {
+        for (std::size_t i{0}; i < maxGroups; ++i)
+            if (mGroupsA[i] && (masks[i] & mGroupsB).any())
+                return true;
 
-    // Arrays to get a component with specific ID and known the existing of a
-    // component with specific ID.
-    ComponentArray componentArray;
-    ComponentBitset componentBitset;
+        return false;
+    }
 
-    GroupBitset groupBitset;
+    const GroupBitset &getMask(std::size_t mGroup) const noexcept { return masks[mGroup]; }
+};
+
+// Position of an entity inside each of its group vectors, so it can be
+// removed from them without searching.
+using GroupIndex = std::uint32_t;
+constexpr GroupIndex invalidGroupIndex{std::numeric_limits<GroupIndex>::max()};
+
+// Entities keep an index (of a component in its pool, or of the entity
+// in a group vector) for each of the keys they have, out of `TKeys`
+// possible ones.
+//
+// The dense map has a slot for every key, lookups are a plain array
+// access but every entity pays for all the keys it doesn't have.
+template <std::size_t TKeys, typename TValue>
+class DenseIndexMap
+{
+  private:
+    std::bitset<TKeys> keys;
+    std::array<TValue, TKeys> values;
 
   public:
-    Entity(Manager &mManager) : manager(mManager) {}
+    const std::bitset<TKeys> &getKeys() const noexcept { return keys; }
+    bool has(std::size_t mKey) const noexcept { return keys[mKey]; }
 
-    void update(float mFT)
+    TValue get(std::size_t mKey) const noexcept
     {
-        for (auto &component : components)
-            component->update(mFT);
+        assert(has(mKey));
+        return values[mKey];
     }
-    void draw()
+
+    void set(std::size_t mKey, TValue mValue) noexcept
     {
-        for (auto &component : components)
-            component->draw();
+        keys[mKey] = true;
+        values[mKey] = mValue;
     }
 
-    bool isAlive() const { return alive; }
-    void destroy() { alive = false; }
+    void erase(std::size_t mKey) noexcept { keys[mKey] = false; }
+};
 
-    // To check if an entity has a component.
-    template <typename T>
-    bool hasComponent() const
+// The packed map only stores the values of the keys present, in key
+// order, and at most `TCapacity` of them. The slot of a key is the
+// number of keys below it: entities are a few times smaller, lookups
+// cost a shift and a popcount.
+template <std::size_t TKeys, typename TValue, std::size_t TCapacity>
+class PackedIndexMap
+{
+  private:
+    std::bitset<TKeys> keys;
+    std::array<TValue, TCapacity> values;
+
+    std::size_t getSlot(std::size_t mKey) const noexcept
     {
-        return componentBitset[getComponentTypeID<T>()];
+        // Only the keys below `mKey` are left, shifted to the top.
+        return mKey == 0 ? 0 : (keys << (TKeys - mKey)).count();
     }
 
-    bool hasGroup(Group mGroup) const noexcept
+  public:
+    const std::bitset<TKeys> &getKeys() const noexcept { return keys; }
+    bool has(std::size_t mKey) const noexcept { return keys[mKey]; }
+
+    TValue get(std::size_t mKey) const noexcept
     {
-        return groupBitset[mGroup];
+        assert(has(mKey));
+        return values[getSlot(mKey)];
     }
 
-    void addGroup(Group mGroup) noexcept;
-    void delGroup(Group mGroup) noexcept
+    void set(std::size_t mKey, TValue mValue) noexcept
     {
-        groupBitset[mGroup] = false;
+        const auto slot(getSlot(mKey));
+        if (!keys[mKey])
+        {
+            const auto size(keys.count());
+            if (size == TCapacity)
+            {
+                cerr << "An entity can only have " << TCapacity << " of these, the map is full" << endl;
+                std::abort();
+            }
+
+            std::copy_backward(values.data() + slot, values.data() + size, values.data() + size + 1);
+            keys[mKey] = true;
+        }
+
+        values[slot] = mValue;
     }
 
-    template <typename T, typename... TArgs>
-    T &addComponent(TArgs &&... mArgs)
+    void erase(std::size_t mKey) noexcept
     {
-        assert(!hasComponent<T>());
+        if (!keys[mKey])
+            return;
 
-        T *c(new T(std::forward<TArgs>(mArgs)...));
-        c->entity = this;
-        std::unique_ptr<Component> uPtr{c};
-        components.emplace_back(std::move(uPtr));
+        const auto slot(getSlot(mKey)), size(keys.count());
+        std::copy(values.data() + slot + 1, values.data() + size, values.data() + slot);
+        keys[mKey] = false;
+    }
+};
 
-        componentArray[getComponentTypeID<T>()] = c;
-        componentBitset[getComponentTypeID<T>()] = true;
+// ARKANOID_DENSE_ENTITY_MAPS gives every entity the dense maps, by
+// default they are packed with room for this many keys.
+constexpr std::size_t maxEntityComponents{8};
+constexpr std::size_t maxEntityGroups{4};
 
-        c->init();
+#ifdef ARKANOID_DENSE_ENTITY_MAPS
+template <std::size_t TKeys, typename TValue, std::size_t TCapacity>
+using EntityIndexMap = DenseIndexMap<TKeys, TValue>;
+#else
+template <std::size_t TKeys, typename TValue, std::size_t TCapacity>
+using EntityIndexMap = PackedIndexMap<TKeys, TValue, TCapacity>;
+#endif
 
-        return *c;
-    }
+using ComponentIndexMap = EntityIndexMap<maxComponents, ComponentIndex, maxEntityComponents>;
+using GroupIndexMap = EntityIndexMap<maxGroups, GroupIndex, maxEntityGroups>;
 
-    template <typename T>
-    T &getComponent() const
+// Max number of different component signatures `Manager::view` is asked
+// for.
+constexpr std::size_t maxViews{64};
+using ViewBitset = std::bitset<maxViews>;
+
+// Handles are the safe way to keep a reference to an entity: the slot of
+// the entity in the manager's pool plus the generation of that slot, which
+// is increased every time the slot is freed. Resolving a handle to an
+// entity that was destroyed fails in O(1) instead of dangling.
+using EntityGeneration = std::uint32_t;
+
+struct EntityHandle
+{
+    std::size_t index;
+    EntityGeneration generation;
+};
+
+// Call `mFunction(id)` for the ID of every component in `mBitset`, in
+// order. It stops at the highest one, with the few components of a
+// typical entity that is much faster than testing every bit.
+template <typename TF>
+void forEachComponentID(const ComponentBitset &mBitset, TF &&mFunction)
+{
+    if (maxComponents > 64)
     {
-        assert(hasComponent<T>());
-        auto ptr(componentArray[getComponentTypeID<T>()]);
-        return *static_cast<T *>(ptr);
+        for (auto i(0u); i < maxComponents; ++i)
+            if (mBitset[i])
+                mFunction(i);
+        return;
     }
+
+    auto bits(mBitset.to_ullong());
+    for (ComponentID i{0}; bits != 0; ++i, bits >>= 1)
+        if ((bits & 1) != 0)
+            mFunction(i);
+}
+
+// Give every type of `TypeList<Ts...>` its ID now, in the order of the
+// list, so the IDs are the same in every run whichever thread uses a
+// type first.
+template <typename... Ts>
+void registerComponentTypes(TypeList<Ts...>) noexcept
+{
+    ((void)getComponentTypeID<Ts>(), ...);
+}
+
+// Build the bitset with the IDs of every component in `Ts`.
+template <typename... Ts>
+ComponentBitset getComponentSignature() noexcept
+{
+    ComponentBitset signature;
+    (signature.set(getComponentTypeID<Ts>()), ...);
+    return signature;
+}
+
+struct Component
+{
+    // Pointer to parent entity
+    Entity *entity;
+
+    virtual void init() {}
+    virtual void update(float mFT) {}
+    virtual void draw() {}
+    // Called after a snapshot wrote its bytes over the component, to bring
+    // what mirrors it outside the manager up to date.
+    virtual void restored() {}
+
+  protected:
+    // Components are only ever destroyed by their pool, which knows their
+    // type. Without a virtual destructor the plain data ones are trivially
+    // destructible, and their pools free them without a loop.
+    ~Component() = default;
 };
 
-struct Manager
+// True when T provides its own `update`/`draw` instead of the empty defaults,
+// so pools of pure data components can skip their loops at compile time.
+template <typename T>
+struct HasOwnUpdate
+    : std::integral_constant<bool, !std::is_same<decltype(&T::update), void (Component::*)(float)>::value>
 {
-  private:
-    std::vector<std::unique_ptr<Entity>> entities;
-    std::array<std::vector<Entity *>, maxGroups> groupedEntities;
+};
+
+template <typename T>
+struct HasOwnDraw
+    : std::integral_constant<bool, !std::is_same<decltype(&T::draw), void (Component::*)()>::value>
+{
+};
+
+// Occupancy of a pool, see `ObjectPool::getCount`.
+struct PoolStats
+{
+    std::size_t count, slots, capacity;
+};
+
+// Type erased interface so the manager can keep a pool for every component
+// type in a single array indexed by `getComponentTypeID<T>()`.
+struct ComponentPoolBase
+{
+    virtual void update(float mFT) = 0;
+    virtual void draw() = 0;
+    // Returns the entity of the component that was moved into `mIndex`
+    // to keep the pool dense, nullptr when none was.
+    virtual Entity *release(ComponentIndex mIndex) = 0;
+
+    // Snapshots copy the components as plain bytes, `getComponentSize`
+    // of them each.
+    virtual std::size_t getComponentSize() const noexcept = 0;
+    virtual void save(ComponentIndex mIndex, unsigned char *mBytes) const = 0;
+    virtual void restore(ComponentIndex mIndex, const unsigned char *mBytes) = 0;
+    // Create a component from the bytes of a saved one, `init` isn't
+    // called yet.
+    virtual ComponentIndex createFrom(const unsigned char *mBytes, Entity &mEntity) = 0;
+    virtual void init(ComponentIndex mIndex) = 0;
+
+    // Move the component in slot `mOrder[i]` to slot `i`.
+    virtual void reorder(const std::vector<ComponentIndex> &mOrder) = 0;
+
+    // Release the components of the dead entities in one pass, see
+    // `ComponentPool::releaseDead`.
+    virtual void releaseDead() = 0;
+    // Destroy every component, the entities are told nothing.
+    virtual void clear() noexcept = 0;
+
+    virtual PoolStats getStats() const noexcept = 0;
+
+    virtual ~ComponentPoolBase() {}
+};
+
+// Pool of objects of type T, constructed in place and recycled through a
+// free list so creating and destroying them doesn't hit the system
+// allocator once the pool has grown.
+// Slots are allocated in fixed-size chunks instead of a single growing
+// array, that way the pointers into the pool are never invalidated when
+// the pool grows.
+template <typename T>
+class ObjectPool
+{
+  private:
+    static constexpr std::size_t chunkSize{256};
+
+    using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+    using Chunk = std::array<Slot, chunkSize>;
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    // Marks which slots hold a constructed object.
+    std::vector<bool> used;
+    // Released slots are reused before growing the pool.
+    std::vector<std::size_t> freeIndices;
+    // Kept by `reorder` to avoid allocating every time.
+    std::vector<Slot> reorderedSlots;
+    // Constructed objects, kept as they come and go instead of counting
+    // `used`.
+    std::size_t count{0};
+
+    T *slot(std::size_t mIndex) const noexcept
+    {
+        return reinterpret_cast<T *>(&(*chunks[mIndex / chunkSize])[mIndex % chunkSize]);
+    }
+
+  public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    ~ObjectPool() { clear(); }
+
+    // Destroy every object at once, the chunks stay for the next ones.
+    // Trivially destructible objects are just forgotten.
+    void clear() noexcept
+    {
+        if constexpr (!std::is_trivially_destructible<T>::value)
+            for (auto i(0u); i < used.size(); ++i)
+                if (used[i])
+                    slot(i)->~T();
+
+        used.clear();
+        freeIndices.clear();
+        count = 0;
+    }
+
+    // Index the next call to `create` will use.
+    std::size_t nextIndex() const noexcept
+    {
+        return freeIndices.empty() ? used.size() : freeIndices.back();
+    }
+
+    // A free slot, marked as used, for the caller to construct the
+    // object in.
+    std::size_t allocate()
+    {
+        std::size_t index;
+
+        if (!freeIndices.empty())
+        {
+            index = freeIndices.back();
+            freeIndices.pop_back();
+        }
+        else
+        {
+            index = used.size();
+            used.emplace_back(false);
+
+            if (index / chunkSize >= chunks.size())
+            {
+                chunks.emplace_back(new Chunk);
+                // Room for every slot to be released, `release` never
+                // allocates.
+                freeIndices.reserve(chunks.size() * chunkSize);
+            }
+        }
+
+        used[index] = true;
+        ++count;
+        return index;
+    }
+
+    template <typename... TArgs>
+    std::size_t create(TArgs &&... mArgs)
+    {
+        const auto index(allocate());
+        new (slot(index)) T(std::forward<TArgs>(mArgs)...);
+
+        return index;
+    }
+
+    // Construct the object in the free slot `mIndex`. The free list is
+    // left as it is, `rebuildFreeList` must be called before the next
+    // `create`.
+    template <typename... TArgs>
+    void createAt(std::size_t mIndex, TArgs &&... mArgs)
+    {
+        while (used.size() <= mIndex)
+        {
+            if (used.size() / chunkSize >= chunks.size())
+            {
+                chunks.emplace_back(new Chunk);
+                freeIndices.reserve(chunks.size() * chunkSize);
+            }
+            used.emplace_back(false);
+        }
+
+        assert(!used[mIndex]);
+        new (slot(mIndex)) T(std::forward<TArgs>(mArgs)...);
+        used[mIndex] = true;
+        ++count;
+    }
+
+    // Move the object of slot `mOrder[i]` to slot `i`, the slots past the
+    // last one are left free. Objects are moved as plain bytes, like
+    // snapshots copy them, so nothing may point into them from outside.
+    template <typename TIndex>
+    void reorder(const std::vector<TIndex> &mOrder)
+    {
+        assert(mOrder.size() == used.size() - std::count(std::begin(used), std::end(used), false));
+
+        // The objects go through a copy, then back into the same chunks
+        // in their new order. The pool doesn't shrink.
+        reorderedSlots.resize(mOrder.size());
+        for (std::size_t i{0}; i < mOrder.size(); ++i)
+            std::memcpy(static_cast<void *>(&reorderedSlots[i]), static_cast<const void *>(slot(mOrder[i])),
+                        sizeof(T));
+
+        for (std::size_t i{0}; i < mOrder.size(); ++i)
+            std::memcpy(static_cast<void *>(&(*chunks[i / chunkSize])[i % chunkSize]),
+                        static_cast<const void *>(&reorderedSlots[i]), sizeof(T));
+
+        used.assign(mOrder.size(), true);
+        freeIndices.clear();
+        count = mOrder.size();
+    }
+
+    // Lowest slots are used first.
+    void rebuildFreeList()
+    {
+        freeIndices.clear();
+        for (auto i(used.size()); i-- > 0;)
+            if (!used[i])
+                freeIndices.emplace_back(i);
+    }
+
+    void release(std::size_t mIndex)
+    {
+        assert(used[mIndex]);
+
+        slot(mIndex)->~T();
+        used[mIndex] = false;
+        freeIndices.emplace_back(mIndex);
+        --count;
+    }
+
+    // For pools that only ever use `create` and this: they stay dense.
+    // The last object is moved, as plain bytes, into the slot of
+    // `mIndex`, which returns the slot it came from (`mIndex` itself when
+    // it was the last).
+    std::size_t releaseSwap(std::size_t mIndex)
+    {
+        assert(used[mIndex] && freeIndices.empty());
+
+        const auto last(used.size() - 1);
+        slot(mIndex)->~T();
+        if (mIndex != last)
+            std::memcpy(static_cast<void *>(slot(mIndex)), static_cast<const void *>(slot(last)), sizeof(T));
+
+        used.pop_back();
+        --count;
+        return last;
+    }
+
+    // For pools without holes: keep the objects for which
+    // `mKeep(object, slot)` is true, moved as plain bytes to the lowest
+    // slots in the same order, `slot` being the one the object goes to,
+    // and destroy the others, in a single pass.
+    template <typename TF>
+    void retain(TF &&mKeep)
+    {
+        assert(freeIndices.empty() && count == used.size());
+
+        std::size_t kept{0};
+        for (std::size_t i{0}; i < used.size(); ++i)
+        {
+            if (!mKeep(*slot(i), kept))
+            {
+                if constexpr (!std::is_trivially_destructible<T>::value)
+                    slot(i)->~T();
+                continue;
+            }
+
+            if (i != kept)
+                std::memcpy(static_cast<void *>(slot(kept)), static_cast<const void *>(slot(i)), sizeof(T));
+            ++kept;
+        }
+
+        used.resize(kept);
+        count = kept;
+    }
+
+    // Constructed objects, slots handed out so far (the ones between
+    // the two are holes) and slots the chunks have room for.
+    std::size_t getCount() const noexcept { return count; }
+    std::size_t getSlotCount() const noexcept { return used.size(); }
+    std::size_t getCapacity() const noexcept { return chunks.size() * chunkSize; }
+
+    T &get(std::size_t mIndex) const noexcept
+    {
+        assert(used[mIndex]);
+        return *slot(mIndex);
+    }
+
+    // Call `mFunction(object)` for every constructed object, in slot order.
+    template <typename TF>
+    void forEach(TF &&mFunction) const
+    {
+        for (auto i(0u); i < used.size(); ++i)
+            if (used[i])
+                mFunction(*slot(i));
+    }
+};
+
+// Scratch memory of a frame, for the containers rebuilt every frame or
+// step: they are made with `get()` as their memory resource, growing
+// them is a pointer bump into a buffer allocated up front, and they are
+// all freed at once by `reset`, at the top of the next frame. Nothing
+// made from it may outlive the frame. A frame that needs more than the
+// buffer gets the rest from the heap, then `reset` grows the buffer to
+// fit, so a steady game allocates nothing.
+class FrameArena
+{
+  private:
+    // Counts what the frame had to get from the heap.
+    class Upstream : public std::pmr::memory_resource
+    {
+      public:
+        std::size_t bytes{0};
+
+      private:
+        void *do_allocate(std::size_t mBytes, std::size_t mAlignment) override
+        {
+            bytes += mBytes;
+            return std::pmr::new_delete_resource()->allocate(mBytes, mAlignment);
+        }
+
+        void do_deallocate(void *mPointer, std::size_t mBytes, std::size_t mAlignment) override
+        {
+            std::pmr::new_delete_resource()->deallocate(mPointer, mBytes, mAlignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &mOther) const noexcept override { return this == &mOther; }
+    };
+
+    std::unique_ptr<unsigned char[]> buffer;
+    std::size_t size;
+    Upstream upstream;
+    std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+  public:
+    explicit FrameArena(std::size_t mBytes = 64 * 1024) : buffer{new unsigned char[mBytes]}, size{mBytes}
+    {
+        resource.emplace(buffer.get(), size, &upstream);
+    }
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    std::pmr::memory_resource *get() noexcept { return &*resource; }
+
+    // Uninitialised room for `mCount` objects of type T.
+    template <typename T>
+    T *allocate(std::size_t mCount)
+    {
+        return static_cast<T *>(resource->allocate(mCount * sizeof(T), alignof(T)));
+    }
+
+    void reset()
+    {
+        resource->release();
+        if (upstream.bytes == 0)
+            return;
+
+        // Room for the whole of the last frame from now on.
+        size += upstream.bytes;
+        upstream.bytes = 0;
+        resource.reset();
+        buffer.reset(new unsigned char[size]);
+        resource.emplace(buffer.get(), size, &upstream);
+    }
+};
+
+// Two frame arenas used in turns, for what a frame hands over to the
+// render thread: `flip` only resets the arena of the frame before last,
+// the one of the last frame stays valid while it is drawn.
+class DoubleFrameArena
+{
+  private:
+    std::array<FrameArena, 2> arenas;
+    std::size_t current{0};
+
+  public:
+    FrameArena &flip()
+    {
+        current = 1 - current;
+        arenas[current].reset();
+        return arenas[current];
+    }
+};
+
+// Dense storage for all the components of type T: released components
+// are replaced by the last one, so the pool has no holes. The slots
+// don't move when the pool grows, but a component can move when another
+// one is released. Every move bumps the layout version, which tells
+// `ComponentRef`s when they have to look their component up again.
+template <typename T>
+class ComponentPool : public ComponentPoolBase
+{
+  private:
+    ObjectPool<T> components;
+    std::uint32_t layout{0};
+
+  public:
+    template <typename... TArgs>
+    ComponentIndex create(TArgs &&... mArgs)
+    {
+        return components.create(std::forward<TArgs>(mArgs)...);
+    }
+
+    Entity *release(ComponentIndex mIndex) override
+    {
+        if (components.releaseSwap(mIndex) == mIndex)
+            return nullptr;
+
+        ++layout;
+        return components.get(mIndex).entity;
+    }
+
+    std::size_t getComponentSize() const noexcept override { return sizeof(T); }
+
+    void save(ComponentIndex mIndex, unsigned char *mBytes) const override
+    {
+        std::memcpy(mBytes, static_cast<const void *>(&components.get(mIndex)), sizeof(T));
+    }
+
+    void restore(ComponentIndex mIndex, const unsigned char *mBytes) override
+    {
+        T &component(components.get(mIndex));
+        std::memcpy(static_cast<void *>(&component), mBytes, sizeof(T));
+        component.T::restored();
+    }
+
+    ComponentIndex createFrom(const unsigned char *mBytes, Entity &mEntity) override
+    {
+        const auto index(components.allocate());
+        T &component(components.get(index));
+        std::memcpy(static_cast<void *>(&component), mBytes, sizeof(T));
+        component.entity = &mEntity;
+
+        return index;
+    }
+
+    void init(ComponentIndex mIndex) override
+    {
+        components.get(mIndex).T::init();
+    }
+
+    void reorder(const std::vector<ComponentIndex> &mOrder) override
+    {
+        components.reorder(mOrder);
+        ++layout;
+    }
+
+    // The live components are packed to the front in the same order and
+    // their entities told where they went, instead of a move into the
+    // hole of every dead one. The dead entities keep their index, the
+    // manager forgets it.
+    void releaseDead() override
+    {
+        const auto id(getComponentTypeID<T>());
+        components.retain([id](T &mComponent, std::size_t mSlot) {
+            if (!mComponent.entity->isAlive())
+                return false;
+
+            mComponent.entity->components.set(id, static_cast<ComponentIndex>(mSlot));
+            return true;
+        });
+        ++layout;
+    }
+
+    void clear() noexcept override
+    {
+        components.clear();
+        ++layout;
+    }
+
+    std::uint32_t getLayout() const noexcept { return layout; }
+
+    PoolStats getStats() const noexcept override
+    {
+        return {components.getCount(), components.getSlotCount(), components.getCapacity()};
+    }
+
+    T &get(ComponentIndex mIndex) const noexcept
+    {
+        return components.get(mIndex);
+    }
+
+    // The static type is known here, so `T::update` and `T::draw` are
+    // called directly instead of through the vtable.
+    void update(float mFT) override
+    {
+        if constexpr (HasOwnUpdate<T>::value)
+            components.forEach([mFT](T &mComponent) { mComponent.T::update(mFT); });
+    }
+
+    void draw() override
+    {
+        if constexpr (HasOwnDraw<T>::value)
+            components.forEach([](T &mComponent) { mComponent.T::draw(); });
+    }
+};
+
+// Reference from a component to another component of the same entity.
+// The pointer is kept for the fast path, along with the layout version
+// of the pool it points into: as long as no component of the pool moved,
+// it is still the right one. The first access after a move finds the
+// component again through the index of the entity, so the reference
+// never dangles, even when it comes back from a snapshot.
+template <typename T>
+class ComponentRef
+{
+  private:
+    const ComponentPool<T> *pool{nullptr};
+    mutable T *component{nullptr};
+    mutable std::uint32_t layout{0};
+
+  public:
+    // `mOwner` must already have the component.
+    void bind(Entity &mOwner);
+
+    T &get(const Entity &mOwner) const
+    {
+        if (layout != pool->getLayout())
+            resolve(mOwner);
+
+        return *component;
+    }
+
+  private:
+    void resolve(const Entity &mOwner) const;
+};
+
+class Entity
+{
+  private:
+    // The manager keeps the group vectors in sync with `groupIndices`.
+    friend struct Manager;
+    template <typename>
+    friend class ComponentRef;
+    template <typename>
+    friend class ComponentPool;
+
+    Manager &manager;
+    // Slot of the entity inside the manager's entity pool.
+    EntityHandle handle;
+
+    // Index of every component of the entity in its pool, by component ID.
+    ComponentIndexMap components;
+
+    GroupBitset groupBitset;
+    // Where the entity is in the group vectors it is stored in. Those can
+    // still include groups it left since the last refresh.
+    GroupIndexMap groupIndices;
+    // Views that list the entity, the same way it can still be listed in
+    // views it left since the last refresh.
+    ViewBitset views;
+
+    // Used to know if the entity is aliver or not
+    bool alive{true};
+
+  public:
+    Entity(Manager &mManager, const EntityHandle &mHandle) : manager(mManager), handle(mHandle) {}
+    ~Entity();
+
+    const EntityHandle &getHandle() const noexcept { return handle; }
+    std::size_t getPoolIndex() const noexcept { return handle.index; }
+
+    bool isAlive() const { return alive; }
+    void destroy() noexcept;
+
+    // To check if an entity has a component.
+    template <typename T>
+    bool hasComponent() const
+    {
+        return components.has(getComponentTypeID<T>());
+    }
+
+    bool hasGroup(Group mGroup) const noexcept
+    {
+        return groupBitset[mGroup];
+    }
+
+    const GroupBitset &getGroups() const noexcept { return groupBitset; }
+
+    void addGroup(Group mGroup) noexcept;
+    // The entity leaves the group vector on the next `Manager::refresh`.
+    void delGroup(Group mGroup) noexcept;
+
+    // Check if the entity owns every component of `mSignature`.
+    bool matches(const ComponentBitset &mSignature) const noexcept
+    {
+        return (components.getKeys() & mSignature) == mSignature;
+    }
+
+    template <typename T, typename... TArgs>
+    T &addComponent(TArgs &&... mArgs);
+
+    // The component goes back to its pool, the last one of the pool
+    // takes its slot. Components of the entity that point at it must be
+    // removed first.
+    template <typename T>
+    void removeComponent();
+
+    template <typename T>
+    T &getComponent() const;
+};
+
+#ifdef ARKANOID_TRACE
+// Timeline of the zones every thread went through, written when the
+// program exits as Chrome trace events, for chrome://tracing or Perfetto.
+// Each thread records into its own buffer, so zones don't contend.
+class Trace
+{
+  private:
+    using Clock = chrono::high_resolution_clock;
+
+    // Past that many events a thread drops the next ones.
+    static constexpr std::size_t maxThreadEvents{1u << 18};
+
+    struct Event
+    {
+        const char *name;
+        Clock::time_point start, end;
+    };
+
+    struct ThreadEvents
+    {
+        std::size_t id;
+        const char *name{"thread"};
+        std::vector<Event> events;
+        std::size_t dropped{0};
+
+        ThreadEvents(std::size_t mID) : id{mID} { events.reserve(4096); }
+    };
+
+    const Clock::time_point origin{Clock::now()};
+    std::string path{"trace.json"};
+
+    // The buffers belong to the trace, not to their threads, that way
+    // they are still there once the threads are gone.
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadEvents>> threads;
+
+    Trace() = default;
+
+    ThreadEvents &getThreadEvents()
+    {
+        static thread_local ThreadEvents *events{nullptr};
+        if (events != nullptr)
+            return *events;
+
+        std::lock_guard<std::mutex> lock{mutex};
+        threads.emplace_back(new ThreadEvents{threads.size()});
+        events = threads.back().get();
+        return *events;
+    }
+
+    double microseconds(Clock::time_point mTime) const noexcept
+    {
+        return chrono::duration_cast<chrono::duration<double, micro>>(mTime - origin).count();
+    }
+
+  public:
+    static Trace &get()
+    {
+        static Trace trace;
+        return trace;
+    }
+
+    ~Trace()
+    {
+        if (!write())
+            cerr << "Can't write trace " << path << endl;
+    }
+
+    void setPath(const char *mPath) { path = mPath; }
+
+    // Shown instead of the thread number. `mName` must be a literal.
+    void nameThread(const char *mName) { getThreadEvents().name = mName; }
+
+    void add(const char *mName, Clock::time_point mStart, Clock::time_point mEnd)
+    {
+        auto &thread(getThreadEvents());
+        if (thread.events.size() < maxThreadEvents)
+            thread.events.emplace_back(Event{mName, mStart, mEnd});
+        else
+            ++thread.dropped;
+    }
+
+    // Only once the other threads stopped adding events.
+    bool write()
+    {
+        std::ofstream file{path};
+        if (!file)
+            return false;
+
+        char line[256];
+        file << "{\"traceEvents\":[\n";
+        bool first{true};
+        auto writeLine([&] {
+            file << (first ? "" : ",\n") << line;
+            first = false;
+        });
+
+        for (const auto &thread : threads)
+        {
+            std::snprintf(line, sizeof(line),
+                          R"({"name":"thread_name","ph":"M","pid":0,"tid":%zu,"args":{"name":"%s %zu"}})", thread->id,
+                          thread->name, thread->id);
+            writeLine();
+
+            for (const auto &event : thread->events)
+            {
+                std::snprintf(line, sizeof(line), R"({"name":"%s","ph":"X","pid":0,"tid":%zu,"ts":%.3f,"dur":%.3f})",
+                              event.name, thread->id, microseconds(event.start),
+                              microseconds(event.end) - microseconds(event.start));
+                writeLine();
+            }
+
+            if (thread->dropped != 0)
+                cerr << "Trace: " << thread->dropped << " events dropped on " << thread->name << ' ' << thread->id
+                     << endl;
+        }
+
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return static_cast<bool>(file);
+    }
+};
+
+// Adds the time between its construction and destruction to the trace.
+class TraceZone
+{
+  private:
+    const char *name;
+    chrono::high_resolution_clock::time_point start{chrono::high_resolution_clock::now()};
+
+  public:
+    TraceZone(const char *mName) noexcept : name{mName} {}
+    ~TraceZone() { Trace::get().add(name, start, chrono::high_resolution_clock::now()); }
+};
+
+#define ARKANOID_TRACE_CONCAT_(mA, mB) mA##mB
+#define ARKANOID_TRACE_CONCAT(mA, mB) ARKANOID_TRACE_CONCAT_(mA, mB)
+// `ARKANOID_ZONE("name")` traces the rest of the scope, `ARKANOID_THREAD`
+// names the calling thread. Both are nothing without ARKANOID_TRACE.
+#define ARKANOID_ZONE(mName) CompositionArkanoid::TraceZone ARKANOID_TRACE_CONCAT(traceZone, __LINE__){mName}
+#define ARKANOID_THREAD(mName) CompositionArkanoid::Trace::get().nameThread(mName)
+#else
+#define ARKANOID_ZONE(mName)
+#define ARKANOID_THREAD(mName)
+#endif
+
+// Small work stealing job system. Every worker thread has its own queue of
+// jobs, takes work from the back of it and, once it is empty, steals from
+// the front of the queues of the others. Jobs are plain function pointers
+// over a range of indices, so scheduling them never allocates.
+class JobSystem
+{
+  private:
+    struct Job
+    {
+        void (*run)(void *, std::size_t, std::size_t);
+        void *context;
+        std::size_t first, last;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    // Queue 0 belongs to the thread calling `parallelFor`, which also runs
+    // jobs while it waits for the workers.
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    // Jobs still in a queue, and jobs not finished yet.
+    std::atomic<std::size_t> queuedJobs{0}, pendingJobs{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    bool pop(std::size_t mQueue, Job &mJob)
+    {
+        auto &queue(*queues[mQueue]);
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        if (queue.jobs.empty())
+            return false;
+
+        mJob = queue.jobs.back();
+        queue.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(std::size_t mThief, Job &mJob)
+    {
+        for (auto i(1u); i < queues.size(); ++i)
+        {
+            auto &queue(*queues[(mThief + i) % queues.size()]);
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            if (queue.jobs.empty())
+                continue;
+
+            mJob = queue.jobs.front();
+            queue.jobs.pop_front();
+            return true;
+        }
+
+        return false;
+    }
+
+    bool runOne(std::size_t mQueue)
+    {
+        Job job;
+        if (!pop(mQueue, job) && !steal(mQueue, job))
+            return false;
+
+        --queuedJobs;
+        ARKANOID_ZONE("job");
+        job.run(job.context, job.first, job.last);
+        --pendingJobs;
+        return true;
+    }
+
+    // Which job system and queue the current thread works for.
+    struct ThreadSlot
+    {
+        const JobSystem *jobSystem;
+        std::size_t queue;
+    };
+
+    static ThreadSlot &getThreadSlot() noexcept
+    {
+        static thread_local ThreadSlot slot{nullptr, 0};
+        return slot;
+    }
+
+    void work(std::size_t mQueue)
+    {
+        getThreadSlot() = ThreadSlot{this, mQueue};
+        ARKANOID_THREAD("worker");
+
+        while (!stopping)
+        {
+            if (runOne(mQueue))
+                continue;
+
+            std::unique_lock<std::mutex> lock{sleepMutex};
+            wakeUp.wait(lock, [this] { return stopping || queuedJobs > 0; });
+        }
+    }
+
+  public:
+    // Use every core by default, the calling thread counts as one.
+    JobSystem(std::size_t mThreads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (std::size_t i{0}; i < std::max<std::size_t>(1, mThreads); ++i)
+            queues.emplace_back(new Queue);
+
+        for (std::size_t i{1}; i < queues.size(); ++i)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+            stopping = true;
+        }
+        wakeUp.notify_all();
+
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    std::size_t getThreadCount() const noexcept { return queues.size(); }
+
+    // Index of the calling thread, from 0 to `getThreadCount() - 1`. Any
+    // thread other than the workers is 0, like the one that calls
+    // `parallelFor`.
+    std::size_t getThreadIndex() const noexcept
+    {
+        const auto &slot(getThreadSlot());
+        return slot.jobSystem == this ? slot.queue : 0;
+    }
+
+    // Split [0, mCount) in ranges of `mGrain` indices and call
+    // `mFunction(first, last)` for each of them across all the threads.
+    // Returns once every range is done.
+    template <typename TF>
+    void parallelFor(std::size_t mCount, std::size_t mGrain, TF &&mFunction)
+    {
+        using Function = typename std::remove_reference<TF>::type;
+
+        if (workers.empty() || mCount <= mGrain)
+        {
+            mFunction(std::size_t{0}, mCount);
+            return;
+        }
+
+        const std::size_t jobCount{(mCount + mGrain - 1) / mGrain};
+        pendingJobs += jobCount;
+
+        for (std::size_t i{0}; i < jobCount; ++i)
+        {
+            Job job{[](void *mContext, std::size_t mFirst, std::size_t mLast) {
+                        (*static_cast<Function *>(mContext))(mFirst, mLast);
+                    },
+                    const_cast<void *>(static_cast<const void *>(&mFunction)), i * mGrain,
+                    std::min(mCount, (i + 1) * mGrain)};
+
+            auto &queue(*queues[i % queues.size()]);
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            queue.jobs.emplace_back(job);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{sleepMutex};
+            queuedJobs += jobCount;
+        }
+        wakeUp.notify_all();
+
+        while (pendingJobs > 0)
+            if (!runOne(0))
+                std::this_thread::yield();
+    }
+};
+
+// Systems hold the per-frame logic for every entity that matches a
+// component signature. The manager calls them once per update, so there
+// is a single virtual call per system instead of one per component.
+struct SystemBase
+{
+    virtual void update(Manager &mManager, float mFT) = 0;
+
+    virtual ~SystemBase() {}
+};
+
+// Every alive entity of a manager with its components, in one flat buffer
+// of plain bytes. Components are copied with `memcpy`, so saving is a
+// copy of the world and restoring the entities that are still alive is
+// another one. Layout, in native byte order:
+//   size_t entity count, then for every entity in creation order:
+//     EntityRecord, the bytes of each component in ID order
+//   for every group: u32 count, size_t pool index of each entity
+// A snapshot is only meaningful to the manager (and the process) that
+// saved it: the bytes include pointers.
+struct ManagerSnapshot
+{
+    struct EntityRecord
+    {
+        EntityHandle handle;
+        ComponentBitset components;
+        GroupBitset groups;
+    };
+
+    std::vector<unsigned char> data;
+
+    std::size_t size() const noexcept { return data.size(); }
+};
+
+// Entities with at least the components in `Ts`, from `Manager::view`.
+// The manager keeps the list up to date as components are added and
+// removed and entities die, so going through it never visits the others.
+// Until the next refresh it still lists the entities that died or lost a
+// component since, `forEach` skips them.
+template <typename... Ts>
+class EntityView
+{
+  private:
+    const std::vector<Entity *> &entities;
+    const ComponentBitset &signature;
+
+  public:
+    EntityView(const std::vector<Entity *> &mEntities, const ComponentBitset &mSignature) noexcept
+        : entities(mEntities), signature(mSignature)
+    {
+    }
+
+    std::vector<Entity *>::const_iterator begin() const noexcept { return entities.begin(); }
+    std::vector<Entity *>::const_iterator end() const noexcept { return entities.end(); }
+    std::size_t size() const noexcept { return entities.size(); }
+    Entity &operator[](std::size_t mIndex) const noexcept { return *entities[mIndex]; }
+
+    // False for the entities that are only still listed.
+    bool matches(const Entity &mEntity) const noexcept;
+
+    // Call `mFunction(entity, components...)` for every entity that
+    // matches. Entities that get the components during the call are
+    // visited too.
+    template <typename TF>
+    void forEach(TF &&mFunction) const;
+};
+
+// Structural changes recorded while systems run, for the manager to play
+// back at its next refresh: creating and destroying entities, adding and
+// removing components and joining groups. Every thread of the job system records
+// into its own buffer, so nothing is locked. Components are built in
+// blocks the buffer keeps between playbacks, recording doesn't allocate
+// once they have grown.
+class CommandBuffer
+{
+  public:
+    // What a command applies to: an entity that already exists, or one
+    // created by an earlier command of the same buffer.
+    struct Target
+    {
+        EntityHandle handle;
+        std::size_t created;
+    };
+
+  private:
+    static constexpr std::size_t notCreated{std::numeric_limits<std::size_t>::max()};
+    static constexpr std::size_t blockSize{4096};
+    using Block = std::aligned_storage<blockSize, alignof(std::max_align_t)>::type;
+
+    enum class Kind
+    {
+        Create,
+        Destroy,
+        AddComponent,
+        RemoveComponent,
+        AddGroup
+    };
+
+    struct Command
+    {
+        Kind kind;
+        Target target;
+        Group group;
+        // For the component commands, called with the entity (nullptr if
+        // it is gone) and `component`. Adding moves the component recorded
+        // in the blocks into the entity and destroys the recorded one.
+        void (*apply)(Entity *, void *);
+        void *component;
+    };
+
+    std::vector<Command> commands;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::size_t currentBlock{0}, blockUsed{0};
+    std::size_t createdCount{0};
+    // Entities created during the playback, by `Target::created`.
+    std::vector<Entity *> created;
+
+    void *allocate(std::size_t mSize, std::size_t mAlignment)
+    {
+        assert(mSize <= blockSize);
+
+        blockUsed = (blockUsed + mAlignment - 1) / mAlignment * mAlignment;
+        if (currentBlock < blocks.size() && blockUsed + mSize > blockSize)
+        {
+            ++currentBlock;
+            blockUsed = 0;
+        }
+
+        if (currentBlock == blocks.size())
+            blocks.emplace_back(new Block);
+
+        auto memory(reinterpret_cast<unsigned char *>(blocks[currentBlock].get()) + blockUsed);
+        blockUsed += mSize;
+        return memory;
+    }
+
+    template <typename T>
+    static void addRecordedComponent(Entity *mEntity, void *mComponent);
+    template <typename T>
+    static void removeComponentOf(Entity *mEntity, void *);
+
+    Entity *resolve(Manager &mManager, const Target &mTarget) const;
+
+  public:
+    CommandBuffer() = default;
+    CommandBuffer(const CommandBuffer &) = delete;
+    CommandBuffer &operator=(const CommandBuffer &) = delete;
+
+    ~CommandBuffer()
+    {
+        for (auto &command : commands)
+            if (command.kind == Kind::AddComponent)
+                command.apply(nullptr, command.component);
+    }
+
+    bool empty() const noexcept { return commands.empty(); }
+
+    Target target(const Entity &mEntity) const noexcept;
+
+    // The entity only exists once the buffer is played back, until then
+    // the target stands for it.
+    Target createEntity()
+    {
+        commands.emplace_back(Command{Kind::Create, Target{EntityHandle{0, 0}, notCreated}, 0, nullptr, nullptr});
+        return Target{EntityHandle{0, 0}, createdCount++};
+    }
+
+    void destroy(const Target &mTarget)
+    {
+        commands.emplace_back(Command{Kind::Destroy, mTarget, 0, nullptr, nullptr});
+    }
+
+    // The component is built now and moved into the entity on playback.
+    template <typename T, typename... TArgs>
+    void addComponent(const Target &mTarget, TArgs &&... mArgs)
+    {
+        auto component(new (allocate(sizeof(T), alignof(T))) T(std::forward<TArgs>(mArgs)...));
+        commands.emplace_back(Command{Kind::AddComponent, mTarget, 0, &addRecordedComponent<T>, component});
+    }
+
+    template <typename T>
+    void removeComponent(const Target &mTarget)
+    {
+        commands.emplace_back(Command{Kind::RemoveComponent, mTarget, 0, &removeComponentOf<T>, nullptr});
+    }
+
+    void addGroup(const Target &mTarget, Group mGroup)
+    {
+        commands.emplace_back(Command{Kind::AddGroup, mTarget, mGroup, nullptr, nullptr});
+    }
+
+    // Apply the commands in the order they were recorded. Commands on an
+    // entity that died in the meantime are dropped.
+    void playBack(Manager &mManager);
+};
+
+struct Manager
+{
+  private:
+    // Pools are declared before the entities, so they are still alive
+    // when the entities release their components on destruction.
+    std::array<std::unique_ptr<ComponentPoolBase>, maxComponents> pools;
+    // Entities are recycled from a pool too, `entities` only keeps the
+    // alive ones in creation order.
+    ObjectPool<Entity> entityPool;
+    std::vector<Entity *> entities;
+    // Generation of every slot of `entityPool`.
+    std::vector<EntityGeneration> generations;
+    std::array<std::vector<Entity *>, maxGroups> groupedEntities;
+    // Groups left through `Entity::delGroup` since the last refresh.
+    std::vector<std::pair<EntityHandle, Group>> pendingGroupRemovals;
+    std::vector<std::unique_ptr<SystemBase>> systems;
+    // Called with every dead entity right before it is freed.
+    std::vector<std::function<void(Entity &)>> destroyListeners;
+    // Called with every entity a snapshot brought back.
+    std::vector<std::function<void(Entity &)>> restoreListeners;
+    // Kept by `restore` and `compact` to avoid allocating every time.
+    std::vector<bool> keptSlots;
+    std::vector<Entity *> restoredEntities;
+    std::vector<ComponentBitset> archetypes;
+    std::vector<Entity *> sortedEntities;
+    std::array<std::vector<ComponentIndex>, maxComponents> componentOrders;
+    // Entities destroyed since the dead ones were last erased. Most steps
+    // nothing dies, and then there is nothing to clean up.
+    std::size_t pendingDeadEntities{0};
+    // Used by `forEachParallel`, when there is none everything runs on the
+    // calling thread.
+    JobSystem *jobSystem{nullptr};
+
+    // One for each thread of the job system.
+    std::vector<std::unique_ptr<CommandBuffer>> commandBuffers;
+
+    // Entities matching `signature`, in the order they started to match.
+    // Created by the first `view` of the signature. Entities that lost a
+    // component stay listed until the next refresh, and make it `stale`.
+    struct ViewCache
+    {
+        ComponentBitset signature;
+        std::vector<Entity *> entities;
+        // Bit of the view in `Entity::views`.
+        std::size_t index;
+        bool stale;
+    };
+    std::vector<std::unique_ptr<ViewCache>> views;
+    bool staleViews{false};
+
+    ViewCache &getViewCache(const ComponentBitset &mSignature)
+    {
+        // Only a handful of signatures are ever queried.
+        for (auto &view : views)
+            if (view->signature == mSignature)
+                return *view;
+
+        if (views.size() == maxViews)
+        {
+            cerr << "Too many views, maxViews is " << maxViews << endl;
+            std::abort();
+        }
+
+        views.emplace_back(new ViewCache{mSignature, {}, views.size(), false});
+        fillView(*views.back());
+        return *views.back();
+    }
+
+    void fillView(ViewCache &mView)
+    {
+        for (auto entity : mView.entities)
+            entity->views[mView.index] = false;
+
+        mView.entities.clear();
+        mView.stale = false;
+        for (auto entity : entities)
+            if (entity->isAlive() && entity->matches(mView.signature))
+            {
+                mView.entities.emplace_back(entity);
+                entity->views[mView.index] = true;
+            }
+    }
+
+    // Take the entities that left since the last refresh out of the lists.
+    void eraseStaleViewEntries()
+    {
+        staleViews = false;
+        for (auto &view : views)
+        {
+            if (!view->stale)
+                continue;
+
+            auto &viewEntities(view->entities);
+            viewEntities.erase(std::remove_if(std::begin(viewEntities), std::end(viewEntities),
+                                              [&view](Entity *mEntity) {
+                                                  if (mEntity->isAlive() && mEntity->matches(view->signature))
+                                                      return false;
+
+                                                  mEntity->views[view->index] = false;
+                                                  return true;
+                                              }),
+                               std::end(viewEntities));
+            view->stale = false;
+        }
+    }
+
+    // Swap the last entity of the group into the slot of `mEntity`.
+    void removeFromGroup(Entity &mEntity, Group mGroup)
+    {
+        if (!mEntity.groupIndices.has(mGroup))
+            return;
+
+        const auto index(mEntity.groupIndices.get(mGroup));
+        auto &group(groupedEntities[mGroup]);
+        group[index] = group.back();
+        group[index]->groupIndices.set(mGroup, index);
+        group.pop_back();
+
+        mEntity.groupIndices.erase(mGroup);
+    }
+
+    std::array<std::size_t, maxComponents> getComponentSizes() const noexcept
+    {
+        std::array<std::size_t, maxComponents> sizes;
+        for (auto i(0u); i < maxComponents; ++i)
+            sizes[i] = pools[i] != nullptr ? pools[i]->getComponentSize() : 0;
+
+        return sizes;
+    }
+
+    void eraseDeadEntities()
+    {
+        if (pendingDeadEntities == 0)
+            return;
+
+        // When most entities die at once, as when a level is left, every
+        // pool releases its dead components in one pass instead of one
+        // move per component.
+        const bool bulk{pendingDeadEntities * 2 >= entities.size()};
+        pendingDeadEntities = 0;
+        if (bulk)
+        {
+            // The listeners still see the components of the dead.
+            for (auto entity : entities)
+                if (!entity->isAlive())
+                    for (auto &listener : destroyListeners)
+                        listener(*entity);
+
+            for (auto &pool : pools)
+                if (pool != nullptr)
+                    pool->releaseDead();
+        }
+
+        // Before the dead entities are freed.
+        for (auto &view : views)
+            view->entities.erase(std::remove_if(std::begin(view->entities), std::end(view->entities),
+                                                [](Entity *mEntity) { return !mEntity->isAlive(); }),
+                                 std::end(view->entities));
+
+        entities.erase(
+            std::remove_if(std::begin(entities), std::end(entities),
+                           [this, bulk](Entity *mEntity) {
+                               if (mEntity->isAlive())
+                                   return false;
+
+                               if (!bulk)
+                                   for (auto &listener : destroyListeners)
+                                       listener(*mEntity);
+
+                               // Only the groups the entity is still stored in.
+                               for (auto i(0u); i < maxGroups; ++i)
+                                   if (mEntity->groupIndices.has(i))
+                                       removeFromGroup(*mEntity, i);
+
+                               ++generations[mEntity->getPoolIndex()];
+                               // Its components are gone already.
+                               if (bulk)
+                                   mEntity->components = ComponentIndexMap{};
+                               entityPool.release(mEntity->getPoolIndex());
+                               return true;
+                           }),
+            std::end(entities));
+    }
+
+    void playBackCommands()
+    {
+        for (auto &buffer : commandBuffers)
+            if (!buffer->empty())
+                buffer->playBack(*this);
+    }
+
+  public:
+    Manager() { commandBuffers.emplace_back(new CommandBuffer); }
+    Manager(const Manager &) = delete;
+    Manager &operator=(const Manager &) = delete;
+
+    // All at once: the pools free their components a chunk at a time,
+    // then the entities have nothing left to release.
+    ~Manager()
+    {
+        for (auto &pool : pools)
+            if (pool != nullptr)
+                pool->clear();
+
+        entityPool.forEach([](Entity &mEntity) { mEntity.components = ComponentIndexMap{}; });
+    }
+
+    void update(float mFT)
+    {
+        ARKANOID_ZONE("Manager::update");
+
+        // Clean up dead entities
+        eraseDeadEntities();
+
+        for (auto &system : systems)
+            system->update(*this, mFT);
+
+        // Components that still define their own `update`.
+        for (auto &pool : pools)
+            if (pool != nullptr)
+                pool->update(mFT);
+    }
+
+    // Systems run in the same order they were added.
+    template <typename T, typename... TArgs>
+    T &addSystem(TArgs &&... mArgs)
+    {
+        T *s(new T(std::forward<TArgs>(mArgs)...));
+        systems.emplace_back(s);
+        return *s;
+    }
+
+    // Alive entities that own all the components in `Ts`. The list stays
+    // valid and up to date for the lifetime of the manager.
+    template <typename... Ts>
+    EntityView<Ts...> view()
+    {
+        const auto &cache(getViewCache(getComponentSignature<Ts...>()));
+        return EntityView<Ts...>{cache.entities, cache.signature};
+    }
+
+    // Call `mFunction(entity, components...)` for every alive entity that
+    // owns all the components in `Ts`.
+    template <typename... Ts, typename TF>
+    void forEach(TF &&mFunction)
+    {
+        view<Ts...>().forEach(std::forward<TF>(mFunction));
+    }
+
+    // Same as `forEach`, but the entities are split across the job system
+    // threads once there are more than `mMinEntities` of them. `mFunction`
+    // must only touch the components it is given.
+    template <typename... Ts, typename TF>
+    void forEachParallel(std::size_t mMinEntities, TF &&mFunction)
+    {
+        const auto matching(view<Ts...>());
+        if (jobSystem == nullptr || matching.size() < mMinEntities)
+        {
+            matching.forEach(std::forward<TF>(mFunction));
+            return;
+        }
+
+        const auto grain(std::max<std::size_t>(256, matching.size() / (jobSystem->getThreadCount() * 4)));
+
+        jobSystem->parallelFor(matching.size(), grain, [&](std::size_t mFirst, std::size_t mLast) {
+            for (auto i(mFirst); i < mLast; ++i)
+            {
+                Entity &entity(matching[i]);
+                if (matching.matches(entity))
+                    mFunction(entity, entity.getComponent<Ts>()...);
+            }
+        });
+    }
+
+    void setJobSystem(JobSystem *mJobSystem)
+    {
+        playBackCommands();
+
+        jobSystem = mJobSystem;
+        commandBuffers.resize(jobSystem != nullptr ? jobSystem->getThreadCount() : 1);
+        for (auto &buffer : commandBuffers)
+            if (buffer == nullptr)
+                buffer.reset(new CommandBuffer);
+    }
+
+    // Buffer of the calling thread, safe to record into from a parallel
+    // system. Played back by the next `refresh`, the buffers in thread
+    // order.
+    CommandBuffer &getCommandBuffer() noexcept
+    {
+        return *commandBuffers[jobSystem != nullptr ? jobSystem->getThreadIndex() : 0];
+    }
+
+    void draw()
+    {
+        for (auto &pool : pools)
+            if (pool != nullptr)
+                pool->draw();
+    }
+
+    template <typename T>
+    ComponentPool<T> &getPool()
+    {
+        auto &pool(pools[getComponentTypeID<T>()]);
+        if (pool == nullptr)
+            pool.reset(new ComponentPool<T>);
+
+        return *static_cast<ComponentPool<T> *>(pool.get());
+    }
+
+    void releaseComponent(ComponentID mID, ComponentIndex mIndex)
+    {
+        auto moved(pools[mID]->release(mIndex));
+        if (moved == nullptr)
+            return;
+
+        moved->components.set(mID, mIndex);
+    }
+
+    // `mEntity` just got component `mID`: it joins the views it matches
+    // now, unless it is still listed there since it lost the component.
+    void addToViews(Entity &mEntity, ComponentID mID)
+    {
+        for (auto &view : views)
+            if (view->signature[mID] && !mEntity.views[view->index] && mEntity.matches(view->signature))
+            {
+                view->entities.emplace_back(&mEntity);
+                mEntity.views[view->index] = true;
+            }
+    }
+
+    // `mEntity` lost component `mID`. It stays listed in the views that
+    // need it until the next refresh, their `forEach` skips it.
+    void removeFromViews(Entity &mEntity, ComponentID mID)
+    {
+        for (auto &view : views)
+            if (view->signature[mID] && mEntity.views[view->index])
+                view->stale = staleViews = true;
+    }
+
+    void addToGroup(Entity *mEntity, Group mGroup)
+    {
+        // It may still be in the vector if it left the group since the
+        // last refresh.
+        if (mEntity->groupIndices.has(mGroup))
+            return;
+
+        auto &group(groupedEntities[mGroup]);
+        mEntity->groupIndices.set(mGroup, static_cast<GroupIndex>(group.size()));
+        group.emplace_back(mEntity);
+    }
+
+    void delFromGroup(Entity *mEntity, Group mGroup)
+    {
+        pendingGroupRemovals.emplace_back(mEntity->getHandle(), mGroup);
+    }
+
+    void markDead() noexcept
+    {
+        ++pendingDeadEntities;
+    }
+
+    // Entity of `mHandle`, or nullptr if it was already destroyed.
+    Entity *getEntity(const EntityHandle &mHandle) const noexcept
+    {
+        if (mHandle.index >= generations.size() || generations[mHandle.index] != mHandle.generation)
+            return nullptr;
+
+        return &entityPool.get(mHandle.index);
+    }
+
+    std::vector<Entity *> &getEntitiesByGroup(Group mGroup)
+    {
+        return groupedEntities[mGroup];
+    }
+
+    const std::vector<Entity *> &getEntitiesByGroup(Group mGroup) const
+    {
+        return groupedEntities[mGroup];
+    }
+
+    // Entities alive or only killed since the last refresh.
+    std::size_t getEntityCount() const noexcept { return entities.size(); }
+
+    // Occupancy of the pool of component type `mID`, all zero before the
+    // first component of the type. The pools keep the counts, nothing is
+    // scanned.
+    PoolStats getPoolStats(ComponentID mID) const noexcept
+    {
+        return pools[mID] ? pools[mID]->getStats() : PoolStats{0, 0, 0};
+    }
+
+    PoolStats getEntityPoolStats() const noexcept
+    {
+        return {entityPool.getCount(), entityPool.getSlotCount(), entityPool.getCapacity()};
+    }
+
+    // Group vectors are kept up to date as entities join and leave them,
+    // so only the pending removals and the dead entities are processed.
+    // When neither happened since the last refresh, it returns at once.
+    void refresh()
+    {
+        ARKANOID_ZONE("Manager::refresh");
+        playBackCommands();
+
+        if (staleViews)
+            eraseStaleViewEntries();
+
+        if (pendingGroupRemovals.empty() && pendingDeadEntities == 0)
+            return;
+
+        for (auto &removal : pendingGroupRemovals)
+        {
+            auto entity(getEntity(removal.first));
+            if (entity != nullptr && !entity->hasGroup(removal.second))
+                removeFromGroup(*entity, removal.second);
+        }
+        pendingGroupRemovals.clear();
+
+        eraseDeadEntities();
+    }
+
+    // Let other structures (like the brick grid) drop their references
+    // to an entity before it is removed from the manager.
+    void addDestroyListener(std::function<void(Entity &)> mListener)
+    {
+        MemoryScope memoryScope{MCallbacks};
+        destroyListeners.emplace_back(std::move(mListener));
+    }
+
+    void addRestoreListener(std::function<void(Entity &)> mListener)
+    {
+        MemoryScope memoryScope{MCallbacks};
+        restoreListeners.emplace_back(std::move(mListener));
+    }
+
+    // Write every alive entity into `mSnapshot`. Once its buffer has grown
+    // to fit the world, saving no longer allocates.
+    void save(ManagerSnapshot &mSnapshot) const
+    {
+        const auto sizes(getComponentSizes());
+
+        // The whole buffer is sized first, then only copied into.
+        std::size_t count{0}, total{sizeof(count) + maxGroups * sizeof(std::uint32_t)};
+        for (const auto entity : entities)
+        {
+            if (!entity->isAlive())
+                continue;
+
+            ++count;
+            total += sizeof(ManagerSnapshot::EntityRecord);
+            forEachComponentID(entity->components.getKeys(), [&](ComponentID mID) { total += sizes[mID]; });
+        }
+
+        for (auto i(0u); i < maxGroups; ++i)
+            for (const auto entity : groupedEntities[i])
+                if (entity->isAlive() && entity->hasGroup(i))
+                    total += sizeof(entity->handle.index);
+
+        mSnapshot.data.resize(total);
+        unsigned char *bytes(mSnapshot.data.data());
+        auto write([&bytes](const void *mValue, std::size_t mSize) {
+            std::memcpy(bytes, mValue, mSize);
+            bytes += mSize;
+        });
+
+        write(&count, sizeof(count));
+        for (const auto entity : entities)
+        {
+            if (!entity->isAlive())
+                continue;
+
+            const ManagerSnapshot::EntityRecord record{entity->handle, entity->components.getKeys(),
+                                                       entity->groupBitset};
+            write(&record, sizeof(record));
+
+            forEachComponentID(record.components, [&](ComponentID mID) {
+                pools[mID]->save(entity->components.get(mID), bytes);
+                bytes += sizes[mID];
+            });
+        }
+
+        for (auto i(0u); i < maxGroups; ++i)
+        {
+            const auto &group(groupedEntities[i]);
+            const std::uint32_t members(std::count_if(std::begin(group), std::end(group), [i](const Entity *mEntity) {
+                return mEntity->isAlive() && mEntity->hasGroup(i);
+            }));
+            write(&members, sizeof(members));
+
+            for (const auto entity : group)
+                if (entity->isAlive() && entity->hasGroup(i))
+                    write(&entity->handle.index, sizeof(entity->handle.index));
+        }
+    }
+
+    // Bring the manager back to `mSnapshot`. The entities alive in both
+    // keep their slots and get the saved bytes, the ones created since
+    // are destroyed and the ones destroyed since come back in their old
+    // slot with their old handle. Components of the entities that come
+    // back are `init`ed again and the restore listeners are called with
+    // them, so the structures outside the manager can take them back.
+    void restore(const ManagerSnapshot &mSnapshot)
+    {
+        refresh();
+
+        auto read([](const unsigned char *&mBytes, void *mValue, std::size_t mSize) {
+            std::memcpy(mValue, mBytes, mSize);
+            mBytes += mSize;
+        });
+
+        const auto sizes(getComponentSizes());
+        const unsigned char *bytes(mSnapshot.data.data());
+        std::size_t count;
+        read(bytes, &count, sizeof(count));
+        const auto firstRecord(bytes);
+
+        // Which entities are still the ones of the snapshot.
+        keptSlots.assign(generations.size(), false);
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            ManagerSnapshot::EntityRecord record;
+            read(bytes, &record, sizeof(record));
+
+            auto entity(getEntity(record.handle));
+            if (entity != nullptr && entity->isAlive() && entity->components.getKeys() == record.components)
+                keptSlots[record.handle.index] = true;
+
+            forEachComponentID(record.components, [&](ComponentID mID) { bytes += sizes[mID]; });
+        }
+
+        for (auto entity : entities)
+            if (!keptSlots[entity->getPoolIndex()])
+                entity->destroy();
+        refresh();
+
+        bytes = firstRecord;
+        entities.clear();
+        restoredEntities.clear();
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            ManagerSnapshot::EntityRecord record;
+            read(bytes, &record, sizeof(record));
+            const auto index(record.handle.index);
+
+            Entity *entity;
+            if (index < keptSlots.size() && keptSlots[index])
+            {
+                entity = &entityPool.get(index);
+                forEachComponentID(record.components, [&](ComponentID mID) {
+                    pools[mID]->restore(entity->components.get(mID), bytes);
+                    bytes += sizes[mID];
+                });
+            }
+            else
+            {
+                if (index >= generations.size())
+                    generations.resize(index + 1, 0);
+                generations[index] = record.handle.generation;
+
+                entityPool.createAt(index, *this, record.handle);
+                entity = &entityPool.get(index);
+                forEachComponentID(record.components, [&](ComponentID mID) {
+                    entity->components.set(mID, pools[mID]->createFrom(bytes, *entity));
+                    bytes += sizes[mID];
+                });
+
+                // Once all the components are there, they can find each other.
+                forEachComponentID(record.components,
+                                   [&](ComponentID mID) { pools[mID]->init(entity->components.get(mID)); });
+
+                restoredEntities.emplace_back(entity);
+            }
+
+            entity->groupBitset = record.groups;
+            entities.emplace_back(entity);
+        }
+        entityPool.rebuildFreeList();
+
+        // The groups in their saved order.
+        for (auto i(0u); i < maxGroups; ++i)
+        {
+            auto &group(groupedEntities[i]);
+            for (auto entity : group)
+                entity->groupIndices.erase(i);
+            group.clear();
+
+            std::uint32_t members;
+            read(bytes, &members, sizeof(members));
+            for (std::uint32_t j{0}; j < members; ++j)
+            {
+                std::size_t index;
+                read(bytes, &index, sizeof(index));
+
+                auto &entity(entityPool.get(index));
+                entity.groupIndices.set(i, static_cast<GroupIndex>(group.size()));
+                group.emplace_back(&entity);
+            }
+        }
+
+        // Entities came back and changed order, the views start over.
+        for (auto &view : views)
+            fillView(*view);
+
+        for (auto entity : restoredEntities)
+            for (auto &listener : restoreListeners)
+                listener(*entity);
+    }
+
+    Entity &addEntity()
+    {
+        MemoryScope memoryScope{MEntities};
+        EntityHandle handle{entityPool.nextIndex(), 0};
+        if (handle.index >= generations.size())
+            generations.resize(handle.index + 1, 0);
+        handle.generation = generations[handle.index];
+
+        auto index(entityPool.create(*this, handle));
+        Entity &e(entityPool.get(index));
+        entities.emplace_back(&e);
+        return e;
+    }
+
+    // Make room for `mCount` more entities, before adding many at once.
+    void reserve(std::size_t mCount)
+    {
+        MemoryScope memoryScope{MEntities};
+        entities.reserve(entities.size() + mCount);
+        generations.reserve(generations.size() + mCount);
+    }
+
+    // An archetype is a set of components, every brick has one and every
+    // ball another. This puts the entities of each archetype together, in
+    // the order the archetypes first appear, and moves the components to
+    // match: each pool ends up in the order of the entities, without
+    // holes, so going through a view reads the pools front to back.
+    // It moves every component of the world, so it is meant for after
+    // big changes like loading a level. Snapshots saved before it no
+    // longer apply.
+    void compact()
+    {
+        refresh();
+
+        archetypes.clear();
+        for (auto entity : entities)
+            if (std::find(std::begin(archetypes), std::end(archetypes), entity->components.getKeys()) ==
+                std::end(archetypes))
+                archetypes.emplace_back(entity->components.getKeys());
+
+        // New order of the entities and, for each pool, the old slot of
+        // the component that goes in each of its slots.
+        sortedEntities.clear();
+        sortedEntities.reserve(entities.size());
+        for (auto &order : componentOrders)
+            order.clear();
+
+        for (const auto &archetype : archetypes)
+            for (auto entity : entities)
+            {
+                if (entity->components.getKeys() != archetype)
+                    continue;
+
+                sortedEntities.emplace_back(entity);
+                forEachComponentID(archetype, [&](ComponentID mID) {
+                    componentOrders[mID].emplace_back(entity->components.get(mID));
+                    entity->components.set(mID, static_cast<ComponentIndex>(componentOrders[mID].size() - 1));
+                });
+            }
+
+        for (auto i(0u); i < maxComponents; ++i)
+            if (pools[i] != nullptr)
+                pools[i]->reorder(componentOrders[i]);
+
+        entities.swap(sortedEntities);
+        for (auto &view : views)
+            fillView(*view);
+    }
+};
+
+Entity::~Entity()
+{
+    forEachComponentID(components.getKeys(),
+                       [this](ComponentID mID) { manager.releaseComponent(mID, components.get(mID)); });
+}
+
+void Entity::addGroup(Group mGroup) noexcept
+{
+    groupBitset[mGroup] = true;
+    manager.addToGroup(this, mGroup);
+}
+
+void Entity::destroy() noexcept
+{
+    if (!alive)
+        return;
+
+    alive = false;
+    manager.markDead();
+}
+
+void Entity::delGroup(Group mGroup) noexcept
+{
+    if (!groupBitset[mGroup])
+        return;
+
+    groupBitset[mGroup] = false;
+    manager.delFromGroup(this, mGroup);
+}
+
+template <typename T, typename... TArgs>
+T &Entity::addComponent(TArgs &&... mArgs)
+{
+    assert(!hasComponent<T>());
+    MemoryScope memoryScope{MComponents};
+
+    auto &pool(manager.getPool<T>());
+    auto index(pool.create(std::forward<TArgs>(mArgs)...));
+
+    components.set(getComponentTypeID<T>(), index);
+    manager.addToViews(*this, getComponentTypeID<T>());
+
+    T &c(pool.get(index));
+    c.entity = this;
+    c.init();
+
+    return c;
+}
+
+template <typename T>
+void Entity::removeComponent()
+{
+    assert(hasComponent<T>());
+
+    const auto id(getComponentTypeID<T>());
+    const auto index(components.get(id));
+    components.erase(id);
+    manager.removeFromViews(*this, id);
+    manager.releaseComponent(id, index);
+}
+
+template <typename T>
+T &Entity::getComponent() const
+{
+    assert(hasComponent<T>());
+    return manager.getPool<T>().get(components.get(getComponentTypeID<T>()));
+}
+
+template <typename T>
+void ComponentRef<T>::bind(Entity &mOwner)
+{
+    pool = &mOwner.manager.getPool<T>();
+    resolve(mOwner);
+}
+
+template <typename T>
+void ComponentRef<T>::resolve(const Entity &mOwner) const
+{
+    component = &mOwner.getComponent<T>();
+    layout = pool->getLayout();
+}
+
+template <typename T>
+void CommandBuffer::addRecordedComponent(Entity *mEntity, void *mComponent)
+{
+    auto &component(*static_cast<T *>(mComponent));
+    if (mEntity != nullptr)
+        mEntity->addComponent<T>(std::move(component));
+
+    component.~T();
+}
+
+template <typename T>
+void CommandBuffer::removeComponentOf(Entity *mEntity, void *)
+{
+    if (mEntity != nullptr && mEntity->hasComponent<T>())
+        mEntity->removeComponent<T>();
+}
+
+CommandBuffer::Target CommandBuffer::target(const Entity &mEntity) const noexcept
+{
+    return Target{mEntity.getHandle(), notCreated};
+}
+
+Entity *CommandBuffer::resolve(Manager &mManager, const Target &mTarget) const
+{
+    auto entity(mTarget.created == notCreated ? mManager.getEntity(mTarget.handle)
+                                              : mTarget.created < created.size() ? created[mTarget.created] : nullptr);
+    return entity != nullptr && entity->isAlive() ? entity : nullptr;
+}
+
+void CommandBuffer::playBack(Manager &mManager)
+{
+    created.clear();
+    for (auto &command : commands)
+    {
+        auto entity(command.kind == Kind::Create ? nullptr : resolve(mManager, command.target));
+        switch (command.kind)
+        {
+            case Kind::Create: created.emplace_back(&mManager.addEntity()); break;
+            case Kind::Destroy:
+                if (entity != nullptr)
+                    entity->destroy();
+                break;
+            case Kind::AddComponent:
+            case Kind::RemoveComponent: command.apply(entity, command.component); break;
+            case Kind::AddGroup:
+                if (entity != nullptr)
+                    entity->addGroup(command.group);
+                break;
+        }
+    }
+
+    commands.clear();
+    currentBlock = blockUsed = createdCount = 0;
+}
+
+template <typename... Ts>
+bool EntityView<Ts...>::matches(const Entity &mEntity) const noexcept
+{
+    return mEntity.isAlive() && mEntity.matches(signature);
+}
+
+template <typename... Ts>
+template <typename TF>
+void EntityView<Ts...>::forEach(TF &&mFunction) const
+{
+    for (std::size_t i{0}; i < entities.size(); ++i)
+    {
+        auto &entity(*entities[i]);
+        if (matches(entity))
+            mFunction(entity, entity.getComponent<Ts>()...);
+    }
+}
+
+// Position of the entities in the world
+struct CPosition : Component
+{
+    // Position at the start of the last logic step, used to interpolate
+    // when the frame is drawn between two steps.
+    PhysicsVector position, previousPosition;
+    // Bumped every time `position` or `previousPosition` is written, so the
+    // drawing components only sync the entities that moved.
+    std::uint32_t version{0};
+
+    CPosition() = default;
+    CPosition(const Vector2f &mPosition)
+        : position(fromVector2f<PhysicsScalar>(mPosition)), previousPosition(position)
+    {
+    }
+
+    PhysicsScalar x() const noexcept { return position.x; }
+    PhysicsScalar y() const noexcept { return position.y; }
+
+    // Whether the drawn position may differ from when `mVersion` was read:
+    // the entity moved since, or it is still being interpolated.
+    bool changedSince(std::uint32_t mVersion) const noexcept
+    {
+        return version != mVersion || position != previousPosition;
+    }
+
+    // Drawn positions are floats in every build.
+    Vector2f interpolated(float mAlpha) const noexcept
+    {
+        const Vector2f previous{toVector2f(previousPosition)};
+        return previous + (toVector2f(position) - previous) * mAlpha;
+    }
+};
+
+struct CPhysics : Component
+{
+    // Everything the collision tests read is in this component, that way
+    // it fits in a single cache line.
+    ComponentRef<CPosition> cPosition;
+    PhysicsVector velocity, halfSize;
+
+    // Called with the side the entity went out of the window through. It is
+    // a plain function pointer instead of a `std::function`: it can't
+    // allocate and calling it doesn't go through type erasure.
+    using OutOfBoundsHandler = void (*)(CPhysics &, const Vector2f &);
+    OutOfBoundsHandler onOutOfBounds{nullptr};
+    CPhysics(const Vector2f &mHalfSize) : halfSize{fromVector2f<PhysicsScalar>(mHalfSize)} {}
+
+    void init() override { cPosition.bind(*entity); }
+
+    PhysicsScalar x() const noexcept { return cPosition.get(*entity).x(); }
+    PhysicsScalar y() const noexcept { return cPosition.get(*entity).y(); }
+    PhysicsScalar left() const noexcept { return x() - halfSize.x; }
+    PhysicsScalar right() const noexcept { return x() + halfSize.x; }
+    PhysicsScalar top() const noexcept { return y() - halfSize.y; }
+    PhysicsScalar bottom() const noexcept { return y() + halfSize.y; }
+};
+
+// A single tessellated circle of radius 1, shared by every ball. It lives
+// in a `VertexBuffer` when the driver supports them, and every ball draws
+// it with its own transform, so balls don't own any geometry.
+class CircleMesh : public Drawable
+{
+  private:
+    static constexpr std::size_t pointCount{30};
+
+    VertexArray vertices{TriangleFan};
+    VertexBuffer buffer{TriangleFan, VertexBuffer::Static};
+    bool useBuffer{false};
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        if (useBuffer)
+            mTarget.draw(buffer, mStates);
+        else
+            mTarget.draw(vertices, mStates);
+    }
+
+  public:
+    // Needs a graphics context, for the vertex buffer.
+    void build(const Color &mColor)
+    {
+        vertices.clear();
+        vertices.append(Vertex{Vector2f{0.f, 0.f}, mColor});
+        for (std::size_t i{0}; i <= pointCount; ++i)
+        {
+            const float angle{i * 2.f * 3.14159265f / pointCount};
+            vertices.append(Vertex{Vector2f{std::cos(angle), std::sin(angle)}, mColor});
+        }
+
+        useBuffer = VertexBuffer::isAvailable() && buffer.create(vertices.getVertexCount()) &&
+                    buffer.update(&vertices[0]);
+    }
+
+    std::size_t getVertexCount() const noexcept { return vertices.getVertexCount(); }
+};
+
+// Where a circle is drawn, the mesh is scaled by `radius`.
+struct CircleInstance
+{
+    Vector2f position;
+    float radius;
+
+    RenderStates getStates(RenderStates mStates) const
+    {
+        mStates.transform.translate(position).scale(radius, radius);
+        return mStates;
+    }
+};
+
+struct CCircle : Component
+{
+    Game *game{nullptr};
+    CircleInstance instance;
+    // `CPosition::version` when `instance` was last synced.
+    std::uint32_t syncedVersion{std::numeric_limits<std::uint32_t>::max()};
+
+    CCircle(Game *mGame, float mRadius) : game{mGame}, instance{Vector2f{}, mRadius} {}
+};
+
+// All the rectangles are drawn as quads of a single vertex array, so the
+// whole batch is submitted with one draw call. Each rectangle owns a quad
+// and only rewrites its four vertices when it changes.
+class RectangleBatch : public Drawable
+{
+  private:
+    VertexArray vertices{Quads};
+    // Quads of removed rectangles, reused before growing the array.
+    std::vector<std::size_t> freeQuads;
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        mStates.texture = texture;
+        mTarget.draw(vertices, mStates);
+    }
+
+    // Quads changed since `clearDirty`, for renderers that keep their own
+    // copy of the batch.
+    std::size_t dirtyFirst{0}, dirtyLast{0};
+
+    void markDirty(std::size_t mQuad) noexcept
+    {
+        if (dirtyFirst == dirtyLast)
+        {
+            dirtyFirst = mQuad;
+            dirtyLast = mQuad + 1;
+            return;
+        }
+
+        dirtyFirst = std::min(dirtyFirst, mQuad);
+        dirtyLast = std::max(dirtyLast, mQuad + 1);
+    }
+
+  public:
+    // Every quad of the batch is drawn with the same texture, if any.
+    const Texture *texture{nullptr};
+
+    std::size_t getQuadCount() const noexcept { return vertices.getVertexCount() / 4; }
+    const Vertex *getQuad(std::size_t mQuad) const { return &vertices[mQuad * 4]; }
+
+    std::size_t getDirtyFirst() const noexcept { return dirtyFirst; }
+    std::size_t getDirtyLast() const noexcept { return dirtyLast; }
+    void clearDirty() noexcept { dirtyFirst = dirtyLast = 0; }
+
+    std::size_t add()
+    {
+        if (!freeQuads.empty())
+        {
+            auto quad(freeQuads.back());
+            freeQuads.pop_back();
+            return quad;
+        }
+
+        auto quad(vertices.getVertexCount() / 4);
+        vertices.resize(vertices.getVertexCount() + 4);
+        // Room for every quad to be removed, `remove` never allocates.
+        if (freeQuads.capacity() <= quad)
+            freeQuads.reserve(2 * (quad + 1));
+        return quad;
+    }
+
+    // The quad is collapsed to a point, that way it is not rasterized
+    // and the rest of the array doesn't have to move.
+    void remove(std::size_t mQuad)
+    {
+        for (auto i(0u); i < 4; ++i)
+            vertices[mQuad * 4 + i] = Vertex{};
+
+        freeQuads.emplace_back(mQuad);
+        markDirty(mQuad);
+    }
+
+    void set(std::size_t mQuad, const Vector2f &mCenter, const Vector2f &mHalfSize, const Color &mColor,
+             const FloatRect &mTextureRect = FloatRect{})
+    {
+        markDirty(mQuad);
+
+        Vertex *quad(&vertices[mQuad * 4]);
+        const float textureRight{mTextureRect.left + mTextureRect.width};
+        const float textureBottom{mTextureRect.top + mTextureRect.height};
+
+        quad[0] = Vertex{Vector2f{mCenter.x - mHalfSize.x, mCenter.y - mHalfSize.y}, mColor,
+                         Vector2f{mTextureRect.left, mTextureRect.top}};
+        quad[1] = Vertex{Vector2f{mCenter.x + mHalfSize.x, mCenter.y - mHalfSize.y}, mColor,
+                         Vector2f{textureRight, mTextureRect.top}};
+        quad[2] = Vertex{Vector2f{mCenter.x + mHalfSize.x, mCenter.y + mHalfSize.y}, mColor,
+                         Vector2f{textureRight, textureBottom}};
+        quad[3] = Vertex{Vector2f{mCenter.x - mHalfSize.x, mCenter.y + mHalfSize.y}, mColor,
+                         Vector2f{mTextureRect.left, textureBottom}};
+    }
+};
+
+// The bricks only change when one breaks, so they are drawn once into a
+// texture, and every frame only that texture is drawn, as a single quad.
+// The texture is drawn again when a brick of `batch` changed, or when the
+// view moved.
+class StaticLayer : public Drawable
+{
+  private:
+    RenderTexture texture;
+    Sprite sprite;
+    Vector2f renderedCenter;
+    bool valid{false};
+    // Parts of the view whose quads changed, when all the changes are
+    // known to be in them.
+    std::vector<FloatRect> damaged;
+
+    // Drawn in window coordinates, set the default view first.
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        mTarget.draw(sprite, mStates);
+    }
+
+  public:
+    RectangleBatch batch;
+
+    bool create(unsigned mWidth, unsigned mHeight)
+    {
+        if (!texture.create(mWidth, mHeight))
+            return false;
+
+        sprite.setTexture(texture.getTexture());
+        return true;
+    }
+
+    bool needsUpdate(const View &mView) const noexcept
+    {
+        return !valid || batch.getDirtyFirst() != batch.getDirtyLast() || mView.getCenter() != renderedCenter;
+    }
+
+    // Draw the texture again with the quads of `mVertices`, the ones of
+    // `batch` that can be seen through `mView`.
+    template <typename TVertices>
+    void update(const View &mView, const TVertices &mVertices)
+    {
+        texture.setView(mView);
+        texture.clear(Color::Transparent);
+        if (!mVertices.empty())
+            texture.draw(mVertices.data(), mVertices.size(), Quads);
+        texture.display();
+
+        batch.clearDirty();
+        damaged.clear();
+        renderedCenter = mView.getCenter();
+        valid = true;
+    }
+
+    // Only `mArea` needs to be drawn again, see `patch`.
+    void damage(const FloatRect &mArea) { damaged.emplace_back(mArea); }
+    const std::vector<FloatRect> &getDamaged() const noexcept { return damaged; }
+
+    // Whether `patch` can do instead of `update`: the texture is of the
+    // same view, and the caller marked where the quads changed.
+    bool canPatch(const View &mView) const noexcept
+    {
+        return valid && !damaged.empty() && mView.getCenter() == renderedCenter;
+    }
+
+    // Draw again only the damaged areas: every one is cleared, then the
+    // quads of `mVertices` that are in it are drawn. The quads must not
+    // overlap others out of the area, like the bricks of a level.
+    template <typename TF>
+    void patch(const View &mView, TF &&mGetVertices)
+    {
+        texture.setView(mView);
+        for (const auto &area : damaged)
+        {
+            const float right{area.left + area.width}, bottom{area.top + area.height};
+            const Vertex clear[]{Vertex{Vector2f{area.left, area.top}, Color::Transparent},
+                                 Vertex{Vector2f{right, area.top}, Color::Transparent},
+                                 Vertex{Vector2f{right, bottom}, Color::Transparent},
+                                 Vertex{Vector2f{area.left, bottom}, Color::Transparent}};
+            texture.draw(clear, 4, Quads, RenderStates{BlendNone});
+
+            const auto &vertices(mGetVertices(area));
+            if (!vertices.empty())
+                texture.draw(vertices.data(), vertices.size(), Quads);
+        }
+        texture.display();
+
+        batch.clearDirty();
+        damaged.clear();
+    }
+};
+
+// Batches that move as a whole, each drawn with its own transform, so
+// moving one doesn't write its vertices. A call per batch.
+struct KinematicLayer : Drawable
+{
+    std::vector<RectangleBatch> batches;
+    std::vector<Transform> transforms;
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        for (std::size_t i{0}; i < batches.size(); ++i)
+            mTarget.draw(batches[i], getStates(i, mStates));
+    }
+
+    RenderStates getStates(std::size_t mBatch, RenderStates mStates) const
+    {
+        mStates.transform *= transforms[mBatch];
+        return mStates;
+    }
+};
+
+// All the images of the game packed into a single texture when it starts,
+// so every textured quad can still go into one `RectangleBatch` and one
+// draw call. Images are packed in shelves, tallest first.
+class TextureAtlas
+{
+  public:
+    static constexpr std::size_t npos{std::numeric_limits<std::size_t>::max()};
+
+  private:
+    // Transparent pixels around every image, so filtering doesn't bleed
+    // the neighbours in.
+    static constexpr unsigned padding{1};
+
+    struct Region
+    {
+        std::string name;
+        Image image;
+        IntRect rect;
+    };
+
+    std::vector<Region> regions;
+    Texture texture;
+
+  public:
+    // Returns the index of the new region, valid once `build` succeeded.
+    std::size_t add(const std::string &mName, const Image &mImage)
+    {
+        regions.emplace_back(Region{mName, mImage, IntRect{}});
+        return regions.size() - 1;
+    }
+
+    // Replace the image of a region, e.g. one added as a placeholder before
+    // its image was loaded. Takes effect at the next `build`.
+    void setImage(std::size_t mRegion, const Image &mImage) { regions[mRegion].image = mImage; }
+
+    bool addFromFile(const std::string &mName, const std::string &mPath)
+    {
+        Image image;
+        if (!image.loadFromFile(mPath))
+            return false;
+
+        add(mName, image);
+        return true;
+    }
+
+    std::size_t find(const std::string &mName) const
+    {
+        for (auto i(0u); i < regions.size(); ++i)
+            if (regions[i].name == mName)
+                return i;
+
+        return npos;
+    }
+
+    bool build(unsigned mWidth = 1024)
+    {
+        std::vector<std::size_t> order(regions.size());
+        std::iota(std::begin(order), std::end(order), 0);
+        std::sort(std::begin(order), std::end(order), [this](std::size_t mA, std::size_t mB) {
+            return regions[mA].image.getSize().y > regions[mB].image.getSize().y;
+        });
+
+        unsigned x{padding}, y{padding}, shelfHeight{0};
+        for (auto index : order)
+        {
+            auto &region(regions[index]);
+            const auto size(region.image.getSize());
+            if (size.x + padding * 2 > mWidth)
+                return false;
+
+            if (x + size.x + padding > mWidth)
+            {
+                x = padding;
+                y += shelfHeight + padding;
+                shelfHeight = 0;
+            }
+
+            region.rect = IntRect{static_cast<int>(x), static_cast<int>(y), static_cast<int>(size.x),
+                                  static_cast<int>(size.y)};
+            x += size.x + padding;
+            shelfHeight = std::max(shelfHeight, size.y);
+        }
+
+        Image atlas;
+        atlas.create(mWidth, y + shelfHeight + padding, Color::Transparent);
+        for (auto &region : regions)
+        {
+            atlas.copy(region.image, region.rect.left, region.rect.top);
+            // Only the texture keeps the pixels.
+            region.image = Image{};
+        }
+
+        return texture.loadFromImage(atlas);
+    }
+
+    FloatRect getTextureRect(std::size_t mRegion) const
+    {
+        const auto &rect(regions[mRegion].rect);
+        return FloatRect{static_cast<float>(rect.left), static_cast<float>(rect.top), static_cast<float>(rect.width),
+                         static_cast<float>(rect.height)};
+    }
+
+    const Texture &getTexture() const noexcept { return texture; }
+};
+
+// Read-only view of a whole file. Mapped where the OS supports it, so
+// nothing is copied and only the pages that are touched get read.
+class MappedFile
+{
+  private:
+    const char *data{nullptr};
+    std::size_t size{0};
+#ifndef ARKANOID_MMAP
+    std::vector<char> contents;
+#endif
+
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() { close(); }
+
+    bool open(const char *mPath)
+    {
+        close();
+
+#ifdef ARKANOID_MMAP
+        int file{::open(mPath, O_RDONLY)};
+        if (file < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0)
+        {
+            ::close(file);
+            return false;
+        }
+
+        void *mapping(mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0));
+        ::close(file);
+
+        if (mapping == MAP_FAILED)
+            return false;
+
+        data = static_cast<const char *>(mapping);
+        size = info.st_size;
+#else
+        std::ifstream file{mPath, std::ios::binary};
+        if (!file)
+            return false;
+
+        contents.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+        data = contents.data();
+        size = contents.size();
+#endif
+        return true;
+    }
+
+    void close() noexcept
+    {
+#ifdef ARKANOID_MMAP
+        if (data != nullptr)
+            munmap(const_cast<char *>(data), size);
+#else
+        contents = std::vector<char>{};
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const char *getData() const noexcept { return data; }
+    std::size_t getSize() const noexcept { return size; }
+};
+
+// Tells when a file was written since it was last looked at, for the files
+// that are edited while the game runs. It is polled from the frame, at most
+// every `interval` milliseconds, so watching costs nothing in between.
+// Where there is no `stat`, the contents are compared instead, only fit
+// for small files.
+class FileWatcher
+{
+  private:
+    std::string path;
+    FrameTime interval, elapsed{0.f};
+#ifdef ARKANOID_MMAP
+    using Stamp = std::pair<time_t, off_t>;
+#else
+    using Stamp = std::string;
+#endif
+    Stamp stamp;
+
+    Stamp getStamp() const
+    {
+#ifdef ARKANOID_MMAP
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0)
+            return Stamp{};
+        return Stamp{info.st_mtime, info.st_size};
+#else
+        std::ifstream file{path, std::ios::binary};
+        return Stamp{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+#endif
+    }
+
+  public:
+    FileWatcher(FrameTime mInterval = 500.f) : interval{mInterval} {}
+
+    void watch(const std::string &mPath)
+    {
+        path = mPath;
+        stamp = getStamp();
+        elapsed = 0.f;
+    }
+
+    bool isWatching() const noexcept { return !path.empty(); }
+    const std::string &getPath() const noexcept { return path; }
+
+    // True once after every write. A file being written may be seen
+    // half-done, readers should leave the old contents on a parse error.
+    bool poll(FrameTime mFT)
+    {
+        if (path.empty() || (elapsed += mFT) < interval)
+            return false;
+
+        elapsed = 0.f;
+        auto current(getStamp());
+        if (current == stamp)
+            return false;
+
+        stamp = std::move(current);
+        return true;
+    }
+};
+
+// Many small files packed into one, so startup opens a single file instead
+// of one per asset. The file starts with "ARKP", a version byte, three
+// padding bytes and the entry count, then the index: for every entry its
+// offset and size (64 bits, little-endian), the length of its name (16
+// bits) and the name. The contents follow, each aligned to 16 bytes.
+// Entries are read straight from the mapping.
+class AssetArchive
+{
+  private:
+    static constexpr std::uint8_t version{1};
+    static constexpr std::size_t headerSize{12}, alignment{16};
+    // Offset, size and name length, for an entry with an empty name.
+    static constexpr std::size_t minEntrySize{18};
+
+    struct Entry
+    {
+        std::string name;
+        std::uint64_t offset, size;
+    };
+
+    MappedFile file;
+    std::vector<Entry> entries;
+
+    template <typename T>
+    static bool read(const char *&mCursor, const char *mEnd, T &mValue) noexcept
+    {
+        if (static_cast<std::size_t>(mEnd - mCursor) < sizeof(T))
+            return false;
+
+        std::memcpy(&mValue, mCursor, sizeof(T));
+        mCursor += sizeof(T);
+        return true;
+    }
+
+  public:
+    bool open(const char *mPath)
+    {
+        entries.clear();
+        if (!file.open(mPath))
+            return false;
+
+        const char *cursor(file.getData()), *end(cursor + file.getSize());
+        std::uint32_t count;
+        if (file.getSize() < headerSize || std::memcmp(cursor, "ARKP", 4) != 0 ||
+            static_cast<std::uint8_t>(cursor[4]) != version)
+            return false;
+
+        cursor += 8;
+        if (!read(cursor, end, count))
+            return false;
+
+        // The count of a corrupt archive could ask for any amount of memory.
+        if (count > (file.getSize() - headerSize) / minEntrySize)
+            return false;
+
+        entries.resize(count);
+        for (auto &entry : entries)
+        {
+            std::uint16_t nameLength;
+            if (!read(cursor, end, entry.offset) || !read(cursor, end, entry.size) || !read(cursor, end, nameLength) ||
+                static_cast<std::size_t>(end - cursor) < nameLength)
+                return false;
+
+            entry.name.assign(cursor, nameLength);
+            cursor += nameLength;
+
+            if (entry.offset > file.getSize() || entry.size > file.getSize() - entry.offset)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Contents of `mName`, which stay valid as long as the archive is open.
+    bool find(const std::string &mName, const char *&mData, std::size_t &mSize) const
+    {
+        for (const auto &entry : entries)
+            if (entry.name == mName)
+            {
+                mData = file.getData() + entry.offset;
+                mSize = entry.size;
+                return true;
+            }
+
+        return false;
+    }
+
+    // Pack `mFiles` into `mPath`, every file is stored under its path.
+    static bool pack(const char *mPath, const std::vector<std::string> &mFiles)
+    {
+        std::vector<std::vector<char>> contents;
+        std::size_t indexSize{headerSize};
+        for (const auto &name : mFiles)
+        {
+            std::ifstream input{name, std::ios::binary};
+            if (!input || name.size() > std::numeric_limits<std::uint16_t>::max())
+                return false;
+
+            contents.emplace_back(std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{});
+            indexSize += sizeof(std::uint64_t) * 2 + sizeof(std::uint16_t) + name.size();
+        }
+
+        auto align([](std::uint64_t mOffset) { return (mOffset + alignment - 1) / alignment * alignment; });
+
+        std::vector<char> data(headerSize, 0);
+        std::memcpy(data.data(), "ARKP", 4);
+        data[4] = static_cast<char>(version);
+        const auto count(static_cast<std::uint32_t>(mFiles.size()));
+        std::memcpy(data.data() + 8, &count, sizeof(count));
+
+        auto append([&data](const void *mValue, std::size_t mSize) {
+            data.insert(std::end(data), static_cast<const char *>(mValue), static_cast<const char *>(mValue) + mSize);
+        });
+
+        std::uint64_t offset{align(indexSize)};
+        for (std::size_t i{0}; i < mFiles.size(); ++i)
+        {
+            const std::uint64_t size{contents[i].size()};
+            const auto nameLength(static_cast<std::uint16_t>(mFiles[i].size()));
+            append(&offset, sizeof(offset));
+            append(&size, sizeof(size));
+            append(&nameLength, sizeof(nameLength));
+            append(mFiles[i].data(), nameLength);
+            offset = align(offset + size);
+        }
+
+        for (const auto &file : contents)
+        {
+            data.resize(align(data.size()), 0);
+            append(file.data(), file.size());
+        }
+
+        std::ofstream output{mPath, std::ios::binary};
+        output.write(data.data(), data.size());
+        return static_cast<bool>(output);
+    }
+};
+
+// Loads files in the background and hands out handles to them, the same
+// path is only loaded once. Files are read and decoded on a loader thread.
+// What needs the OpenGL context (the texture uploads) is finished by
+// `update`, called from the main thread every frame, which also runs the
+// callbacks of the assets that became ready meanwhile.
+class AssetCache
+{
+  public:
+    template <typename T>
+    struct Handle
+    {
+        static constexpr std::uint32_t invalid{std::numeric_limits<std::uint32_t>::max()};
+        std::uint32_t index{invalid};
+
+        Handle() = default;
+        explicit Handle(std::uint32_t mIndex) : index{mIndex} {}
+
+        bool isValid() const noexcept { return index != invalid; }
+    };
+
+  private:
+    enum class Kind : std::uint8_t
+    {
+        KImage,
+        KTexture,
+        KSound,
+        KFont
+    };
+
+    enum class State : std::uint8_t
+    {
+        Loading,
+        // Decoded, waiting for `update` to upload it.
+        Decoded,
+        Ready,
+        Failed
+    };
+
+    struct Asset
+    {
+        std::string path;
+        Kind kind;
+        std::atomic<State> state{State::Loading};
+        // Fonts read their glyphs from the file contents as they go, so
+        // the contents are kept for them.
+        std::vector<char> contents;
+        Image image;
+        Texture texture;
+        SoundBuffer sound;
+        Font font;
+        // Called with the asset, or null when it couldn't be loaded.
+        std::vector<std::function<void(const Asset *)>> callbacks;
+        bool notified{false};
+    };
+
+    // Searched before the file system, see `mount`. Destroyed after the
+    // assets, fonts keep reading from it.
+    std::unique_ptr<AssetArchive> archive;
+    std::vector<std::unique_ptr<Asset>> assets;
+    std::deque<Asset *> pending;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping{false};
+    // Only started by the first load, headless games never load assets.
+    std::thread loader;
+
+    static Kind kindOf(const Image *) noexcept { return Kind::KImage; }
+    static Kind kindOf(const Texture *) noexcept { return Kind::KTexture; }
+    static Kind kindOf(const SoundBuffer *) noexcept { return Kind::KSound; }
+    static Kind kindOf(const Font *) noexcept { return Kind::KFont; }
+
+    static const Image &resource(const Asset &mAsset, const Image *) noexcept { return mAsset.image; }
+    static const Texture &resource(const Asset &mAsset, const Texture *) noexcept { return mAsset.texture; }
+    static const SoundBuffer &resource(const Asset &mAsset, const SoundBuffer *) noexcept { return mAsset.sound; }
+    static const Font &resource(const Asset &mAsset, const Font *) noexcept { return mAsset.font; }
+
+    bool decode(Asset &mAsset)
+    {
+        // Archived assets are decoded straight from the mapping.
+        const char *data;
+        std::size_t size;
+        if (archive == nullptr || !archive->find(mAsset.path, data, size))
+        {
+            std::ifstream file{mAsset.path, std::ios::binary};
+            if (!file)
+                return false;
+
+            mAsset.contents.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+            data = mAsset.contents.data();
+            size = mAsset.contents.size();
+        }
+
+        bool decoded{false};
+        switch (mAsset.kind)
+        {
+            case Kind::KImage:
+            case Kind::KTexture: decoded = mAsset.image.loadFromMemory(data, size); break;
+            case Kind::KSound: decoded = mAsset.sound.loadFromMemory(data, size); break;
+            case Kind::KFont: return mAsset.font.loadFromMemory(data, size);
+        }
+
+        mAsset.contents = std::vector<char>{};
+        return decoded;
+    }
+
+    void run()
+    {
+        ARKANOID_THREAD("assets");
+
+        while (true)
+        {
+            Asset *asset;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                wakeUp.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (stopping)
+                    return;
+
+                asset = pending.front();
+                pending.pop_front();
+            }
+
+            ARKANOID_ZONE("decode");
+            if (!decode(*asset))
+                asset->state.store(State::Failed, std::memory_order_release);
+            else
+                asset->state.store(asset->kind == Kind::KTexture ? State::Decoded : State::Ready,
+                                   std::memory_order_release);
+        }
+    }
+
+    // Upload a decoded texture and call the callbacks of a finished asset.
+    void finish(Asset &mAsset)
+    {
+        auto state(mAsset.state.load(std::memory_order_acquire));
+        if (state == State::Decoded)
+        {
+            const bool uploaded{mAsset.texture.loadFromImage(mAsset.image)};
+            mAsset.image = Image{};
+            state = uploaded ? State::Ready : State::Failed;
+            mAsset.state.store(state, std::memory_order_relaxed);
+        }
+
+        if (state == State::Loading)
+            return;
+
+        mAsset.notified = true;
+        for (auto &callback : mAsset.callbacks)
+            callback(state == State::Ready ? &mAsset : nullptr);
+        mAsset.callbacks.clear();
+    }
+
+  public:
+    AssetCache() = default;
+    AssetCache(const AssetCache &) = delete;
+    AssetCache &operator=(const AssetCache &) = delete;
+
+    ~AssetCache()
+    {
+        if (!loader.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wakeUp.notify_one();
+        loader.join();
+    }
+
+    // Load the assets from the archive at `mPath` when it has them, by
+    // their path. Has to be called before the first load.
+    bool mount(const char *mPath)
+    {
+        assert(assets.empty());
+
+        archive.reset(new AssetArchive);
+        if (archive->open(mPath))
+            return true;
+
+        archive.reset();
+        return false;
+    }
+
+    // T is Image, Texture, SoundBuffer or Font.
+    template <typename T>
+    Handle<T> load(const std::string &mPath)
+    {
+        const auto kind(kindOf(static_cast<const T *>(nullptr)));
+        for (std::size_t i{0}; i < assets.size(); ++i)
+            if (assets[i]->kind == kind && assets[i]->path == mPath)
+                return Handle<T>{static_cast<std::uint32_t>(i)};
+
+        assets.emplace_back(new Asset);
+        auto &asset(*assets.back());
+        asset.path = mPath;
+        asset.kind = kind;
+
+        if (!loader.joinable())
+            loader = std::thread{[this] { run(); }};
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            pending.emplace_back(&asset);
+        }
+        wakeUp.notify_one();
+
+        return Handle<T>{static_cast<std::uint32_t>(assets.size() - 1)};
+    }
+
+    // Null until the asset is ready.
+    template <typename T>
+    const T *get(Handle<T> mHandle) const noexcept
+    {
+        const auto &asset(*assets[mHandle.index]);
+        if (!asset.notified || asset.state.load(std::memory_order_acquire) != State::Ready)
+            return nullptr;
+
+        return &resource(asset, static_cast<const T *>(nullptr));
+    }
+
+    // `mCallback(resource)` runs from `update` once the asset is loaded,
+    // with a null pointer when it couldn't be. It runs right away for
+    // assets that are already done.
+    template <typename T, typename TF>
+    void onLoaded(Handle<T> mHandle, TF mCallback)
+    {
+        auto &asset(*assets[mHandle.index]);
+        MemoryScope memoryScope{MCallbacks};
+        std::function<void(const Asset *)> callback([mCallback](const Asset *mAsset) {
+            mCallback(mAsset != nullptr ? &resource(*mAsset, static_cast<const T *>(nullptr)) : nullptr);
+        });
+
+        if (asset.notified)
+            callback(asset.state.load(std::memory_order_acquire) == State::Ready ? &asset : nullptr);
+        else
+            asset.callbacks.emplace_back(callback);
+    }
+
+    std::size_t getPendingCount() const noexcept
+    {
+        std::size_t count{0};
+        for (const auto &asset : assets)
+            count += !asset->notified;
+
+        return count;
+    }
+
+    void update()
+    {
+        for (auto &asset : assets)
+            if (!asset->notified)
+                finish(*asset);
+    }
+};
+
+// Quads drawn straight from a vector, for ones gathered every frame.
+struct QuadList : Drawable
+{
+    std::vector<Vertex> vertices;
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        if (!vertices.empty())
+            mTarget.draw(vertices.data(), vertices.size(), Quads, mStates);
+    }
+};
+
+// What a frame sent to the GPU, counted where the game draws.
+struct RenderStats
+{
+    std::size_t drawCalls{0}, vertices{0};
+    // Between two draw calls that don't use the same one.
+    std::size_t textureSwitches{0}, shaderSwitches{0};
+    // Objects drawn by a call shared with others, every rectangle of a
+    // batch but the first.
+    std::size_t batchedObjects{0};
+
+    void draw(std::size_t mVertices, std::size_t mObjects = 1) noexcept
+    {
+        ++drawCalls;
+        vertices += mVertices;
+        batchedObjects += mObjects > 0 ? mObjects - 1 : 0;
+    }
+
+    void add(const RenderStats &mStats) noexcept
+    {
+        drawCalls += mStats.drawCalls;
+        vertices += mStats.vertices;
+        textureSwitches += mStats.textureSwitches;
+        shaderSwitches += mStats.shaderSwitches;
+        batchedObjects += mStats.batchedObjects;
+    }
+};
+
+// Draw order of the render queue, lowest first.
+enum RenderLayer : std::uint8_t
+{
+    LBalls,
+    LRectangles,
+    LBricks,
+    LStaticLayer,
+    LEffects,
+    LOverlay
+};
+
+#ifdef ARKANOID_GPU_TIMERS
+// Where the GPU time of a frame goes: the render layers, put together,
+// and the post-process.
+enum GpuPass : std::size_t
+{
+    GpuBalls,
+    GpuBricks,
+    GpuEffects,
+    GpuHud,
+    GpuPost,
+    GpuPassCount
+};
+
+// GPU time of every pass, from OpenGL timestamp queries (3.3 or
+// ARB_timer_query). The time `display` spends waiting for the GPU is only
+// seen here. Two sets of queries take turns: a frame issues its own and
+// reads the ones of the frame before, by then the GPU is most likely done
+// with them. When it isn't, the pass keeps its last time instead of
+// waiting. Render textures are drawn in the window's context with SFML
+// 2.5, so the post-process passes are timed by the window's queries too.
+class GpuTimers
+{
+  private:
+    static constexpr std::size_t frames{2};
+    static constexpr GLenum timestamp{0x8E28}, queryResult{0x8866}, queryResultAvailable{0x8867};
+
+    struct Functions
+    {
+        void(ARKANOID_GLAPI *genQueries)(GLsizei, GLuint *);
+        void(ARKANOID_GLAPI *queryCounter)(GLuint, GLenum);
+        void(ARKANOID_GLAPI *getQueryObjectiv)(GLuint, GLenum, GLint *);
+        void(ARKANOID_GLAPI *getQueryObjectui64v)(GLuint, GLenum, std::uint64_t *);
+    };
+
+    Functions gl{};
+    bool available{false};
+    // A start and an end timestamp per pass, for each set.
+    std::array<std::array<GLuint, 2 * GpuPassCount>, frames> queries{};
+    std::array<std::array<bool, GpuPassCount>, frames> issued{};
+    std::array<float, GpuPassCount> milliseconds{};
+    std::size_t frame{0};
+    GpuPass open{GpuPassCount};
+
+    template <typename T>
+    bool load(T &mFunction, const char *mName, const char *mFallback = nullptr)
+    {
+        auto function(Context::getFunction(mName));
+        if (function == nullptr && mFallback != nullptr)
+            function = Context::getFunction(mFallback);
+
+        mFunction = reinterpret_cast<T>(function);
+        return mFunction != nullptr;
+    }
+
+  public:
+    // Call with the window's context active.
+    bool init()
+    {
+        available = load(gl.genQueries, "glGenQueries", "glGenQueriesARB") && load(gl.queryCounter, "glQueryCounter") &&
+                    load(gl.getQueryObjectiv, "glGetQueryObjectiv", "glGetQueryObjectivARB") &&
+                    load(gl.getQueryObjectui64v, "glGetQueryObjectui64v", "glGetQueryObjectui64vEXT");
+        if (!available)
+        {
+            cerr << "Can't time the GPU, timestamp queries aren't supported" << endl;
+            return false;
+        }
+
+        for (auto &set : queries)
+            gl.genQueries(static_cast<GLsizei>(set.size()), set.data());
+        return true;
+    }
+
+    bool isAvailable() const noexcept { return available; }
+
+    float getMilliseconds(GpuPass mPass) const noexcept { return milliseconds[mPass]; }
+
+    // Starts timing `mPass`, the pass started before ends there. Every
+    // pass is timed once per frame, starting it again restarts it.
+    void begin(GpuPass mPass)
+    {
+        if (!available || mPass == open)
+            return;
+
+        end();
+        gl.queryCounter(queries[frame][2 * mPass], timestamp);
+        open = mPass;
+    }
+
+    void end()
+    {
+        if (!available || open == GpuPassCount)
+            return;
+
+        gl.queryCounter(queries[frame][2 * open + 1], timestamp);
+        issued[frame][open] = true;
+        open = GpuPassCount;
+    }
+
+    // Before the first pass of a frame: the times of the frame before are
+    // read, and their queries are issued again by this one.
+    void newFrame()
+    {
+        if (!available)
+            return;
+
+        end();
+        frame = (frame + 1) % frames;
+        for (std::size_t pass{0}; pass < GpuPassCount; ++pass)
+        {
+            if (!issued[frame][pass])
+            {
+                milliseconds[pass] = 0.f;
+                continue;
+            }
+
+            GLint ready{0};
+            gl.getQueryObjectiv(queries[frame][2 * pass + 1], queryResultAvailable, &ready);
+            if (ready == 0)
+                continue;
+
+            std::uint64_t start{0}, finish{0};
+            gl.getQueryObjectui64v(queries[frame][2 * pass], queryResult, &start);
+            gl.getQueryObjectui64v(queries[frame][2 * pass + 1], queryResult, &finish);
+            milliseconds[pass] = (finish - start) / 1e6f;
+        }
+
+        issued[frame].fill(false);
+    }
+};
+#endif
+
+// Everything to draw in a frame is submitted here instead of each entity
+// drawing itself. Items are sorted by a key made of layer, shader and
+// texture, so items sharing states are drawn one after the other, and the
+// view is only changed between items that need a different one. Items with
+// the same key keep the order they were submitted in.
+class RenderQueue
+{
+  private:
+    struct Item
+    {
+        const Drawable *drawable;
+        RenderStates states;
+        const View *view;
+        std::size_t vertices, objects;
+    };
+
+    // Key in the high 32 bits, index of the item in the low ones.
+    std::vector<std::uint64_t> keys, sorted;
+    std::vector<Item> items;
+    // Textures and shaders seen this frame, their position is their id.
+    std::vector<const Texture *> textures;
+    std::vector<const Shader *> shaders;
+
+    template <typename T>
+    static std::uint32_t getID(std::vector<const T *> &mSeen, const T *mResource)
+    {
+        if (mResource == nullptr)
+            return 0;
+
+        for (std::size_t i{0}; i < mSeen.size(); ++i)
+            if (mSeen[i] == mResource)
+                return i + 1;
+
+        mSeen.emplace_back(mResource);
+        return mSeen.size();
+    }
+
+#ifdef ARKANOID_GPU_TIMERS
+    static GpuPass getGpuPass(RenderLayer mLayer) noexcept
+    {
+        switch (mLayer)
+        {
+            case LBalls: return GpuBalls;
+            case LEffects: return GpuEffects;
+            case LOverlay: return GpuHud;
+            default: return GpuBricks;
+        }
+    }
+#endif
+
+    // LSD radix sort on the key bytes. Bytes that are the same for every
+    // item, such as the shader most of the time, don't need a pass.
+    void sort()
+    {
+        sorted.resize(keys.size());
+
+        for (unsigned int shift{32}; shift < 64; shift += 8)
+        {
+            std::array<std::size_t, 256> counts{};
+            for (auto key : keys)
+                ++counts[(key >> shift) & 0xff];
+
+            if (counts[(keys.front() >> shift) & 0xff] == keys.size())
+                continue;
+
+            std::size_t offset{0};
+            for (auto &count : counts)
+            {
+                const auto size(count);
+                count = offset;
+                offset += size;
+            }
+
+            for (auto key : keys)
+                sorted[counts[(key >> shift) & 0xff]++] = key;
+
+            keys.swap(sorted);
+        }
+    }
+
+  public:
+#ifdef ARKANOID_GPU_TIMERS
+    // When set, every layer drawn by `flush` is timed on the GPU.
+    GpuTimers *timers{nullptr};
+
+#endif
+    // Every drawable is drawn with a single call, of `mVertices` vertices
+    // for `mObjects` objects.
+    void submit(RenderLayer mLayer, const Drawable &mDrawable, const RenderStates &mStates, const View &mView,
+                std::size_t mVertices, std::size_t mObjects = 1)
+    {
+        const std::uint64_t key{(std::uint64_t{mLayer} << 24) | (std::uint64_t{getID(shaders, mStates.shader) & 0xff} << 16) |
+                                (getID(textures, mStates.texture) & 0xffff)};
+        keys.emplace_back((key << 32) | items.size());
+        items.emplace_back(Item{&mDrawable, mStates, &mView, mVertices, mObjects});
+    }
+
+    std::size_t getItemCount() const noexcept { return items.size(); }
+
+    // Draw everything submitted since the last flush, in key order, and
+    // count it into `mStats`. The views are drawn into `mViewport` of the
+    // target.
+    void flush(RenderTarget &mTarget, RenderStats &mStats, const FloatRect &mViewport = FloatRect{0.f, 0.f, 1.f, 1.f})
+    {
+        if (!keys.empty())
+        {
+            sort();
+
+            const View *view{nullptr};
+            const Item *previous{nullptr};
+            for (auto key : keys)
+            {
+                const auto &item(items[key & 0xffffffff]);
+#ifdef ARKANOID_GPU_TIMERS
+                if (timers != nullptr)
+                    timers->begin(getGpuPass(static_cast<RenderLayer>(key >> 56)));
+#endif
+                if (item.view != view)
+                {
+                    view = item.view;
+                    View framed{*view};
+                    framed.setViewport(mViewport);
+                    mTarget.setView(framed);
+                }
+
+                mTarget.draw(*item.drawable, item.states);
+
+                mStats.draw(item.vertices, item.objects);
+                if (previous != nullptr)
+                {
+                    mStats.textureSwitches += previous->states.texture != item.states.texture;
+                    mStats.shaderSwitches += previous->states.shader != item.states.shader;
+                }
+                previous = &item;
+            }
+#ifdef ARKANOID_GPU_TIMERS
+            if (timers != nullptr)
+                timers->end();
+#endif
+        }
+
+        keys.clear();
+        items.clear();
+        textures.clear();
+        shaders.clear();
+    }
+};
+
+// Lines over the game for tuning the broad phase: grid cells, tree nodes,
+// candidate pairs and contacts. Everything goes into a single vertex array
+// drawn with one call, instead of a call per shape like `RectangleShape`.
+// It is compiled into the builds with asserts, and into the others with
+// ARKANOID_DEBUG_DRAW. Without it, `DebugDraw` does nothing and `enabled`
+// is a constant false, so the code drawing into it goes away too.
+#if !defined(NDEBUG) && !defined(ARKANOID_DEBUG_DRAW)
+#define ARKANOID_DEBUG_DRAW
+#endif
+
+#ifdef ARKANOID_DEBUG_DRAW
+class DebugDraw : public Drawable
+{
+  private:
+    VertexArray vertices{Lines};
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        mTarget.draw(vertices, mStates);
+    }
+
+  public:
+    bool enabled{false};
+
+    std::size_t getVertexCount() const noexcept { return vertices.getVertexCount(); }
+
+    void clear() { vertices.clear(); }
+
+    void line(const Vector2f &mFrom, const Vector2f &mTo, const Color &mColor)
+    {
+        vertices.append(Vertex{mFrom, mColor});
+        vertices.append(Vertex{mTo, mColor});
+    }
+
+    void rect(float mLeft, float mTop, float mRight, float mBottom, const Color &mColor)
+    {
+        line(Vector2f{mLeft, mTop}, Vector2f{mRight, mTop}, mColor);
+        line(Vector2f{mRight, mTop}, Vector2f{mRight, mBottom}, mColor);
+        line(Vector2f{mRight, mBottom}, Vector2f{mLeft, mBottom}, mColor);
+        line(Vector2f{mLeft, mBottom}, Vector2f{mLeft, mTop}, mColor);
+    }
+
+    void cross(const Vector2f &mCenter, float mSize, const Color &mColor)
+    {
+        line(mCenter - Vector2f{mSize, mSize}, mCenter + Vector2f{mSize, mSize}, mColor);
+        line(mCenter - Vector2f{mSize, -mSize}, mCenter + Vector2f{mSize, -mSize}, mColor);
+    }
+};
+#else
+struct DebugDraw
+{
+    static constexpr bool enabled{false};
+
+    std::size_t getVertexCount() const noexcept { return 0; }
+    void clear() noexcept {}
+    void line(const Vector2f &, const Vector2f &, const Color &) noexcept {}
+    void rect(float, float, float, float, const Color &) noexcept {}
+    void cross(const Vector2f &, float, const Color &) noexcept {}
+};
+#endif
+
+struct CRectangle : Component
+{
+    Game *game{nullptr};
+    RectangleBatch *batch{nullptr};
+    Vector2f halfSize;
+    Color color{Color::Red};
+
+    // Quad of the rectangle inside the batch, and the position (and its
+    // `CPosition::version`) its vertices were last written with.
+    std::size_t quad;
+    Vector2f syncedPosition;
+    std::uint32_t syncedVersion{std::numeric_limits<std::uint32_t>::max()};
+
+    // Without a batch, the rectangle goes into the game's rectangle batch.
+    CRectangle(Game *mGame, const Vector2f &mHalfSize, const Color &mColor = Color::Red,
+               RectangleBatch *mBatch = nullptr)
+        : game{mGame}, batch{mBatch}, halfSize{mHalfSize}, color{mColor}
+    {
+    }
+    ~CRectangle();
+
+    void init() override;
+
+    // The batch still has the quad as it was drawn last.
+    void restored() override { batch->set(quad, syncedPosition, halfSize, color); }
+
+    void sync(const Vector2f &mPosition)
+    {
+        if (mPosition == syncedPosition)
+            return;
+
+        syncedPosition = mPosition;
+        batch->set(quad, syncedPosition, halfSize, color);
+    }
+
+    // Only the quad is written again, where it was last drawn.
+    void setColor(const Color &mColor)
+    {
+        color = mColor;
+        batch->set(quad, syncedPosition, halfSize, color);
+    }
+
+    // A null size hides the rectangle, its quad stays in the batch.
+    void setHalfSize(const Vector2f &mHalfSize)
+    {
+        halfSize = mHalfSize;
+        batch->set(quad, syncedPosition, halfSize, color);
+    }
+};
+
+// Marks the entities moved by a player, 0 is the local one.
+struct CPaddleControl : Component
+{
+    std::size_t player;
+    // Pixels per millisecond at the end of the last step, see `SPaddleControl`.
+    float speed{0.f};
+
+    CPaddleControl(std::size_t mPlayer = 0) : player{mPlayer} {}
+};
+
+// Paddles that play by themselves, for soak tests, benchmarks and batch
+// runs. See `SAutopilot`.
+struct CAutopilot : Component
+{
+    // Where the next ball should come down, kept while none is coming.
+    float target;
+
+    CAutopilot(float mTarget = windowWidth / 2.f) : target{mTarget} {}
+};
+
+// Textured rectangle: a region of the game's texture atlas, drawn by the
+// sprite batch the same way `CRectangle` is drawn by the rectangle batch.
+struct CSprite : Component
+{
+    Game *game{nullptr};
+    RectangleBatch *batch{nullptr};
+    Vector2f halfSize;
+    std::size_t region;
+    // Multiplies the texture colors.
+    Color color{Color::White};
+
+    std::size_t quad;
+    Vector2f syncedPosition;
+    std::uint32_t syncedVersion{std::numeric_limits<std::uint32_t>::max()};
+    FloatRect textureRect;
+
+    CSprite(Game *mGame, const Vector2f &mHalfSize, std::size_t mRegion, const Color &mColor = Color::White)
+        : game{mGame}, halfSize{mHalfSize}, region{mRegion}, color{mColor}
+    {
+    }
+    ~CSprite();
+
+    void init() override;
+
+    void restored() override { batch->set(quad, syncedPosition, halfSize, color, textureRect); }
+
+    void sync(const Vector2f &mPosition)
+    {
+        if (mPosition == syncedPosition)
+            return;
+
+        syncedPosition = mPosition;
+        batch->set(quad, syncedPosition, halfSize, color, textureRect);
+    }
+
+    void setColor(const Color &mColor)
+    {
+        color = mColor;
+        batch->set(quad, syncedPosition, halfSize, color, textureRect);
+    }
+};
+
+// What a brick does is looked up by its type in `brickTypes`, the brick
+// itself only keeps the type and its hit points.
+enum BrickType : std::uint8_t
+{
+    BNormal,
+    BHard,
+    BIndestructible,
+    BExplosive,
+    BCount
+};
+
+struct BrickTypeInfo
+{
+    static constexpr std::size_t maxShades{4};
+
+    // Used when the level gives the brick no hit points.
+    std::uint8_t hitPoints;
+    bool indestructible, explosive;
+    // RGBA color of the brick with 1, 2, ... hit points left, the last one
+    // for more. 0 keeps the color of the level.
+    std::uint32_t shades[maxShades];
+};
+
+constexpr BrickTypeInfo brickTypes[BCount]{
+    {1, false, false, {0, 0, 0, 0}},
+    {3, false, false, {0xc83232ff, 0xe6822dff, 0xe6d22dff, 0xf0f0f0ff}},
+    {1, true, false, {0x808080ff, 0x808080ff, 0x808080ff, 0x808080ff}},
+    {1, false, true, {0xff8c00ff, 0xff8c00ff, 0xff8c00ff, 0xff8c00ff}},
+};
+
+// Color of a brick of `mType` with `mHitPoints` left.
+inline Color getBrickColor(BrickType mType, std::uint8_t mHitPoints, const Color &mLevelColor) noexcept
+{
+    const auto &shades(brickTypes[mType].shades);
+    const std::size_t shade{std::min(std::max<std::size_t>(mHitPoints, 1), std::size_t{BrickTypeInfo::maxShades})};
+    return shades[shade - 1] != 0 ? Color{shades[shade - 1]} : mLevelColor;
+}
+
+// Hits a brick takes before it breaks.
+struct CBrick : Component
+{
+    BrickType type;
+    std::uint8_t hitPoints;
+
+    CBrick(BrickType mType, std::uint8_t mHitPoints) : type{mType}, hitPoints{mHitPoints} {}
+};
+
+enum class PowerupKind : std::uint8_t
+{
+    WidePaddle,
+    MultiBall,
+    SlowBall,
+    Laser,
+    Count
+};
+
+// Falls from a broken brick until a paddle catches it. The powerup
+// entities are created once with the game and recycled: the ones that
+// aren't falling are hidden and rest where they were caught.
+struct CPowerup : Component
+{
+    PowerupKind kind{PowerupKind::WidePaddle};
+    bool falling{false};
+};
+
+// State of the game controls, sampled once per frame in `inputPhase`. The
+// logic steps only read the snapshot, so they all see the same input and
+// never ask the OS for the keyboard state.
+struct InputSnapshot
+{
+    enum Button : std::uint8_t
+    {
+        BLeft = 1 << 0,
+        BRight = 1 << 1
+    };
+
+    std::uint8_t buttons{0};
+    // Analog paddle direction from a gamepad, from -127 (full left) to 127
+    // (full right). Quantized, so recordings play back exactly.
+    std::int8_t axis{0};
+
+    bool isDown(Button mButton) const noexcept { return (buttons & mButton) != 0; }
+
+    float getAxis() const noexcept { return axis / 127.f; }
+
+    bool operator==(const InputSnapshot &mOther) const noexcept
+    {
+        return buttons == mOther.buttons && axis == mOther.axis;
+    }
+    bool operator!=(const InputSnapshot &mOther) const noexcept { return !(*this == mOther); }
+};
+
+// Lock-free single producer, single consumer ring buffer of `TCapacity - 1`
+// elements. The producer only writes `tail` and the consumer only writes
+// `head`, so neither side ever waits for the other.
+template <typename T, std::size_t TCapacity>
+class SpscQueue
+{
+  private:
+    std::array<T, TCapacity> elements;
+    std::atomic<std::size_t> head{0}, tail{0};
+
+  public:
+    // Returns false, dropping `mElement`, when the queue is full.
+    bool push(const T &mElement) noexcept
+    {
+        const auto current(tail.load(std::memory_order_relaxed));
+        const auto next((current + 1) % TCapacity);
+        if (next == head.load(std::memory_order_acquire))
+            return false;
+
+        elements[current] = mElement;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &mElement) noexcept
+    {
+        const auto current(head.load(std::memory_order_relaxed));
+        if (current == tail.load(std::memory_order_acquire))
+            return false;
+
+        mElement = elements[current];
+        head.store((current + 1) % TCapacity, std::memory_order_release);
+        return true;
+    }
+
+    // From the consumer, like `pop`.
+    bool empty() const noexcept
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+};
+
+// Base for the systems, `TDerived::process` is called with the components
+// in `Ts` of every matching entity. The call is resolved at compile time.
+// Systems whose `process` only touches its own components can go parallel
+// by setting `minParallelEntities`, the entity count from which the work
+// is split across the job system.
+template <typename TDerived, typename... Ts>
+struct System : SystemBase
+{
+    static constexpr std::size_t minParallelEntities{std::numeric_limits<std::size_t>::max()};
+
+    void update(Manager &mManager, float mFT) override
+    {
+        auto derived(static_cast<TDerived *>(this));
+        mManager.forEachParallel<Ts...>(TDerived::minParallelEntities, [derived, mFT](Entity &, Ts &... mComponents) {
+            derived->process(mFT, mComponents...);
+        });
+    }
+};
+
+// The paddle speeds up toward the speed of the input at
+// `paddleAcceleration`, and where it goes in a step is computed from that
+// exactly, as is where it stops against a side: the same input moves it
+// the same way with steps of any length. `CPhysics::velocity` is the
+// average of the step, `SPhysics` moves the paddle with it.
+struct SPaddleControl : System<SPaddleControl, CPhysics, CPaddleControl>
+{
+    // Input of every player, by `CPaddleControl::player`.
+    const InputSnapshot *inputs;
+    // Factor of `paddleVelocity`, owned by the game.
+    const float &speedScale;
+    // Owned by the game too, see `Tunables`.
+    const float &acceleration;
+
+    SPaddleControl(const InputSnapshot *mInputs, const float &mSpeedScale, const float &mAcceleration)
+        : inputs{mInputs}, speedScale(mSpeedScale), acceleration(mAcceleration)
+    {
+    }
+
+    void process(float mFT, CPhysics &mPhysics, CPaddleControl &mControl)
+    {
+        steer(mPhysics, mControl, inputs[mControl.player], paddleVelocity * speedScale, acceleration, mFT);
+    }
+
+    // Brings `mSpeed` toward `mTarget` over `mFT` and returns how far the
+    // paddle goes meanwhile.
+    static float advance(float &mSpeed, float mTarget, float mAcceleration, float mFT) noexcept
+    {
+        const float difference{mTarget - mSpeed};
+        const float change{mAcceleration * mFT};
+        if (mAcceleration > 0.f && std::abs(difference) > change)
+        {
+            const float direction{difference < 0.f ? -1.f : 1.f};
+            const float distance{(mSpeed + direction * change / 2.f) * mFT};
+            mSpeed += direction * change;
+            return distance;
+        }
+
+        // The target speed is reached during the step, then kept.
+        const float reached{mAcceleration > 0.f ? std::abs(difference) / mAcceleration : 0.f};
+        const float distance{(mSpeed + mTarget) / 2.f * reached + mTarget * (mFT - reached)};
+        mSpeed = mTarget;
+        return distance;
+    }
+
+    // Also used by network clients to predict their paddle.
+    static void steer(CPhysics &mPhysics, CPaddleControl &mControl, const InputSnapshot &mInput, float mSpeed,
+                      float mAcceleration, float mFT)
+    {
+        // A gamepad stick moves the paddle proportionally.
+        float target{mInput.getAxis() * mSpeed};
+        if (mInput.axis == 0 && mInput.isDown(InputSnapshot::BLeft))
+            target = -mSpeed;
+        else if (mInput.axis == 0 && mInput.isDown(InputSnapshot::BRight))
+            target = mSpeed;
+
+        const float x{toFloat(mPhysics.x())}, halfWidth{toFloat(mPhysics.halfSize.x)};
+        const float moved{x + advance(mControl.speed, target, mAcceleration, mFT)};
+        const float clamped{std::max(halfWidth, std::min(moved, windowWidth - halfWidth))};
+        if (clamped != moved)
+            mControl.speed = 0.f;
+
+        mPhysics.velocity.x = mFT > 0.f ? PhysicsScalar((clamped - x) / mFT) : PhysicsScalar{};
+    }
+};
+
+// Plays in place of the player of a paddle: it extrapolates the balls
+// coming down, bounced off the sides of `bounds`, to where they cross the
+// top of the paddle, and steers toward where the soonest one lands. It
+// only writes the player's input, so the paddle moves like the player
+// would move it, and with one pass over the balls it is cheap enough for
+// thousands of games at once. Bricks in the way are ignored.
+struct SAutopilot : System<SAutopilot, CPosition, CPhysics, CPaddleControl, CAutopilot>
+{
+    InputSnapshot *inputs;
+    const std::vector<Entity *> &balls;
+    const FloatRect &bounds;
+
+    SAutopilot(InputSnapshot *mInputs, const std::vector<Entity *> &mBalls, const FloatRect &mBounds)
+        : inputs{mInputs}, balls(mBalls), bounds(mBounds)
+    {
+    }
+
+    void process(float, CPosition &mPosition, CPhysics &mPhysics, CPaddleControl &mControl, CAutopilot &mAutopilot)
+    {
+        const float top{toFloat(mPosition.position.y - mPhysics.halfSize.y)};
+        float soonest{std::numeric_limits<float>::max()};
+
+        for (const auto &ball : balls)
+        {
+            const auto &cPhysics(ball->getComponent<CPhysics>());
+            const auto position(toVector2f(ball->getComponent<CPosition>().position));
+            const auto velocity(toVector2f(cPhysics.velocity));
+            const float radius{toFloat(cPhysics.halfSize.y)};
+            if (velocity.y <= 0.f || position.y + radius > top)
+                continue;
+
+            const float time{(top - radius - position.y) / velocity.y};
+            if (time < soonest)
+            {
+                soonest = time;
+                mAutopilot.target = bounce(position.x + velocity.x * time, radius);
+            }
+        }
+
+        // Full speed from half a paddle away, slower closer so it doesn't
+        // overshoot.
+        const float offset{mAutopilot.target - toFloat(mPosition.position.x)};
+        const float axis{std::max(-1.f, std::min(1.f, offset / toFloat(mPhysics.halfSize.x)))};
+
+        auto &input(inputs[mControl.player]);
+        input.buttons = 0;
+        input.axis = static_cast<std::int8_t>(axis * 127.f);
+    }
+
+    // Where a ball of `mRadius` that would get to `mX` without the sides
+    // gets to, reflected back and forth between them.
+    float bounce(float mX, float mRadius) const noexcept
+    {
+        const float left{bounds.left + mRadius}, width{bounds.width - 2.f * mRadius};
+        if (width <= 0.f)
+            return left;
+
+        float x{std::fmod(mX - left, 2.f * width)};
+        if (x < 0.f)
+            x += 2.f * width;
+
+        return left + (x > width ? 2.f * width - x : x);
+    }
+};
+
+struct SPhysics : System<SPhysics, CPosition, CPhysics>
+{
+    static constexpr std::size_t minParallelEntities{4096};
+
+    // Area the entities are kept into, it moves in scrolling levels.
+    const FloatRect &bounds;
+
+    SPhysics(const FloatRect &mBounds) : bounds(mBounds) {}
+
+    void process(float mFT, CPosition &mPosition, CPhysics &mPhysics)
+    {
+        // Resting entities (most of them are bricks) are left untouched,
+        // so their version doesn't change.
+        if (mPhysics.velocity == PhysicsVector{} && mPosition.previousPosition == mPosition.position)
+            return;
+
+        mPosition.previousPosition = mPosition.position;
+        mPosition.position += mPhysics.velocity * PhysicsScalar(mFT);
+        ++mPosition.version;
+
+        if (mPhysics.onOutOfBounds == nullptr)
+            return;
+
+        if (mPhysics.left() < PhysicsScalar(bounds.left))
+            mPhysics.onOutOfBounds(mPhysics, Vector2f{1.f, 0.f});
+        else if (mPhysics.right() > PhysicsScalar(bounds.left + bounds.width))
+            mPhysics.onOutOfBounds(mPhysics, Vector2f{-1.f, 0.f});
+
+        if (mPhysics.top() < PhysicsScalar(bounds.top))
+            mPhysics.onOutOfBounds(mPhysics, Vector2f{0.f, 1.0f});
+        else if (mPhysics.bottom() > PhysicsScalar(bounds.top + bounds.height))
+            mPhysics.onOutOfBounds(mPhysics, Vector2f{0.f, -1.f});
+    }
+};
+
+// Copy the simulated positions into the shapes before drawing.
+// These systems run once per drawn frame instead of once per logic step,
+// and get the interpolation alpha between the last two steps instead of
+// a frametime.
+struct SRectangleSync : System<SRectangleSync, CPosition, CRectangle>
+{
+    void process(float mAlpha, CPosition &mPosition, CRectangle &mRectangle)
+    {
+        if (!mPosition.changedSince(mRectangle.syncedVersion))
+            return;
+
+        mRectangle.syncedVersion = mPosition.version;
+        mRectangle.sync(mPosition.interpolated(mAlpha));
+    }
+};
+
+struct SSpriteSync : System<SSpriteSync, CPosition, CSprite>
+{
+    void process(float mAlpha, CPosition &mPosition, CSprite &mSprite)
+    {
+        if (!mPosition.changedSince(mSprite.syncedVersion))
+            return;
+
+        mSprite.syncedVersion = mPosition.version;
+        mSprite.sync(mPosition.interpolated(mAlpha));
+    }
+};
+
+struct SCircleSync : System<SCircleSync, CPosition, CCircle>
+{
+    void process(float mAlpha, CPosition &mPosition, CCircle &mCircle)
+    {
+        if (!mPosition.changedSince(mCircle.syncedVersion))
+            return;
+
+        mCircle.syncedVersion = mPosition.version;
+        mCircle.instance.position = mPosition.interpolated(mAlpha);
+    }
+};
+
+// Structure of arrays storage for large amounts of simple moving bodies
+// (debris, chaos mode balls) that don't need to be full entities. Every
+// field is its own array, so integration and the bounce against the window
+// borders process four bodies at a time with SSE2 or NEON.
+class PhysicsBodies
+{
+  private:
+    std::vector<float> x, y, vx, vy, halfWidth, halfHeight;
+
+    // Scalar version of the kernel, for the bodies that don't fill a whole
+    // SIMD register and for targets without SIMD.
+    void integrate(std::size_t mFirst, std::size_t mLast, float mFT) noexcept
+    {
+        for (auto i(mFirst); i < mLast; ++i)
+        {
+            x[i] += vx[i] * mFT;
+            y[i] += vy[i] * mFT;
+
+            if (x[i] - halfWidth[i] < 0.f)
+                vx[i] = std::abs(vx[i]);
+            else if (x[i] + halfWidth[i] > windowWidth)
+                vx[i] = -std::abs(vx[i]);
+
+            if (y[i] - halfHeight[i] < 0.f)
+                vy[i] = std::abs(vy[i]);
+            else if (y[i] + halfHeight[i] > windowHeight)
+                vy[i] = -std::abs(vy[i]);
+        }
+    }
+
+  public:
+    std::size_t size() const noexcept { return x.size(); }
+
+    std::size_t add(const Vector2f &mPosition, const Vector2f &mVelocity, const Vector2f &mHalfSize)
+    {
+        x.emplace_back(mPosition.x);
+        y.emplace_back(mPosition.y);
+        vx.emplace_back(mVelocity.x);
+        vy.emplace_back(mVelocity.y);
+        halfWidth.emplace_back(mHalfSize.x);
+        halfHeight.emplace_back(mHalfSize.y);
+        return size() - 1;
+    }
+
+    // The last body is moved into the slot of the removed one.
+    void remove(std::size_t mIndex) noexcept
+    {
+        for (auto field : {&x, &y, &vx, &vy, &halfWidth, &halfHeight})
+        {
+            (*field)[mIndex] = field->back();
+            field->pop_back();
+        }
+    }
+
+    void clear() noexcept
+    {
+        for (auto field : {&x, &y, &vx, &vy, &halfWidth, &halfHeight})
+            field->clear();
+    }
+
+    Vector2f getPosition(std::size_t mIndex) const noexcept { return Vector2f{x[mIndex], y[mIndex]}; }
+    Vector2f getVelocity(std::size_t mIndex) const noexcept { return Vector2f{vx[mIndex], vy[mIndex]}; }
+    Vector2f getHalfSize(std::size_t mIndex) const noexcept { return Vector2f{halfWidth[mIndex], halfHeight[mIndex]}; }
+
+    void setVelocity(std::size_t mIndex, const Vector2f &mVelocity) noexcept
+    {
+        vx[mIndex] = mVelocity.x;
+        vy[mIndex] = mVelocity.y;
+    }
+
+    // Move every body by its velocity and bounce the ones that went out
+    // of the window back inside.
+    void integrate(float mFT) noexcept
+    {
+        const std::size_t count{size()};
+        std::size_t i{0};
+
+#if defined(ARKANOID_SSE2)
+        const __m128 ft(_mm_set1_ps(mFT)), zero(_mm_setzero_ps());
+        const __m128 width(_mm_set1_ps(windowWidth)), height(_mm_set1_ps(windowHeight));
+        const __m128 signMask(_mm_set1_ps(-0.f));
+
+        // Choose |v| when below the low border and -|v| when above the high
+        // one. As in the scalar kernel, the low border wins when both apply.
+        auto bounce = [&](__m128 mV, __m128 mLow, __m128 mHigh, __m128 mMax) {
+            const __m128 absV(_mm_andnot_ps(signMask, mV));
+            const __m128 below(_mm_cmplt_ps(mLow, zero));
+            const __m128 above(_mm_andnot_ps(below, _mm_cmpgt_ps(mHigh, mMax)));
+            mV = _mm_or_ps(_mm_and_ps(below, absV), _mm_andnot_ps(below, mV));
+            return _mm_or_ps(_mm_and_ps(above, _mm_or_ps(absV, signMask)), _mm_andnot_ps(above, mV));
+        };
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 px(_mm_loadu_ps(&x[i])), py(_mm_loadu_ps(&y[i]));
+            __m128 pvx(_mm_loadu_ps(&vx[i])), pvy(_mm_loadu_ps(&vy[i]));
+            const __m128 hw(_mm_loadu_ps(&halfWidth[i])), hh(_mm_loadu_ps(&halfHeight[i]));
+
+            px = _mm_add_ps(px, _mm_mul_ps(pvx, ft));
+            py = _mm_add_ps(py, _mm_mul_ps(pvy, ft));
+
+            pvx = bounce(pvx, _mm_sub_ps(px, hw), _mm_add_ps(px, hw), width);
+            pvy = bounce(pvy, _mm_sub_ps(py, hh), _mm_add_ps(py, hh), height);
+
+            _mm_storeu_ps(&x[i], px);
+            _mm_storeu_ps(&y[i], py);
+            _mm_storeu_ps(&vx[i], pvx);
+            _mm_storeu_ps(&vy[i], pvy);
+        }
+#elif defined(ARKANOID_NEON)
+        const float32x4_t zero(vdupq_n_f32(0.f));
+        const float32x4_t width(vdupq_n_f32(windowWidth)), height(vdupq_n_f32(windowHeight));
+
+        auto bounce = [&](float32x4_t mV, float32x4_t mLow, float32x4_t mHigh, float32x4_t mMax) {
+            const float32x4_t absV(vabsq_f32(mV));
+            const uint32x4_t below(vcltq_f32(mLow, zero));
+            mV = vbslq_f32(below, absV, mV);
+            return vbslq_f32(vbicq_u32(vcgtq_f32(mHigh, mMax), below), vnegq_f32(absV), mV);
+        };
+
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t px(vld1q_f32(&x[i])), py(vld1q_f32(&y[i]));
+            float32x4_t pvx(vld1q_f32(&vx[i])), pvy(vld1q_f32(&vy[i]));
+            const float32x4_t hw(vld1q_f32(&halfWidth[i])), hh(vld1q_f32(&halfHeight[i]));
+
+            px = vmlaq_n_f32(px, pvx, mFT);
+            py = vmlaq_n_f32(py, pvy, mFT);
+
+            pvx = bounce(pvx, vsubq_f32(px, hw), vaddq_f32(px, hw), width);
+            pvy = bounce(pvy, vsubq_f32(py, hh), vaddq_f32(py, hh), height);
+
+            vst1q_f32(&x[i], px);
+            vst1q_f32(&y[i], py);
+            vst1q_f32(&vx[i], pvx);
+            vst1q_f32(&vy[i], pvy);
+        }
+#endif
+
+        integrate(i, count, mFT);
+    }
+
+    // Write every body as a point.
+    void writeVertices(VertexArray &mVertices, const Color &mColor) const
+    {
+        mVertices.resize(size());
+        for (auto i(0u); i < size(); ++i)
+            mVertices[i] = Vertex{Vector2f{x[i], y[i]}, mColor};
+    }
+};
+
+// Brick debris. Particles are far too many and too short lived to be
+// entities, so they live in fixed size arrays (one per field, like
+// `PhysicsBodies`) and are drawn as one vertex array of small quads.
+// Spawning past the capacity drops the particles that don't fit.
+class ParticleSystem
+{
+  public:
+    static constexpr std::size_t capacity{16384};
+    // Milliseconds a particle lives, it fades out meanwhile.
+    static constexpr float lifetime{600.f};
+    static constexpr float gravity{0.0008f}, halfSize{1.5f};
+
+  private:
+    // Padded, so the SIMD loop can run over the last partial register.
+    static constexpr std::size_t storage{capacity + 4};
+
+    std::vector<float> x, y, vx, vy, life;
+    std::vector<Color> colors;
+    std::size_t count{0};
+    // Only used for looks, so it doesn't touch the game's random engine
+    // and replays stay deterministic.
+    std::minstd_rand random;
+
+  public:
+    // Everything is allocated here, spawning never allocates. Headless
+    // games have no debris and never call it.
+    void reserve()
+    {
+        for (auto field : {&x, &y, &vx, &vy, &life})
+            field->resize(storage);
+        colors.resize(capacity);
+    }
+
+    std::size_t size() const noexcept { return count; }
+
+    // `mCount` particles from `mPosition`, thrown in random directions.
+    void spawn(const Vector2f &mPosition, const Color &mColor, std::size_t mCount)
+    {
+        std::uniform_real_distribution<float> angle{0.f, 2.f * 3.14159265f}, speed{0.05f, 0.3f};
+
+        for (std::size_t i{0}; i < mCount && count < colors.size(); ++i, ++count)
+        {
+            const float a{angle(random)}, s{speed(random)};
+            x[count] = mPosition.x;
+            y[count] = mPosition.y;
+            vx[count] = std::cos(a) * s;
+            vy[count] = std::sin(a) * s;
+            life[count] = lifetime;
+            colors[count] = mColor;
+        }
+    }
+
+    void update(float mFT) noexcept
+    {
+        std::size_t i{0};
+
+#if defined(ARKANOID_SSE2)
+        const __m128 ft(_mm_set1_ps(mFT)), fall(_mm_set1_ps(gravity * mFT));
+        for (; i < count; i += 4)
+        {
+            const __m128 pvy(_mm_add_ps(_mm_loadu_ps(&vy[i]), fall));
+            _mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(_mm_loadu_ps(&vx[i]), ft)));
+            _mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(pvy, ft)));
+            _mm_storeu_ps(&vy[i], pvy);
+            _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), ft));
+        }
+#elif defined(ARKANOID_NEON)
+        const float32x4_t fall(vdupq_n_f32(gravity * mFT)), ft(vdupq_n_f32(mFT));
+        for (; i < count; i += 4)
+        {
+            const float32x4_t pvy(vaddq_f32(vld1q_f32(&vy[i]), fall));
+            vst1q_f32(&x[i], vmlaq_n_f32(vld1q_f32(&x[i]), vld1q_f32(&vx[i]), mFT));
+            vst1q_f32(&y[i], vmlaq_n_f32(vld1q_f32(&y[i]), pvy, mFT));
+            vst1q_f32(&vy[i], pvy);
+            vst1q_f32(&life[i], vsubq_f32(vld1q_f32(&life[i]), ft));
+        }
+#else
+        for (; i < count; ++i)
+        {
+            vy[i] += gravity * mFT;
+            x[i] += vx[i] * mFT;
+            y[i] += vy[i] * mFT;
+            life[i] -= mFT;
+        }
+#endif
+
+        // The last particle is moved into the slot of a dead one.
+        for (i = 0; i < count;)
+        {
+            if (life[i] > 0.f)
+            {
+                ++i;
+                continue;
+            }
+
+            --count;
+            x[i] = x[count];
+            y[i] = y[count];
+            vx[i] = vx[count];
+            vy[i] = vy[count];
+            life[i] = life[count];
+            colors[i] = colors[count];
+        }
+    }
+
+    // Write every particle as a quad.
+    void writeVertices(VertexArray &mVertices) const
+    {
+        mVertices.setPrimitiveType(Quads);
+        mVertices.resize(count * 4);
+
+        for (std::size_t i{0}; i < count; ++i)
+        {
+            Color color{colors[i]};
+            color.a = static_cast<Uint8>(color.a * life[i] / lifetime);
+
+            Vertex *quad{&mVertices[i * 4]};
+            quad[0] = Vertex{Vector2f{x[i] - halfSize, y[i] - halfSize}, color};
+            quad[1] = Vertex{Vector2f{x[i] + halfSize, y[i] - halfSize}, color};
+            quad[2] = Vertex{Vector2f{x[i] + halfSize, y[i] + halfSize}, color};
+            quad[3] = Vertex{Vector2f{x[i] - halfSize, y[i] + halfSize}, color};
+        }
+    }
+};
+
+// Using to check the colliding of two shapes.
+template <class T1, class T2>
+bool isIntersecting(T1 &mA, T2 &mB)
+{
+    return mA.right() >= mB.left() && mA.left() <= mB.right() && mA.bottom() >= mB.top() && mA.top() <= mB.bottom();
+}
+
+// Bounding boxes packed as structure of arrays, to test one box against
+// many of them with SIMD compares instead of one `isIntersecting` call per
+// pair. The test is the same as `isIntersecting`.
+class PackedBoxes
+{
+  private:
+    std::vector<float> lefts, tops, rights, bottoms;
+
+  public:
+    std::size_t size() const noexcept { return lefts.size(); }
+
+    void add(float mLeft, float mTop, float mRight, float mBottom)
+    {
+        lefts.emplace_back(mLeft);
+        tops.emplace_back(mTop);
+        rights.emplace_back(mRight);
+        bottoms.emplace_back(mBottom);
+    }
+
+    // The last box is moved into the slot of the removed one.
+    void remove(std::size_t mIndex) noexcept
+    {
+        for (auto field : {&lefts, &tops, &rights, &bottoms})
+        {
+            (*field)[mIndex] = field->back();
+            field->pop_back();
+        }
+    }
+
+    // Bit `i` of the result is set if the box `mFirst + i` intersects the
+    // given one, for up to four boxes.
+    std::uint32_t intersect4(std::size_t mFirst, float mLeft, float mTop, float mRight, float mBottom) const noexcept
+    {
+        std::uint32_t mask{0};
+        std::size_t i{mFirst};
+        const std::size_t last{std::min(mFirst + 4, size())};
+
+#if defined(ARKANOID_SSE2)
+        if (last - mFirst == 4)
+        {
+            const __m128 hit(_mm_and_ps(
+                _mm_and_ps(_mm_cmpge_ps(_mm_set1_ps(mRight), _mm_loadu_ps(&lefts[i])),
+                           _mm_cmple_ps(_mm_set1_ps(mLeft), _mm_loadu_ps(&rights[i]))),
+                _mm_and_ps(_mm_cmpge_ps(_mm_set1_ps(mBottom), _mm_loadu_ps(&tops[i])),
+                           _mm_cmple_ps(_mm_set1_ps(mTop), _mm_loadu_ps(&bottoms[i])))));
+            return static_cast<std::uint32_t>(_mm_movemask_ps(hit));
+        }
+#elif defined(ARKANOID_NEON)
+        if (last - mFirst == 4)
+        {
+            const uint32x4_t hit(vandq_u32(
+                vandq_u32(vcgeq_f32(vdupq_n_f32(mRight), vld1q_f32(&lefts[i])),
+                          vcleq_f32(vdupq_n_f32(mLeft), vld1q_f32(&rights[i]))),
+                vandq_u32(vcgeq_f32(vdupq_n_f32(mBottom), vld1q_f32(&tops[i])),
+                          vcleq_f32(vdupq_n_f32(mTop), vld1q_f32(&bottoms[i])))));
+            const uint32x4_t bits{1, 2, 4, 8};
+            return vaddvq_u32(vandq_u32(hit, bits));
+        }
+#endif
+
+        for (; i < last; ++i)
+            if (mRight >= lefts[i] && mLeft <= rights[i] && mBottom >= tops[i] && mTop <= bottoms[i])
+                mask |= 1u << (i - mFirst);
+
+        return mask;
+    }
+
+    // Fill `mMask` with one bit per box, set for the boxes that intersect
+    // the given one.
+    void intersect(float mLeft, float mTop, float mRight, float mBottom, std::vector<std::uint64_t> &mMask) const
+    {
+        mMask.assign((size() + 63) / 64, 0);
+
+        for (std::size_t i{0}; i < size(); i += 4)
+            mMask[i / 64] |= std::uint64_t{intersect4(i, mLeft, mTop, mRight, mBottom)} << (i % 64);
+    }
+
+    // Call `mFunction(index)` for every box that intersects the given one.
+    template <typename TF>
+    void forEachIntersecting(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction) const
+    {
+        for (std::size_t i{0}; i < size(); i += 4)
+            for (auto mask(intersect4(i, mLeft, mTop, mRight, mBottom)); mask != 0; mask &= mask - 1)
+            {
+                std::size_t bit{0};
+                while (((mask >> bit) & 1u) == 0)
+                    ++bit;
+
+                mFunction(i + bit);
+            }
+    }
+
+    // Index of the box spanning `mX` with the lowest bottom in
+    // [`mTop`, `mBottom`] that `mAccept(index)` takes, `size()` if there is
+    // none. Only boxes lower than `mLowest` count, it is set to the bottom
+    // of the one found.
+    template <typename TF>
+    std::size_t findLowest(float mX, float mTop, float mBottom, float &mLowest, TF &&mAccept) const
+    {
+        std::size_t found{size()};
+        for (std::size_t i{0}; i < size(); ++i)
+            if (lefts[i] <= mX && mX <= rights[i] && bottoms[i] >= mTop && bottoms[i] <= mBottom &&
+                bottoms[i] > mLowest && mAccept(i))
+            {
+                found = i;
+                mLowest = bottoms[i];
+            }
+
+        return found;
+    }
+};
+
+// Broad phase for the bricks: a uniform grid with cells of the size of a
+// brick. Each brick is stored only in the cell of its center, and since a
+// brick is never bigger than a cell it can only overlap the neighbour
+// cells, so queries look one cell around the area they are given.
+// Bricks never move, so the grid only changes when a brick dies.
+class BrickGrid
+{
+  private:
+    static constexpr float cellWidth{blockWidth}, cellHeight{blockHeight};
+    static constexpr int columns{static_cast<int>(windowWidth / cellWidth) + 1};
+    static constexpr int rows{static_cast<int>(windowHeight / cellHeight) + 1};
+
+    // The bounding boxes of the bricks of every cell are also packed, so
+    // the exact overlap test runs with SIMD over all of them.
+    struct Cell
+    {
+        std::vector<Entity *> bricks;
+        PackedBoxes boxes;
+    };
+
+    std::array<Cell, columns * rows> cells;
+
+    static int column(float mX) noexcept
+    {
+        return std::max(0, std::min(columns - 1, static_cast<int>(mX / cellWidth)));
+    }
+
+    // Rows wrap around vertically, so scrolling levels reuse the grid:
+    // bricks a window height apart share their cells, which only costs a
+    // few extra exact tests.
+    static int row(float mY) noexcept
+    {
+        return static_cast<int>(std::floor(mY / cellHeight));
+    }
+
+    static int wrap(int mRow) noexcept
+    {
+        return (mRow % rows + rows) % rows;
+    }
+
+    Cell &cellAt(const CPhysics &mPhysics)
+    {
+        return cells[wrap(row(toFloat(mPhysics.y()))) * columns + column(toFloat(mPhysics.x()))];
+    }
+
+    template <typename TF>
+    void forEachCell(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction)
+    {
+        const int firstColumn{column(mLeft) - 1}, lastColumn{column(mRight) + 1};
+        const int firstRow{row(mTop) - 1}, lastRow{row(mBottom) + 1};
+
+        for (int iY{firstRow}; iY <= std::min(firstRow + rows - 1, lastRow); ++iY)
+            for (int iX{std::max(0, firstColumn)}; iX <= std::min(columns - 1, lastColumn); ++iX)
+                mFunction(cells[wrap(iY) * columns + iX]);
+    }
+
+  public:
+    // Bricks bigger than a cell can't be added.
+    static bool fits(const Vector2f &mHalfSize) noexcept
+    {
+        return mHalfSize.x <= cellWidth / 2.f && mHalfSize.y <= cellHeight / 2.f;
+    }
+
+    void add(Entity &mBrick)
+    {
+        auto &cPhysics(mBrick.getComponent<CPhysics>());
+        assert(toFloat(cPhysics.halfSize.x) <= cellWidth / 2.f && toFloat(cPhysics.halfSize.y) <= cellHeight / 2.f);
+
+        auto &cell(cellAt(cPhysics));
+        cell.bricks.emplace_back(&mBrick);
+        cell.boxes.add(toFloat(cPhysics.left()), toFloat(cPhysics.top()), toFloat(cPhysics.right()),
+                       toFloat(cPhysics.bottom()));
+    }
+
+    void remove(Entity &mBrick)
+    {
+        auto &cell(cellAt(mBrick.getComponent<CPhysics>()));
+        auto it(std::find(std::begin(cell.bricks), std::end(cell.bricks), &mBrick));
+        if (it == std::end(cell.bricks))
+            return;
+
+        // Same swap and pop as `PackedBoxes::remove`, to keep both in sync.
+        const auto index(static_cast<std::size_t>(it - std::begin(cell.bricks)));
+        cell.bricks[index] = cell.bricks.back();
+        cell.bricks.pop_back();
+        cell.boxes.remove(index);
+    }
+
+    // Call `mFunction(brick)` for every brick whose box intersects the one
+    // of `mPhysics`, tested in batches with `PackedBoxes`.
+    template <typename TF>
+    void queryIntersecting(const CPhysics &mPhysics, TF &&mFunction)
+    {
+        const float left{mPhysics.left()}, top{mPhysics.top()}, right{mPhysics.right()}, bottom{mPhysics.bottom()};
+
+        forEachCell(left, top, right, bottom, [&](Cell &mCell) {
+            mCell.boxes.forEachIntersecting(left, top, right, bottom, [&](std::size_t mIndex) {
+                mFunction(*mCell.bricks[mIndex]);
+            });
+        });
+    }
+
+    // Call `mFunction(brick)` for every brick that may intersect `mPhysics`.
+    template <typename TF>
+    void query(const CPhysics &mPhysics, TF &&mFunction)
+    {
+        query(mPhysics.left(), mPhysics.top(), mPhysics.right(), mPhysics.bottom(), std::forward<TF>(mFunction));
+    }
+
+    // Same as above, for an arbitrary area (e.g. the area swept by a ball).
+    template <typename TF>
+    void query(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction)
+    {
+        forEachCell(mLeft, mTop, mRight, mBottom, [&mFunction](Cell &mCell) {
+            for (auto &brick : mCell.bricks)
+                mFunction(*brick);
+        });
+    }
+
+    // The first brick a point going straight up from `mFromY` to `mToY`
+    // at `mX` runs into, or nullptr. Instead of an area query, only the
+    // columns a brick spanning `mX` can be stored in are visited, a row at
+    // a time from the bottom, and the march ends at the first row whose
+    // bricks can't be lower than the one found. Dead bricks stay in the
+    // grid until the next refresh, they are skipped.
+    Entity *castUp(float mX, float mFromY, float mToY)
+    {
+        const int firstColumn{column(mX - cellWidth / 2.f)}, lastColumn{column(mX + cellWidth / 2.f)};
+        const int firstRow{row(mFromY)}, lastRow{row(mToY - cellHeight / 2.f)};
+
+        Entity *hit{nullptr};
+        float lowest{mToY};
+        for (int iY{firstRow}; iY >= std::max(lastRow, firstRow - rows + 1); --iY)
+        {
+            // The bottoms of the bricks centered in this row and above.
+            if (hit != nullptr && lowest >= (iY + 1) * cellHeight + cellHeight / 2.f)
+                break;
+
+            for (int iX{firstColumn}; iX <= lastColumn; ++iX)
+            {
+                auto &cell(cells[wrap(iY) * columns + iX]);
+                const auto index(cell.boxes.findLowest(mX, mToY, mFromY, lowest, [&cell](std::size_t mIndex) {
+                    return cell.bricks[mIndex]->isAlive();
+                }));
+                if (index != cell.boxes.size())
+                    hit = cell.bricks[index];
+            }
+        }
+
+        return hit;
+    }
+
+    // Call `mFunction(left, top, right, bottom)` for the cells with bricks,
+    // in the first window height the rows wrap around, for debug drawing.
+    template <typename TF>
+    void forEachOccupiedCell(TF &&mFunction) const
+    {
+        for (int iY{0}; iY < rows; ++iY)
+            for (int iX{0}; iX < columns; ++iX)
+                if (!cells[iY * columns + iX].bricks.empty())
+                    mFunction(iX * cellWidth, iY * cellHeight, (iX + 1) * cellWidth, (iY + 1) * cellHeight);
+    }
+};
+
+// The bullets of the laser paddle: a fixed pool kept as arrays, the live
+// bullets packed at the front, so a step moves them all in one loop over
+// the positions. Every bullet owns a quad of the shared rectangle batch
+// for as long as the pool lives, collapsed while it isn't flying.
+class Projectiles
+{
+  public:
+    static constexpr std::size_t capacity{64};
+    static constexpr float speed{0.8f}, halfWidth{1.5f}, halfHeight{6.f};
+
+  private:
+    std::array<float, capacity> xs, ys;
+    std::array<std::size_t, capacity> quads;
+    std::size_t count{0};
+    RectangleBatch *batch{nullptr};
+
+    void hide(std::size_t mIndex) { batch->set(quads[mIndex], Vector2f{}, Vector2f{}, Color::Transparent); }
+
+    // The last bullet takes the place of the removed one.
+    void kill(std::size_t mIndex)
+    {
+        --count;
+        std::swap(xs[mIndex], xs[count]);
+        std::swap(ys[mIndex], ys[count]);
+        std::swap(quads[mIndex], quads[count]);
+        hide(count);
+    }
+
+  public:
+    void attach(RectangleBatch &mBatch)
+    {
+        batch = &mBatch;
+        for (std::size_t i{0}; i < capacity; ++i)
+        {
+            quads[i] = batch->add();
+            hide(i);
+        }
+    }
+
+    std::size_t size() const noexcept { return count; }
+    float getX(std::size_t mIndex) const noexcept { return xs[mIndex]; }
+    float getY(std::size_t mIndex) const noexcept { return ys[mIndex]; }
+
+    // False when every bullet of the pool is already flying.
+    bool fire(float mX, float mY)
+    {
+        if (count == capacity)
+            return false;
+
+        xs[count] = mX;
+        ys[count] = mY;
+        ++count;
+        return true;
+    }
+
+    void clear()
+    {
+        while (count > 0)
+            kill(count - 1);
+    }
+
+    // Move the bullets up and take out the ones that leave above `mTop` or
+    // for which `mHit(x, fromY, toY)`, called with the part of the column
+    // their top went through, returns true.
+    template <typename TF>
+    void update(float mFT, float mTop, TF &&mHit)
+    {
+        const float distance{speed * mFT};
+        for (std::size_t i{0}; i < count; ++i)
+            ys[i] -= distance;
+
+        for (std::size_t i{0}; i < count;)
+        {
+            const float top{ys[i] - halfHeight};
+            if (mHit(xs[i], top + distance, top) || ys[i] + halfHeight < mTop)
+            {
+                kill(i);
+                continue;
+            }
+
+            batch->set(quads[i], Vector2f{xs[i], ys[i]}, Vector2f{halfWidth, halfHeight}, Color::Red);
+            ++i;
+        }
+    }
+};
+
+// Broad phase for the levels the grid doesn't fit, with bricks bigger than
+// its cells or scattered with very different sizes: a bounding volume
+// hierarchy built once over the bricks of the level, split at the median
+// of its longest side down to a few bricks per leaf. Bricks are only taken
+// out after that: a dead brick leaves its leaf and the alive counts up the
+// tree go down, so the subtrees without bricks left are skipped. The boxes
+// don't shrink.
+class BrickTree
+{
+  private:
+    static constexpr std::size_t leafSize{4}, maxDepth{64};
+    static constexpr std::uint32_t none{std::numeric_limits<std::uint32_t>::max()};
+
+    struct Node
+    {
+        float left, top, right, bottom;
+        // Leaves have `count` bricks from `first` in `bricks`, the others
+        // their two children from `first` in `nodes`.
+        std::uint32_t first, count, parent, alive;
+    };
+
+    std::vector<Node> nodes;
+    // In the order of the leaves, null once dead.
+    std::vector<Entity *> bricks;
+    std::vector<EntityHandle> handles;
+    std::vector<std::uint32_t> leaves;
+    // Slot in `bricks` of every entity of the tree, by pool index.
+    std::vector<std::uint32_t> slots;
+
+    static float center(const CPhysics &mPhysics, bool mVertical) noexcept
+    {
+        return toFloat(mVertical ? mPhysics.y() : mPhysics.x());
+    }
+
+    void buildNode(std::uint32_t mNode, std::size_t mFirst, std::size_t mLast)
+    {
+        float left{highest<float>()}, top{highest<float>()}, right{-highest<float>()}, bottom{-highest<float>()};
+        Vector2f centerMin{highest<float>(), highest<float>()}, centerMax{-highest<float>(), -highest<float>()};
+        for (auto i(mFirst); i < mLast; ++i)
+        {
+            const auto &cPhysics(bricks[i]->getComponent<CPhysics>());
+            left = std::min(left, toFloat(cPhysics.left()));
+            top = std::min(top, toFloat(cPhysics.top()));
+            right = std::max(right, toFloat(cPhysics.right()));
+            bottom = std::max(bottom, toFloat(cPhysics.bottom()));
+
+            const Vector2f brickCenter{center(cPhysics, false), center(cPhysics, true)};
+            centerMin = Vector2f{std::min(centerMin.x, brickCenter.x), std::min(centerMin.y, brickCenter.y)};
+            centerMax = Vector2f{std::max(centerMax.x, brickCenter.x), std::max(centerMax.y, brickCenter.y)};
+        }
+
+        auto &node(nodes[mNode]);
+        node.left = left;
+        node.top = top;
+        node.right = right;
+        node.bottom = bottom;
+        node.alive = static_cast<std::uint32_t>(mLast - mFirst);
+
+        if (mLast - mFirst <= leafSize)
+        {
+            node.first = static_cast<std::uint32_t>(mFirst);
+            node.count = static_cast<std::uint32_t>(mLast - mFirst);
+            for (auto i(mFirst); i < mLast; ++i)
+                leaves[i] = mNode;
+            return;
+        }
+
+        const bool vertical{centerMax.y - centerMin.y > centerMax.x - centerMin.x};
+        const auto middle(mFirst + (mLast - mFirst) / 2);
+        std::nth_element(std::begin(bricks) + mFirst, std::begin(bricks) + middle, std::begin(bricks) + mLast,
+                         [vertical](Entity *mA, Entity *mB) {
+                             return center(mA->getComponent<CPhysics>(), vertical) <
+                                    center(mB->getComponent<CPhysics>(), vertical);
+                         });
+
+        // `node` can move with the new nodes.
+        const auto children(static_cast<std::uint32_t>(nodes.size()));
+        nodes[mNode].first = children;
+        nodes[mNode].count = 0;
+        nodes.resize(nodes.size() + 2);
+        nodes[children].parent = nodes[children + 1].parent = mNode;
+
+        buildNode(children, mFirst, middle);
+        buildNode(children + 1, middle, mLast);
+    }
+
+    std::uint32_t find(const Entity &mBrick) const noexcept
+    {
+        const auto &handle(mBrick.getHandle());
+        if (handle.index >= slots.size())
+            return none;
+
+        const auto slot(slots[handle.index]);
+        if (slot == none || handles[slot].index != handle.index || handles[slot].generation != handle.generation)
+            return none;
+
+        return slot;
+    }
+
+    void addAlive(std::uint32_t mSlot, std::uint32_t mDelta) noexcept
+    {
+        for (auto node(leaves[mSlot]); node != none; node = nodes[node].parent)
+            nodes[node].alive += mDelta;
+    }
+
+  public:
+    bool empty() const noexcept { return nodes.empty(); }
+
+    // Replace the tree with one over `mBricks`.
+    void build(const std::vector<Entity *> &mBricks)
+    {
+        clear();
+        if (mBricks.empty())
+            return;
+
+        bricks = mBricks;
+        leaves.resize(bricks.size());
+        nodes.reserve(bricks.size() / leafSize * 2 + 1);
+        nodes.resize(1);
+        nodes[0].parent = none;
+        buildNode(0, 0, bricks.size());
+
+        for (std::size_t i{0}; i < bricks.size(); ++i)
+        {
+            const auto &handle(bricks[i]->getHandle());
+            handles.emplace_back(handle);
+            if (handle.index >= slots.size())
+                slots.resize(handle.index + 1, std::uint32_t{none});
+            slots[handle.index] = static_cast<std::uint32_t>(i);
+        }
+    }
+
+    void clear()
+    {
+        nodes.clear();
+        bricks.clear();
+        handles.clear();
+        leaves.clear();
+        slots.clear();
+    }
+
+    // Returns false when `mBrick` isn't in the tree.
+    bool remove(const Entity &mBrick) noexcept
+    {
+        const auto slot(find(mBrick));
+        if (slot == none)
+            return false;
+
+        if (bricks[slot] != nullptr)
+        {
+            bricks[slot] = nullptr;
+            addAlive(slot, std::numeric_limits<std::uint32_t>::max());
+        }
+        return true;
+    }
+
+    // A brick brought back by a snapshot takes its slot again. Returns
+    // false when it was never in the tree.
+    bool restore(Entity &mBrick) noexcept
+    {
+        const auto slot(find(mBrick));
+        if (slot == none)
+            return false;
+
+        if (bricks[slot] == nullptr)
+        {
+            bricks[slot] = &mBrick;
+            addAlive(slot, 1);
+        }
+        return true;
+    }
+
+    // Call `mFunction(brick)` for every brick whose box intersects the area.
+    template <typename TF>
+    void query(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction) const
+    {
+        if (nodes.empty())
+            return;
+
+        std::array<std::uint32_t, maxDepth> stack;
+        std::size_t size{0};
+        stack[size++] = 0;
+
+        while (size > 0)
+        {
+            const auto &node(nodes[stack[--size]]);
+            if (node.alive == 0 || node.right < mLeft || node.left > mRight || node.bottom < mTop ||
+                node.top > mBottom)
+                continue;
+
+            if (node.count == 0)
+            {
+                stack[size++] = node.first;
+                stack[size++] = node.first + 1;
+                continue;
+            }
+
+            for (auto i(node.first); i < node.first + node.count; ++i)
+                if (bricks[i] != nullptr)
+                    mFunction(*bricks[i]);
+        }
+    }
+
+    // Call `mFunction(left, top, right, bottom, leaf)` for the nodes with
+    // bricks left, for debug drawing.
+    template <typename TF>
+    void forEachNode(TF &&mFunction) const
+    {
+        for (const auto &node : nodes)
+            if (node.alive > 0)
+                mFunction(node.left, node.top, node.right, node.bottom, node.count > 0);
+    }
+};
+
+// Balls move every step, so instead of moving them between cells this grid
+// is rebuilt from scratch each step with a counting sort. The balls of a
+// cell end up next to each other in one dense array, and the neighbours of
+// a ball are a few contiguous ranges of it. Rows wrap like in `BrickGrid`.
+class BallGrid
+{
+  private:
+    static constexpr float cellSize{ballRadius * 2.f};
+    static constexpr int columns{static_cast<int>(windowWidth / cellSize) + 1};
+    static constexpr int rows{static_cast<int>(windowHeight / cellSize) + 1};
+
+    // Where the balls of every cell start in `sorted`, and one past the
+    // end of the last cell.
+    std::array<std::uint32_t, columns * rows + 1> starts;
+    std::vector<std::uint32_t> sorted, cellOf;
+
+    static int cell(const Vector2f &mPosition) noexcept
+    {
+        const int iX{std::max(0, std::min(columns - 1, static_cast<int>(mPosition.x / cellSize)))};
+        const int iY{static_cast<int>(std::floor(mPosition.y / cellSize))};
+        return ((iY % rows + rows) % rows) * columns + iX;
+    }
+
+    template <typename TF>
+    void forEachPair(int mCell, int mOther, TF &mFunction)
+    {
+        for (auto i(starts[mCell]); i < starts[mCell + 1]; ++i)
+            for (auto j(mCell == mOther ? i + 1 : starts[mOther]); j < starts[mOther + 1]; ++j)
+                mFunction(sorted[i], sorted[j]);
+    }
+
+  public:
+    template <typename TPositions>
+    void build(const TPositions &mPositions)
+    {
+        cellOf.resize(mPositions.size());
+        starts.fill(0);
+
+        for (std::size_t i{0}; i < mPositions.size(); ++i)
+        {
+            cellOf[i] = cell(mPositions[i]);
+            ++starts[cellOf[i] + 1];
+        }
+
+        for (std::size_t i{1}; i < starts.size(); ++i)
+            starts[i] += starts[i - 1];
+
+        auto next(starts);
+        sorted.resize(mPositions.size());
+        for (std::size_t i{0}; i < mPositions.size(); ++i)
+            sorted[next[cellOf[i]]++] = i;
+    }
+
+    // Call `mFunction(i, j)` once for every pair of balls in the same or
+    // in neighbouring cells, with the indices given to `build`. Only half
+    // of the neighbours of a cell are visited, the other half visit it.
+    template <typename TF>
+    void forEachPair(TF &&mFunction)
+    {
+        for (int iY{0}; iY < rows; ++iY)
+            for (int iX{0}; iX < columns; ++iX)
+            {
+                const int current{iY * columns + iX};
+                if (starts[current] == starts[current + 1])
+                    continue;
+
+                const int below{((iY + 1) % rows) * columns};
+                forEachPair(current, current, mFunction);
+                forEachPair(current, below + iX, mFunction);
+
+                if (iX + 1 < columns)
+                {
+                    const int above{((iY + rows - 1) % rows) * columns};
+                    forEachPair(current, above + iX + 1, mFunction);
+                    forEachPair(current, iY * columns + iX + 1, mFunction);
+                    forEachPair(current, below + iX + 1, mFunction);
+                }
+            }
+    }
+
+    // Call `mFunction(left, top, right, bottom)` for the cells with balls,
+    // for debug drawing.
+    template <typename TF>
+    void forEachOccupiedCell(TF &&mFunction) const
+    {
+        for (int i{0}; i < columns * rows; ++i)
+            if (starts[i] != starts[i + 1])
+                mFunction(i % columns * cellSize, i / columns * cellSize, (i % columns + 1) * cellSize,
+                          (i / columns + 1) * cellSize);
+    }
+};
+
+// Broad phase for many moving boxes of any size: they are kept sorted by
+// their left side, so a box can only overlap the ones after it until one
+// starts past its right side. Between two steps the boxes barely move, so
+// the order of the last step is almost sorted already and an insertion
+// sort puts it back in close to linear time.
+class SweepAndPrune
+{
+  public:
+    struct Box
+    {
+        float left, top, right, bottom;
+    };
+
+  private:
+    // A copy of the box, the sweep only reads this array.
+    struct Interval
+    {
+        Box box;
+        std::uint32_t index;
+    };
+
+    std::vector<Interval> intervals;
+
+  public:
+    // Sort `mBoxes`, the box of every object at its index. When there are
+    // as many as last time the indices must be the same objects, the
+    // previous order is then the starting point.
+    template <typename TBoxes>
+    void update(const TBoxes &mBoxes)
+    {
+        if (intervals.size() != mBoxes.size())
+        {
+            intervals.resize(mBoxes.size());
+            for (std::size_t i{0}; i < mBoxes.size(); ++i)
+                intervals[i] = Interval{mBoxes[i], static_cast<std::uint32_t>(i)};
+
+            std::sort(std::begin(intervals), std::end(intervals),
+                      [](const Interval &mA, const Interval &mB) { return mA.box.left < mB.box.left; });
+            return;
+        }
+
+        for (auto &interval : intervals)
+            interval.box = mBoxes[interval.index];
+
+        for (std::size_t i{1}; i < intervals.size(); ++i)
+        {
+            const auto interval(intervals[i]);
+            auto j(i);
+            for (; j > 0 && intervals[j - 1].box.left > interval.box.left; --j)
+                intervals[j] = intervals[j - 1];
+            intervals[j] = interval;
+        }
+    }
+
+    // Call `mFunction(i, j)` once for every pair of boxes that intersect,
+    // with their indices in the last `update`.
+    template <typename TF>
+    void forEachPair(TF &&mFunction) const
+    {
+        for (std::size_t i{0}; i < intervals.size(); ++i)
+        {
+            const auto &box(intervals[i].box);
+            for (auto j(i + 1); j < intervals.size() && intervals[j].box.left <= box.right; ++j)
+            {
+                const auto &other(intervals[j].box);
+                if (other.top <= box.bottom && other.bottom >= box.top)
+                    mFunction(intervals[i].index, intervals[j].index);
+            }
+        }
+    }
+};
+
+// Time of impact of a box sweeping against a static one, between 0 (start
+// of the movement) and 1 (end of the movement), and the side it hit.
+struct SweepHit
+{
+    PhysicsScalar time;
+    PhysicsVector normal;
+};
+
+// Sweep a box of `mHalfSize` from `mFrom` along `mDelta` against `mTarget`.
+// The target is expanded by the moving box, so the test becomes a ray
+// against a box solved with the slab method. Boxes that already overlap at
+// the start are not reported, `isIntersecting` handles them. The target
+// is anything with the sides of a box, like `CPhysics`.
+template <typename TBox>
+bool sweepAABB(const PhysicsVector &mFrom, const PhysicsVector &mDelta, const PhysicsVector &mHalfSize,
+               const TBox &mTarget, SweepHit &mHit) noexcept
+{
+    const PhysicsScalar left{mTarget.left() - mHalfSize.x}, right{mTarget.right() + mHalfSize.x};
+    const PhysicsScalar top{mTarget.top() - mHalfSize.y}, bottom{mTarget.bottom() + mHalfSize.y};
+    const PhysicsScalar infinity{highest<PhysicsScalar>()}, zero{}, one(1.f);
+
+    PhysicsScalar entryX{-infinity}, exitX{infinity}, entryY{-infinity}, exitY{infinity};
+
+    if (mDelta.x != zero)
+    {
+        const PhysicsScalar t1{(left - mFrom.x) / mDelta.x}, t2{(right - mFrom.x) / mDelta.x};
+        entryX = std::min(t1, t2);
+        exitX = std::max(t1, t2);
+    }
+    else if (mFrom.x < left || mFrom.x > right)
+        return false;
+
+    if (mDelta.y != zero)
+    {
+        const PhysicsScalar t1{(top - mFrom.y) / mDelta.y}, t2{(bottom - mFrom.y) / mDelta.y};
+        entryY = std::min(t1, t2);
+        exitY = std::max(t1, t2);
+    }
+    else if (mFrom.y < top || mFrom.y > bottom)
+        return false;
+
+    const PhysicsScalar entry{std::max(entryX, entryY)}, exit{std::min(exitX, exitY)};
+    if (entry > exit || entry < zero || entry > one)
+        return false;
+
+    mHit.time = entry;
+    if (entryX > entryY)
+        mHit.normal = PhysicsVector{mDelta.x > zero ? -one : one, zero};
+    else
+        mHit.normal = PhysicsVector{zero, mDelta.y > zero ? -one : one};
+
+    return true;
+}
+
+// Direction a ball leaves the paddle in, from where it hit it: straight
+// up from the center, up to `maxAngle` from the vertical at the edges.
+// Sampled once into a table, looking a direction up is then a clamp and
+// a linear interpolation, without branches nor trigonometry.
+class PaddleReflection
+{
+  private:
+    static constexpr std::size_t samples{64};
+    static constexpr float maxAngle{3.14159265f / 3.f};
+
+    std::array<PhysicsVector, samples + 1> directions;
+
+  public:
+    PaddleReflection()
+    {
+        for (std::size_t i{0}; i <= samples; ++i)
+        {
+            const PhysicsScalar angle((i * 2.f / samples - 1.f) * maxAngle);
+            directions[i] = PhysicsVector{sine(angle), -cosine(angle)};
+        }
+    }
+
+    // `mOffset` goes from -1, the left edge, to 1, the right one. Outside
+    // of that it is clamped.
+    PhysicsVector getDirection(PhysicsScalar mOffset) const noexcept
+    {
+        const PhysicsScalar one(1.f);
+        const PhysicsScalar position{(std::min(std::max(mOffset, -one), one) + one) * PhysicsScalar(samples / 2.f)};
+        const auto index(std::min(static_cast<std::size_t>(toFloat(position)), samples - 1));
+        const PhysicsScalar fraction{position - PhysicsScalar(static_cast<int>(index))};
+
+        return directions[index] + (directions[index + 1] - directions[index]) * fraction;
+    }
+
+    static const PaddleReflection &get()
+    {
+        static const PaddleReflection reflection;
+        return reflection;
+    }
+};
+
+// A ball touching a paddle, found before any is reflected.
+struct PaddleContact
+{
+    CPhysics *ball;
+    // Where the ball is along the paddle, -1 to 1.
+    PhysicsScalar offset;
+};
+
+// Send the balls of `mContacts` back up, all in one pass: the offset picks
+// the direction and the ball keeps its speed.
+inline void reflectOffPaddles(const PaddleContact *mContacts, std::size_t mCount) noexcept
+{
+    const auto &reflection(PaddleReflection::get());
+    for (std::size_t i{0}; i < mCount; ++i)
+    {
+        auto &velocity(mContacts[i].ball->velocity);
+        const PhysicsScalar speed{squareRoot(velocity.x * velocity.x + velocity.y * velocity.y)};
+        velocity = reflection.getDirection(mContacts[i].offset) * speed;
+    }
+}
+
+// Testing the paddle and ball collision.
+// Returns true when the ball was coming down, the first step of a bounce.
+bool testCollisionPB(Entity &mPaddle, Entity &mBall)
+{
+    auto &cpPaddle(mPaddle.getComponent<CPhysics>());
+    auto &cpBall(mBall.getComponent<CPhysics>());
+
+    // If not collision, return.
+    if (!isIntersecting(cpPaddle, cpBall))
+        return false;
+
+    const bool bounced{cpBall.velocity.y > PhysicsScalar{}};
+
+    // Otherwise change velocity (push ball to upwards), depending on
+    // where it hit the paddle.
+    const PaddleContact contact{&cpBall, (cpBall.x() - cpPaddle.x()) / cpPaddle.halfSize.x};
+    reflectOffPaddles(&contact, 1);
+
+    return bounced;
+}
+
+// A brick was hit by a ball, it breaks once it has no hit points left.
+// Bricks whose type has shades take the color of their hit points.
+// Returns true when the brick broke.
+bool damageBrick(Entity &mBrick)
+{
+    if (mBrick.hasComponent<CBrick>())
+    {
+        auto &cBrick(mBrick.getComponent<CBrick>());
+        if (brickTypes[cBrick.type].indestructible)
+            return false;
+
+        if (cBrick.hitPoints > 1)
+        {
+            --cBrick.hitPoints;
+            if (brickTypes[cBrick.type].shades[0] != 0)
+            {
+                if (mBrick.hasComponent<CRectangle>())
+                    mBrick.getComponent<CRectangle>().setColor(getBrickColor(cBrick.type, cBrick.hitPoints, Color{}));
+                else if (mBrick.hasComponent<CSprite>())
+                    mBrick.getComponent<CSprite>().setColor(getBrickColor(cBrick.type, cBrick.hitPoints, Color{}));
+            }
+            return false;
+        }
+    }
+
+    mBrick.destroy();
+    return true;
+}
+
+// Axis along which a ball overlapping a brick is pushed out the least:
+// `time` holds how deep the overlap is and `normal` points from the brick
+// towards the ball.
+template <typename TBox>
+SweepHit getOverlap(const TBox &mBrick, const CPhysics &mBall) noexcept
+{
+    const PhysicsScalar overlapLeft{mBall.right() - mBrick.left()};
+    const PhysicsScalar overlapRight{mBrick.right() - mBall.left()};
+    const PhysicsScalar overlapTop{mBall.bottom() - mBrick.top()};
+    const PhysicsScalar overlapBottom{mBrick.bottom() - mBall.top()};
+
+    const bool ballFromLeft(absolute(overlapLeft) < absolute(overlapRight));
+    const bool ballFromTop(absolute(overlapTop) < absolute(overlapBottom));
+
+    const PhysicsScalar minOverlapX{absolute(ballFromLeft ? overlapLeft : overlapRight)};
+    const PhysicsScalar minOverlapY{absolute(ballFromTop ? overlapTop : overlapBottom)};
+
+    if (minOverlapX < minOverlapY)
+        return SweepHit{minOverlapX, fromVector2f<PhysicsScalar>(Vector2f{ballFromLeft ? -1.f : 1.f, 0.f})};
+
+    return SweepHit{minOverlapY, fromVector2f<PhysicsScalar>(Vector2f{0.f, ballFromTop ? -1.f : 1.f})};
+}
+
+// What a ball touched during a step, gathered before anything is resolved.
+struct BrickContact
+{
+    static constexpr std::uint8_t maxBricks{4};
+
+    // Bricks of `Game::brickField` have no entity, their slot is in
+    // `slots` instead. So do the ones of `Game::kinematicBricks`, with
+    // `KinematicBricks::slotFlag` set.
+    std::array<Entity *, maxBricks> bricks;
+    std::array<std::uint32_t, maxBricks> slots;
+    std::uint8_t count{0};
+    // Index of the ball in its group.
+    std::uint32_t ball{0};
+    // Found by the sweep, then `response.time` is the time of the first
+    // impact. Otherwise the ball overlapped the bricks and it is the depth
+    // of the deepest overlap.
+    bool swept{false};
+    SweepHit response;
+    // The direction the ball leaves in along each axis it was reflected
+    // on, 0 along the others, and where a swept ball ends the step.
+    PhysicsVector normal, end;
+};
+
+// Overriding testCollision method for bricks and ball.
+// Returns true when the brick broke.
+bool testCollisionBB(Entity &mBrick, Entity &mBall)
+{
+    auto &cpBrick(mBrick.getComponent<CPhysics>());
+    auto &cpBall(mBall.getComponent<CPhysics>());
+
+    // If not collision, return.
+    if (!isIntersecting(cpBrick, cpBall))
+        return false;
+
+    // Otherwise damage the brick!
+    const bool broken{damageBrick(mBrick)};
+
+    // The ball keeps its speed, only the direction flips. The axis comes
+    // from `getOverlap`, like in the other collision paths, so an exactly
+    // diagonal hit is resolved the same way whichever path ran.
+    const SweepHit overlap{getOverlap(cpBrick, cpBall)};
+    if (overlap.normal.x != PhysicsScalar{})
+        cpBall.velocity.x = absolute(cpBall.velocity.x) * overlap.normal.x;
+    else
+        cpBall.velocity.y = absolute(cpBall.velocity.y) * overlap.normal.y;
+
+    return broken;
+}
+
+// Frame profiler, every frame the time spent in each phase is stored in a
+// ring buffer, so the last few seconds can be summarized or dumped.
+enum ProfilePhase : std::size_t
+{
+    PInput,
+    PUpdate,
+    PRefresh,
+    PLogic,
+    PCollision,
+    PDraw,
+    // The post-process passes, inside `PDraw`.
+    PBlurX,
+    PBlurY,
+    PComposite,
+#ifdef ARKANOID_GPU_TIMERS
+    // GPU time, from `GpuTimers`, a frame or two behind.
+    PGpuBalls,
+    PGpuBricks,
+    PGpuEffects,
+    PGpuHud,
+    PGpuPost,
+#endif
+    PFrame,
+    PCount
+};
+
+constexpr const char *profilePhaseNames[PCount]{
+    "input", "update", "refresh", "logic", "collision", "draw", "blur x", "blur y", "composite",
+#ifdef ARKANOID_GPU_TIMERS
+    "gpu balls", "gpu bricks", "gpu effects", "gpu hud", "gpu post",
+#endif
+    "frame"};
+
+struct ProfileStats
+{
+    float min{0.f}, avg{0.f}, p50{0.f}, p99{0.f};
+};
+
+class FrameProfiler
+{
+  private:
+    static constexpr std::size_t historySize{256};
+
+    // Milliseconds spent in every phase, for the last `historySize` frames.
+    std::array<std::array<float, historySize>, PCount> history;
+    // Time accumulated during the current frame. A phase can run several
+    // times per frame (e.g. refresh runs once per logic step).
+    std::array<float, PCount> current;
+    std::size_t frames{0};
+
+    // Heap allocations made during every frame, by every thread.
+    std::array<std::size_t, historySize> allocations;
+    std::size_t allocationsBefore{allocationCount.load(std::memory_order_relaxed)};
+    // Logic steps dropped by every frame, see `Tunables::maxSteps`.
+    std::array<std::size_t, historySize> droppedSteps;
+    std::size_t currentDroppedSteps{0};
+#ifdef ARKANOID_MEMORY_TRACKING
+    // Bytes live at the end of every frame, by tag.
+    std::array<std::array<std::size_t, historySize>, MCount> liveBytes;
+#endif
+
+  public:
+    // Disabled profilers make `ScopedTimer` skip reading the clock.
+    bool enabled{true};
+
+    FrameProfiler()
+    {
+        current.fill(0.f);
+    }
+
+    void add(ProfilePhase mPhase, float mMilliseconds) noexcept
+    {
+        current[mPhase] += mMilliseconds;
+    }
+
+    void addDroppedSteps(std::size_t mSteps) noexcept { currentDroppedSteps += mSteps; }
+
+    void endFrame() noexcept
+    {
+        for (auto i(0u); i < PCount; ++i)
+            history[i][frames % historySize] = current[i];
+
+        const auto allocationsAfter(allocationCount.load(std::memory_order_relaxed));
+        allocations[frames % historySize] = allocationsAfter - allocationsBefore;
+        allocationsBefore = allocationsAfter;
+        droppedSteps[frames % historySize] = currentDroppedSteps;
+        currentDroppedSteps = 0;
+#ifdef ARKANOID_MEMORY_TRACKING
+        for (auto i(0u); i < MCount; ++i)
+            liveBytes[i][frames % historySize] = memoryCounters[i].live.load(std::memory_order_relaxed);
+#endif
+
+        current.fill(0.f);
+        ++frames;
+    }
+
+    // Allocations of the last frame, and the most any stored frame made.
+    std::size_t getLastAllocations() const noexcept
+    {
+        return frames == 0 ? 0 : allocations[(frames - 1) % historySize];
+    }
+
+    std::size_t getMaxAllocations() const noexcept
+    {
+        const auto count(getSampleCount());
+        return count == 0 ? 0 : *std::max_element(std::begin(allocations), std::begin(allocations) + count);
+    }
+
+    // Milliseconds of `mPhase` in the last frame.
+    float getLast(ProfilePhase mPhase) const noexcept
+    {
+        return frames == 0 ? 0.f : history[mPhase][(frames - 1) % historySize];
+    }
+
+    std::size_t getLastDroppedSteps() const noexcept
+    {
+        return frames == 0 ? 0 : droppedSteps[(frames - 1) % historySize];
+    }
+
+    std::size_t getMaxDroppedSteps() const noexcept
+    {
+        const auto count(getSampleCount());
+        return count == 0 ? 0 : *std::max_element(std::begin(droppedSteps), std::begin(droppedSteps) + count);
+    }
+
+    std::size_t getSampleCount() const noexcept
+    {
+        return frames < historySize ? frames : historySize;
+    }
+
+    ProfileStats getStats(ProfilePhase mPhase) const
+    {
+        ProfileStats stats;
+        const auto count(getSampleCount());
+        if (count == 0)
+            return stats;
+
+        std::array<float, historySize> sorted;
+        std::copy_n(std::begin(history[mPhase]), count, std::begin(sorted));
+
+        auto first(std::begin(sorted)), last(first + count);
+        auto p99(first + (count - 1) * 99 / 100);
+        std::nth_element(first, p99, last);
+        // The median is among the smaller ones, before the p99.
+        auto p50(first + (count - 1) / 2);
+        std::nth_element(first, p50, p99);
+
+        stats.p50 = *p50;
+        stats.p99 = *p99;
+        stats.min = *std::min_element(first, last);
+        stats.avg = std::accumulate(first, last, 0.f) / count;
+        return stats;
+    }
+
+    // Write the stored frames, oldest first, as CSV.
+    void dumpCSV(std::ostream &mStream) const
+    {
+        mStream << "frame";
+        for (auto name : profilePhaseNames)
+            mStream << ',' << name;
+        mStream << ",allocations,dropped steps";
+#ifdef ARKANOID_MEMORY_TRACKING
+        for (auto name : memoryTagNames)
+            mStream << ',' << name << " bytes";
+#endif
+        mStream << '\n';
+
+        const auto count(getSampleCount());
+        for (auto i(frames - count); i < frames; ++i)
+        {
+            mStream << i;
+            for (auto phase(0u); phase < PCount; ++phase)
+                mStream << ',' << history[phase][i % historySize];
+            mStream << ',' << allocations[i % historySize] << ',' << droppedSteps[i % historySize];
+#ifdef ARKANOID_MEMORY_TRACKING
+            for (auto tag(0u); tag < MCount; ++tag)
+                mStream << ',' << liveBytes[tag][i % historySize];
+#endif
+            mStream << '\n';
+        }
+    }
+};
+
+// Add the time elapsed between its construction and destruction to a
+// profiler phase.
+class ScopedTimer
+{
+  private:
+    FrameProfiler &profiler;
+    ProfilePhase phase;
+    chrono::high_resolution_clock::time_point start;
+
+  public:
+    ScopedTimer(FrameProfiler &mProfiler, ProfilePhase mPhase) : profiler(mProfiler), phase{mPhase}
+    {
+        if (profiler.enabled)
+            start = chrono::high_resolution_clock::now();
+    }
+
+    ~ScopedTimer()
+    {
+        if (!profiler.enabled)
+            return;
+
+        auto elapsedTime(chrono::high_resolution_clock::now() - start);
+        profiler.add(phase, chrono::duration_cast<chrono::duration<float, milli>>(elapsedTime).count());
+    }
+};
+
+// Bars with the min, average and p99 time of every phase. They are drawn
+// from a single vertex array, and only rebuilt a few times per second.
+// Below them, the allocations per frame: the last frame and, in red, the
+// most a stored frame made, a steady frame should make none. Then the draw
+// calls of the last frame, and the logic steps dropped, the same way as
+// the allocations. With the memory tracker, one more row per tag has the
+// live bytes and the peak.
+class ProfilerOverlay : public Drawable
+{
+  private:
+    static constexpr float barHeight{8.f}, rowHeight{12.f}, margin{10.f};
+    // A 60 fps frame (16.6 ms) takes 200 pixels.
+    static constexpr float pixelsPerMillisecond{12.f};
+    static constexpr float pixelsPerAllocation{4.f}, pixelsPerDrawCall{8.f}, pixelsPerStep{2.f};
+    // 1 MiB takes 256 pixels, bars stop at the edge of the window.
+    static constexpr float pixelsPerKilobyte{0.25f}, maxBarWidth{windowWidth - 2 * margin};
+
+    VertexArray vertices{Quads};
+
+    void addBar(float mY, float mFrom, float mTo, const Color &mColor)
+    {
+        addPixelBar(mY, mFrom * pixelsPerMillisecond, mTo * pixelsPerMillisecond, mColor);
+    }
+
+    // From `mFrom` to `mTo` pixels, the bars measured in something else
+    // than milliseconds.
+    void addPixelBar(float mY, float mFrom, float mTo, const Color &mColor)
+    {
+        const float left{margin + std::min(mFrom, float{maxBarWidth})};
+        const float right{margin + std::min(mTo, float{maxBarWidth})};
+
+        vertices.append(Vertex{Vector2f{left, mY}, mColor});
+        vertices.append(Vertex{Vector2f{right, mY}, mColor});
+        vertices.append(Vertex{Vector2f{right, mY + barHeight}, mColor});
+        vertices.append(Vertex{Vector2f{left, mY + barHeight}, mColor});
+    }
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        mTarget.draw(vertices, mStates);
+    }
+
+  public:
+    bool visible{false};
+
+    std::size_t getVertexCount() const noexcept { return vertices.getVertexCount(); }
+
+    void rebuild(const FrameProfiler &mProfiler, const RenderStats &mRenderStats)
+    {
+        vertices.clear();
+
+        for (auto i(0u); i < PCount; ++i)
+        {
+            auto stats(mProfiler.getStats(static_cast<ProfilePhase>(i)));
+            const float y{margin + i * rowHeight};
+
+            addBar(y, 0.f, stats.min, Color{0, 160, 0});
+            addBar(y, stats.min, stats.avg, Color{200, 200, 0});
+            // The p99 is a thin marker at the end of the row.
+            addBar(y, stats.p99, stats.p99 + 0.25f, Color::White);
+        }
+
+        // Frame budget at 60 fps.
+        vertices.append(Vertex{Vector2f{margin + 16.6f * pixelsPerMillisecond, margin}, Color::Red});
+        vertices.append(Vertex{Vector2f{margin + 16.6f * pixelsPerMillisecond + 1.f, margin}, Color::Red});
+        vertices.append(Vertex{Vector2f{margin + 16.6f * pixelsPerMillisecond + 1.f, margin + PCount * rowHeight}, Color::Red});
+        vertices.append(Vertex{Vector2f{margin + 16.6f * pixelsPerMillisecond, margin + PCount * rowHeight}, Color::Red});
+
+        const float allocationsY{margin + PCount * rowHeight};
+        addPixelBar(allocationsY, 0.f, mProfiler.getMaxAllocations() * pixelsPerAllocation, Color::Red);
+        addPixelBar(allocationsY, 0.f, mProfiler.getLastAllocations() * pixelsPerAllocation, Color{200, 200, 0});
+
+        // Draw calls, with a marker for every texture or shader switch.
+        const float drawCallsY{allocationsY + rowHeight};
+        addPixelBar(drawCallsY, 0.f, mRenderStats.drawCalls * pixelsPerDrawCall, Color{0, 160, 160});
+        const auto switches(mRenderStats.textureSwitches + mRenderStats.shaderSwitches);
+        for (std::size_t i{0}; i < switches; ++i)
+            addPixelBar(drawCallsY, i * pixelsPerDrawCall, i * pixelsPerDrawCall + 1.f, Color::White);
+
+        const float droppedStepsY{drawCallsY + rowHeight};
+        addPixelBar(droppedStepsY, 0.f, mProfiler.getMaxDroppedSteps() * pixelsPerStep, Color::Red);
+        addPixelBar(droppedStepsY, 0.f, mProfiler.getLastDroppedSteps() * pixelsPerStep, Color{200, 200, 0});
+
+#ifdef ARKANOID_MEMORY_TRACKING
+        for (auto i(0u); i < MCount; ++i)
+        {
+            const float y{allocationsY + (i + 3) * rowHeight};
+            const float live{memoryCounters[i].live.load(std::memory_order_relaxed) / 1024.f * pixelsPerKilobyte};
+            const float peak{memoryCounters[i].peak.load(std::memory_order_relaxed) / 1024.f * pixelsPerKilobyte};
+
+            addPixelBar(y, 0.f, live, Color{0, 120, 200});
+            addPixelBar(y, peak, peak + 3.f, Color::White);
+        }
+#endif
+    }
+};
+
+// Full-screen effects, for the frame once it is drawn into a texture.
+// Every effect goes into as few full-size passes as it can: the bloom is
+// blurred at a quarter of the size, across then down, and the first of
+// the two passes also keeps only the bright parts. A single pass at full
+// size then adds the bloom to the frame and, for the CRT look, bends it,
+// darkens every other line and the corners. The effects are uniforms of
+// that pass, turning them on and off doesn't build anything.
+class PostProcess
+{
+  private:
+    static constexpr unsigned bloomDivisor{4};
+    static constexpr float bloomThreshold{0.6f}, bloomStrength{1.5f};
+
+    // A 9 tap gaussian in 5 fetches, the linear filtering of the texture
+    // mixes the pairs of taps. Below `threshold` a color adds nothing.
+    static constexpr const char *blurSource{R"(
+        uniform sampler2D source;
+        uniform vec2 direction;
+        uniform float threshold;
+
+        vec4 bright(vec2 mPosition)
+        {
+            return max(texture2D(source, mPosition) - threshold, 0.0) / (1.0 - threshold);
+        }
+
+        void main()
+        {
+            vec2 position = gl_TexCoord[0].xy;
+            vec4 sum = bright(position) * 0.227027;
+            sum += (bright(position + direction * 1.384615) + bright(position - direction * 1.384615)) * 0.316216;
+            sum += (bright(position + direction * 3.230769) + bright(position - direction * 3.230769)) * 0.070270;
+            gl_FragColor = vec4(sum.rgb, 1.0);
+        })"};
+
+    static constexpr const char *compositeSource{R"(
+        uniform sampler2D scene;
+        uniform sampler2D bloom;
+        uniform float bloomStrength;
+        uniform float crt;
+        uniform float lines;
+
+        void main()
+        {
+            vec2 position = gl_TexCoord[0].xy;
+            vec2 centered = position * 2.0 - 1.0;
+            centered *= 1.0 + dot(centered.yx, centered.yx) * 0.04 * crt;
+            position = centered * 0.5 + 0.5;
+
+            vec3 color = texture2D(scene, position).rgb + texture2D(bloom, position).rgb * bloomStrength;
+            float scanline = 0.8 + 0.2 * sin(position.y * lines * 3.141593);
+            color *= mix(1.0, scanline * (1.0 - dot(centered, centered) * 0.15), crt);
+
+            bool outside = any(lessThan(position, vec2(0.0))) || any(greaterThan(position, vec2(1.0)));
+            gl_FragColor = outside ? vec4(0.0, 0.0, 0.0, 1.0) : vec4(color, 1.0);
+        })"};
+
+    Shader blurShader, compositeShader;
+    // Across into the first, down into the second.
+    RenderTexture blurTextures[2];
+    Sprite blurSprite;
+    bool loaded{false}, created{false};
+
+    // The shaders are only compiled the first time an effect is used.
+    bool load()
+    {
+        if (loaded)
+            return true;
+
+        if (!Shader::isAvailable())
+        {
+            cerr << "Can't post-process, shaders aren't supported" << endl;
+            return false;
+        }
+
+        if (!blurShader.loadFromMemory(blurSource, Shader::Fragment) ||
+            !compositeShader.loadFromMemory(compositeSource, Shader::Fragment))
+        {
+            cerr << "Can't compile the post-process shaders" << endl;
+            return false;
+        }
+
+        blurShader.setUniform("source", Shader::CurrentTexture);
+        compositeShader.setUniform("scene", Shader::CurrentTexture);
+        loaded = true;
+        return true;
+    }
+
+  public:
+    bool bloom{false}, crt{false};
+
+    bool isEnabled() const noexcept { return created && (bloom || crt); }
+
+    // For a scene texture of `mWidth` by `mHeight` pixels. False, and
+    // nothing changes, when the shaders or the textures can't be made.
+    bool create(unsigned mWidth, unsigned mHeight)
+    {
+        created = false;
+        if (!load())
+            return false;
+
+        const unsigned width{std::max(mWidth / bloomDivisor, 1u)}, height{std::max(mHeight / bloomDivisor, 1u)};
+        for (auto &texture : blurTextures)
+        {
+            if (texture.getSize() == Vector2u{width, height})
+                continue;
+
+            if (!texture.create(width, height))
+            {
+                cerr << "Can't create the bloom textures" << endl;
+                return false;
+            }
+            texture.setSmooth(true);
+        }
+
+        compositeShader.setUniform("bloom", blurTextures[1].getTexture());
+        created = true;
+        return true;
+    }
+
+    // `mScene` is drawn into `mTarget` with the effects that are on.
+    void apply(const Sprite &mScene, RenderTarget &mTarget, FrameProfiler &mProfiler, RenderStats &mStats)
+    {
+        if (bloom)
+        {
+            const auto size(blurTextures[0].getSize());
+            {
+                ScopedTimer timer{mProfiler, PBlurX};
+                blurSprite.setTexture(*mScene.getTexture(), true);
+                blurSprite.setScale(static_cast<float>(size.x) / mScene.getTexture()->getSize().x,
+                                    static_cast<float>(size.y) / mScene.getTexture()->getSize().y);
+                blurShader.setUniform("direction", Glsl::Vec2{1.f / size.x, 0.f});
+                blurShader.setUniform("threshold", bloomThreshold);
+                blurTextures[0].draw(blurSprite, RenderStates{&blurShader});
+                blurTextures[0].display();
+                mStats.draw(4, 1);
+            }
+            {
+                ScopedTimer timer{mProfiler, PBlurY};
+                blurSprite.setTexture(blurTextures[0].getTexture(), true);
+                blurSprite.setScale(1.f, 1.f);
+                blurShader.setUniform("direction", Glsl::Vec2{0.f, 1.f / size.y});
+                blurShader.setUniform("threshold", 0.f);
+                blurTextures[1].draw(blurSprite, RenderStates{&blurShader});
+                blurTextures[1].display();
+                mStats.draw(4, 1);
+            }
+        }
+
+        ScopedTimer timer{mProfiler, PComposite};
+        compositeShader.setUniform("bloomStrength", bloom ? bloomStrength : 0.f);
+        compositeShader.setUniform("crt", crt ? 1.f : 0.f);
+        // A dark line every other line of the game, whatever the scale.
+        compositeShader.setUniform("lines", float{windowHeight});
+
+        mTarget.draw(mScene, RenderStates{&compositeShader});
+        mStats.draw(4, 1);
+    }
+};
+
+// Numbers drawn on top of the game, like the FPS. The digits are
+// rasterised once into an atlas of their own, from a font when there is
+// one and as seven segments otherwise, and every digit on screen is a
+// fixed quad of a single batch. Setting a number only rewrites the quads
+// of the digits that changed, there is no text layout like `sf::Text`
+// does for every new string.
+class Hud
+{
+  public:
+    static constexpr std::size_t maxDigits{8};
+
+  private:
+    // Right aligned on `position`, the top right corner, the leading
+    // slots stay blank.
+    struct Number
+    {
+        Vector2f position;
+        std::size_t firstQuad, digits;
+        std::uint32_t value;
+        // Digit shown by every slot, -1 for a blank one.
+        std::array<std::int8_t, maxDigits> shown;
+    };
+
+    TextureAtlas atlas;
+    // Regions of the atlas, added by the first `build`, the next ones
+    // only replace their images.
+    std::array<std::size_t, 10> regions;
+    std::array<FloatRect, 10> digitRects;
+    Vector2f cellSize;
+    RectangleBatch quads;
+    std::vector<Number> numbers;
+    bool built{false};
+
+    void setDigit(unsigned mDigit, const Image &mImage)
+    {
+        if (atlas.find("0") == TextureAtlas::npos)
+            for (unsigned i{0}; i < 10; ++i)
+                regions[i] = atlas.add(std::string(1, static_cast<char>('0' + i)), Image{});
+
+        atlas.setImage(regions[mDigit], mImage);
+    }
+
+    void setSlot(const Number &mNumber, std::size_t mSlot, std::int8_t mDigit)
+    {
+        const Vector2f halfSize{cellSize / 2.f};
+        const Vector2f center{mNumber.position.x - (mNumber.digits - mSlot) * cellSize.x + halfSize.x,
+                             mNumber.position.y + halfSize.y};
+
+        // A blank slot is collapsed to a point.
+        if (mDigit < 0)
+            quads.set(mNumber.firstQuad + mSlot, center, Vector2f{}, Color::Transparent);
+        else
+            quads.set(mNumber.firstQuad + mSlot, center, halfSize, Color::White, digitRects[mDigit]);
+    }
+
+    void write(Number &mNumber, bool mAll)
+    {
+        auto value(mNumber.value);
+        for (auto slot(mNumber.digits); slot-- > 0;)
+        {
+            const std::int8_t digit{value == 0 && slot + 1 < mNumber.digits ? std::int8_t{-1}
+                                                                           : static_cast<std::int8_t>(value % 10)};
+            value /= 10;
+
+            if (mAll || digit != mNumber.shown[slot])
+                setSlot(mNumber, slot, digit);
+            mNumber.shown[slot] = digit;
+        }
+    }
+
+    // Segments of every digit, bit 0 is the top one, then clockwise, the
+    // middle one is bit 6.
+    static Image segmentDigit(unsigned mDigit, unsigned mWidth, unsigned mHeight)
+    {
+        static constexpr std::uint8_t segments[10]{0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
+        constexpr unsigned thickness{2}, margin{1};
+
+        Image image;
+        image.create(mWidth, mHeight, Color::Transparent);
+        auto fill([&image](unsigned mLeft, unsigned mTop, unsigned mRight, unsigned mBottom) {
+            for (auto y(mTop); y < mBottom; ++y)
+                for (auto x(mLeft); x < mRight; ++x)
+                    image.setPixel(x, y, Color::White);
+        });
+
+        const unsigned left{margin}, right{mWidth - margin}, top{margin}, bottom{mHeight - margin};
+        const unsigned middle{mHeight / 2};
+        const auto bits(segments[mDigit]);
+        if (bits & 0x01) fill(left, top, right, top + thickness);
+        if (bits & 0x02) fill(right - thickness, top, right, middle + 1);
+        if (bits & 0x04) fill(right - thickness, middle, right, bottom);
+        if (bits & 0x08) fill(left, bottom - thickness, right, bottom);
+        if (bits & 0x10) fill(left, middle, left + thickness, bottom);
+        if (bits & 0x20) fill(left, top, left + thickness, middle + 1);
+        if (bits & 0x40) fill(left, middle - thickness / 2, right, middle - thickness / 2 + thickness);
+
+        return image;
+    }
+
+  public:
+    // The digits, once `build` succeeded, are drawn with the texture of
+    // the batch.
+    const RectangleBatch &getQuads() const noexcept { return quads; }
+    bool isBuilt() const noexcept { return built; }
+
+    // `mDigits` slots left of `mPosition`, the top right corner of the
+    // number. Returns the index to `set` the number with.
+    std::size_t addNumber(const Vector2f &mPosition, std::size_t mDigits)
+    {
+        assert(mDigits > 0 && mDigits <= maxDigits);
+
+        Number number{mPosition, quads.getQuadCount(), mDigits, 0, {}};
+        number.shown.fill(-1);
+        for (std::size_t i{0}; i < mDigits; ++i)
+            quads.add();
+
+        numbers.emplace_back(number);
+        if (built)
+            write(numbers.back(), true);
+
+        return numbers.size() - 1;
+    }
+
+    // Values that don't fit show their lowest digits.
+    void set(std::size_t mNumber, std::uint32_t mValue)
+    {
+        auto &number(numbers[mNumber]);
+        if (number.value == mValue)
+            return;
+
+        number.value = mValue;
+        if (built)
+            write(number, false);
+    }
+
+    // Rasterise the digits, from `mFont` when it isn't null. Can be
+    // called again, e.g. once a font finished loading.
+    bool build(const Font *mFont, unsigned mCharacterSize = 20)
+    {
+        if (mFont != nullptr)
+        {
+            // Every digit gets a cell of the same size, with the glyph at
+            // its place on the baseline, so the digits line up.
+            float ascent{0.f}, width{0.f};
+            for (unsigned i{0}; i < 10; ++i)
+            {
+                const auto &glyph(mFont->getGlyph('0' + i, mCharacterSize, false));
+                ascent = std::max(ascent, -glyph.bounds.top);
+                width = std::max(width, glyph.advance);
+            }
+
+            const auto page(mFont->getTexture(mCharacterSize).copyToImage());
+            cellSize = Vector2f{std::ceil(width), std::ceil(ascent) + 1.f};
+            for (unsigned i{0}; i < 10; ++i)
+            {
+                const auto &glyph(mFont->getGlyph('0' + i, mCharacterSize, false));
+                Image image;
+                image.create(static_cast<unsigned>(cellSize.x), static_cast<unsigned>(cellSize.y), Color::Transparent);
+                image.copy(page, static_cast<unsigned>(std::max(0.f, glyph.bounds.left)),
+                           static_cast<unsigned>(std::max(0.f, ascent + glyph.bounds.top)), glyph.textureRect);
+                setDigit(i, image);
+            }
+        }
+        else
+        {
+            cellSize = Vector2f{std::round(mCharacterSize * 0.6f), static_cast<float>(mCharacterSize)};
+            for (unsigned i{0}; i < 10; ++i)
+                setDigit(i, segmentDigit(i, static_cast<unsigned>(cellSize.x), static_cast<unsigned>(cellSize.y)));
+        }
+
+        built = atlas.build(256);
+        if (!built)
+            return false;
+
+        for (unsigned i{0}; i < 10; ++i)
+            digitRects[i] = atlas.getTextureRect(regions[i]);
+        quads.texture = &atlas.getTexture();
+
+        for (auto &number : numbers)
+            write(number, true);
+
+        return true;
+    }
+};
+
+// Entity inspector, over the right side of the game: the entities of
+// every group, the components of every type and how full their pools
+// are, with a row for the entity pool and its holes. Clicking an entity
+// shows its slot, position, velocity and size. The counts are kept by the
+// pools and the group vectors as entities come and go, a rebuild only
+// reads them, it never goes through the entities.
+class Inspector : public Drawable
+{
+  private:
+    static constexpr float rowHeight{14.f}, margin{4.f}, barWidth{96.f}, digitWidth{7.f};
+    static constexpr float left{windowWidth - 256.f}, top{40.f};
+    static constexpr float barLeft{left + 154.f};
+    // Velocities are shown in pixels per second.
+    static constexpr float velocityScale{1000.f};
+
+    enum SelectionNumber : std::size_t
+    {
+        SIndex,
+        SX,
+        SY,
+        SVelocityX,
+        SVelocityY,
+        SWidth,
+        SHeight,
+        SCount
+    };
+
+    VertexArray vertices{Quads};
+    Hud numbers, selectionNumbers;
+    std::vector<std::size_t> groupNumbers;
+    // Count, slots and capacity of every component pool, then of the
+    // entity pool.
+    std::vector<std::array<std::size_t, 3>> poolNumbers;
+    std::array<std::size_t, SCount> selectionIndices;
+    float selectionTop{0.f};
+    bool selected{false};
+
+    void addQuad(float mLeft, float mTop, float mRight, float mBottom, const Color &mColor)
+    {
+        vertices.append(Vertex{Vector2f{mLeft, mTop}, mColor});
+        vertices.append(Vertex{Vector2f{mRight, mTop}, mColor});
+        vertices.append(Vertex{Vector2f{mRight, mBottom}, mColor});
+        vertices.append(Vertex{Vector2f{mLeft, mBottom}, mColor});
+    }
+
+    float rowTop(std::size_t mRow) const noexcept { return top + margin + mRow * rowHeight; }
+
+    // Right edges of the columns: ID, count, slots and capacity.
+    static float column(std::size_t mColumn) noexcept { return left + 21.f + mColumn * 42.f; }
+
+    // Used slots are green, holes red, the rest of the capacity grey.
+    void addOccupancy(float mY, const PoolStats &mStats)
+    {
+        if (mStats.capacity == 0)
+            return;
+
+        const float scale{barWidth / mStats.capacity};
+        addQuad(barLeft, mY, barLeft + barWidth, mY + 8.f, Color{60, 60, 60});
+        addQuad(barLeft, mY, barLeft + mStats.count * scale, mY + 8.f, Color{0, 160, 0});
+        addQuad(barLeft + mStats.count * scale, mY, barLeft + mStats.slots * scale, mY + 8.f, Color::Red);
+    }
+
+    void setPool(std::size_t mRow, const PoolStats &mStats)
+    {
+        numbers.set(poolNumbers[mRow][0], static_cast<std::uint32_t>(mStats.count));
+        numbers.set(poolNumbers[mRow][1], static_cast<std::uint32_t>(mStats.slots));
+        numbers.set(poolNumbers[mRow][2], static_cast<std::uint32_t>(mStats.capacity));
+    }
+
+    // Digits have no sign, a negative value gets a dash left of it.
+    void setSigned(SelectionNumber mNumber, float mValue)
+    {
+        auto value(static_cast<std::uint32_t>(std::abs(mValue) + 0.5f));
+        selectionNumbers.set(selectionIndices[mNumber], value);
+        if (mValue > -0.5f)
+            return;
+
+        float right{mNumber % 2 == 1 ? column(1) : column(3)};
+        for (; value > 0; value /= 10)
+            right -= digitWidth;
+
+        const float y{selectionTop + (mNumber + 1) / 2 * rowHeight + 5.f};
+        addQuad(right - 6.f, y, right - 1.f, y + 2.f, Color::White);
+    }
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        mTarget.draw(vertices, mStates);
+    }
+
+  public:
+    bool visible{false};
+
+    std::size_t getVertexCount() const noexcept { return vertices.getVertexCount(); }
+    const Hud &getNumbers() const noexcept { return numbers; }
+    // Only drawn while an entity is selected.
+    const Hud &getSelectionNumbers() const noexcept { return selectionNumbers; }
+    bool hasSelection() const noexcept { return selected; }
+
+    // A row for each of `mGroups` groups and `mComponentTypes` component
+    // types, then one for the entity pool. Needs a graphics context, for
+    // the digits.
+    bool build(std::size_t mGroups, std::size_t mComponentTypes)
+    {
+        std::size_t row{0};
+        for (std::size_t i{0}; i < mGroups; ++i, ++row)
+        {
+            numbers.set(numbers.addNumber(Vector2f{column(0), rowTop(row)}, 2), static_cast<std::uint32_t>(i));
+            groupNumbers.emplace_back(numbers.addNumber(Vector2f{column(1), rowTop(row)}, 5));
+        }
+
+        // The entity pool has no ID, its row is the last one.
+        for (std::size_t i{0}; i <= mComponentTypes; ++i, ++row)
+        {
+            if (i < mComponentTypes)
+                numbers.set(numbers.addNumber(Vector2f{column(0), rowTop(row)}, 2), static_cast<std::uint32_t>(i));
+
+            poolNumbers.emplace_back(std::array<std::size_t, 3>{
+                {numbers.addNumber(Vector2f{column(1), rowTop(row)}, 5),
+                 numbers.addNumber(Vector2f{column(2), rowTop(row)}, 5),
+                 numbers.addNumber(Vector2f{column(3), rowTop(row)}, 5)}});
+        }
+
+        // The slot of the entity, then its position, velocity and size
+        // as pairs.
+        selectionTop = rowTop(row) + rowHeight;
+        selectionIndices[SIndex] = selectionNumbers.addNumber(Vector2f{column(1), selectionTop}, 5);
+        for (std::size_t i{SX}; i < SCount; ++i)
+        {
+            const float y{selectionTop + (i + 1) / 2 * rowHeight};
+            selectionIndices[i] = selectionNumbers.addNumber(Vector2f{i % 2 == 1 ? column(1) : column(3), y}, 5);
+        }
+
+        return numbers.build(nullptr, 12) && selectionNumbers.build(nullptr, 12);
+    }
+
+    // `mSelected` is the clicked entity, nullptr when there is none or it
+    // was destroyed since.
+    void rebuild(const Manager &mManager, const Entity *mSelected)
+    {
+        vertices.clear();
+
+        const auto poolRows(poolNumbers.size());
+        const float bottom{rowTop(groupNumbers.size() + poolRows) + (mSelected != nullptr ? 4 * rowHeight : 0.f)};
+        addQuad(left, top, windowWidth, bottom + margin, Color{0, 0, 0, 160});
+
+        // Groups are green, component types cyan and the entity pool
+        // yellow, on a mark left of their row.
+        for (std::size_t i{0}; i < groupNumbers.size(); ++i)
+        {
+            numbers.set(groupNumbers[i], static_cast<std::uint32_t>(mManager.getEntitiesByGroup(i).size()));
+            addQuad(left + margin, rowTop(i) + 2.f, left + margin + 4.f, rowTop(i) + 10.f, Color{0, 160, 0});
+        }
+
+        for (std::size_t i{0}; i < poolRows; ++i)
+        {
+            const auto y(rowTop(groupNumbers.size() + i));
+            const auto stats(i + 1 < poolRows ? mManager.getPoolStats(i) : mManager.getEntityPoolStats());
+            setPool(i, stats);
+            addQuad(left + margin, y + 2.f, left + margin + 4.f, y + 10.f,
+                    i + 1 < poolRows ? Color{0, 160, 160} : Color{200, 200, 0});
+            addOccupancy(y + 2.f, stats);
+        }
+
+        selected = mSelected != nullptr;
+        if (!selected)
+            return;
+
+        selectionNumbers.set(selectionIndices[SIndex], static_cast<std::uint32_t>(mSelected->getHandle().index));
+        if (mSelected->hasComponent<CPosition>())
+        {
+            const auto &cPosition(mSelected->getComponent<CPosition>());
+            setSigned(SX, toFloat(cPosition.x()));
+            setSigned(SY, toFloat(cPosition.y()));
+        }
+
+        if (mSelected->hasComponent<CPhysics>())
+        {
+            const auto &cPhysics(mSelected->getComponent<CPhysics>());
+            setSigned(SVelocityX, toFloat(cPhysics.velocity.x) * velocityScale);
+            setSigned(SVelocityY, toFloat(cPhysics.velocity.y) * velocityScale);
+            setSigned(SWidth, toFloat(cPhysics.halfSize.x) * 2.f);
+            setSigned(SHeight, toFloat(cPhysics.halfSize.y) * 2.f);
+        }
+    }
+};
+
+// Sound effects. The buffers are loaded once, through the asset cache,
+// and played through a fixed pool of voices (OpenAL sources), the oldest
+// voice is stolen when all are busy. The game only pushes requests into a
+// lock-free queue, the voices are started from the audio thread, so
+// `updatePhase` never waits on the audio device.
+class AudioEngine
+{
+  public:
+    enum SoundID : std::uint8_t
+    {
+        SPaddleHit,
+        SBrickHit,
+        SBrickBreak,
+        SCount
+    };
+
+  private:
+    static constexpr std::size_t voiceCount{16};
+
+    // Synthesized stand-ins, played until the files are loaded and in
+    // place of the missing ones.
+    std::array<SoundBuffer, SCount> fallbacks;
+    std::array<std::atomic<const SoundBuffer *>, SCount> buffers;
+    std::array<Sound, voiceCount> voices;
+    // When every voice was started, in requests played so far.
+    std::array<std::uint64_t, voiceCount> startedAt{};
+    std::uint64_t played{0};
+
+    SpscQueue<SoundID, 64> requests;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    // Short decaying tone, used when a sound file is missing.
+    static bool synthesize(SoundBuffer &mBuffer, float mFrequency, float mMilliseconds)
+    {
+        constexpr unsigned int sampleRate{44100};
+        std::vector<Int16> samples(static_cast<std::size_t>(sampleRate * mMilliseconds / 1000.f));
+
+        for (std::size_t i{0}; i < samples.size(); ++i)
+        {
+            const float t{static_cast<float>(i) / sampleRate};
+            const float envelope{1.f - static_cast<float>(i) / samples.size()};
+            samples[i] = static_cast<Int16>(std::sin(2.f * 3.14159265f * mFrequency * t) * envelope * 8000.f);
+        }
+
+        return mBuffer.loadFromSamples(samples.data(), samples.size(), 1, sampleRate);
+    }
+
+    void play(SoundID mSound)
+    {
+        std::size_t voice{0};
+        for (std::size_t i{0}; i < voiceCount; ++i)
+        {
+            if (voices[i].getStatus() == Sound::Stopped)
+            {
+                voice = i;
+                break;
+            }
+
+            if (startedAt[i] < startedAt[voice])
+                voice = i;
+        }
+
+        voices[voice].setBuffer(*buffers[mSound].load(std::memory_order_acquire));
+        voices[voice].play();
+        startedAt[voice] = ++played;
+    }
+
+    void run()
+    {
+        ARKANOID_THREAD("audio");
+
+        while (!stopping)
+        {
+            SoundID sound;
+            bool any{false};
+            while (requests.pop(sound))
+            {
+                play(sound);
+                any = true;
+            }
+
+            if (!any)
+                std::this_thread::sleep_for(chrono::milliseconds{2});
+        }
+    }
+
+  public:
+    // Sounds are read from `mDirectory`: paddle.wav, brick.wav and
+    // break.wav.
+    AudioEngine(AssetCache &mAssets, const std::string &mDirectory)
+    {
+        const char *files[SCount]{"paddle.wav", "brick.wav", "break.wav"};
+        const float frequencies[SCount]{440.f, 660.f, 990.f};
+
+        for (std::size_t i{0}; i < SCount; ++i)
+        {
+            synthesize(fallbacks[i], frequencies[i], i == SBrickBreak ? 120.f : 50.f);
+            buffers[i] = &fallbacks[i];
+
+            mAssets.onLoaded(mAssets.load<SoundBuffer>(mDirectory + "/" + files[i]), [this, i](const SoundBuffer *mSound) {
+                if (mSound != nullptr)
+                    buffers[i].store(mSound, std::memory_order_release);
+            });
+        }
+
+        thread = std::thread{[this] { run(); }};
+    }
+
+    AudioEngine(const AudioEngine &) = delete;
+    AudioEngine &operator=(const AudioEngine &) = delete;
+
+    ~AudioEngine()
+    {
+        stopping = true;
+        thread.join();
+    }
+
+    // Never blocks, the request is dropped when the queue is full.
+    void request(SoundID mSound) noexcept { requests.push(mSound); }
+};
+
+// Music track streamed from disk in chunks of `bufferFrames` frames, so
+// tracks are never loaded whole. The first chunk is read by `open`, which
+// makes the track ready to play without touching the file again.
+class MusicTrack : public SoundStream
+{
+  private:
+    InputSoundFile file;
+    std::vector<Int16> samples;
+    // Samples of `samples` already read by `open` and not played yet.
+    std::size_t prebuffered{0};
+
+    bool onGetData(Chunk &mData) override
+    {
+        std::size_t count{prebuffered};
+        prebuffered = 0;
+        if (count == 0)
+            count = static_cast<std::size_t>(file.read(samples.data(), samples.size()));
+
+        mData.samples = samples.data();
+        mData.sampleCount = count;
+
+        // Returning false at the end of the file rewinds it, tracks loop.
+        return count == samples.size();
+    }
+
+    void onSeek(Time mOffset) override
+    {
+        prebuffered = 0;
+        file.seek(mOffset);
+    }
+
+  public:
+    // An empty chunk would never end the stream, so there must be a frame
+    // per chunk at least, and the file must have some.
+    bool open(const std::string &mPath, std::size_t mBufferFrames)
+    {
+        if (mBufferFrames == 0)
+        {
+            cerr << "Music needs chunks of one frame at least" << endl;
+            return false;
+        }
+
+        if (!file.openFromFile(mPath))
+            return false;
+
+        samples.resize(mBufferFrames * file.getChannelCount());
+        prebuffered = static_cast<std::size_t>(file.read(samples.data(), samples.size()));
+        if (prebuffered == 0)
+        {
+            cerr << "No samples in " << mPath << endl;
+            return false;
+        }
+
+        initialize(file.getChannelCount(), file.getSampleRate());
+        setLoop(true);
+        return true;
+    }
+};
+
+// Plays one track at a time. A new track is opened and pre-buffered on a
+// loader thread, and only switched to once ready: the game loop never
+// waits on the file.
+class MusicPlayer
+{
+  private:
+    std::size_t bufferFrames;
+    std::unique_ptr<MusicTrack> current, next;
+    std::atomic<bool> nextReady{false};
+    // A held track waits for `release` once buffered.
+    bool held{false};
+    std::string currentPath, nextPath;
+    std::thread loader;
+
+    void switchTracks()
+    {
+        nextReady = false;
+        currentPath = std::move(nextPath);
+        nextPath.clear();
+
+        if (current != nullptr)
+            current->stop();
+
+        current = std::move(next);
+        current->play();
+    }
+
+  public:
+    // Chunks of a quarter of a second of 44.1 kHz audio by default.
+    MusicPlayer(std::size_t mBufferFrames = 11025) : bufferFrames{mBufferFrames} {}
+
+    MusicPlayer(const MusicPlayer &) = delete;
+    MusicPlayer &operator=(const MusicPlayer &) = delete;
+
+    ~MusicPlayer()
+    {
+        if (loader.joinable())
+            loader.join();
+    }
+
+    void setBufferFrames(std::size_t mBufferFrames) noexcept { bufferFrames = mBufferFrames; }
+
+    // Start loading `mPath`, `update` switches to it once buffered, or
+    // after `release` when `mHeld`.
+    void queue(const std::string &mPath, bool mHeld = false)
+    {
+        if (loader.joinable())
+            loader.join();
+
+        nextReady = false;
+        held = mHeld;
+        nextPath = mPath;
+        next.reset(new MusicTrack);
+        loader = std::thread{[this, mPath] {
+            if (next->open(mPath, bufferFrames))
+                nextReady = true;
+            else
+                cerr << "Can't read music " << mPath << endl;
+        }};
+    }
+
+    // Called every frame.
+    void update()
+    {
+        if (!nextReady || held)
+            return;
+
+        loader.join();
+        switchTracks();
+    }
+
+    // Switch to the held track now, waiting for it to be buffered.
+    void release()
+    {
+        held = false;
+        if (!loader.joinable())
+            return;
+
+        loader.join();
+        if (nextReady)
+            switchTracks();
+    }
+
+    // Play `mPath`, unless it already plays: right away when it was
+    // prepared, once buffered otherwise.
+    void play(const std::string &mPath)
+    {
+        if (mPath == currentPath)
+            return;
+
+        if (mPath == nextPath)
+            release();
+        else
+            queue(mPath);
+    }
+
+    // Buffer `mPath` ahead of a `play`, without replacing a track that is
+    // about to play.
+    void prepare(const std::string &mPath)
+    {
+        if (mPath == currentPath || mPath == nextPath || (!nextPath.empty() && !held))
+            return;
+
+        queue(mPath, true);
+    }
+};
+
+// Measures how long a key press or release takes to reach the screen: from
+// the `inputPhase` that first sees the transition to the end of the
+// `display()` of the first frame drawn after the paddle velocity changed.
+class LatencyProbe
+{
+  public:
+    using Clock = chrono::high_resolution_clock;
+
+  private:
+    Clock::time_point transition;
+    bool waiting{false}, applied{false};
+    // Written by whichever thread displays the frames.
+    std::mutex mutex;
+    std::vector<FrameTime> samples;
+
+  public:
+    // A transition seen while the previous one isn't on screen yet is
+    // measured from the previous one.
+    void keyChanged()
+    {
+        if (waiting)
+            return;
+
+        transition = Clock::now();
+        waiting = true;
+        applied = false;
+    }
+
+    void velocityChanged() noexcept
+    {
+        if (waiting)
+            applied = true;
+    }
+
+    // Time of the transition the next drawn frame shows, or a default time
+    // point when there is none.
+    Clock::time_point takeApplied() noexcept
+    {
+        if (!applied)
+            return Clock::time_point{};
+
+        waiting = applied = false;
+        return transition;
+    }
+
+    void displayed(Clock::time_point mTransition)
+    {
+        if (mTransition == Clock::time_point{})
+            return;
+
+        const FrameTime latency{chrono::duration_cast<chrono::duration<float, milli>>(Clock::now() - mTransition).count()};
+
+        std::lock_guard<std::mutex> lock{mutex};
+        samples.emplace_back(latency);
+    }
+
+    void report()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (samples.empty())
+        {
+            std::printf("no input latency samples\n");
+            return;
+        }
+
+        std::vector<FrameTime> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile([&sorted](float mPercent) { return sorted[static_cast<std::size_t>(mPercent * (sorted.size() - 1))]; });
+
+        std::printf("%zu transitions, input to display p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+                    sorted.size(), percentile(0.5f), percentile(0.95f), percentile(0.99f), sorted.back());
+    }
+};
+
+// Everything needed to draw one frame, copied out of the game so it can be
+// drawn while the next steps are simulated.
+struct RenderFrame : Drawable
+{
+    const CircleMesh *circleMesh{nullptr};
+    // In the arena the frame was published with, see `DoubleFrameArena`.
+    const CircleInstance *circles{nullptr};
+    std::size_t circleCount{0};
+    RectangleBatch rectangles, sprites, bricks, hud;
+    KinematicLayer kinematicBricks;
+    VertexArray chaosVertices{Points}, particleVertices{Quads};
+    ProfilerOverlay profilerOverlay;
+    // `view` for the game, `screenView` for the overlays, both drawn into
+    // `viewport` of the window.
+    View view, screenView;
+    FloatRect viewport{0.f, 0.f, 1.f, 1.f};
+    // Passed to `latencyProbe` once the frame is displayed.
+    LatencyProbe *latencyProbe{nullptr};
+    LatencyProbe::Clock::time_point inputTransition;
+
+    void draw(RenderTarget &mTarget, RenderStates mStates) const override
+    {
+        View framed{view};
+        framed.setViewport(viewport);
+        mTarget.setView(framed);
+
+        for (std::size_t i{0}; i < circleCount; ++i)
+            mTarget.draw(*circleMesh, circles[i].getStates(mStates));
+
+        mTarget.draw(rectangles, mStates);
+        mTarget.draw(sprites, mStates);
+        mTarget.draw(bricks, mStates);
+        mTarget.draw(kinematicBricks, mStates);
+
+        if (chaosVertices.getVertexCount() > 0)
+            mTarget.draw(chaosVertices, mStates);
+
+        if (particleVertices.getVertexCount() > 0)
+            mTarget.draw(particleVertices, mStates);
+
+        framed = screenView;
+        framed.setViewport(viewport);
+        mTarget.setView(framed);
+
+        if (profilerOverlay.visible)
+            mTarget.draw(profilerOverlay, mStates);
+
+        mTarget.draw(hud, mStates);
+    }
+
+    // What `draw` is going to send.
+    void count(RenderStats &mStats) const noexcept
+    {
+        for (std::size_t i{0}; i < circleCount; ++i)
+            mStats.draw(circleMesh->getVertexCount());
+
+        mStats.draw(rectangles.getQuadCount() * 4, rectangles.getQuadCount());
+        mStats.draw(sprites.getQuadCount() * 4, sprites.getQuadCount());
+        mStats.draw(bricks.getQuadCount() * 4, bricks.getQuadCount());
+        for (const auto &batch : kinematicBricks.batches)
+            mStats.draw(batch.getQuadCount() * 4, batch.getQuadCount());
+
+        // Only the batches can have a texture.
+        const Texture *previous{nullptr};
+        for (auto texture : {rectangles.texture, sprites.texture, bricks.texture})
+        {
+            mStats.textureSwitches += texture != previous;
+            previous = texture;
+        }
+        mStats.textureSwitches += previous != nullptr;
+
+        if (chaosVertices.getVertexCount() > 0)
+            mStats.draw(chaosVertices.getVertexCount(), chaosVertices.getVertexCount());
+
+        if (particleVertices.getVertexCount() > 0)
+            mStats.draw(particleVertices.getVertexCount(), particleVertices.getVertexCount() / 4);
+
+        if (profilerOverlay.visible)
+            mStats.draw(profilerOverlay.getVertexCount());
+
+        mStats.draw(hud.getQuadCount() * 4, hud.getQuadCount());
+        mStats.textureSwitches += hud.texture != nullptr;
+    }
+};
+
+#ifdef ARKANOID_GL_INSTANCING
+// Alternative to drawing the rectangle batch and the circles through SFML:
+// every rectangle and circle is an instance of one unit quad, drawn with a
+// single instanced call each. The rectangle instances stay on the GPU and
+// only the quads the batch marks as dirty are uploaded again. Needs OpenGL
+// 3.3 or ARB_instanced_arrays, `init` fails without them.
+class InstancedRenderer
+{
+  private:
+    // OpenGL 1.1 headers only, the rest is loaded at runtime.
+    using GlSizeiptr = std::ptrdiff_t;
+    using GlIntptr = std::ptrdiff_t;
+    static constexpr GLenum arrayBuffer{0x8892}, dynamicDraw{0x88E8}, staticDraw{0x88E4};
+    static constexpr GLenum vertexShader{0x8B31}, fragmentShader{0x8B30};
+    static constexpr GLenum compileStatus{0x8B81}, linkStatus{0x8B82};
+
+    struct Functions
+    {
+        GLuint(ARKANOID_GLAPI *createShader)(GLenum);
+        void(ARKANOID_GLAPI *shaderSource)(GLuint, GLsizei, const char *const *, const GLint *);
+        void(ARKANOID_GLAPI *compileShader)(GLuint);
+        void(ARKANOID_GLAPI *getShaderiv)(GLuint, GLenum, GLint *);
+        void(ARKANOID_GLAPI *deleteShader)(GLuint);
+        GLuint(ARKANOID_GLAPI *createProgram)();
+        void(ARKANOID_GLAPI *attachShader)(GLuint, GLuint);
+        void(ARKANOID_GLAPI *bindAttribLocation)(GLuint, GLuint, const char *);
+        void(ARKANOID_GLAPI *linkProgram)(GLuint);
+        void(ARKANOID_GLAPI *getProgramiv)(GLuint, GLenum, GLint *);
+        void(ARKANOID_GLAPI *useProgram)(GLuint);
+        GLint(ARKANOID_GLAPI *getUniformLocation)(GLuint, const char *);
+        void(ARKANOID_GLAPI *uniform1f)(GLint, GLfloat);
+        void(ARKANOID_GLAPI *uniform4f)(GLint, GLfloat, GLfloat, GLfloat, GLfloat);
+        void(ARKANOID_GLAPI *genBuffers)(GLsizei, GLuint *);
+        void(ARKANOID_GLAPI *bindBuffer)(GLenum, GLuint);
+        void(ARKANOID_GLAPI *bufferData)(GLenum, GlSizeiptr, const void *, GLenum);
+        void(ARKANOID_GLAPI *bufferSubData)(GLenum, GlIntptr, GlSizeiptr, const void *);
+        void(ARKANOID_GLAPI *enableVertexAttribArray)(GLuint);
+        void(ARKANOID_GLAPI *disableVertexAttribArray)(GLuint);
+        void(ARKANOID_GLAPI *vertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *);
+        void(ARKANOID_GLAPI *vertexAttribDivisor)(GLuint, GLuint);
+        void(ARKANOID_GLAPI *drawArraysInstanced)(GLenum, GLint, GLsizei, GLsizei);
+    };
+
+    // Per instance data, the same layout for rectangles and circles.
+    struct Instance
+    {
+        float centerX, centerY, halfWidth, halfHeight;
+        std::uint8_t color[4];
+    };
+
+    // Attribute locations.
+    enum : GLuint
+    {
+        ACorner,
+        ACenter,
+        AHalfSize,
+        AColor
+    };
+
+    Functions gl{};
+    bool available{false};
+    GLuint program{0}, cornerBuffer{0}, rectangleBuffer{0}, circleBuffer{0};
+    GLint viewUniform{-1}, roundUniform{-1};
+    std::size_t rectangleCapacity{0}, circleCapacity{0};
+    std::vector<Instance> instances;
+
+    template <typename T>
+    bool load(T &mFunction, const char *mName, const char *mFallback = nullptr)
+    {
+        auto function(Context::getFunction(mName));
+        if (function == nullptr && mFallback != nullptr)
+            function = Context::getFunction(mFallback);
+
+        mFunction = reinterpret_cast<T>(function);
+        return mFunction != nullptr;
+    }
+
+    GLuint compile(GLenum mType, const char *mSource)
+    {
+        GLuint shader{gl.createShader(mType)};
+        gl.shaderSource(shader, 1, &mSource, nullptr);
+        gl.compileShader(shader);
+
+        GLint status{0};
+        gl.getShaderiv(shader, compileStatus, &status);
+        return status != 0 ? shader : 0;
+    }
+
+    static Instance fromQuad(const Vertex *mQuad)
+    {
+        const auto &topLeft(mQuad[0].position), &bottomRight(mQuad[2].position);
+        const auto &color(mQuad[0].color);
+
+        return Instance{(topLeft.x + bottomRight.x) / 2.f, (topLeft.y + bottomRight.y) / 2.f,
+                        (bottomRight.x - topLeft.x) / 2.f, (bottomRight.y - topLeft.y) / 2.f,
+                        {color.r, color.g, color.b, color.a}};
+    }
+
+    void bindInstances(GLuint mBuffer)
+    {
+        gl.bindBuffer(arrayBuffer, mBuffer);
+        gl.vertexAttribPointer(ACenter, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), nullptr);
+        gl.vertexAttribPointer(AHalfSize, 2, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                               reinterpret_cast<const void *>(2 * sizeof(float)));
+        gl.vertexAttribPointer(AColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance),
+                               reinterpret_cast<const void *>(4 * sizeof(float)));
+    }
+
+  public:
+    // Call with the window's context active.
+    bool init()
+    {
+        available = load(gl.createShader, "glCreateShader") && load(gl.shaderSource, "glShaderSource") &&
+                    load(gl.compileShader, "glCompileShader") && load(gl.getShaderiv, "glGetShaderiv") &&
+                    load(gl.deleteShader, "glDeleteShader") && load(gl.createProgram, "glCreateProgram") &&
+                    load(gl.attachShader, "glAttachShader") && load(gl.bindAttribLocation, "glBindAttribLocation") &&
+                    load(gl.linkProgram, "glLinkProgram") && load(gl.getProgramiv, "glGetProgramiv") &&
+                    load(gl.useProgram, "glUseProgram") && load(gl.getUniformLocation, "glGetUniformLocation") &&
+                    load(gl.uniform1f, "glUniform1f") && load(gl.uniform4f, "glUniform4f") &&
+                    load(gl.genBuffers, "glGenBuffers") && load(gl.bindBuffer, "glBindBuffer") &&
+                    load(gl.bufferData, "glBufferData") && load(gl.bufferSubData, "glBufferSubData") &&
+                    load(gl.enableVertexAttribArray, "glEnableVertexAttribArray") &&
+                    load(gl.disableVertexAttribArray, "glDisableVertexAttribArray") &&
+                    load(gl.vertexAttribPointer, "glVertexAttribPointer") &&
+                    load(gl.vertexAttribDivisor, "glVertexAttribDivisor", "glVertexAttribDivisorARB") &&
+                    load(gl.drawArraysInstanced, "glDrawArraysInstanced", "glDrawArraysInstancedARB");
+        if (!available)
+            return false;
+
+        // `view` is the left, top, width and height of the view. Circles
+        // discard what is outside the unit circle of the quad.
+        const char *vertexSource{"#version 120\n"
+                                 "attribute vec2 corner, center, halfSize;\n"
+                                 "attribute vec4 color;\n"
+                                 "uniform vec4 view;\n"
+                                 "varying vec2 local;\n"
+                                 "varying vec4 tint;\n"
+                                 "void main() {\n"
+                                 "    vec2 position = (center + corner * halfSize - view.xy) / view.zw;\n"
+                                 "    gl_Position = vec4(position.x * 2.0 - 1.0, 1.0 - position.y * 2.0, 0.0, 1.0);\n"
+                                 "    local = corner;\n"
+                                 "    tint = color;\n"
+                                 "}\n"};
+        const char *fragmentSource{"#version 120\n"
+                                   "uniform float round;\n"
+                                   "varying vec2 local;\n"
+                                   "varying vec4 tint;\n"
+                                   "void main() {\n"
+                                   "    if (round > 0.5 && dot(local, local) > 1.0) discard;\n"
+                                   "    gl_FragColor = tint;\n"
+                                   "}\n"};
+
+        GLuint vertex{compile(vertexShader, vertexSource)}, fragment{compile(fragmentShader, fragmentSource)};
+        available = vertex != 0 && fragment != 0;
+        if (available)
+        {
+            program = gl.createProgram();
+            gl.attachShader(program, vertex);
+            gl.attachShader(program, fragment);
+            gl.bindAttribLocation(program, ACorner, "corner");
+            gl.bindAttribLocation(program, ACenter, "center");
+            gl.bindAttribLocation(program, AHalfSize, "halfSize");
+            gl.bindAttribLocation(program, AColor, "color");
+            gl.linkProgram(program);
+
+            GLint status{0};
+            gl.getProgramiv(program, linkStatus, &status);
+            available = status != 0;
+        }
+
+        gl.deleteShader(vertex);
+        gl.deleteShader(fragment);
+        if (!available)
+            return false;
+
+        viewUniform = gl.getUniformLocation(program, "view");
+        roundUniform = gl.getUniformLocation(program, "round");
+
+        const float corners[]{-1.f, -1.f, 1.f, -1.f, 1.f, 1.f, -1.f, 1.f};
+        gl.genBuffers(1, &cornerBuffer);
+        gl.bindBuffer(arrayBuffer, cornerBuffer);
+        gl.bufferData(arrayBuffer, sizeof(corners), corners, staticDraw);
+
+        gl.genBuffers(1, &rectangleBuffer);
+        gl.genBuffers(1, &circleBuffer);
+        gl.bindBuffer(arrayBuffer, 0);
+        return true;
+    }
+
+    bool isAvailable() const noexcept { return available; }
+
+    // Draw `mRectangles` and `mCircles` seen through `mView`. Leaves the
+    // SFML states dirty, reset them before drawing through SFML again.
+    void draw(RectangleBatch &mRectangles, const std::vector<CircleInstance> &mCircles, const Color &mCircleColor,
+              const View &mView)
+    {
+        const auto quadCount(mRectangles.getQuadCount());
+
+        if (quadCount > rectangleCapacity)
+        {
+            // Grown: upload the whole batch again, with room to spare.
+            rectangleCapacity = std::max<std::size_t>(quadCount * 2, 1024);
+            instances.resize(quadCount);
+            for (std::size_t i{0}; i < quadCount; ++i)
+                instances[i] = fromQuad(mRectangles.getQuad(i));
+
+            gl.bindBuffer(arrayBuffer, rectangleBuffer);
+            gl.bufferData(arrayBuffer, rectangleCapacity * sizeof(Instance), nullptr, dynamicDraw);
+            gl.bufferSubData(arrayBuffer, 0, quadCount * sizeof(Instance), instances.data());
+        }
+        else if (mRectangles.getDirtyFirst() != mRectangles.getDirtyLast())
+        {
+            // Usually a few bricks broke, or only the paddle moved.
+            const auto first(mRectangles.getDirtyFirst()), last(std::min(quadCount, mRectangles.getDirtyLast()));
+            instances.resize(last - first);
+            for (auto i(first); i < last; ++i)
+                instances[i - first] = fromQuad(mRectangles.getQuad(i));
+
+            gl.bindBuffer(arrayBuffer, rectangleBuffer);
+            gl.bufferSubData(arrayBuffer, first * sizeof(Instance), instances.size() * sizeof(Instance),
+                             instances.data());
+        }
+        mRectangles.clearDirty();
+
+        // The circles move every frame, they are all uploaded.
+        instances.clear();
+        for (const auto &circle : mCircles)
+            instances.emplace_back(Instance{circle.position.x, circle.position.y, circle.radius, circle.radius,
+                                            {mCircleColor.r, mCircleColor.g, mCircleColor.b, mCircleColor.a}});
+
+        gl.bindBuffer(arrayBuffer, circleBuffer);
+        if (instances.size() > circleCapacity)
+        {
+            circleCapacity = std::max<std::size_t>(instances.size() * 2, 64);
+            gl.bufferData(arrayBuffer, circleCapacity * sizeof(Instance), nullptr, dynamicDraw);
+        }
+        gl.bufferSubData(arrayBuffer, 0, instances.size() * sizeof(Instance), instances.data());
+
+        gl.useProgram(program);
+        gl.uniform4f(viewUniform, mView.getCenter().x - mView.getSize().x / 2.f,
+                     mView.getCenter().y - mView.getSize().y / 2.f, mView.getSize().x, mView.getSize().y);
+
+        gl.bindBuffer(arrayBuffer, cornerBuffer);
+        gl.vertexAttribPointer(ACorner, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        for (GLuint attribute : {ACorner, ACenter, AHalfSize, AColor})
+            gl.enableVertexAttribArray(attribute);
+        for (GLuint attribute : {ACenter, AHalfSize, AColor})
+            gl.vertexAttribDivisor(attribute, 1);
+
+        // Removed quads are collapsed to a point, so they cover no pixel.
+        gl.uniform1f(roundUniform, 0.f);
+        bindInstances(rectangleBuffer);
+        gl.drawArraysInstanced(GL_QUADS, 0, 4, static_cast<GLsizei>(quadCount));
+
+        gl.uniform1f(roundUniform, 1.f);
+        bindInstances(circleBuffer);
+        gl.drawArraysInstanced(GL_QUADS, 0, 4, static_cast<GLsizei>(mCircles.size()));
+
+        for (GLuint attribute : {ACenter, AHalfSize, AColor})
+            gl.vertexAttribDivisor(attribute, 0);
+        for (GLuint attribute : {ACorner, ACenter, AHalfSize, AColor})
+            gl.disableVertexAttribArray(attribute);
+
+        gl.bindBuffer(arrayBuffer, 0);
+        gl.useProgram(0);
+    }
+};
+#endif
+
+// The time source of the game loop. Time is read in ticks of a monotonic
+// clock, `high_resolution_clock` is the system clock on some platforms and
+// jumps when it is set, and is added up as doubles: a float of
+// milliseconds stops counting 16 ms frames exactly after a few hours.
+// Replays and tests can give it a source of their own. Pausing and the
+// time scale change how fast the game time goes, the frame time stays
+// the real one.
+class FrameClock
+{
+  public:
+    using Clock = chrono::steady_clock;
+    // Nanoseconds.
+    using Ticks = std::int64_t;
+    using Source = std::function<Ticks()>;
+
+  private:
+    Source source;
+    Ticks lastTicks{0};
+    double frameTime{0.0}, gameDelta{0.0};
+    double realTime{0.0}, gameTime{0.0};
+    double timeScale{1.0};
+    bool paused{false};
+
+  public:
+    FrameClock() { setSource(nullptr); }
+
+    static Ticks getSteadyTicks() noexcept
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    // Null for the steady clock. The next frame starts from the new
+    // source's current time.
+    void setSource(Source mSource)
+    {
+        source = mSource != nullptr ? std::move(mSource) : Source{&FrameClock::getSteadyTicks};
+        lastTicks = source();
+    }
+
+    // Starts a new frame, returns the real milliseconds since the last one.
+    double tick()
+    {
+        const auto ticks(source());
+        frameTime = (ticks - lastTicks) / 1e6;
+        lastTicks = ticks;
+
+        gameDelta = paused ? 0.0 : frameTime * timeScale;
+        realTime += frameTime;
+        gameTime += gameDelta;
+        return frameTime;
+    }
+
+    // Starts counting from now, without changing the totals.
+    void restart() { lastTicks = source(); }
+
+    void setPaused(bool mPaused) noexcept { paused = mPaused; }
+    bool isPaused() const noexcept { return paused; }
+
+    // 0.5 runs the game at half speed.
+    void setTimeScale(double mScale) noexcept { timeScale = mScale; }
+    double getTimeScale() const noexcept { return timeScale; }
+
+    // Of the last frame, in milliseconds, real and game time.
+    double getFrameTime() const noexcept { return frameTime; }
+    double getGameDelta() const noexcept { return gameDelta; }
+
+    // Since the clock was made, in milliseconds.
+    double getRealTime() const noexcept { return realTime; }
+    double getGameTime() const noexcept { return gameTime; }
+};
+
+// Decides when the next frame starts. `setFramerateLimit` sleeps with
+// millisecond granularity, so frames jitter around the limit; here the
+// wait sleeps until shortly before the deadline and spins the rest.
+//
+// The wait happens before input is sampled, right before the accumulator
+// is advanced, so the time from sampling to drawing doesn't depend on how
+// long the wait was.
+class FramePacer
+{
+  public:
+    enum class Mode
+    {
+        // `display()` blocks until the vertical blank.
+        VSync,
+        // Frames start every `1000 / rate` milliseconds.
+        Limit,
+        Uncapped
+    };
+
+  private:
+    using Clock = FrameClock::Clock;
+
+    // Sleeping can overshoot by about this much, the rest is spun.
+    static constexpr float spinMargin{1.5f};
+    static constexpr std::size_t refreshSamples{120};
+
+    Mode mode{Mode::Limit};
+    FrameTime interval{1000.f / 60.f};
+    Clock::time_point deadline{Clock::now()}, lastDisplay;
+    std::vector<FrameTime> displayIntervals;
+    float refreshRate{0.f};
+
+  public:
+    void setMode(RenderWindow &mWindow, Mode mMode, float mRate = 60.f)
+    {
+        mode = mMode;
+        interval = mRate > 0.f ? 1000.f / mRate : 0.f;
+        mWindow.setFramerateLimit(0);
+        mWindow.setVerticalSyncEnabled(mode == Mode::VSync);
+
+        deadline = Clock::now();
+        displayIntervals.clear();
+        refreshRate = 0.f;
+    }
+
+    Mode getMode() const noexcept { return mode; }
+
+    // Refresh rate of the display measured from the vsync'd frames, zero
+    // until enough of them were seen.
+    float getRefreshRate() const noexcept { return refreshRate; }
+
+    void wait()
+    {
+        if (mode != Mode::Limit)
+            return;
+
+        deadline += chrono::duration_cast<Clock::duration>(chrono::duration<float, milli>{interval});
+
+        // Don't catch up with frames that are already late.
+        auto now(Clock::now());
+        if (deadline < now)
+        {
+            deadline = now;
+            return;
+        }
+
+        const auto margin(chrono::duration_cast<Clock::duration>(chrono::duration<float, milli>{spinMargin}));
+        if (deadline - now > margin)
+            std::this_thread::sleep_until(deadline - margin);
+
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+    }
+
+    // Called after `display()`. With vsync its intervals are the refresh
+    // period, the median of the first ones is kept as the refresh rate.
+    void frameDisplayed()
+    {
+        auto now(Clock::now());
+        if (mode == Mode::VSync && refreshRate == 0.f && lastDisplay != Clock::time_point{})
+        {
+            displayIntervals.emplace_back(chrono::duration_cast<chrono::duration<float, milli>>(now - lastDisplay).count());
+            if (displayIntervals.size() == refreshSamples)
+            {
+                auto middle(std::begin(displayIntervals) + refreshSamples / 2);
+                std::nth_element(std::begin(displayIntervals), middle, std::end(displayIntervals));
+                refreshRate = *middle > 0.f ? 1000.f / *middle : 0.f;
+                displayIntervals.clear();
+            }
+        }
+
+        lastDisplay = now;
+    }
+};
+
+// Screenshots and recordings of the window, without waiting for the GPU
+// like `RenderWindow::capture` does. A frame is read into one of `delay`
+// pixel buffer objects, the GPU copies it there while the next frames are
+// drawn, and the buffer is only mapped `delay` frames later, when the copy
+// is long done. The pixels then go to threads that write them as PNG
+// files. The game doesn't wait for them either: when every image is still
+// being written, the frame is dropped and counted.
+class FrameCapture
+{
+  private:
+    static constexpr std::size_t delay{3}, images{8};
+    static constexpr std::size_t maxPath{256};
+    using GlSizeiptr = std::ptrdiff_t;
+    static constexpr GLenum pixelPackBuffer{0x88EB}, streamRead{0x88E1}, readOnly{0x88B8};
+
+    struct Functions
+    {
+        void(ARKANOID_GLAPI *genBuffers)(GLsizei, GLuint *);
+        void(ARKANOID_GLAPI *bindBuffer)(GLenum, GLuint);
+        void(ARKANOID_GLAPI *bufferData)(GLenum, GlSizeiptr, const void *, GLenum);
+        void *(ARKANOID_GLAPI *mapBuffer)(GLenum, GLenum);
+        GLboolean(ARKANOID_GLAPI *unmapBuffer)(GLenum);
+        void(ARKANOID_GLAPI *readPixels)(GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void *);
+    };
+
+    // A frame read into a buffer, empty paths for free buffers.
+    struct Pending
+    {
+        GLuint buffer{0};
+        std::array<char, maxPath> path{};
+    };
+
+    // Bottom-up pixels, the way OpenGL reads them.
+    struct Encoding
+    {
+        std::vector<std::uint8_t> pixels;
+        Vector2u size;
+        std::array<char, maxPath> path{};
+    };
+
+    Functions gl{};
+    bool initialized{false}, available{false};
+    std::array<Pending, delay> pending;
+    std::size_t next{0};
+    Vector2u size;
+
+    std::array<Encoding, images> encoded;
+    // Indices into `encoded`, of the images to write and of the free ones.
+    std::deque<std::size_t> queued, free;
+    std::mutex mutex;
+    std::condition_variable imageQueued;
+    std::vector<std::thread> encoders;
+    bool stopping{false};
+
+    bool recording{false}, screenshotRequested{false};
+    std::string recordingPrefix;
+    unsigned recordedFrames{0}, screenshots{0};
+    std::size_t dropped{0};
+
+    template <typename T>
+    bool load(T &mFunction, const char *mName, const char *mFallback = nullptr)
+    {
+        auto function(Context::getFunction(mName));
+        if (function == nullptr && mFallback != nullptr)
+            function = Context::getFunction(mFallback);
+
+        mFunction = reinterpret_cast<T>(function);
+        return mFunction != nullptr;
+    }
+
+    // With the window's context active, the first time something is
+    // captured.
+    bool init()
+    {
+        if (initialized)
+            return available;
+
+        initialized = true;
+        available = load(gl.genBuffers, "glGenBuffers", "glGenBuffersARB") &&
+                    load(gl.bindBuffer, "glBindBuffer", "glBindBufferARB") &&
+                    load(gl.bufferData, "glBufferData", "glBufferDataARB") &&
+                    load(gl.mapBuffer, "glMapBuffer", "glMapBufferARB") &&
+                    load(gl.unmapBuffer, "glUnmapBuffer", "glUnmapBufferARB") && load(gl.readPixels, "glReadPixels");
+        if (!available)
+        {
+            cerr << "Can't capture the window, pixel buffer objects aren't supported" << endl;
+            return false;
+        }
+
+        for (auto &frame : pending)
+            gl.genBuffers(1, &frame.buffer);
+
+        for (std::size_t i{0}; i < images; ++i)
+            free.emplace_back(i);
+
+        const auto threads(std::max(std::thread::hardware_concurrency() / 2, 1u));
+        for (auto i(0u); i < threads; ++i)
+            encoders.emplace_back([this] { encode(); });
+        return true;
+    }
+
+    void encode()
+    {
+        ARKANOID_THREAD("capture");
+        Image image;
+
+        while (true)
+        {
+            std::size_t index;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                imageQueued.wait(lock, [this] { return stopping || !queued.empty(); });
+                // The queued images are still written when stopping.
+                if (queued.empty())
+                    return;
+
+                index = queued.front();
+                queued.pop_front();
+            }
+
+            auto &frame(encoded[index]);
+            image.create(frame.size.x, frame.size.y, frame.pixels.data());
+            image.flipVertically();
+            if (!image.saveToFile(frame.path.data()))
+                cerr << "Can't write " << frame.path.data() << endl;
+
+            std::lock_guard<std::mutex> lock{mutex};
+            free.emplace_back(index);
+        }
+    }
+
+    // The frame read `delay` frames ago, if any, goes to the encoders.
+    void collect(Pending &mFrame)
+    {
+        if (mFrame.path[0] == '\0')
+            return;
+
+        std::size_t index{images};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (!free.empty())
+            {
+                index = free.front();
+                free.pop_front();
+            }
+        }
+
+        gl.bindBuffer(pixelPackBuffer, mFrame.buffer);
+        const std::uint8_t *pixels{nullptr};
+        if (index < images)
+            pixels = static_cast<const std::uint8_t *>(gl.mapBuffer(pixelPackBuffer, readOnly));
+        if (pixels != nullptr)
+        {
+            auto &image(encoded[index]);
+            image.pixels.assign(pixels, pixels + std::size_t{size.x} * size.y * 4);
+            image.size = size;
+            image.path = mFrame.path;
+            gl.unmapBuffer(pixelPackBuffer);
+
+            std::lock_guard<std::mutex> lock{mutex};
+            queued.emplace_back(index);
+            imageQueued.notify_one();
+        }
+        else
+        {
+            ++dropped;
+            if (index < images)
+            {
+                std::lock_guard<std::mutex> lock{mutex};
+                free.emplace_back(index);
+            }
+        }
+
+        mFrame.path[0] = '\0';
+    }
+
+  public:
+    FrameCapture() = default;
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    ~FrameCapture()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        imageQueued.notify_all();
+        for (auto &encoder : encoders)
+            encoder.join();
+
+        if (dropped > 0)
+            cerr << dropped << " captured frames were dropped" << endl;
+    }
+
+    bool isRecording() const noexcept { return recording; }
+
+    // The next frame goes to "screenshot-<time>-<n>.png".
+    void screenshot() noexcept { screenshotRequested = true; }
+
+    // Every frame goes to "<prefix>000000.png", "<prefix>000001.png"...
+    void startRecording(const std::string &mPrefix)
+    {
+        recordingPrefix = mPrefix;
+        recordedFrames = 0;
+        recording = true;
+    }
+
+    void stopRecording() noexcept { recording = false; }
+
+    // After the frame is drawn, before `display`.
+    void update(const RenderWindow &mWindow)
+    {
+        if (!recording && !screenshotRequested && !initialized)
+            return;
+        if (!init())
+        {
+            recording = screenshotRequested = false;
+            return;
+        }
+
+        // A frame read at another size is dropped.
+        const auto windowSize(mWindow.getSize());
+        auto &frame(pending[next]);
+        if (windowSize == size)
+            collect(frame);
+        else if (frame.path[0] != '\0')
+        {
+            ++dropped;
+            frame.path[0] = '\0';
+        }
+
+        if (recording)
+            std::snprintf(frame.path.data(), maxPath, "%s%06u.png", recordingPrefix.c_str(), recordedFrames++);
+        else if (screenshotRequested)
+            std::snprintf(frame.path.data(), maxPath, "screenshot-%lld-%u.png",
+                          static_cast<long long>(std::time(nullptr)), screenshots++);
+        screenshotRequested = false;
+
+        if (frame.path[0] != '\0')
+        {
+            gl.bindBuffer(pixelPackBuffer, frame.buffer);
+            if (windowSize != size)
+            {
+                size = windowSize;
+                for (auto &other : pending)
+                {
+                    if (other.path[0] != '\0' && &other != &frame)
+                    {
+                        ++dropped;
+                        other.path[0] = '\0';
+                    }
+                    gl.bindBuffer(pixelPackBuffer, other.buffer);
+                    gl.bufferData(pixelPackBuffer, GlSizeiptr(size.x) * size.y * 4, nullptr, streamRead);
+                }
+                gl.bindBuffer(pixelPackBuffer, frame.buffer);
+            }
+
+            // Into the buffer, the GPU does the copy later on.
+            gl.readPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        gl.bindBuffer(pixelPackBuffer, 0);
+        next = (next + 1) % delay;
+    }
+};
+
+// Owns the window's OpenGL context and draws the frames published by the
+// simulation thread, so vsync and the frame limit in `display()` only ever
+// block this thread.
+//
+// Frames are double buffered: the simulation fills the back frame without
+// locking, and `publish` swaps it with the front one. The render thread
+// keeps the lock while it submits the front frame, but not while it waits
+// in `display()`.
+class RenderThread
+{
+  private:
+    RenderWindow &window;
+    std::array<RenderFrame, 2> frames;
+    std::size_t front{0};
+    bool fresh{false}, stopping{false};
+    std::mutex mutex;
+    std::condition_variable frameReady;
+    std::thread thread;
+
+    void run()
+    {
+        MemoryScope memoryScope{MRender};
+        ARKANOID_THREAD("render");
+        window.setActive(true);
+
+        while (true)
+        {
+            LatencyProbe *latencyProbe;
+            LatencyProbe::Clock::time_point inputTransition;
+
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                frameReady.wait(lock, [this] { return stopping || fresh; });
+                if (stopping)
+                    break;
+
+                ARKANOID_ZONE("draw frame");
+                window.clear(Color::Black);
+                window.draw(frames[front]);
+                fresh = false;
+
+                latencyProbe = frames[front].latencyProbe;
+                inputTransition = frames[front].inputTransition;
+            }
+
+            {
+                ARKANOID_ZONE("display");
+                window.display();
+            }
+
+            if (latencyProbe != nullptr)
+                latencyProbe->displayed(inputTransition);
+        }
+
+        window.setActive(false);
+    }
+
+  public:
+    RenderThread(RenderWindow &mWindow) : window(mWindow)
+    {
+        // A context can only be active in one thread at a time.
+        window.setActive(false);
+        thread = std::thread{[this] { run(); }};
+    }
+
+    RenderThread(const RenderThread &) = delete;
+    RenderThread &operator=(const RenderThread &) = delete;
+
+    ~RenderThread()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        frameReady.notify_one();
+        thread.join();
+
+        window.setActive(true);
+    }
+
+    // Only the simulation thread touches the back frame.
+    RenderFrame &getBackFrame() noexcept { return frames[1 - front]; }
+
+    void publish()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            front = 1 - front;
+            fresh = true;
+        }
+        frameReady.notify_one();
+    }
+};
+
+// Hash of the simulation state, cheap enough to update every step. The
+// words are mixed FNV-1a style into the hash of the steps before, so two
+// runs that differ once keep differing from that step on.
+class StateHash
+{
+  private:
+    std::uint64_t value{14695981039346656037ull};
+
+  public:
+    void add(std::uint32_t mWord) noexcept { value = (value ^ mWord) * 1099511628211ull; }
+    void add(Fixed mValue) noexcept { add(static_cast<std::uint32_t>(mValue.getRaw())); }
+
+    void add(float mValue) noexcept
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &mValue, sizeof(bits));
+        add(bits);
+    }
+
+    void add(const PhysicsVector &mVector) noexcept
+    {
+        add(mVector.x);
+        add(mVector.y);
+    }
+
+    // Folded to the 32 bits the recordings store.
+    std::uint32_t get() const noexcept { return static_cast<std::uint32_t>(value ^ (value >> 32)); }
+};
+
+// Input of every logic step of a session, plus what is needed to start the
+// same session again: the random seed and the step length. Steps with the
+// same input are stored as a single run, so a session is a few bytes per
+// key press or release. The state hash of every `hashInterval`th step is
+// stored too, a playback that doesn't reach the same state stops there.
+//
+// File layout, little endian:
+//   "ARKR" u8 version u32 seed f32 timeStep u32 runCount
+//   runCount x (u32 steps, u8 buttons, i8 axis)
+//   u32 hashInterval u32 hashCount hashCount x u32 hash
+class Replay
+{
+  private:
+    // Writes the same format, from a signal handler.
+    friend class FlightRecorder;
+
+    struct Run
+    {
+        std::uint32_t steps;
+        InputSnapshot input;
+    };
+
+    // Version 1 recordings have no gamepad axis, version 2 ones no hashes.
+    static constexpr std::uint8_t version{3};
+
+    std::uint32_t seed{0};
+    FrameTime timeStep{ftSlice};
+    std::vector<Run> runs;
+    // Playback position.
+    std::size_t currentRun{0};
+    std::uint32_t currentStep{0};
+
+    std::uint32_t hashInterval{16};
+    std::vector<std::uint32_t> hashes;
+    // Steps hashed so far, and the first step whose hash didn't match.
+    std::size_t hashedSteps{0};
+    std::size_t divergedStep{noStep};
+
+    static void write32(std::ostream &mStream, std::uint32_t mValue)
+    {
+        for (auto i(0u); i < 4; ++i)
+            mStream.put(static_cast<char>((mValue >> (i * 8)) & 0xFF));
+    }
+
+    static std::uint32_t read32(std::istream &mStream)
+    {
+        std::uint32_t value{0};
+        for (auto i(0u); i < 4; ++i)
+            value |= static_cast<std::uint32_t>(static_cast<unsigned char>(mStream.get())) << (i * 8);
+
+        return value;
+    }
+
+    // Bytes left after the read position, so that a count read from a
+    // corrupt file can be checked before anything is allocated for it.
+    static std::uint64_t remainingBytes(std::istream &mStream)
+    {
+        const auto position(mStream.tellg());
+        mStream.seekg(0, std::ios::end);
+        const auto end(mStream.tellg());
+        mStream.seekg(position);
+        return position < 0 || end < position ? 0 : static_cast<std::uint64_t>(end - position);
+    }
+
+  public:
+    static constexpr std::size_t noStep{std::numeric_limits<std::size_t>::max()};
+
+    Replay() = default;
+    Replay(std::uint32_t mSeed, FrameTime mTimeStep) : seed{mSeed}, timeStep{mTimeStep} {}
+
+    std::uint32_t getSeed() const noexcept { return seed; }
+    FrameTime getTimeStep() const noexcept { return timeStep; }
+    // `noStep` while the playback matches the recording.
+    std::size_t getDivergedStep() const noexcept { return divergedStep; }
+
+    std::size_t getStepCount() const noexcept
+    {
+        std::size_t steps{0};
+        for (const auto &run : runs)
+            steps += run.steps;
+
+        return steps;
+    }
+
+    void record(const InputSnapshot &mInput)
+    {
+        if (!runs.empty() && runs.back().input == mInput &&
+            runs.back().steps < std::numeric_limits<std::uint32_t>::max())
+        {
+            ++runs.back().steps;
+            return;
+        }
+
+        runs.emplace_back(Run{1, mInput});
+    }
+
+    // Input of the next step, returns false once the recording is over.
+    bool next(InputSnapshot &mInput) noexcept
+    {
+        while (currentRun < runs.size() && currentStep >= runs[currentRun].steps)
+        {
+            ++currentRun;
+            currentStep = 0;
+        }
+
+        if (currentRun >= runs.size())
+            return false;
+
+        mInput = runs[currentRun].input;
+        ++currentStep;
+        return true;
+    }
+
+    // For playbacks that only want the input.
+    void dropHashes() noexcept { hashes.clear(); }
+
+    // Once per recorded step, the hash of the state it ended in.
+    void recordHash(std::uint32_t mHash)
+    {
+        if (hashedSteps++ % hashInterval == 0)
+            hashes.emplace_back(mHash);
+    }
+
+    // Once per played step, compared with the recorded hash when there is
+    // one for it. False from the first step that doesn't match on, which
+    // diverged since the last hash that did.
+    bool verifyHash(std::uint32_t mHash) noexcept
+    {
+        const auto step(hashedSteps++);
+        if (divergedStep == noStep && step % hashInterval == 0 && step / hashInterval < hashes.size() &&
+            hashes[step / hashInterval] != mHash)
+            divergedStep = step;
+
+        return divergedStep == noStep;
+    }
+
+    bool save(const char *mPath) const
+    {
+        std::ofstream file{mPath, std::ios::binary};
+        file.write("ARKR", 4);
+        file.put(static_cast<char>(version));
+        write32(file, seed);
+
+        std::uint32_t timeStepBits;
+        std::memcpy(&timeStepBits, &timeStep, sizeof(timeStepBits));
+        write32(file, timeStepBits);
+
+        write32(file, static_cast<std::uint32_t>(runs.size()));
+        for (const auto &run : runs)
+        {
+            write32(file, run.steps);
+            file.put(static_cast<char>(run.input.buttons));
+            file.put(static_cast<char>(run.input.axis));
+        }
+
+        write32(file, hashInterval);
+        write32(file, static_cast<std::uint32_t>(hashes.size()));
+        for (auto hash : hashes)
+            write32(file, hash);
+
+        return static_cast<bool>(file);
+    }
+
+    bool load(const char *mPath)
+    {
+        std::ifstream file{mPath, std::ios::binary};
+        char magic[4];
+        if (!file.read(magic, 4) || std::memcmp(magic, "ARKR", 4) != 0)
+            return false;
+
+        const auto fileVersion(file.get());
+        if (fileVersion < 1 || fileVersion > version)
+            return false;
+
+        seed = read32(file);
+
+        auto timeStepBits(read32(file));
+        std::memcpy(&timeStep, &timeStepBits, sizeof(timeStep));
+
+        const std::uint64_t runSize{fileVersion >= 2 ? 6u : 5u};
+        const auto runCount(read32(file));
+        if (!file || runCount > remainingBytes(file) / runSize)
+            return false;
+
+        runs.resize(runCount);
+        for (auto &run : runs)
+        {
+            run.steps = read32(file);
+            run.input.buttons = static_cast<std::uint8_t>(file.get());
+            run.input.axis = fileVersion >= 2 ? static_cast<std::int8_t>(file.get()) : 0;
+        }
+
+        hashes.clear();
+        if (fileVersion >= 3)
+        {
+            hashInterval = std::max(read32(file), std::uint32_t{1});
+            const auto hashCount(read32(file));
+            if (!file || hashCount > remainingBytes(file) / 4)
+                return false;
+
+            hashes.resize(hashCount);
+            for (auto &hash : hashes)
+                hash = read32(file);
+        }
+
+        currentRun = 0;
+        currentStep = 0;
+        hashedSteps = 0;
+        divergedStep = noStep;
+        return static_cast<bool>(file);
+    }
+};
+
+// Flight recorder, for the kiosks: when the game crashes, the session is
+// written to a file from the signal handler. In buffers allocated up
+// front it keeps
+// - the input runs and the state hashes of the whole session, written
+//   first as a replay, which `--replay` plays back to the crash,
+// - the input and the state hash of every step and the profiler samples
+//   of every frame, of the last seconds only, after the replay.
+// A signal handler can't allocate nor use the streams: the file is
+// encoded into a buffer sized for a full recorder, then written with
+// plain system calls. Recording is a few stores per step and per frame.
+//
+// After the replay, little endian:
+//   "ARKF" u32 stepCount stepCount x (u32 step, u8 buttons, i8 axis, u32 hash)
+//   u32 phaseCount u32 frameCount frameCount x (u32 frame, phaseCount x f32 ms, u32 dropped steps)
+class FlightRecorder
+{
+  private:
+    // A session that doesn't fit stops growing the replay, at 1 ms steps
+    // the hashes last more than four hours. The last seconds are still
+    // kept.
+    static constexpr std::size_t maxRuns{1u << 18}, maxHashes{1u << 18};
+    static constexpr std::uint32_t hashInterval{64};
+    // Frames kept per second of `mSeconds`.
+    static constexpr std::size_t maxFrameRate{240};
+
+    struct Step
+    {
+        std::uint32_t step;
+        InputSnapshot input;
+        std::uint32_t hash;
+    };
+
+    struct Frame
+    {
+        std::uint32_t frame;
+        std::array<float, PCount> phases;
+        std::uint32_t droppedSteps;
+    };
+
+    std::uint32_t seed;
+    FrameTime timeStep;
+    std::vector<Replay::Run> runs;
+    std::vector<std::uint32_t> hashes;
+    std::size_t runCount{0}, hashCount{0};
+    bool truncated{false};
+
+    // Rings of the last seconds.
+    std::vector<Step> steps;
+    std::vector<Frame> frames;
+    std::size_t stepCount{0}, frameCount{0};
+    InputSnapshot stepInput;
+
+    std::vector<unsigned char> file;
+    std::array<char, 256> path;
+    std::vector<char> signalStack;
+
+    static std::atomic<FlightRecorder *> &getInstalled() noexcept
+    {
+        static std::atomic<FlightRecorder *> installed{nullptr};
+        return installed;
+    }
+
+    static void put32(unsigned char *&mBytes, std::uint32_t mValue) noexcept
+    {
+        for (auto i(0u); i < 4; ++i)
+            *mBytes++ = static_cast<unsigned char>((mValue >> (i * 8)) & 0xFF);
+    }
+
+    static void putFloat(unsigned char *&mBytes, float mValue) noexcept
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &mValue, sizeof(bits));
+        put32(mBytes, bits);
+    }
+
+    static void putInput(unsigned char *&mBytes, const InputSnapshot &mInput) noexcept
+    {
+        *mBytes++ = mInput.buttons;
+        *mBytes++ = static_cast<unsigned char>(mInput.axis);
+    }
+
+    // The oldest entry of a ring, and how many it holds.
+    template <typename T>
+    static std::size_t ringFirst(const std::vector<T> &mRing, std::size_t mCount) noexcept
+    {
+        return mCount > mRing.size() ? mCount - mRing.size() : 0;
+    }
+
+    // The whole file into `file`, returns its size.
+    std::size_t encode() noexcept
+    {
+        auto bytes(file.data());
+        std::memcpy(bytes, "ARKR", 4);
+        bytes += 4;
+        *bytes++ = Replay::version;
+        put32(bytes, seed);
+        putFloat(bytes, timeStep);
+
+        put32(bytes, static_cast<std::uint32_t>(runCount));
+        for (std::size_t i{0}; i < runCount; ++i)
+        {
+            put32(bytes, runs[i].steps);
+            putInput(bytes, runs[i].input);
+        }
+
+        put32(bytes, hashInterval);
+        put32(bytes, static_cast<std::uint32_t>(hashCount));
+        for (std::size_t i{0}; i < hashCount; ++i)
+            put32(bytes, hashes[i]);
+
+        std::memcpy(bytes, "ARKF", 4);
+        bytes += 4;
+        const auto firstStep(ringFirst(steps, stepCount));
+        put32(bytes, static_cast<std::uint32_t>(stepCount - firstStep));
+        for (auto i(firstStep); i < stepCount; ++i)
+        {
+            const auto &step(steps[i % steps.size()]);
+            put32(bytes, step.step);
+            putInput(bytes, step.input);
+            put32(bytes, step.hash);
+        }
+
+        const auto firstFrame(ringFirst(frames, frameCount));
+        put32(bytes, std::uint32_t{PCount});
+        put32(bytes, static_cast<std::uint32_t>(frameCount - firstFrame));
+        for (auto i(firstFrame); i < frameCount; ++i)
+        {
+            const auto &frame(frames[i % frames.size()]);
+            put32(bytes, frame.frame);
+            for (auto phase : frame.phases)
+                putFloat(bytes, phase);
+            put32(bytes, frame.droppedSteps);
+        }
+
+        return static_cast<std::size_t>(bytes - file.data());
+    }
+
+    static void onSignal(int mSignal)
+    {
+        if (auto recorder = getInstalled().load())
+            recorder->dump();
+
+        // The default action now, it was reset by the handler.
+        std::signal(mSignal, SIG_DFL);
+        std::raise(mSignal);
+    }
+
+  public:
+    FlightRecorder(std::uint32_t mSeed, FrameTime mTimeStep, float mSeconds)
+        : seed{mSeed}, timeStep{mTimeStep}, runs(maxRuns), hashes(maxHashes),
+          steps(std::max(static_cast<std::size_t>(mSeconds * 1000.f / mTimeStep), std::size_t{1})),
+          frames(std::max(static_cast<std::size_t>(mSeconds * maxFrameRate), std::size_t{1}))
+    {
+        file.resize(17 + runs.size() * 6 + 8 + hashes.size() * 4 + 8 + steps.size() * 10 + 8 +
+                    frames.size() * (8 + PCount * 4));
+        path.fill('\0');
+    }
+
+    FlightRecorder(const FlightRecorder &) = delete;
+    FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+    ~FlightRecorder()
+    {
+        FlightRecorder *self{this};
+        getInstalled().compare_exchange_strong(self, nullptr);
+    }
+
+    // False once the session outgrew the replay, it then ends early.
+    bool isComplete() const noexcept { return !truncated; }
+
+    // Before every step, with the input it runs with.
+    void recordInput(const InputSnapshot &mInput) noexcept
+    {
+        stepInput = mInput;
+        if (truncated)
+            return;
+
+        if (runCount > 0 && runs[runCount - 1].input == mInput &&
+            runs[runCount - 1].steps < std::numeric_limits<std::uint32_t>::max())
+        {
+            ++runs[runCount - 1].steps;
+            return;
+        }
+
+        if (runCount == runs.size())
+            truncated = true;
+        else
+            runs[runCount++] = Replay::Run{1, mInput};
+    }
+
+    // After every step, with the hash of the state it ended in.
+    void recordHash(std::uint32_t mHash) noexcept
+    {
+        const auto step(stepCount++);
+        steps[step % steps.size()] = Step{static_cast<std::uint32_t>(step), stepInput, mHash};
+
+        if (truncated || step % hashInterval != 0)
+            return;
+
+        if (hashCount == hashes.size())
+            truncated = true;
+        else
+            hashes[hashCount++] = mHash;
+    }
+
+    // After `FrameProfiler::endFrame`.
+    void recordFrame(const FrameProfiler &mProfiler) noexcept
+    {
+        auto &frame(frames[frameCount % frames.size()]);
+        frame.frame = static_cast<std::uint32_t>(frameCount++);
+        for (auto i(0u); i < PCount; ++i)
+            frame.phases[i] = mProfiler.getLast(static_cast<ProfilePhase>(i));
+        frame.droppedSteps = static_cast<std::uint32_t>(mProfiler.getLastDroppedSteps());
+    }
+
+    // Write the recorder to the path given to `install`. Only uses what
+    // is safe in a signal handler.
+    bool dump() noexcept
+    {
+        const auto size(encode());
+#ifdef ARKANOID_MMAP
+        const int fd{::open(path.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+        if (fd < 0)
+            return false;
+
+        std::size_t written{0};
+        while (written < size)
+        {
+            const auto result(::write(fd, file.data() + written, size - written));
+            if (result <= 0)
+                break;
+            written += static_cast<std::size_t>(result);
+        }
+
+        ::close(fd);
+        return written == size;
+#else
+        // Not safe in a signal handler, but there is nothing better here.
+        auto stream(std::fopen(path.data(), "wb"));
+        if (stream == nullptr)
+            return false;
+
+        const bool written{std::fwrite(file.data(), 1, size, stream) == size};
+        std::fclose(stream);
+        return written;
+#endif
+    }
+
+    // Dump to `mPath` when the game crashes, on a stack of its own in case
+    // it overflowed the main one.
+    bool install(const char *mPath)
+    {
+        if (std::strlen(mPath) >= path.size())
+            return false;
+
+        std::strcpy(path.data(), mPath);
+        getInstalled().store(this);
+
+        for (int crash : {SIGSEGV, SIGABRT, SIGFPE, SIGILL})
+        {
+#ifdef ARKANOID_MMAP
+            if (signalStack.empty())
+            {
+                signalStack.resize(64 * 1024);
+                stack_t stack{};
+                stack.ss_sp = signalStack.data();
+                stack.ss_size = signalStack.size();
+                sigaltstack(&stack, nullptr);
+            }
+
+            struct sigaction action
+            {
+            };
+            action.sa_handler = onSignal;
+            action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+            sigemptyset(&action.sa_mask);
+            sigaction(crash, &action, nullptr);
+#else
+            std::signal(crash, onSignal);
+#endif
+        }
+
+        return true;
+    }
+
+    // Print the last seconds of a dump as CSV: the steps, then the frames.
+    static bool printLog(const char *mPath, std::ostream &mStream)
+    {
+        Replay replay;
+        std::ifstream in{mPath, std::ios::binary};
+        if (!replay.load(mPath) || !in)
+            return false;
+
+        // The replay part, see `Replay::save`.
+        in.seekg(17 + replay.runs.size() * 6 + 8 + replay.hashes.size() * 4);
+        char magic[4];
+        if (!in.read(magic, 4) || std::memcmp(magic, "ARKF", 4) != 0)
+            return false;
+
+        mStream << "step,buttons,axis,hash\n";
+        for (auto count(Replay::read32(in)); count-- > 0 && in;)
+        {
+            const auto step(Replay::read32(in));
+            const auto buttons(in.get());
+            const auto axis(static_cast<std::int8_t>(in.get()));
+            mStream << step << ',' << buttons << ',' << int{axis} << ',' << std::hex << Replay::read32(in) << std::dec
+                    << '\n';
+        }
+
+        // Builds with other phases write other columns.
+        const auto phaseCount(Replay::read32(in));
+        mStream << "\nframe";
+        for (std::uint32_t i{0}; i < phaseCount; ++i)
+            if (phaseCount == PCount)
+                mStream << ',' << profilePhaseNames[i];
+            else
+                mStream << ",phase " << i;
+        mStream << ",dropped steps\n";
+
+        for (auto count(Replay::read32(in)); count-- > 0 && in;)
+        {
+            mStream << Replay::read32(in);
+            for (std::uint32_t i{0}; i < phaseCount; ++i)
+            {
+                const auto bits(Replay::read32(in));
+                float milliseconds;
+                std::memcpy(&milliseconds, &bits, sizeof(milliseconds));
+                mStream << ',' << milliseconds;
+            }
+            mStream << ',' << Replay::read32(in) << '\n';
+        }
+
+        return static_cast<bool>(in);
+    }
+};
+
+// The LZ4 block format: sequences of literals then a match, a token with
+// both lengths, extra length bytes of 255 and the offset of the match in
+// two bytes. Greedy, a match is looked up by the hash of its first four
+// bytes, enough for data as repetitive as brick layouts. The sizes are
+// kept by the caller, a block doesn't store them.
+class LZ4Block
+{
+  private:
+    static constexpr std::size_t minMatch{4}, lastLiterals{5}, matchLimit{12}, maxOffset{65535};
+    static constexpr unsigned hashBits{12};
+    static constexpr std::uint32_t none{std::numeric_limits<std::uint32_t>::max()};
+
+    static std::uint32_t read32(const char *mData) noexcept
+    {
+        std::uint32_t value;
+        std::memcpy(&value, mData, sizeof(value));
+        return value;
+    }
+
+    static void writeLength(std::vector<char> &mOut, std::size_t mLength)
+    {
+        for (; mLength >= 255; mLength -= 255)
+            mOut.emplace_back(static_cast<char>(255));
+        mOut.emplace_back(static_cast<char>(mLength));
+    }
+
+    // Literals from `mLiterals`, then a match of `mLength` bytes
+    // `mOffset` back, none when `mLength` is 0.
+    static void writeSequence(std::vector<char> &mOut, const char *mLiterals, std::size_t mLiteralCount,
+                              std::size_t mOffset, std::size_t mLength)
+    {
+        const std::size_t matchCode{mLength > 0 ? mLength - minMatch : 0};
+        mOut.emplace_back(static_cast<char>((std::min<std::size_t>(mLiteralCount, 15) << 4) |
+                                            std::min<std::size_t>(matchCode, 15)));
+        if (mLiteralCount >= 15)
+            writeLength(mOut, mLiteralCount - 15);
+        mOut.insert(std::end(mOut), mLiterals, mLiterals + mLiteralCount);
+
+        if (mLength == 0)
+            return;
+
+        mOut.emplace_back(static_cast<char>(mOffset & 0xff));
+        mOut.emplace_back(static_cast<char>(mOffset >> 8));
+        if (matchCode >= 15)
+            writeLength(mOut, matchCode - 15);
+    }
+
+    // Adds up a length and its extra bytes, false past the end.
+    static bool readLength(const unsigned char *&mIn, const unsigned char *mEnd, std::size_t &mLength) noexcept
+    {
+        if (mLength != 15)
+            return true;
+
+        for (;;)
+        {
+            if (mIn == mEnd)
+                return false;
+
+            const auto byte(*mIn++);
+            mLength += byte;
+            if (byte != 255)
+                return true;
+        }
+    }
+
+  public:
+    // Bytes a byte of a block makes at most: every length byte of a match
+    // adds 255 to it.
+    static constexpr std::size_t maxRatio{255};
+
+    // Append the block of `mSize` bytes from `mData` to `mOut`.
+    static void compress(const char *mData, std::size_t mSize, std::vector<char> &mOut)
+    {
+        std::vector<std::uint32_t> table(std::size_t{1} << hashBits, none);
+        std::size_t anchor{0}, i{0};
+
+        while (mSize >= matchLimit && i + matchLimit <= mSize)
+        {
+            const auto sequence(read32(mData + i));
+            auto &entry(table[(sequence * 2654435761u) >> (32 - hashBits)]);
+            const auto candidate(entry);
+            entry = static_cast<std::uint32_t>(i);
+
+            if (candidate == none || i - candidate > maxOffset || read32(mData + candidate) != sequence)
+            {
+                ++i;
+                continue;
+            }
+
+            std::size_t length{minMatch};
+            while (i + length < mSize - lastLiterals && mData[candidate + length] == mData[i + length])
+                ++length;
+
+            writeSequence(mOut, mData + anchor, i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+        }
+
+        writeSequence(mOut, mData + anchor, mSize - anchor, 0, 0);
+    }
+
+    // Fill the `mSize` bytes of `mOut` from the block of `mBlockSize`
+    // bytes at `mBlock`. False when the block is corrupt or doesn't make
+    // exactly `mSize` bytes, nothing is read or written out of bounds.
+    static bool decompress(const char *mBlock, std::size_t mBlockSize, char *mOut, std::size_t mSize) noexcept
+    {
+        auto in(reinterpret_cast<const unsigned char *>(mBlock));
+        const auto end(in + mBlockSize);
+        std::size_t written{0};
+
+        while (in != end)
+        {
+            const auto token(*in++);
+            std::size_t literals(token >> 4);
+            if (!readLength(in, end, literals) || literals > static_cast<std::size_t>(end - in) ||
+                literals > mSize - written)
+                return false;
+
+            std::memcpy(mOut + written, in, literals);
+            in += literals;
+            written += literals;
+
+            // The last sequence has no match.
+            if (in == end)
+                break;
+
+            if (end - in < 2)
+                return false;
+            const std::size_t offset(in[0] | (in[1] << 8));
+            in += 2;
+
+            std::size_t length(token & 15);
+            if (!readLength(in, end, length))
+                return false;
+            length += minMatch;
+
+            if (offset == 0 || offset > written || length > mSize - written)
+                return false;
+
+            // Byte by byte, the match can overlap what it writes.
+            for (std::size_t j{0}; j < length; ++j, ++written)
+                mOut[written] = mOut[written - offset];
+        }
+
+        return written == mSize;
+    }
+};
+
+struct LevelBrick
+{
+    Vector2f position, halfSize;
+    Color color;
+    std::uint8_t hitPoints;
+    BrickType type;
+};
+
+// Bricks that appear during the level: once it was played for `value`
+// steps, or once `value` bricks were broken. They must fit the brick
+// grid, and only levels of entities have them, not the brick field. The
+// level is over once its bricks are broken, waves still to come or not.
+struct LevelWave
+{
+    enum Trigger : std::uint8_t
+    {
+        After,
+        Broken
+    };
+
+    Trigger trigger;
+    std::uint32_t value;
+    std::vector<LevelBrick> bricks;
+};
+
+// Bricks that slide sideways together, back and forth at `speed` pixels
+// per millisecond over `distance` pixels from where they are laid out, to
+// the left when it is negative. A row can ride on an earlier one, its
+// `parent`, and then slides relative to it, for formations. Like the
+// waves, they are for local games.
+struct LevelRow
+{
+    static constexpr std::uint32_t noParent{std::numeric_limits<std::uint32_t>::max()};
+
+    float speed, distance;
+    std::uint32_t parent;
+    std::vector<LevelBrick> bricks;
+};
+
+// Brick layout of a level. It can be read from two formats:
+//
+// Text, one brick per line, `#` starts a comment:
+//   x y width height RRGGBB[AA] hitPoints [type]
+// where type is 0 (normal), 1 (hard), 2 (indestructible) or 3 (explosive).
+// A `broadphase grid` or `broadphase tree` line picks the broad phase,
+// bricks bigger than a grid cell get the tree anyway.
+// A `wave after steps` or `wave broken count` line puts the bricks after
+// it in a new `LevelWave`, a `slide speed distance` line in a new
+// `LevelRow`. It can end with the index of the row it rides on, counted
+// from 0 in the order of the file. Wave bricks must fit a grid cell.
+// Any other line is an error, reported with its number.
+//
+// Binary, meant to be memory-mapped and copied straight out. The records
+// are stored as they are in memory on the (little endian) targets we run:
+//   "ARKL" u8 version u8 broad phase u8[2] padding u32 count
+//   count x (f32 x, y, halfWidth, halfHeight, u8 r, g, b, a, hitPoints, type, u8[2] padding)
+// then, in files that have waves or rows:
+//   u32 waveCount waveCount x (u8 trigger u8[3] padding u32 value u32 count count x record)
+// then, in files that have rows:
+//   u32 rowCount rowCount x (f32 speed, distance u32 parent u32 count count x record)
+class Level
+{
+  public:
+    // How the collisions find the bricks: `BrickGrid` or `BrickTree`. By
+    // default the tree only takes the levels with bricks too big for the
+    // grid.
+    enum class BroadPhase : std::uint8_t
+    {
+        Auto,
+        Grid,
+        Tree
+    };
+
+  private:
+    static constexpr std::uint8_t version{1};
+    static constexpr std::size_t headerSize{12}, recordSize{24};
+
+    // Read the bricks out of a whole binary file.
+    bool parseBinary(const char *mData, std::size_t mSize)
+    {
+        if (mSize < headerSize || std::memcmp(mData, "ARKL", 4) != 0 ||
+            static_cast<std::uint8_t>(mData[4]) != version)
+            return false;
+
+        // Files written before it have 0 there.
+        const auto phase(static_cast<std::uint8_t>(mData[5]));
+        if (phase > static_cast<std::uint8_t>(BroadPhase::Tree))
+            return false;
+        broadPhase = static_cast<BroadPhase>(phase);
+
+        bricks.clear();
+        waves.clear();
+        rows.clear();
+        const char *data(mData + 8);
+        const char *end(mData + mSize);
+        if (!parseRecords(data, end, bricks))
+            return false;
+
+        // Files written before the waves end there.
+        if (data == end)
+            return true;
+
+        std::uint32_t waveCount;
+        if (end - data < 4)
+            return false;
+        std::memcpy(&waveCount, data, sizeof(waveCount));
+        data += 4;
+
+        for (std::uint32_t i{0}; i < waveCount; ++i)
+        {
+            if (end - data < 8 || static_cast<std::uint8_t>(data[0]) > LevelWave::Broken)
+                return false;
+
+            LevelWave wave{static_cast<LevelWave::Trigger>(data[0]), 0, {}};
+            std::memcpy(&wave.value, data + 4, sizeof(wave.value));
+            data += 8;
+            if (!parseRecords(data, end, wave.bricks))
+                return false;
+
+            waves.emplace_back(std::move(wave));
+        }
+
+        // Files written before the rows end there.
+        if (data == end)
+            return true;
+
+        std::uint32_t rowCount;
+        if (end - data < 4)
+            return false;
+        std::memcpy(&rowCount, data, sizeof(rowCount));
+        data += 4;
+
+        for (std::uint32_t i{0}; i < rowCount; ++i)
+        {
+            if (end - data < 12)
+                return false;
+
+            LevelRow row{0.f, 0.f, LevelRow::noParent, {}};
+            std::memcpy(&row.speed, data, sizeof(row.speed));
+            std::memcpy(&row.distance, data + 4, sizeof(row.distance));
+            std::memcpy(&row.parent, data + 8, sizeof(row.parent));
+            if (row.parent != LevelRow::noParent && row.parent >= i)
+                return false;
+            data += 12;
+            if (!parseRecords(data, end, row.bricks))
+                return false;
+
+            rows.emplace_back(std::move(row));
+        }
+
+        return true;
+    }
+
+    // A u32 count then the records, from `mData`, which is moved past them.
+    static bool parseRecords(const char *&mData, const char *mEnd, std::vector<LevelBrick> &mBricks)
+    {
+        std::uint32_t count;
+        if (mEnd - mData < 4)
+            return false;
+        std::memcpy(&count, mData, sizeof(count));
+        mData += 4;
+        if (static_cast<std::size_t>(mEnd - mData) < std::size_t{count} * recordSize)
+            return false;
+
+        mBricks.resize(count);
+        for (auto &brick : mBricks)
+        {
+            float values[4];
+            std::memcpy(values, mData, sizeof(values));
+
+            brick.position = Vector2f{values[0], values[1]};
+            brick.halfSize = Vector2f{values[2], values[3]};
+            brick.color = Color{static_cast<std::uint8_t>(mData[16]), static_cast<std::uint8_t>(mData[17]),
+                                static_cast<std::uint8_t>(mData[18]), static_cast<std::uint8_t>(mData[19])};
+            brick.hitPoints = static_cast<std::uint8_t>(mData[20]);
+            // Files written before the types have 0 there.
+            const auto type(static_cast<std::uint8_t>(mData[21]));
+            if (type >= BCount)
+                return false;
+            brick.type = static_cast<BrickType>(type);
+
+            mData += recordSize;
+        }
+
+        return true;
+    }
+
+    static void writeRecords(std::vector<char> &mData, const std::vector<LevelBrick> &mBricks)
+    {
+        const auto count(static_cast<std::uint32_t>(mBricks.size()));
+        auto offset(mData.size());
+        mData.resize(offset + 4 + mBricks.size() * recordSize, 0);
+        std::memcpy(mData.data() + offset, &count, sizeof(count));
+
+        char *record(mData.data() + offset + 4);
+        for (const auto &brick : mBricks)
+        {
+            const float values[4]{brick.position.x, brick.position.y, brick.halfSize.x, brick.halfSize.y};
+            std::memcpy(record, values, sizeof(values));
+
+            record[16] = static_cast<char>(brick.color.r);
+            record[17] = static_cast<char>(brick.color.g);
+            record[18] = static_cast<char>(brick.color.b);
+            record[19] = static_cast<char>(brick.color.a);
+            record[20] = static_cast<char>(brick.hitPoints);
+            record[21] = static_cast<char>(brick.type);
+
+            record += recordSize;
+        }
+    }
+
+    // Compact format, for sending levels over the network: the whole file
+    // after the header is an LZ4 block, see `LZ4Block`.
+    //   "ARKZ" u8 version u8 broad phase u8[2] padding u32 size of the block once decompressed
+    // It holds the same lists as the binary format, every one as
+    //   varint count varint styleCount styleCount x (f32 halfWidth, halfHeight u8 r, g, b, a, hitPoints)
+    //   then runs until there are count bricks:
+    //   varint style, zigzag varint x, y from the start of the last run, varint length
+    //   [zigzag varint step x, y when length > 1] then the types of the run as (varint repeat, u8 type) pairs
+    // where the positions are in sixteenths of a pixel, and a run is bricks
+    // one after the other in the list, of the same style and a step apart.
+    // After the bricks, varint waveCount waveCount x (u8 trigger varint value list),
+    // then varint rowCount rowCount x (f32 speed, distance varint parent + 1 list).
+    static constexpr std::uint8_t compactVersion{1};
+    static constexpr float compactScale{16.f};
+    // Larger blocks, or more bricks, waves and rows in all the lists of a
+    // file together, are corrupt: runs and LZ4 make a few bytes into any
+    // number of bricks. Below that, the memory asked for is bounded by the
+    // file: a block by what its compressed bytes can make, what is
+    // reserved for the bricks by the bytes left to read.
+    static constexpr std::uint32_t maxCompactSize{1u << 28}, maxCompactBricks{1u << 24};
+    // Two halves, then RGBA and the hit points.
+    static constexpr std::size_t compactStyleSize{13};
+
+    static void writeVarint(std::vector<char> &mData, std::uint64_t mValue)
+    {
+        for (; mValue >= 0x80; mValue >>= 7)
+            mData.emplace_back(static_cast<char>((mValue & 0x7f) | 0x80));
+        mData.emplace_back(static_cast<char>(mValue));
+    }
+
+    static void writeSigned(std::vector<char> &mData, std::int64_t mValue)
+    {
+        writeVarint(mData, (static_cast<std::uint64_t>(mValue) << 1) ^ static_cast<std::uint64_t>(mValue >> 63));
+    }
+
+    static bool readVarint(const char *&mData, const char *mEnd, std::uint64_t &mValue) noexcept
+    {
+        mValue = 0;
+        for (unsigned shift{0}; mData != mEnd && shift < 64; shift += 7)
+        {
+            const auto byte(static_cast<std::uint8_t>(*mData++));
+            mValue |= std::uint64_t{byte & 0x7fu} << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    static bool readSigned(const char *&mData, const char *mEnd, std::int64_t &mValue) noexcept
+    {
+        std::uint64_t value;
+        if (!readVarint(mData, mEnd, value))
+            return false;
+
+        mValue = static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+        return true;
+    }
+
+    // Only the coordinates a float holds exactly in sixteenths of a pixel.
+    static bool quantize(float mValue, std::int64_t &mQuantized) noexcept
+    {
+        const float scaled{mValue * compactScale};
+        if (scaled != std::round(scaled) || std::abs(scaled) > float(1 << 24))
+            return false;
+
+        mQuantized = static_cast<std::int64_t>(scaled);
+        return true;
+    }
+
+    template <typename T>
+    static void writeRaw(std::vector<char> &mData, const T &mValue)
+    {
+        const auto offset(mData.size());
+        mData.resize(offset + sizeof(T));
+        std::memcpy(mData.data() + offset, &mValue, sizeof(T));
+    }
+
+    template <typename T>
+    static bool readRaw(const char *&mData, const char *mEnd, T &mValue) noexcept
+    {
+        if (static_cast<std::size_t>(mEnd - mData) < sizeof(T))
+            return false;
+
+        std::memcpy(&mValue, mData, sizeof(T));
+        mData += sizeof(T);
+        return true;
+    }
+
+    // False when a position can't be quantized.
+    static bool writeCompactRecords(std::vector<char> &mData, const std::vector<LevelBrick> &mBricks)
+    {
+        using Style = std::tuple<std::uint32_t, std::uint32_t, std::uint32_t, std::uint8_t>;
+
+        std::vector<std::uint32_t> styleOf;
+        std::vector<std::array<std::int64_t, 2>> positions;
+        std::map<Style, std::uint32_t> styles;
+        std::vector<const LevelBrick *> palette;
+        for (const auto &brick : mBricks)
+        {
+            std::array<std::int64_t, 2> position;
+            if (!quantize(brick.position.x, position[0]) || !quantize(brick.position.y, position[1]))
+                return false;
+            positions.emplace_back(position);
+
+            std::uint32_t halfWidth, halfHeight;
+            std::memcpy(&halfWidth, &brick.halfSize.x, sizeof(halfWidth));
+            std::memcpy(&halfHeight, &brick.halfSize.y, sizeof(halfHeight));
+            const auto found(styles.emplace(Style{halfWidth, halfHeight, brick.color.toInteger(), brick.hitPoints},
+                                            static_cast<std::uint32_t>(palette.size())));
+            if (found.second)
+                palette.emplace_back(&brick);
+            styleOf.emplace_back(found.first->second);
+        }
+
+        writeVarint(mData, mBricks.size());
+        writeVarint(mData, palette.size());
+        for (auto brick : palette)
+        {
+            writeRaw(mData, brick->halfSize.x);
+            writeRaw(mData, brick->halfSize.y);
+            for (auto channel : {brick->color.r, brick->color.g, brick->color.b, brick->color.a, brick->hitPoints})
+                mData.emplace_back(static_cast<char>(channel));
+        }
+
+        std::array<std::int64_t, 2> start{};
+        for (std::size_t i{0}; i < mBricks.size();)
+        {
+            std::array<std::int64_t, 2> step{};
+            std::size_t last{i + 1};
+            if (last < mBricks.size() && styleOf[last] == styleOf[i])
+            {
+                step = {positions[last][0] - positions[i][0], positions[last][1] - positions[i][1]};
+                while (last < mBricks.size() && styleOf[last] == styleOf[i] &&
+                       positions[last][0] - positions[last - 1][0] == step[0] &&
+                       positions[last][1] - positions[last - 1][1] == step[1])
+                    ++last;
+            }
+
+            writeVarint(mData, styleOf[i]);
+            writeSigned(mData, positions[i][0] - start[0]);
+            writeSigned(mData, positions[i][1] - start[1]);
+            writeVarint(mData, last - i);
+            if (last - i > 1)
+            {
+                writeSigned(mData, step[0]);
+                writeSigned(mData, step[1]);
+            }
+
+            for (auto j(i); j < last;)
+            {
+                auto repeat(j + 1);
+                while (repeat < last && mBricks[repeat].type == mBricks[j].type)
+                    ++repeat;
+
+                writeVarint(mData, repeat - j);
+                mData.emplace_back(static_cast<char>(mBricks[j].type));
+                j = repeat;
+            }
+
+            start = positions[i];
+            i = last;
+        }
+
+        return true;
+    }
+
+    // The bricks are written straight into `mBricks`, and taken out of
+    // `mBudget`, what is left of `maxCompactBricks` for the whole file.
+    static bool readCompactRecords(const char *&mData, const char *mEnd, std::uint64_t &mBudget,
+                                   std::vector<LevelBrick> &mBricks)
+    {
+        std::uint64_t count, styleCount;
+        if (!readVarint(mData, mEnd, count) || count > mBudget || !readVarint(mData, mEnd, styleCount) ||
+            styleCount > count || styleCount > static_cast<std::size_t>(mEnd - mData) / compactStyleSize)
+            return false;
+        // Every run is within `count`, so within the budget.
+        mBudget -= count;
+
+        std::vector<LevelBrick> palette(styleCount);
+        for (auto &style : palette)
+        {
+            std::uint8_t bytes[5];
+            if (!readRaw(mData, mEnd, style.halfSize.x) || !readRaw(mData, mEnd, style.halfSize.y) ||
+                !readRaw(mData, mEnd, bytes))
+                return false;
+
+            style.color = Color{bytes[0], bytes[1], bytes[2], bytes[3]};
+            style.hitPoints = bytes[4];
+        }
+
+        // A run makes many bricks out of a few bytes, so past a brick per
+        // byte left the list grows as the runs are read.
+        mBricks.clear();
+        mBricks.reserve(std::min<std::uint64_t>(count, static_cast<std::uint64_t>(mEnd - mData)));
+        std::int64_t startX{0}, startY{0};
+        while (mBricks.size() < count)
+        {
+            std::uint64_t style, length;
+            std::int64_t x, y, stepX{0}, stepY{0};
+            if (!readVarint(mData, mEnd, style) || style >= palette.size() || !readSigned(mData, mEnd, x) ||
+                !readSigned(mData, mEnd, y) || !readVarint(mData, mEnd, length) || length == 0 ||
+                length > count - mBricks.size() ||
+                (length > 1 && (!readSigned(mData, mEnd, stepX) || !readSigned(mData, mEnd, stepY))))
+                return false;
+
+            startX += x;
+            startY += y;
+            auto brick(palette[style]);
+            for (std::uint64_t i{0}; i < length;)
+            {
+                std::uint64_t repeat;
+                std::uint8_t type;
+                if (!readVarint(mData, mEnd, repeat) || repeat == 0 || repeat > length - i ||
+                    !readRaw(mData, mEnd, type) || type >= BCount)
+                    return false;
+
+                brick.type = static_cast<BrickType>(type);
+                for (; repeat > 0; --repeat, ++i)
+                {
+                    brick.position = Vector2f{(startX + stepX * static_cast<std::int64_t>(i)) / compactScale,
+                                              (startY + stepY * static_cast<std::int64_t>(i)) / compactScale};
+                    mBricks.emplace_back(brick);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool parseCompact(const char *mData, std::size_t mSize)
+    {
+        std::uint32_t rawSize;
+        if (mSize < headerSize || std::memcmp(mData, "ARKZ", 4) != 0 ||
+            static_cast<std::uint8_t>(mData[4]) != compactVersion ||
+            static_cast<std::uint8_t>(mData[5]) > static_cast<std::uint8_t>(BroadPhase::Tree))
+            return false;
+
+        bricks.clear();
+        waves.clear();
+        rows.clear();
+        std::memcpy(&rawSize, mData + 8, sizeof(rawSize));
+        if (rawSize > maxCompactSize || rawSize > (mSize - headerSize) * std::uint64_t{LZ4Block::maxRatio})
+            return false;
+
+        std::vector<char> raw(rawSize);
+        if (!LZ4Block::decompress(mData + headerSize, mSize - headerSize, raw.data(), raw.size()))
+            return false;
+
+        broadPhase = static_cast<BroadPhase>(mData[5]);
+        const char *data(raw.data());
+        const char *end(raw.data() + raw.size());
+        std::uint64_t budget{maxCompactBricks}, waveCount, rowCount;
+        if (!readCompactRecords(data, end, budget, bricks) || !readVarint(data, end, waveCount) ||
+            waveCount > budget)
+            return false;
+        budget -= waveCount;
+
+        for (std::uint64_t i{0}; i < waveCount; ++i)
+        {
+            std::uint8_t trigger;
+            std::uint64_t value;
+            if (!readRaw(data, end, trigger) || trigger > LevelWave::Broken || !readVarint(data, end, value))
+                return false;
+
+            waves.emplace_back(LevelWave{static_cast<LevelWave::Trigger>(trigger), static_cast<std::uint32_t>(value), {}});
+            if (!readCompactRecords(data, end, budget, waves.back().bricks))
+                return false;
+        }
+
+        if (!readVarint(data, end, rowCount) || rowCount > budget)
+            return false;
+        budget -= rowCount;
+
+        for (std::uint64_t i{0}; i < rowCount; ++i)
+        {
+            LevelRow row{0.f, 0.f, LevelRow::noParent, {}};
+            std::uint64_t parent;
+            if (!readRaw(data, end, row.speed) || !readRaw(data, end, row.distance) ||
+                !readVarint(data, end, parent) || parent > i)
+                return false;
+
+            row.parent = parent > 0 ? static_cast<std::uint32_t>(parent - 1) : LevelRow::noParent;
+            rows.emplace_back(std::move(row));
+            if (!readCompactRecords(data, end, budget, rows.back().bricks))
+                return false;
+        }
+
+        return data == end;
+    }
+
+  public:
+    std::vector<LevelBrick> bricks;
+    std::vector<LevelWave> waves;
+    std::vector<LevelRow> rows;
+    BroadPhase broadPhase{BroadPhase::Auto};
+
+    // The original 11x4 wall, or another number of columns and rows.
+    static Level createDefault(int mColumns = countBlockX, int mRows = countBlockY)
+    {
+        Level level;
+        for (int iX{0}; iX < mColumns; ++iX)
+            for (int iY{0}; iY < mRows; ++iY)
+                level.bricks.emplace_back(
+                    LevelBrick{Vector2f{(iX + 1) * (blockWidth + 3) + 22, (iY + 2) * (blockHeight + 3)},
+                               Vector2f{blockWidth / 2.f, blockHeight / 2.f}, Color::Red, 1, BNormal});
+
+        return level;
+    }
+
+    bool loadText(const char *mPath)
+    {
+        std::ifstream file{mPath};
+        if (!file)
+            return false;
+
+        bricks.clear();
+        waves.clear();
+        rows.clear();
+        broadPhase = BroadPhase::Auto;
+        // Where the bricks of the next lines go.
+        auto *target(&bricks);
+
+        std::string line;
+        std::size_t lineNumber{0};
+        auto reject([&](const char *mReason) {
+            cerr << mPath << ':' << lineNumber << ": " << mReason << endl;
+            return false;
+        });
+
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+            auto comment(line.find('#'));
+            if (comment != std::string::npos)
+                line.resize(comment);
+
+            char phase[8];
+            if (std::sscanf(line.c_str(), " broadphase %7s", phase) == 1)
+            {
+                if (std::strcmp(phase, "grid") == 0)
+                    broadPhase = BroadPhase::Grid;
+                else if (std::strcmp(phase, "tree") == 0)
+                    broadPhase = BroadPhase::Tree;
+                else
+                    return reject("broadphase is grid or tree");
+                continue;
+            }
+
+            char trigger[8];
+            unsigned value;
+            if (std::sscanf(line.c_str(), " wave %7s %u", trigger, &value) == 2)
+            {
+                if (std::strcmp(trigger, "after") == 0)
+                    waves.emplace_back(LevelWave{LevelWave::After, value, {}});
+                else if (std::strcmp(trigger, "broken") == 0)
+                    waves.emplace_back(LevelWave{LevelWave::Broken, value, {}});
+                else
+                    return reject("wave is after or broken");
+
+                target = &waves.back().bricks;
+                continue;
+            }
+
+            float speed, distance;
+            unsigned parent;
+            const int slideFields{std::sscanf(line.c_str(), " slide %f %f %u", &speed, &distance, &parent)};
+            if (slideFields >= 2)
+            {
+                if (slideFields == 3 && parent >= rows.size())
+                    return reject("slide parent isn't an earlier slide");
+
+                rows.emplace_back(LevelRow{speed, distance, slideFields == 3 ? parent : LevelRow::noParent, {}});
+                target = &rows.back().bricks;
+                continue;
+            }
+
+            float x, y, width, height;
+            char color[9];
+            unsigned hitPoints, type{BNormal};
+            int fields{std::sscanf(line.c_str(), "%f %f %f %f %8s %u %u", &x, &y, &width, &height, color, &hitPoints,
+                                   &type)};
+
+            // Blank, or only a comment.
+            if (fields < 0)
+                continue;
+
+            if (fields < 6)
+                return reject("expected x y width height color hit-points [type]");
+            if (type >= BCount)
+                return reject("unknown brick type");
+
+            auto rgba(std::strtoul(color, nullptr, 16));
+            if (std::strlen(color) == 6)
+                rgba = (rgba << 8) | 0xFF;
+
+            target->emplace_back(LevelBrick{Vector2f{x, y}, Vector2f{width / 2.f, height / 2.f},
+                                           Color{static_cast<std::uint32_t>(rgba)},
+                                           static_cast<std::uint8_t>(std::min(hitPoints, 255u)),
+                                           static_cast<BrickType>(type)});
+        }
+
+        return true;
+    }
+
+    bool loadBinary(const char *mPath)
+    {
+        MappedFile file;
+        return file.open(mPath) && parseBinary(file.getData(), file.getSize());
+    }
+
+    bool loadCompact(const char *mPath)
+    {
+        MappedFile file;
+        return file.open(mPath) && parseCompact(file.getData(), file.getSize());
+    }
+
+    // From a whole compact file already in memory, one sent over the
+    // network for one.
+    bool loadCompact(const char *mData, std::size_t mSize) { return parseCompact(mData, mSize); }
+
+    // Binary, compact or text, depending on what the file starts with.
+    bool load(const char *mPath)
+    {
+        char magic[4]{};
+        std::ifstream{mPath, std::ios::binary}.read(magic, 4);
+
+        bool loaded;
+        if (std::memcmp(magic, "ARKL", 4) == 0)
+            loaded = loadBinary(mPath);
+        else if (std::memcmp(magic, "ARKZ", 4) == 0)
+            loaded = loadCompact(mPath);
+        else
+            loaded = loadText(mPath);
+
+        if (!loaded)
+            return false;
+
+        // Waves come once the tree is built, their bricks go to the grid.
+        if (const auto *brick = findOversized(false))
+        {
+            cerr << mPath << ": wave brick at " << brick->position.x << ", " << brick->position.y
+                 << " is bigger than a cell of the brick grid" << endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    // The first brick too big for a cell of `BrickGrid` among the ones of
+    // the waves, and among the others too with `mAll`. Null when they all
+    // fit.
+    const LevelBrick *findOversized(bool mAll) const
+    {
+        auto oversized([](const LevelBrick &mBrick) { return !BrickGrid::fits(mBrick.halfSize); });
+
+        if (mAll)
+        {
+            auto it(std::find_if(std::begin(bricks), std::end(bricks), oversized));
+            if (it != std::end(bricks))
+                return &*it;
+        }
+
+        for (const auto &wave : waves)
+        {
+            auto it(std::find_if(std::begin(wave.bricks), std::end(wave.bricks), oversized));
+            if (it != std::end(wave.bricks))
+                return &*it;
+        }
+
+        return nullptr;
+    }
+
+    // False too when a brick isn't on a sixteenth of a pixel.
+    bool saveCompact(const char *mPath) const
+    {
+        std::vector<char> data;
+        if (!saveCompact(data))
+            return false;
+
+        std::ofstream file{mPath, std::ios::binary};
+        file.write(data.data(), data.size());
+        return static_cast<bool>(file);
+    }
+
+    // The whole compact file into `mData`, to send it without a file.
+    bool saveCompact(std::vector<char> &mData) const
+    {
+        std::vector<char> raw;
+        if (!writeCompactRecords(raw, bricks))
+            return false;
+
+        writeVarint(raw, waves.size());
+        for (const auto &wave : waves)
+        {
+            raw.emplace_back(static_cast<char>(wave.trigger));
+            writeVarint(raw, wave.value);
+            if (!writeCompactRecords(raw, wave.bricks))
+                return false;
+        }
+
+        writeVarint(raw, rows.size());
+        for (const auto &row : rows)
+        {
+            writeRaw(raw, row.speed);
+            writeRaw(raw, row.distance);
+            writeVarint(raw, row.parent != LevelRow::noParent ? std::uint64_t{row.parent} + 1 : 0);
+            if (!writeCompactRecords(raw, row.bricks))
+                return false;
+        }
+
+        if (raw.size() > maxCompactSize)
+            return false;
+
+        mData.assign(headerSize, 0);
+        std::memcpy(mData.data(), "ARKZ", 4);
+        mData[4] = static_cast<char>(compactVersion);
+        mData[5] = static_cast<char>(broadPhase);
+        const auto rawSize(static_cast<std::uint32_t>(raw.size()));
+        std::memcpy(mData.data() + 8, &rawSize, sizeof(rawSize));
+        LZ4Block::compress(raw.data(), raw.size(), mData);
+        return true;
+    }
+
+    bool saveBinary(const char *mPath) const
+    {
+        std::vector<char> data(8, 0);
+        std::memcpy(data.data(), "ARKL", 4);
+        data[4] = static_cast<char>(version);
+        data[5] = static_cast<char>(broadPhase);
+        writeRecords(data, bricks);
+
+        if (!waves.empty() || !rows.empty())
+        {
+            const auto waveCount(static_cast<std::uint32_t>(waves.size()));
+            data.resize(data.size() + 4);
+            std::memcpy(data.data() + data.size() - 4, &waveCount, sizeof(waveCount));
+
+            for (const auto &wave : waves)
+            {
+                data.resize(data.size() + 8, 0);
+                data[data.size() - 8] = static_cast<char>(wave.trigger);
+                std::memcpy(data.data() + data.size() - 4, &wave.value, sizeof(wave.value));
+                writeRecords(data, wave.bricks);
+            }
+        }
+
+        if (!rows.empty())
+        {
+            const auto rowCount(static_cast<std::uint32_t>(rows.size()));
+            data.resize(data.size() + 4);
+            std::memcpy(data.data() + data.size() - 4, &rowCount, sizeof(rowCount));
+
+            for (const auto &row : rows)
+            {
+                data.resize(data.size() + 12);
+                std::memcpy(data.data() + data.size() - 12, &row.speed, sizeof(row.speed));
+                std::memcpy(data.data() + data.size() - 8, &row.distance, sizeof(row.distance));
+                std::memcpy(data.data() + data.size() - 4, &row.parent, sizeof(row.parent));
+                writeRecords(data, row.bricks);
+            }
+        }
+
+        std::ofstream file{mPath, std::ios::binary};
+        file.write(data.data(), data.size());
+        return static_cast<bool>(file);
+    }
+};
+
+// Streams the bricks of a tall level in horizontal chunks: only the chunks
+// near the play area have entities in the manager, so `refresh` and the
+// collision tests don't grow with the level. Picking what to spawn for a
+// chunk is done by a loader thread, the entities themselves are created
+// on the game thread since the manager is not thread safe.
+class LevelStreamer
+{
+  public:
+    static constexpr float chunkHeight{windowHeight / 2.f};
+
+  private:
+    enum class ChunkState
+    {
+        Unloaded,
+        Loading,
+        Loaded
+    };
+
+    struct Chunk
+    {
+        // Bricks of the chunk in `level.bricks`.
+        std::size_t first, last;
+        // Bricks already broken stay broken when the chunk comes back.
+        std::vector<bool> broken;
+        // Written by the loader thread while the chunk is loading.
+        std::vector<std::uint32_t> toSpawn;
+        std::vector<std::pair<std::uint32_t, EntityHandle>> spawned;
+        ChunkState state{ChunkState::Unloaded};
+    };
+
+    Level level;
+    int firstChunk{0};
+    std::vector<Chunk> chunks;
+    std::vector<std::size_t> loadedChunks;
+
+    SpscQueue<std::size_t, 64> requests, results;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::thread loader;
+
+    int chunkAt(float mY) const noexcept
+    {
+        return static_cast<int>(std::floor(mY / chunkHeight)) - firstChunk;
+    }
+
+    void load()
+    {
+        ARKANOID_THREAD("level streamer");
+
+        while (!stopping)
+        {
+            std::size_t index;
+            if (!requests.pop(index))
+            {
+                // Requests are notified under the lock, none can come
+                // between the check and the wait.
+                std::unique_lock<std::mutex> lock{mutex};
+                wakeUp.wait(lock, [this] { return stopping || !requests.empty(); });
+                continue;
+            }
+
+            auto &chunk(chunks[index]);
+            chunk.toSpawn.clear();
+            for (auto i(chunk.first); i < chunk.last; ++i)
+                if (!chunk.broken[i - chunk.first])
+                    chunk.toSpawn.emplace_back(static_cast<std::uint32_t>(i - chunk.first));
+
+            // Never more chunks load at once than fit in `requests`.
+            while (!results.push(index))
+                std::this_thread::yield();
+        }
+    }
+
+  public:
+    LevelStreamer(Level mLevel) : level(std::move(mLevel))
+    {
+        auto &bricks(level.bricks);
+        std::sort(std::begin(bricks), std::end(bricks),
+                  [](const LevelBrick &mA, const LevelBrick &mB) { return mA.position.y < mB.position.y; });
+
+        if (!bricks.empty())
+        {
+            firstChunk = static_cast<int>(std::floor(bricks.front().position.y / chunkHeight));
+            chunks.resize(chunkAt(bricks.back().position.y) + 1);
+        }
+
+        std::size_t first{0};
+        for (auto i(0u); i < chunks.size(); ++i)
+        {
+            auto last(first);
+            while (last < bricks.size() && chunkAt(bricks[last].position.y) == static_cast<int>(i))
+                ++last;
+
+            chunks[i].first = first;
+            chunks[i].last = last;
+            chunks[i].broken.resize(last - first, false);
+            first = last;
+        }
+
+        loader = std::thread{[this] { load(); }};
+    }
+
+    LevelStreamer(const LevelStreamer &) = delete;
+    LevelStreamer &operator=(const LevelStreamer &) = delete;
+
+    ~LevelStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wakeUp.notify_one();
+        loader.join();
+    }
+
+    // Stream in the chunks within a chunk of the play area and stream out
+    // the others. Called every step.
+    void update(Game &mGame);
+};
+
+// Network play: the server runs the logic of a two-player game and the
+// client shows it. Every frame the server sends the state, and the
+// client sends its input and the last state it received. The states are
+// sent as deltas against that one, so most of a snapshot is a byte per
+// unchanged position and the bricks destroyed since then.
+//
+// The client doesn't wait for the server to move its own paddle, it
+// predicts it. Every input says for how many steps it was applied, the
+// server applies it for as many, so the prediction only goes wrong when
+// inputs are lost or late.
+//
+// Input packet:    u32 protocol u32 ack u8 count, count times:
+//                  u32 input sequence u16 steps u8 buttons i8 axis
+// Snapshot packet: u32 protocol u32 sequence u32 baseline
+//                  u32 player u32 input sequence u32 input steps
+//                  u32 paddle count, positions, u32 ball count, positions,
+//                  u8 brick encoding, bricks
+// A baseline of 0 means a full state. Positions are a u8 tag followed by
+// nothing (unchanged), two i8 (difference) or two i32 (full position).
+constexpr std::uint32_t netProtocol{0x41524B4E};
+constexpr unsigned short netDefaultPort{51234}, broadcastDefaultPort{51235};
+constexpr std::size_t maxPlayers{2};
+// Positions go over the network in 1/16 of a pixel. Both sides keep the
+// quantized values, so they agree exactly on every baseline.
+constexpr float netPositionScale{16.f};
+
+struct NetState
+{
+    std::uint32_t sequence{0};
+    // Player of the client the state is sent to, the last input of the
+    // client the server applied and for how many of its steps. Only these
+    // differ between the clients.
+    std::uint32_t player{0}, inputSequence{0}, inputSteps{0};
+    std::vector<Vector2i> paddles, balls;
+    // One bit per brick of the level, in the order the level lists them.
+    std::vector<bool> destroyedBricks;
+};
+
+// The last states sent or received, the baselines of the next deltas.
+class NetHistory
+{
+  private:
+    static constexpr std::size_t capacity{32};
+    std::array<NetState, capacity> states;
+
+  public:
+    NetState &store(std::uint32_t mSequence)
+    {
+        auto &state(states[mSequence % capacity]);
+        state.sequence = mSequence;
+        return state;
+    }
+
+    // The state of `mSequence`, or nullptr when it is too old.
+    const NetState *find(std::uint32_t mSequence) const noexcept
+    {
+        const auto &state(states[mSequence % capacity]);
+        return mSequence != 0 && state.sequence == mSequence ? &state : nullptr;
+    }
+};
+
+namespace Internal
+{
+enum NetPositionTag : Uint8
+{
+    NUnchanged,
+    NDifference,
+    NFull
+};
+
+enum NetBrickEncoding : Uint8
+{
+    NChangedBricks,
+    NAllBricks
+};
+
+inline Vector2i quantizePosition(const Vector2f &mPosition) noexcept
+{
+    return Vector2i{static_cast<int>(std::lround(mPosition.x * netPositionScale)),
+                    static_cast<int>(std::lround(mPosition.y * netPositionScale))};
+}
+
+inline Vector2f dequantizePosition(const Vector2i &mPosition) noexcept
+{
+    return Vector2f{mPosition.x / netPositionScale, mPosition.y / netPositionScale};
+}
+
+inline bool fitsInt8(int mValue) noexcept
+{
+    return mValue >= std::numeric_limits<Int8>::min() && mValue <= std::numeric_limits<Int8>::max();
+}
+
+inline void writePositions(Packet &mPacket, const std::vector<Vector2i> &mPositions,
+                           const std::vector<Vector2i> *mBaseline)
+{
+    mPacket << static_cast<Uint32>(mPositions.size());
+    for (std::size_t i{0}; i < mPositions.size(); ++i)
+    {
+        const auto &position(mPositions[i]);
+        if (mBaseline != nullptr && i < mBaseline->size())
+        {
+            const Vector2i difference{position - (*mBaseline)[i]};
+            if (difference == Vector2i{})
+            {
+                mPacket << static_cast<Uint8>(NUnchanged);
+                continue;
+            }
+
+            if (fitsInt8(difference.x) && fitsInt8(difference.y))
+            {
+                mPacket << static_cast<Uint8>(NDifference) << static_cast<Int8>(difference.x)
+                        << static_cast<Int8>(difference.y);
+                continue;
+            }
+        }
+
+        mPacket << static_cast<Uint8>(NFull) << static_cast<Int32>(position.x) << static_cast<Int32>(position.y);
+    }
+}
+
+inline bool readPositions(Packet &mPacket, std::vector<Vector2i> &mPositions, const std::vector<Vector2i> *mBaseline)
+{
+    Uint32 count;
+    if (!(mPacket >> count) || count > UdpSocket::MaxDatagramSize)
+        return false;
+
+    mPositions.resize(count);
+    for (std::size_t i{0}; i < mPositions.size(); ++i)
+    {
+        Uint8 tag;
+        if (!(mPacket >> tag))
+            return false;
+
+        if (tag == NFull)
+        {
+            Int32 x, y;
+            if (!(mPacket >> x >> y))
+                return false;
+
+            mPositions[i] = Vector2i{x, y};
+            continue;
+        }
+
+        if (mBaseline == nullptr || i >= mBaseline->size())
+            return false;
+
+        mPositions[i] = (*mBaseline)[i];
+        if (tag == NDifference)
+        {
+            Int8 x, y;
+            if (!(mPacket >> x >> y))
+                return false;
+
+            mPositions[i] += Vector2i{x, y};
+        }
+        else if (tag != NUnchanged)
+            return false;
+    }
+
+    return true;
+}
+} // namespace Internal
+
+// Write `mState` as a delta against `mBaseline`, a full state without one.
+inline void writeNetState(Packet &mPacket, const NetState &mState, const NetState *mBaseline)
+{
+    using namespace Internal;
+
+    mPacket << netProtocol << mState.sequence << (mBaseline != nullptr ? mBaseline->sequence : Uint32{0})
+            << mState.player << mState.inputSequence << mState.inputSteps;
+    writePositions(mPacket, mState.paddles, mBaseline != nullptr ? &mBaseline->paddles : nullptr);
+    writePositions(mPacket, mState.balls, mBaseline != nullptr ? &mBaseline->balls : nullptr);
+
+    const auto &bricks(mState.destroyedBricks);
+    if (mBaseline != nullptr && mBaseline->destroyedBricks.size() == bricks.size())
+    {
+        // Only the bricks that changed since the baseline.
+        Uint32 changed{0};
+        for (std::size_t i{0}; i < bricks.size(); ++i)
+            changed += bricks[i] != mBaseline->destroyedBricks[i];
+
+        mPacket << static_cast<Uint8>(NChangedBricks) << changed;
+        for (std::size_t i{0}; i < bricks.size(); ++i)
+            if (bricks[i] != mBaseline->destroyedBricks[i])
+                mPacket << static_cast<Uint32>(i);
+
+        return;
+    }
+
+    mPacket << static_cast<Uint8>(NAllBricks) << static_cast<Uint32>(bricks.size());
+    for (std::size_t i{0}; i < bricks.size(); i += 8)
+    {
+        Uint8 bits{0};
+        for (std::size_t j{0}; j < 8 && i + j < bricks.size(); ++j)
+            bits |= static_cast<Uint8>(bricks[i + j]) << j;
+
+        mPacket << bits;
+    }
+}
+
+// Read a state written by `writeNetState` into `mState`. Returns false
+// when the packet is not a state or its baseline is no longer in
+// `mHistory`.
+inline bool readNetState(Packet &mPacket, const NetHistory &mHistory, NetState &mState)
+{
+    using namespace Internal;
+
+    Uint32 protocol, baselineSequence;
+    if (!(mPacket >> protocol >> mState.sequence >> baselineSequence >> mState.player >> mState.inputSequence >>
+          mState.inputSteps) ||
+        protocol != netProtocol)
+        return false;
+
+    const NetState *baseline{nullptr};
+    if (baselineSequence != 0 && (baseline = mHistory.find(baselineSequence)) == nullptr)
+        return false;
+
+    if (!readPositions(mPacket, mState.paddles, baseline != nullptr ? &baseline->paddles : nullptr) ||
+        !readPositions(mPacket, mState.balls, baseline != nullptr ? &baseline->balls : nullptr))
+        return false;
+
+    Uint8 encoding;
+    Uint32 count;
+    if (!(mPacket >> encoding >> count))
+        return false;
+
+    auto &bricks(mState.destroyedBricks);
+    if (encoding == NChangedBricks)
+    {
+        if (baseline == nullptr)
+            return false;
+
+        bricks = baseline->destroyedBricks;
+        for (Uint32 i{0}; i < count; ++i)
+        {
+            Uint32 index;
+            if (!(mPacket >> index) || index >= bricks.size())
+                return false;
+
+            bricks[index] = !bricks[index];
+        }
+
+        return true;
+    }
+
+    if (encoding != NAllBricks || count / 8 > UdpSocket::MaxDatagramSize)
+        return false;
+
+    bricks.assign(count, false);
+    for (std::size_t i{0}; i < bricks.size(); i += 8)
+    {
+        Uint8 bits;
+        if (!(mPacket >> bits))
+            return false;
+
+        for (std::size_t j{0}; j < 8 && i + j < bricks.size(); ++j)
+            bricks[i + j] = (bits >> j) & 1;
+    }
+
+    return true;
+}
+
+// Input of a client frame, and the steps the client ran with it.
+struct NetInput
+{
+    std::uint32_t sequence;
+    std::uint16_t steps;
+    InputSnapshot input;
+};
+
+// Authoritative side of a two-player game. It runs the logic with the
+// input of its clients, and after every frame sends each one the state
+// as a delta against the last one it acknowledged. Clients are given the
+// players from `mFirstPlayer` on in the order they show up, a windowed
+// host plays the first player itself, a dedicated server none.
+class NetServer
+{
+  private:
+    // More queued inputs than this and the client is too far ahead, the
+    // oldest are dropped.
+    static constexpr std::size_t maxPendingInputs{64};
+
+    struct Client
+    {
+        IpAddress address{IpAddress::None};
+        unsigned short port{0};
+        std::uint32_t acknowledged{0};
+        // Inputs received and not applied yet, oldest first.
+        // `queuedSequence` is the newest received, the others are
+        // repeats of lost packets.
+        std::deque<NetInput> pendingInputs;
+        std::uint32_t queuedSequence{0};
+        std::uint32_t appliedSequence{0}, appliedSteps{0};
+    };
+
+    UdpSocket socket;
+    std::size_t firstPlayer;
+    std::vector<Client> clients;
+    std::uint32_t sequence{0};
+    NetHistory history;
+    Packet packet;
+    std::size_t snapshotsSent{0}, bytesSent{0};
+
+  public:
+    NetServer(std::size_t mFirstPlayer = 1) : firstPlayer{mFirstPlayer}, clients(maxPlayers - mFirstPlayer) {}
+
+    bool listen(unsigned short mPort)
+    {
+        if (socket.bind(mPort) != Socket::Done)
+            return false;
+
+        socket.setBlocking(false);
+        return true;
+    }
+
+    // Queue the inputs of the clients, before the steps of the frame.
+    void receive();
+
+    // Input of every client for the next step, into `mInputs` by player.
+    // When none arrived in time the paddle waits for it instead of
+    // guessing, then it still moves exactly as the client predicted, only
+    // later.
+    void nextInputs(std::array<InputSnapshot, maxPlayers> &mInputs)
+    {
+        for (std::size_t i{0}; i < clients.size(); ++i)
+        {
+            auto &client(clients[i]);
+            auto &input(mInputs[firstPlayer + i]);
+            if (client.pendingInputs.empty())
+            {
+                input = InputSnapshot{};
+                continue;
+            }
+
+            const auto &next(client.pendingInputs.front());
+            input = next.input;
+            if (client.appliedSequence != next.sequence)
+            {
+                client.appliedSequence = next.sequence;
+                client.appliedSteps = 0;
+            }
+
+            if (++client.appliedSteps >= next.steps)
+                client.pendingInputs.pop_front();
+        }
+    }
+
+    // Send the state after the steps of the frame.
+    void send(Game &mGame);
+
+    std::size_t getSnapshotCount() const noexcept { return snapshotsSent; }
+    std::size_t getBytesSent() const noexcept { return bytesSent; }
+
+    void report() const
+    {
+        if (snapshotsSent == 0)
+            return;
+
+        cout << snapshotsSent << " snapshots sent, " << bytesSent / snapshotsSent << " bytes on average" << endl;
+    }
+};
+
+// Client side: sends the local input every frame and shows the newest
+// state of the server. Only the paddle of its player is simulated here,
+// from how the server last saw it and the inputs it didn't apply yet.
+class NetClient
+{
+  private:
+    struct Prediction
+    {
+        NetInput input;
+        // Paddle position and speed before the steps of the input.
+        PhysicsVector start;
+        float startSpeed;
+    };
+
+    static constexpr std::size_t maxPredictions{128};
+    // Every input is sent this many times, in the packets of the frames
+    // that follow, so a lost packet doesn't lose it.
+    static constexpr std::size_t inputRepeats{4};
+
+    UdpSocket socket;
+    IpAddress serverAddress{IpAddress::None};
+    unsigned short serverPort{0};
+    // Inputs played, `inputSequence` is the newest.
+    std::array<Prediction, maxPredictions> predictions;
+    std::uint32_t inputSequence{0};
+    std::size_t rollbacks{0};
+    NetHistory history;
+    // Newest state applied to the game.
+    std::uint32_t latest{0};
+    NetState received;
+    Packet packet;
+
+  public:
+    bool connect(const std::string &mHost, unsigned short mPort)
+    {
+        serverAddress = IpAddress{mHost};
+        serverPort = mPort;
+        if (serverAddress == IpAddress::None || socket.bind(Socket::AnyPort) != Socket::Done)
+            return false;
+
+        socket.setBlocking(false);
+        return true;
+    }
+
+    // Apply the newest state received, then move the paddle `mSteps`
+    // steps with the input of this frame and send it.
+    void update(Game &mGame, std::uint16_t mSteps);
+
+    std::size_t getRollbackCount() const noexcept { return rollbacks; }
+
+  private:
+    Prediction *findPrediction(std::uint32_t mSequence) noexcept
+    {
+        auto &prediction(predictions[mSequence % maxPredictions]);
+        return mSequence != 0 && prediction.input.sequence == mSequence ? &prediction : nullptr;
+    }
+
+    // Move the paddle from where `mState` says it was, through the inputs
+    // the server didn't apply yet, unless that's where it was predicted.
+    void reconcile(Game &mGame, Entity &mPaddle, const Vector2i &mConfirmed, const NetState &mState);
+};
+
+// Tournament broadcast: every frame the state is encoded once, as a delta
+// against the previous frame, and the same bytes are queued to every
+// spectator, so a spectator costs a send and no encoding. Every
+// `keyframeInterval` frames the state is a full one instead, and the
+// frames since the last keyframe are kept for the spectators who join
+// late. The spectators connect over TCP, the chain of deltas can't lose
+// a link, and the frames are framed like an `sf::Packet` is on a
+// `TcpSocket`: u32 big-endian size, then a snapshot packet of player
+// `maxPlayers`, none of the paddles.
+//
+// A spectator whose connection can't keep up with the frames drops the
+// ones queued and waits for the next keyframe. The selector lets through
+// at most FD_SETSIZE sockets, hence `maxSpectators`.
+class NetBroadcast
+{
+  private:
+    static constexpr std::uint32_t keyframeInterval{60};
+    static constexpr std::size_t maxQueued{2 * keyframeInterval}, maxSpectators{1000};
+
+    using Frame = std::shared_ptr<const std::vector<char>>;
+
+    struct Spectator
+    {
+        std::unique_ptr<TcpSocket> socket;
+        std::deque<Frame> queued;
+        // Bytes of the first frame already sent.
+        std::size_t offset{0};
+        bool waitingKeyframe{false};
+    };
+
+    TcpListener listener;
+    SocketSelector selector;
+    std::vector<Spectator> spectators;
+    // The last keyframe and the frames after it.
+    std::vector<Frame> sinceKeyframe;
+    std::uint32_t sequence{0};
+    NetHistory history;
+    Packet packet;
+    std::size_t framesEncoded{0}, bytesEncoded{0}, bytesSent{0};
+
+    // Accept the new spectators and forget the ones that left. They send
+    // nothing, a socket that becomes readable was closed.
+    void poll()
+    {
+        if (!selector.wait(microseconds(1)))
+            return;
+
+        char ignored[64];
+        std::size_t received;
+        spectators.erase(std::remove_if(std::begin(spectators), std::end(spectators),
+                                        [&](Spectator &mSpectator) {
+                                            if (!selector.isReady(*mSpectator.socket) ||
+                                                mSpectator.socket->receive(ignored, sizeof(ignored), received) ==
+                                                    Socket::NotReady)
+                                                return false;
+
+                                            selector.remove(*mSpectator.socket);
+                                            return true;
+                                        }),
+                         std::end(spectators));
+
+        if (!selector.isReady(listener))
+            return;
+
+        std::unique_ptr<TcpSocket> socket{new TcpSocket};
+        while (spectators.size() < maxSpectators && listener.accept(*socket) == Socket::Done)
+        {
+            socket->setBlocking(false);
+            selector.add(*socket);
+            spectators.emplace_back(Spectator{std::move(socket), {std::begin(sinceKeyframe), std::end(sinceKeyframe)}});
+            socket.reset(new TcpSocket);
+        }
+    }
+
+    // Send what the socket takes, false when the spectator is gone.
+    bool flush(Spectator &mSpectator)
+    {
+        while (!mSpectator.queued.empty())
+        {
+            const auto &frame(*mSpectator.queued.front());
+            std::size_t sent;
+            const auto status(mSpectator.socket->send(frame.data() + mSpectator.offset,
+                                                      frame.size() - mSpectator.offset, sent));
+            if (status == Socket::Disconnected || status == Socket::Error)
+                return false;
+
+            mSpectator.offset += sent;
+            bytesSent += sent;
+            if (mSpectator.offset < frame.size())
+                return true;
+
+            mSpectator.queued.pop_front();
+            mSpectator.offset = 0;
+        }
+
+        return true;
+    }
+
+  public:
+    bool listen(unsigned short mPort)
+    {
+        if (listener.listen(mPort) != Socket::Done)
+            return false;
+
+        listener.setBlocking(false);
+        selector.add(listener);
+        return true;
+    }
+
+    // Encode the state after the steps of the frame and queue it to
+    // every spectator.
+    void send(Game &mGame);
+
+    std::size_t getSpectatorCount() const noexcept { return spectators.size(); }
+    std::size_t getBytesSent() const noexcept { return bytesSent; }
+
+    void report() const
+    {
+        if (framesEncoded == 0)
+            return;
+
+        cout << framesEncoded << " broadcast frames, " << bytesEncoded / framesEncoded << " bytes on average, "
+             << bytesSent / 1024 << " KiB sent to spectators" << endl;
+    }
+};
+
+// Watches a broadcast: shows the newest state received, nothing is
+// simulated nor sent.
+class NetSpectator
+{
+  private:
+    TcpSocket socket;
+    NetHistory history;
+    std::uint32_t latest{0};
+    NetState received;
+    Packet packet;
+
+  public:
+    bool connect(const std::string &mHost, unsigned short mPort)
+    {
+        const IpAddress address{mHost};
+        if (address == IpAddress::None || socket.connect(address, mPort, seconds(5.f)) != Socket::Done)
+            return false;
+
+        socket.setBlocking(false);
+        return true;
+    }
+
+    // False once the broadcast is over.
+    bool update(Game &mGame);
+};
+
+// Counters of the running game for monitoring, served as text on a local
+// TCP port: every connection gets the latest sample, then it is closed,
+// e.g. `nc localhost 51300`. The text is formatted once per second into a
+// fixed buffer, serving it costs a non-blocking accept per frame.
+class StatsServer
+{
+  private:
+    static constexpr float sampleInterval{1000.f};
+
+    TcpListener listener;
+    TcpSocket client;
+    std::array<char, 2048> text;
+    std::size_t length{0};
+    float sinceSample{sampleInterval};
+
+    void sample(const Game &mGame);
+
+  public:
+    bool listen(unsigned short mPort)
+    {
+        if (listener.listen(mPort, IpAddress::LocalHost) != Socket::Done)
+            return false;
+
+        listener.setBlocking(false);
+        return true;
+    }
+
+    // Once per frame, after the profiler ended it.
+    void update(const Game &mGame, FrameTime mFT)
+    {
+        sinceSample += mFT;
+        if (sinceSample >= sampleInterval)
+        {
+            sample(mGame);
+            sinceSample = 0.f;
+        }
+
+        if (listener.accept(client) != Socket::Done)
+            return;
+
+        // What doesn't fit in the socket buffer is dropped, the sample is
+        // small enough for that never to happen.
+        client.setBlocking(false);
+        std::size_t sent;
+        client.send(text.data(), length, sent);
+        client.disconnect();
+    }
+};
+
+constexpr unsigned short statsDefaultPort{51300};
+
+// Posts the scores to a central leaderboard from a thread of its own:
+// `sf::Http::sendRequest` blocks for the whole round-trip, so the game
+// only queues scores with `submit` and picks the outcomes up with `poll`.
+// The scores queued while a request is on its way go in the next one,
+// up to `maxBatch` of them, one "name points combo" line each. A request
+// that fails on the server's side or on the way is tried again after
+// waiting twice as long as the previous time, a rejected one is dropped.
+class Leaderboard
+{
+  public:
+    struct Result
+    {
+        enum Outcome : std::uint8_t
+        {
+            Accepted,
+            // The server refused them, sending them again wouldn't help.
+            Rejected,
+            // Still failing after `maxAttempts`.
+            Failed
+        };
+
+        Outcome outcome;
+        std::uint32_t scores;
+        int status;
+    };
+
+  private:
+    static constexpr std::size_t maxBatch{32};
+    static constexpr unsigned maxAttempts{8};
+    // Milliseconds, the first wait is doubled up to the last one.
+    static constexpr int firstBackoff{500}, maxBackoff{60000};
+
+    struct Submission
+    {
+        std::string name;
+        std::uint32_t points, combo;
+    };
+
+    Http http;
+    std::string path;
+    std::deque<Submission> pending;
+    std::vector<Result> results;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping{false};
+    // Only started by the first score.
+    std::thread worker;
+
+    static bool isRetried(Http::Response::Status mStatus) noexcept
+    {
+        return mStatus >= Http::Response::InternalServerError || mStatus == Http::Response::ServiceNotAvailable ||
+               mStatus == Http::Response::InvalidResponse || mStatus == Http::Response::ConnectionFailed;
+    }
+
+    // Moves the oldest pending scores into the batch until it is full.
+    void fill(std::vector<Submission> &mBatch)
+    {
+        while (mBatch.size() < maxBatch && !pending.empty())
+        {
+            mBatch.emplace_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+    }
+
+    void run()
+    {
+        ARKANOID_THREAD("leaderboard");
+
+        std::vector<Submission> batch;
+        std::string body;
+        unsigned attempts{0};
+        int backoff{firstBackoff};
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                // A batch being retried is sent again right away.
+                wakeUp.wait(lock, [this, &batch] { return stopping || !pending.empty() || !batch.empty(); });
+                if (stopping)
+                    return;
+
+                fill(batch);
+            }
+
+            body.clear();
+            for (const auto &submission : batch)
+                body += submission.name + ' ' + std::to_string(submission.points) + ' ' +
+                        std::to_string(submission.combo) + '\n';
+
+            Http::Request request{path, Http::Request::Post, body};
+            request.setField("Content-Type", "text/plain");
+            const auto status(http.sendRequest(request, seconds(10.f)).getStatus());
+
+            std::unique_lock<std::mutex> lock{mutex};
+            const bool retried{isRetried(status) && ++attempts < maxAttempts};
+            if (!retried)
+            {
+                const auto outcome(status < Http::Response::MultipleChoices ? Result::Accepted
+                                   : isRetried(status)                      ? Result::Failed
+                                                                            : Result::Rejected);
+                results.emplace_back(Result{outcome, static_cast<std::uint32_t>(batch.size()), status});
+                batch.clear();
+                attempts = 0;
+                backoff = firstBackoff;
+                continue;
+            }
+
+            // Woken up early only to stop, the scores still unsent are lost.
+            if (wakeUp.wait_for(lock, std::chrono::milliseconds{backoff}, [this] { return stopping; }))
+                return;
+            backoff = std::min(backoff * 2, maxBackoff);
+        }
+    }
+
+  public:
+    Leaderboard() = default;
+    Leaderboard(const Leaderboard &) = delete;
+    Leaderboard &operator=(const Leaderboard &) = delete;
+
+    ~Leaderboard()
+    {
+        if (!worker.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wakeUp.notify_one();
+        worker.join();
+    }
+
+    // "http://host[:port]/path", the scheme can be left out. False when
+    // there is no host.
+    bool open(const std::string &mUrl)
+    {
+        std::string host{mUrl.compare(0, 7, "http://") == 0 ? mUrl.substr(7) : mUrl};
+        const auto slash(host.find('/'));
+        path = slash != std::string::npos ? host.substr(slash) : "/";
+        host.resize(std::min(slash, host.size()));
+
+        unsigned short port{0};
+        const auto colon(host.find(':'));
+        if (colon != std::string::npos)
+        {
+            port = static_cast<unsigned short>(std::strtoul(host.c_str() + colon + 1, nullptr, 10));
+            host.resize(colon);
+        }
+
+        if (host.empty())
+            return false;
+
+        http.setHost(host, port);
+        return true;
+    }
+
+    // Spaces in `mName` would split the line, they become underscores.
+    void submit(std::string mName, std::uint32_t mPoints, std::uint32_t mCombo)
+    {
+        for (auto &c : mName)
+            if (std::isspace(static_cast<unsigned char>(c)))
+                c = '_';
+
+        if (!worker.joinable())
+            worker = std::thread{[this] { run(); }};
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            pending.emplace_back(Submission{std::move(mName), mPoints, mCombo});
+        }
+        wakeUp.notify_one();
+    }
+
+    // The outcome of a request since the last call, false when there is
+    // none. Never waits for the worker to be done with a request.
+    bool poll(Result &mResult)
+    {
+        std::unique_lock<std::mutex> lock{mutex, std::try_to_lock};
+        if (!lock.owns_lock() || results.empty())
+            return false;
+
+        mResult = results.front();
+        results.erase(std::begin(results));
+        return true;
+    }
+};
+
+// Bricks of a level laid out on a regular grid, kept out of the `Manager`
+// in fixed arrays indexed by their order in the level. A brick breaking
+// only clears its bit in `alive` and collapses its quad: no entity nor
+// component is freed and nothing moves until the next level. Every cell
+// of the grid holds the slot of its brick, so a ball looks only at the
+// cells it covers and skips the dead bricks with the bitset.
+class BrickField
+{
+  public:
+    static constexpr std::uint32_t noSlot{std::numeric_limits<std::uint32_t>::max()};
+    // Sparse levels would need too many cells.
+    static constexpr std::size_t maxCells{1 << 22};
+
+    // What the collision tests need of a brick, the sides of its box.
+    struct Box
+    {
+        PhysicsVector center, halfSize;
+
+        PhysicsScalar x() const noexcept { return center.x; }
+        PhysicsScalar y() const noexcept { return center.y; }
+        PhysicsScalar left() const noexcept { return center.x - halfSize.x; }
+        PhysicsScalar right() const noexcept { return center.x + halfSize.x; }
+        PhysicsScalar top() const noexcept { return center.y - halfSize.y; }
+        PhysicsScalar bottom() const noexcept { return center.y + halfSize.y; }
+    };
+
+  private:
+    // Center of the first cell, and from one cell to the next.
+    Vector2f origin, pitch;
+    int columns{0}, rows{0};
+    std::vector<std::uint32_t> cells;
+
+    std::vector<Box> boxes;
+    std::vector<std::uint8_t> hitPoints;
+    std::vector<BrickType> types;
+    std::vector<Color> colors;
+    std::vector<std::size_t> quads;
+    std::vector<std::uint64_t> alive;
+    std::size_t aliveCount{0};
+    RectangleBatch *batch{nullptr};
+
+    // Clamped before the conversion, a query can be anywhere.
+    int column(float mX) const noexcept
+    {
+        const float position{(mX - origin.x) / pitch.x + 0.5f};
+        return static_cast<int>(std::floor(std::max(-1.f, std::min(static_cast<float>(columns), position))));
+    }
+
+    int row(float mY) const noexcept
+    {
+        const float position{(mY - origin.y) / pitch.y + 0.5f};
+        return static_cast<int>(std::floor(std::max(-1.f, std::min(static_cast<float>(rows), position))));
+    }
+
+    // Smallest gap between the sorted and unique `mValues`, `mDefault`
+    // when there is only one.
+    static float findPitch(const std::vector<float> &mValues, float mDefault) noexcept
+    {
+        float pitch{0.f};
+        for (std::size_t i{1}; i < mValues.size(); ++i)
+            if (pitch == 0.f || mValues[i] - mValues[i - 1] < pitch)
+                pitch = mValues[i] - mValues[i - 1];
+
+        return pitch != 0.f ? pitch : mDefault;
+    }
+
+  public:
+    BrickField() = default;
+    BrickField(const BrickField &) = delete;
+    BrickField &operator=(const BrickField &) = delete;
+
+    ~BrickField() { clear(); }
+
+    // Take the bricks of `mLevel` when they all have the same size and sit
+    // one per cell on a grid with room for them. Returns false otherwise
+    // and the field stays empty. Nothing is drawn until `attach`, so a
+    // field can be built on another thread.
+    bool build(const Level &mLevel)
+    {
+        clear();
+        if (mLevel.bricks.empty())
+            return false;
+
+        const auto halfSize(mLevel.bricks.front().halfSize);
+        std::vector<float> xs, ys;
+        for (const auto &brick : mLevel.bricks)
+        {
+            if (brick.halfSize != halfSize)
+                return false;
+
+            xs.emplace_back(brick.position.x);
+            ys.emplace_back(brick.position.y);
+        }
+
+        for (auto values : {&xs, &ys})
+        {
+            std::sort(std::begin(*values), std::end(*values));
+            values->erase(std::unique(std::begin(*values), std::end(*values)), std::end(*values));
+        }
+
+        pitch = Vector2f{findPitch(xs, halfSize.x * 2.f), findPitch(ys, halfSize.y * 2.f)};
+        if (pitch.x < halfSize.x * 2.f || pitch.y < halfSize.y * 2.f)
+            return false;
+
+        origin = Vector2f{xs.front(), ys.front()};
+        const auto width(std::lround((xs.back() - xs.front()) / pitch.x) + 1);
+        const auto height(std::lround((ys.back() - ys.front()) / pitch.y) + 1);
+        if (std::int64_t{width} * height > std::int64_t{maxCells})
+            return false;
+
+        columns = static_cast<int>(width);
+        rows = static_cast<int>(height);
+        cells.assign(static_cast<std::size_t>(columns * rows), std::uint32_t{noSlot});
+
+        for (std::size_t i{0}; i < mLevel.bricks.size(); ++i)
+        {
+            // Off the grid, or sharing a cell with another brick.
+            const auto &position(mLevel.bricks[i].position);
+            const int iX{column(position.x)}, iY{row(position.y)};
+            if (iX < 0 || iX >= columns || iY < 0 || iY >= rows ||
+                std::abs(origin.x + iX * pitch.x - position.x) > pitch.x / 100.f ||
+                std::abs(origin.y + iY * pitch.y - position.y) > pitch.y / 100.f ||
+                cells[iY * columns + iX] != noSlot)
+            {
+                cells.clear();
+                columns = rows = 0;
+                return false;
+            }
+
+            cells[iY * columns + iX] = static_cast<std::uint32_t>(i);
+        }
+
+        for (const auto &brick : mLevel.bricks)
+        {
+            // The same defaults as `Game::createBrick`.
+            const std::uint8_t brickHitPoints(brick.hitPoints > 0 ? brick.hitPoints : brickTypes[brick.type].hitPoints);
+            const auto color(getBrickColor(brick.type, brickHitPoints, brick.color));
+
+            boxes.emplace_back(Box{fromVector2f<PhysicsScalar>(brick.position), fromVector2f<PhysicsScalar>(halfSize)});
+            hitPoints.emplace_back(brickHitPoints);
+            types.emplace_back(brick.type);
+            colors.emplace_back(color);
+        }
+
+        aliveCount = boxes.size();
+        alive.assign((aliveCount + 63) / 64, 0);
+        for (std::size_t i{0}; i < aliveCount; ++i)
+            alive[i / 64] |= std::uint64_t{1} << (i % 64);
+
+        return true;
+    }
+
+    // Draw the bricks into `mBatch` from now on.
+    void attach(RectangleBatch &mBatch)
+    {
+        batch = &mBatch;
+        for (std::uint32_t i{0}; i < boxes.size(); ++i)
+        {
+            const auto halfSize(isAlive(i) ? toVector2f(boxes[i].halfSize) : Vector2f{});
+            quads.emplace_back(batch->add());
+            batch->set(quads.back(), toVector2f(boxes[i].center), halfSize, colors[i]);
+        }
+    }
+
+    bool build(const Level &mLevel, RectangleBatch &mBatch)
+    {
+        if (!build(mLevel))
+            return false;
+
+        attach(mBatch);
+        return true;
+    }
+
+    // Exchange the bricks, and the batch they are drawn into, in constant
+    // time.
+    void swap(BrickField &mOther) noexcept
+    {
+        std::swap(origin, mOther.origin);
+        std::swap(pitch, mOther.pitch);
+        std::swap(columns, mOther.columns);
+        std::swap(rows, mOther.rows);
+        cells.swap(mOther.cells);
+        boxes.swap(mOther.boxes);
+        hitPoints.swap(mOther.hitPoints);
+        types.swap(mOther.types);
+        colors.swap(mOther.colors);
+        quads.swap(mOther.quads);
+        alive.swap(mOther.alive);
+        std::swap(aliveCount, mOther.aliveCount);
+        std::swap(batch, mOther.batch);
+    }
+
+    // Give the quads back to the batch, the arrays keep their capacity.
+    void clear()
+    {
+        if (batch != nullptr)
+            for (auto quad : quads)
+                batch->remove(quad);
+
+        batch = nullptr;
+        columns = rows = 0;
+        cells.clear();
+        boxes.clear();
+        hitPoints.clear();
+        types.clear();
+        colors.clear();
+        quads.clear();
+        alive.clear();
+        aliveCount = 0;
+    }
+
+    std::size_t size() const noexcept { return boxes.size(); }
+    std::size_t getAliveCount() const noexcept { return aliveCount; }
+
+    bool isAlive(std::uint32_t mSlot) const noexcept { return ((alive[mSlot / 64] >> (mSlot % 64)) & 1) != 0; }
+    const Box &getBox(std::uint32_t mSlot) const noexcept { return boxes[mSlot]; }
+    const Color &getColor(std::uint32_t mSlot) const noexcept { return colors[mSlot]; }
+    const BrickTypeInfo &getType(std::uint32_t mSlot) const noexcept { return brickTypes[types[mSlot]]; }
+
+    // Hit by a ball, it breaks once it has no hit points left, like
+    // `damageBrick`. Returns true when it broke.
+    bool damage(std::uint32_t mSlot)
+    {
+        const auto &type(getType(mSlot));
+        if (type.indestructible)
+            return false;
+
+        if (hitPoints[mSlot] > 1)
+        {
+            --hitPoints[mSlot];
+            if (type.shades[0] != 0)
+            {
+                colors[mSlot] = getBrickColor(types[mSlot], hitPoints[mSlot], Color{});
+                batch->set(quads[mSlot], toVector2f(boxes[mSlot].center), toVector2f(boxes[mSlot].halfSize),
+                           colors[mSlot]);
+            }
+            return false;
+        }
+
+        kill(mSlot);
+        return true;
+    }
+
+    // The quad is collapsed in place, it stays the brick's until `clear`.
+    void kill(std::uint32_t mSlot)
+    {
+        if (!isAlive(mSlot))
+            return;
+
+        alive[mSlot / 64] &= ~(std::uint64_t{1} << (mSlot % 64));
+        --aliveCount;
+        batch->set(quads[mSlot], toVector2f(boxes[mSlot].center), Vector2f{}, colors[mSlot]);
+    }
+
+    // Call `mFunction(slot)` for every alive brick that may intersect the
+    // area, a cell more on every side for the rounding of the cells.
+    template <typename TF>
+    void query(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction) const
+    {
+        if (aliveCount == 0)
+            return;
+
+        const int firstColumn{std::max(0, column(mLeft) - 1)}, lastColumn{std::min(columns - 1, column(mRight) + 1)};
+        const int firstRow{std::max(0, row(mTop) - 1)}, lastRow{std::min(rows - 1, row(mBottom) + 1)};
+
+        for (int iY{firstRow}; iY <= lastRow; ++iY)
+            for (int iX{firstColumn}; iX <= lastColumn; ++iX)
+            {
+                const auto slot(cells[iY * columns + iX]);
+                if (slot != noSlot && isAlive(slot))
+                    mFunction(slot);
+            }
+    }
+};
+
+// Translations of things that move as a whole, each relative to its
+// parent. Setting one only marks it, `update` computes the world ones of
+// the nodes that changed, or whose parent did, in a single pass since a
+// parent always comes before its children. `getVersion` changes with the
+// world translation, for the caches built on it.
+class TransformHierarchy
+{
+  public:
+    static constexpr std::uint32_t noParent{std::numeric_limits<std::uint32_t>::max()};
+
+  private:
+    struct Node
+    {
+        std::uint32_t parent;
+        PhysicsVector local, world;
+        // Drawn with, in floats in every build.
+        Transform transform;
+        std::uint32_t version{0};
+        bool dirty{true};
+    };
+
+    std::vector<Node> nodes;
+
+  public:
+    // The parent must be added first.
+    std::uint32_t add(const PhysicsVector &mLocal, std::uint32_t mParent = noParent)
+    {
+        assert(mParent == noParent || mParent < nodes.size());
+        nodes.emplace_back(Node{mParent, mLocal, PhysicsVector{}, Transform{}});
+        return static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+
+    void clear() { nodes.clear(); }
+    std::size_t size() const noexcept { return nodes.size(); }
+
+    const PhysicsVector &getLocal(std::uint32_t mNode) const noexcept { return nodes[mNode].local; }
+
+    void setLocal(std::uint32_t mNode, const PhysicsVector &mLocal) noexcept
+    {
+        auto &node(nodes[mNode]);
+        if (node.local == mLocal)
+            return;
+
+        node.local = mLocal;
+        node.dirty = true;
+    }
+
+    void update() noexcept
+    {
+        for (auto &node : nodes)
+        {
+            const Node *parent(node.parent != noParent ? &nodes[node.parent] : nullptr);
+            // Marked by the same pass when it moved.
+            if (!node.dirty && (parent == nullptr || !parent->dirty))
+                continue;
+
+            const auto world(parent != nullptr ? parent->world + node.local : node.local);
+            node.dirty = world != node.world;
+            if (!node.dirty)
+                continue;
+
+            node.world = world;
+            node.transform = Transform{};
+            node.transform.translate(toVector2f(world));
+            ++node.version;
+        }
+
+        // The pass needed them, the next one starts clean.
+        for (auto &node : nodes)
+            node.dirty = false;
+    }
+
+    const PhysicsVector &getWorld(std::uint32_t mNode) const noexcept { return nodes[mNode].world; }
+    const Transform &getTransform(std::uint32_t mNode) const noexcept { return nodes[mNode].transform; }
+    std::uint32_t getVersion(std::uint32_t mNode) const noexcept { return nodes[mNode].version; }
+};
+
+// Bricks of the rows that slide, kept apart from the static ones so the
+// brick grid, the tree and the static layer never change for them. A row
+// is a node of `transforms`, riding on the row it is attached to: a step
+// moves the node, and only the rows whose world translation changed get
+// their world boxes computed again. The search order of a row doesn't
+// change with it, the centers are searched as laid out. Every row has its
+// own batch, drawn with the transform of its node, so no vertex is
+// written until a brick is hit.
+class KinematicBricks
+{
+  public:
+    using Box = BrickField::Box;
+
+    // Set on the slots in `BrickContact::slots`, they aren't the field's.
+    static constexpr std::uint32_t slotFlag{std::uint32_t{1} << 31};
+
+  private:
+    struct Row
+    {
+        std::uint32_t node;
+        // Its own slide, relative to the row it rides on.
+        PhysicsScalar offset{}, minOffset{}, maxOffset{}, velocity{};
+        // The band the boxes of the row span where they are laid out.
+        float top{0.f}, bottom{0.f}, maxHalfWidth{0.f};
+        // Slots of the row by the x of their center, and those centers.
+        std::vector<std::uint32_t> order;
+        std::vector<float> centers;
+        // `TransformHierarchy::getVersion` of the world boxes.
+        std::uint32_t boxesVersion{0};
+        // Drawn between the world translations of the last two steps.
+        Vector2f previousWorld, world;
+    };
+
+    TransformHierarchy transforms;
+    std::vector<Row> rows;
+    // Where the level laid them out, and where they are this step.
+    std::vector<Box> boxes, worldBoxes;
+    std::vector<std::uint32_t> rowOf;
+    std::vector<std::uint8_t> hitPoints;
+    std::vector<BrickType> types;
+    std::vector<Color> colors;
+    std::vector<std::size_t> quads;
+    std::vector<std::uint64_t> alive;
+    std::size_t aliveCount{0};
+
+    void updateBoxes(Row &mRow)
+    {
+        const auto &world(transforms.getWorld(mRow.node));
+        for (auto slot : mRow.order)
+        {
+            worldBoxes[slot] = boxes[slot];
+            worldBoxes[slot].center += world;
+        }
+
+        mRow.boxesVersion = transforms.getVersion(mRow.node);
+    }
+
+  public:
+    KinematicLayer layer;
+
+    // Take the rows of a level, they start where they are laid out and
+    // slide away from there. A row can only ride on one before it.
+    void build(const std::vector<LevelRow> &mRows)
+    {
+        clear();
+        // A row without bricks still carries the ones riding on it.
+        for (const auto &levelRow : mRows)
+        {
+            Row row;
+            row.node = transforms.add(PhysicsVector{}, levelRow.parent < rows.size() ? rows[levelRow.parent].node
+                                                                                     : TransformHierarchy::noParent);
+            row.minOffset = PhysicsScalar(std::min(0.f, levelRow.distance));
+            row.maxOffset = PhysicsScalar(std::max(0.f, levelRow.distance));
+            row.velocity = PhysicsScalar(levelRow.distance < 0.f ? -levelRow.speed : levelRow.speed);
+            row.top = std::numeric_limits<float>::max();
+            row.bottom = std::numeric_limits<float>::lowest();
+
+            const auto rowIndex(static_cast<std::uint32_t>(rows.size()));
+            layer.batches.emplace_back();
+            layer.transforms.emplace_back();
+            auto &batch(layer.batches.back());
+
+            for (const auto &brick : levelRow.bricks)
+            {
+                // The same defaults as `Game::createBrick`.
+                const std::uint8_t brickHitPoints(brick.hitPoints > 0 ? brick.hitPoints
+                                                                      : brickTypes[brick.type].hitPoints);
+                const auto color(getBrickColor(brick.type, brickHitPoints, brick.color));
+
+                row.order.emplace_back(static_cast<std::uint32_t>(boxes.size()));
+                row.top = std::min(row.top, brick.position.y - brick.halfSize.y);
+                row.bottom = std::max(row.bottom, brick.position.y + brick.halfSize.y);
+                row.maxHalfWidth = std::max(row.maxHalfWidth, brick.halfSize.x);
+
+                boxes.emplace_back(
+                    Box{fromVector2f<PhysicsScalar>(brick.position), fromVector2f<PhysicsScalar>(brick.halfSize)});
+                rowOf.emplace_back(rowIndex);
+                hitPoints.emplace_back(brickHitPoints);
+                types.emplace_back(brick.type);
+                colors.emplace_back(color);
+                quads.emplace_back(batch.add());
+                batch.set(quads.back(), brick.position, brick.halfSize, color);
+            }
+
+            std::sort(std::begin(row.order), std::end(row.order), [this](std::uint32_t mA, std::uint32_t mB) {
+                return boxes[mA].center.x < boxes[mB].center.x;
+            });
+            for (auto slot : row.order)
+                row.centers.emplace_back(toFloat(boxes[slot].center.x));
+
+            rows.emplace_back(std::move(row));
+        }
+
+        worldBoxes = boxes;
+        aliveCount = boxes.size();
+        alive.assign((aliveCount + 63) / 64, 0);
+        for (std::size_t i{0}; i < aliveCount; ++i)
+            alive[i / 64] |= std::uint64_t{1} << (i % 64);
+    }
+
+    // The arrays keep their capacity.
+    void clear()
+    {
+        transforms.clear();
+        rows.clear();
+        boxes.clear();
+        worldBoxes.clear();
+        rowOf.clear();
+        hitPoints.clear();
+        types.clear();
+        colors.clear();
+        quads.clear();
+        alive.clear();
+        aliveCount = 0;
+        layer.batches.clear();
+        layer.transforms.clear();
+    }
+
+    std::size_t size() const noexcept { return boxes.size(); }
+    std::size_t getRowCount() const noexcept { return rows.size(); }
+    std::size_t getAliveCount() const noexcept { return aliveCount; }
+
+    bool isAlive(std::uint32_t mSlot) const noexcept { return ((alive[mSlot / 64] >> (mSlot % 64)) & 1) != 0; }
+    const Box &getBox(std::uint32_t mSlot) const noexcept { return worldBoxes[mSlot]; }
+    const Color &getColor(std::uint32_t mSlot) const noexcept { return colors[mSlot]; }
+    const BrickTypeInfo &getType(std::uint32_t mSlot) const noexcept { return brickTypes[types[mSlot]]; }
+
+    // Slide every row by a step of `mFT` milliseconds, bouncing at the
+    // ends of its distance, then bring the world boxes of the rows that
+    // moved up to date, before any query of the step.
+    void update(float mFT)
+    {
+        for (auto &row : rows)
+        {
+            row.offset += row.velocity * PhysicsScalar(mFT);
+
+            if (row.offset > row.maxOffset)
+            {
+                row.offset = row.maxOffset - (row.offset - row.maxOffset);
+                row.velocity = -row.velocity;
+            }
+            else if (row.offset < row.minOffset)
+            {
+                row.offset = row.minOffset + (row.minOffset - row.offset);
+                row.velocity = -row.velocity;
+            }
+
+            transforms.setLocal(row.node, PhysicsVector{row.offset, PhysicsScalar{}});
+        }
+
+        transforms.update();
+        for (auto &row : rows)
+        {
+            row.previousWorld = row.world;
+            if (row.boxesVersion == transforms.getVersion(row.node))
+                continue;
+
+            row.world = toVector2f(transforms.getWorld(row.node));
+            updateBoxes(row);
+        }
+    }
+
+    // Where the layer draws the rows, between the last step and the next.
+    void sync(float mAlpha)
+    {
+        for (std::size_t i{0}; i < rows.size(); ++i)
+        {
+            const auto &row(rows[i]);
+            if (row.previousWorld == row.world)
+            {
+                layer.transforms[i] = transforms.getTransform(row.node);
+                continue;
+            }
+
+            layer.transforms[i] = Transform{};
+            layer.transforms[i].translate(row.previousWorld + (row.world - row.previousWorld) * mAlpha);
+        }
+    }
+
+    // Hit by a ball, like `BrickField::damage`. Returns true when it broke.
+    bool damage(std::uint32_t mSlot)
+    {
+        const auto &type(getType(mSlot));
+        if (type.indestructible)
+            return false;
+
+        if (hitPoints[mSlot] > 1)
+        {
+            --hitPoints[mSlot];
+            if (type.shades[0] != 0)
+            {
+                colors[mSlot] = getBrickColor(types[mSlot], hitPoints[mSlot], Color{});
+                layer.batches[rowOf[mSlot]].set(quads[mSlot], toVector2f(boxes[mSlot].center),
+                                                toVector2f(boxes[mSlot].halfSize), colors[mSlot]);
+            }
+            return false;
+        }
+
+        kill(mSlot);
+        return true;
+    }
+
+    void kill(std::uint32_t mSlot)
+    {
+        if (!isAlive(mSlot))
+            return;
+
+        alive[mSlot / 64] &= ~(std::uint64_t{1} << (mSlot % 64));
+        --aliveCount;
+        layer.batches[rowOf[mSlot]].set(quads[mSlot], toVector2f(boxes[mSlot].center), Vector2f{}, colors[mSlot]);
+    }
+
+    // Call `mFunction(slot)` for every alive brick that may intersect the
+    // area: the rows whose band it crosses, and in them the bricks whose
+    // centers are close enough, found by a binary search.
+    template <typename TF>
+    void query(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction) const
+    {
+        if (aliveCount == 0)
+            return;
+
+        for (const auto &row : rows)
+        {
+            if (mBottom < row.top + row.world.y || mTop > row.bottom + row.world.y)
+                continue;
+
+            const float left{mLeft - row.world.x - row.maxHalfWidth}, right{mRight - row.world.x + row.maxHalfWidth};
+            auto first(std::lower_bound(std::begin(row.centers), std::end(row.centers), left));
+            for (auto i(first - std::begin(row.centers)); i < static_cast<std::ptrdiff_t>(row.centers.size()) &&
+                                                           row.centers[i] <= right;
+                 ++i)
+                if (isAlive(row.order[i]))
+                    mFunction(row.order[i]);
+        }
+    }
+};
+
+// Levels played one after the other, listed in a text file, one per line:
+//   level [music]
+// where `#` starts a comment. While a level is played the next one is
+// read and laid out in a brick field by a loader thread, so the switch
+// is a swap of the prepared field on one step. After the last level
+// comes the first again, the ones that can't be read or have no bricks
+// are skipped.
+class Campaign
+{
+  public:
+    struct Entry
+    {
+        std::string level, music;
+    };
+
+  private:
+    std::vector<Entry> entries;
+    // Of the prepared level.
+    std::size_t current{0};
+    // Written by the loader thread until `ready`.
+    Level level;
+    BrickField field;
+    bool laidOut{false};
+    std::atomic<bool> ready{false};
+    std::thread loader;
+
+    void prepare(std::size_t mFirst)
+    {
+        ready = false;
+        loader = std::thread{[this, mFirst] {
+            ARKANOID_THREAD("campaign loader");
+
+            // Nothing of the level before, or of a file that failed half
+            // way, must be left in the next one.
+            level = Level{};
+            for (std::size_t i{0}; i < entries.size(); ++i)
+            {
+                const auto index((mFirst + i) % entries.size());
+                if (level.load(entries[index].level.c_str()) && !level.bricks.empty())
+                {
+                    current = index;
+                    break;
+                }
+
+                cerr << "Can't read level " << entries[index].level << endl;
+                level = Level{};
+            }
+
+            laidOut = field.build(level);
+            ready = true;
+        }};
+    }
+
+  public:
+    Campaign() = default;
+    Campaign(const Campaign &) = delete;
+    Campaign &operator=(const Campaign &) = delete;
+
+    ~Campaign() { wait(); }
+
+    // Read the list and start preparing its first level.
+    bool load(const std::string &mPath)
+    {
+        std::ifstream file{mPath};
+        if (!file)
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto comment(line.find('#'));
+            if (comment != std::string::npos)
+                line.resize(comment);
+
+            std::istringstream fields{line};
+            Entry entry;
+            if (fields >> entry.level)
+            {
+                fields >> entry.music;
+                entries.emplace_back(std::move(entry));
+            }
+        }
+
+        if (entries.empty())
+            return false;
+
+        prepare(0);
+        return true;
+    }
+
+    bool isReady() const noexcept { return ready; }
+
+    // Until `prepareNext`, the prepared level belongs to the caller.
+    void wait()
+    {
+        if (loader.joinable())
+            loader.join();
+    }
+
+    const Entry &getEntry() const noexcept { return entries[current]; }
+    // The one `prepareNext` tries first.
+    const Entry &getFollowingEntry() const noexcept { return entries[(current + 1) % entries.size()]; }
+    const Level &getLevel() const noexcept { return level; }
+    // Null when the level isn't laid out on a grid.
+    BrickField *getField() noexcept { return laidOut ? &field : nullptr; }
+
+    void prepareNext()
+    {
+        wait();
+        prepare(current + 1);
+    }
+};
+
+// What happened during a logic step. The collision code only pushes these
+// and moves on, the score, the sounds and the particles read them all at
+// the end of the step. Plain data, so pushing one is a copy into a fixed
+// buffer.
+struct GameEvent
+{
+    enum Type : std::uint8_t
+    {
+        EBrickHit,
+        EBrickBroken,
+        EPaddleHit,
+        EBallLost,
+        EPowerupCaught,
+        ECount
+    };
+
+    static constexpr std::uint32_t noEntity{std::numeric_limits<std::uint32_t>::max()};
+
+    Type type;
+    // Entity indices: the brick or the paddle that was hit, and the ball.
+    std::uint32_t entity, ball;
+    Vector2f position;
+    Color color;
+};
+
+// The events of the current step. The buffer is reused from step to step
+// and never grows, the events that don't fit are dropped and counted.
+class GameEvents
+{
+  public:
+    // A chain of explosions can break thousands of bricks in one step.
+    static constexpr std::size_t capacity{4096};
+
+  private:
+    std::array<GameEvent, capacity> events;
+    std::size_t count{0}, dropped{0};
+
+  public:
+    void push(const GameEvent &mEvent) noexcept
+    {
+        if (count == capacity)
+        {
+            ++dropped;
+            return;
+        }
+
+        events[count++] = mEvent;
+    }
+
+    void clear() noexcept { count = 0; }
+
+    const GameEvent *begin() const noexcept { return events.data(); }
+    const GameEvent *end() const noexcept { return events.data() + count; }
+    std::size_t size() const noexcept { return count; }
+    std::size_t getDropped() const noexcept { return dropped; }
+};
+
+// The values of the constants at the top of the file that can change while
+// the game runs. The game keeps its own copy, so the hot loop reads them
+// from one small struct next to the rest of its state.
+struct Tunables
+{
+    float ballRadius{::ballRadius}, ballVelocity{::ballVelocity};
+    float paddleWidth{::paddleWidth}, paddleHeight{::paddleHeight}, paddleVelocity{::paddleVelocity};
+    float paddleAcceleration{::paddleAcceleration};
+    // Milliseconds of game time simulated by a step of `ftSlice`. A
+    // recording made while changing it doesn't replay.
+    FrameTime ftStep{::ftStep};
+    // After a long frame, the steps over `maxSteps` (0 for no limit) are
+    // dropped and the game slows down for a moment. With `catchUp`, up to
+    // `maxSteps` more are kept and run by the next frames instead.
+    int maxSteps{maxFrameSteps}, catchUp{0};
+};
+
+// Settings read from a text file of "name value" lines with `#` comments,
+// arkanoid.cfg unless `--config` names another one:
+//     window_width 1024        window size, at startup
+//     window_height 768
+//     render_scale 0.5         resolution the game is drawn at, at startup
+//     bricks_x 11              bricks of the default level, at startup
+//     bricks_y 4
+//     ft_slice 1               milliseconds per step, at startup
+//     ft_step 1                the `Tunables`, also while the game runs
+//     ball_radius 10
+//     ball_velocity 0.5
+//     paddle_width 60
+//     paddle_height 20
+//     paddle_velocity 0.6
+//     paddle_acceleration 0.01 (0 for full speed right away)
+//     max_steps 100            logic steps per frame at most, 0 for no limit
+//     catch_up 1               run the steps over it later instead of dropping them
+//     idle_unfocused 0         keep playing without the focus, for soak tests
+// Missing names keep their values.
+struct Config
+{
+    unsigned windowWidth{::windowWidth}, windowHeight{::windowHeight};
+    int bricksX{countBlockX}, bricksY{countBlockY};
+    FrameTime ftSlice{::ftSlice};
+    float renderScale{1.f};
+    // Pause and stop drawing while the window doesn't have the focus.
+    int idleUnfocused{1};
+    Tunables tunables;
+
+    // Nothing changes when the file can't be read or has an invalid
+    // value, so a file caught half-written is simply read again later.
+    bool load(const std::string &mPath)
+    {
+        std::ifstream file{mPath};
+        if (!file)
+            return false;
+
+        Config loaded{*this};
+        // The floats must be over 0, or 0 too with `zeroValid`.
+        struct FloatSetting
+        {
+            const char *name;
+            float *value;
+            bool zeroValid;
+        };
+        const FloatSetting floats[]{{"ft_slice", &loaded.ftSlice, false},
+                                    {"render_scale", &loaded.renderScale, false},
+                                    {"ft_step", &loaded.tunables.ftStep, false},
+                                    {"ball_radius", &loaded.tunables.ballRadius, false},
+                                    {"ball_velocity", &loaded.tunables.ballVelocity, false},
+                                    {"paddle_width", &loaded.tunables.paddleWidth, false},
+                                    {"paddle_height", &loaded.tunables.paddleHeight, false},
+                                    {"paddle_velocity", &loaded.tunables.paddleVelocity, false},
+                                    {"paddle_acceleration", &loaded.tunables.paddleAcceleration, true}};
+        const std::pair<const char *, int *> ints[]{{"bricks_x", &loaded.bricksX},
+                                                    {"bricks_y", &loaded.bricksY},
+                                                    {"max_steps", &loaded.tunables.maxSteps},
+                                                    {"catch_up", &loaded.tunables.catchUp},
+                                                    {"idle_unfocused", &loaded.idleUnfocused}};
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto comment(line.find('#'));
+            if (comment != std::string::npos)
+                line.resize(comment);
+
+            std::istringstream fields{line};
+            std::string name;
+            if (!(fields >> name))
+                continue;
+
+            bool known{false}, valid{false};
+            if (name == "window_width" || name == "window_height")
+            {
+                known = true;
+                valid = static_cast<bool>(fields >> (name == "window_width" ? loaded.windowWidth : loaded.windowHeight));
+            }
+            for (const auto &entry : floats)
+                if (name == entry.name)
+                {
+                    known = true;
+                    valid = fields >> *entry.value &&
+                            (*entry.value > 0.f || (entry.zeroValid && *entry.value == 0.f));
+                }
+            for (const auto &entry : ints)
+                if (name == entry.first)
+                {
+                    known = true;
+                    valid = fields >> *entry.second && *entry.second >= 0;
+                }
+
+            if (!known)
+                cerr << "Unknown setting " << name << " in " << mPath << endl;
+            else if (!valid)
+            {
+                cerr << "Can't read " << name << " in " << mPath << endl;
+                return false;
+            }
+        }
+
+        *this = loaded;
+        return true;
+    }
+};
+
+// A timer of a `TimerWheel`. It stops being pending once it expires or
+// is cancelled, even if its slot is used by another timer since.
+struct TimerHandle
+{
+    static constexpr std::uint32_t none{std::numeric_limits<std::uint32_t>::max()};
+
+    std::uint32_t index{none}, generation{0};
+};
+
+// Timers that expire after a number of steps, on a hierarchical wheel:
+// `levels` rings of `slotCount` lists, the first with a slot per step, the
+// next with a slot per `slotCount` steps, and so on. A timer goes to the
+// ring that spans its delay and moves down a ring every time the one
+// below wraps around, so scheduling and cancelling take a constant time
+// and a step only looks at the timers that expire or move down, not at
+// all the ones pending. Timers further away than the wheel spans wait in
+// the last ring and go around it again.
+class TimerWheel
+{
+  public:
+    static constexpr std::size_t levels{4}, slotBits{6}, slotCount{std::size_t{1} << slotBits};
+
+  private:
+    static constexpr std::uint32_t none{TimerHandle::none};
+    static constexpr std::uint64_t span{std::uint64_t{1} << (slotBits * levels)};
+
+    // In a list of the wheel, or in `freeTimers` through `next`.
+    struct Timer
+    {
+        std::uint64_t expiry;
+        std::uint32_t previous, next, generation, tag;
+        std::uint16_t slot;
+        bool pending;
+    };
+
+    std::vector<Timer> timers;
+    std::array<std::uint32_t, levels * slotCount> slots;
+    std::uint32_t freeTimers{none};
+    std::uint64_t tick{0};
+
+    void link(std::uint32_t mIndex)
+    {
+        auto &timer(timers[mIndex]);
+        const auto wait(std::min(timer.expiry - tick, span - 1));
+
+        std::size_t level{0};
+        while (wait >= std::uint64_t{1} << (slotBits * (level + 1)))
+            ++level;
+
+        const auto at(tick + wait);
+        timer.slot = static_cast<std::uint16_t>(level * slotCount + ((at >> (slotBits * level)) & (slotCount - 1)));
+        timer.previous = none;
+        timer.next = slots[timer.slot];
+        if (timer.next != none)
+            timers[timer.next].previous = mIndex;
+        slots[timer.slot] = mIndex;
+    }
+
+    void unlink(std::uint32_t mIndex) noexcept
+    {
+        auto &timer(timers[mIndex]);
+        if (timer.previous != none)
+            timers[timer.previous].next = timer.next;
+        else
+            slots[timer.slot] = timer.next;
+        if (timer.next != none)
+            timers[timer.next].previous = timer.previous;
+    }
+
+    void release(std::uint32_t mIndex) noexcept
+    {
+        auto &timer(timers[mIndex]);
+        timer.pending = false;
+        ++timer.generation;
+        timer.next = freeTimers;
+        freeTimers = mIndex;
+    }
+
+    // Move the timers of a slot to the rings below.
+    void cascade(std::size_t mSlot)
+    {
+        auto index(slots[mSlot]);
+        slots[mSlot] = none;
+        while (index != none)
+        {
+            const auto next(timers[index].next);
+            link(index);
+            index = next;
+        }
+    }
+
+  public:
+    TimerWheel() { slots.fill(none); }
+
+    void reserve(std::size_t mCount) { timers.reserve(mCount); }
+
+    // `mTag` is what `advance` passes on when the timer expires, telling
+    // what it was for. It expires at the `mSteps`th call to `advance`,
+    // at least the next one.
+    TimerHandle schedule(std::uint64_t mSteps, std::uint32_t mTag)
+    {
+        auto index(freeTimers);
+        if (index != none)
+            freeTimers = timers[index].next;
+        else
+        {
+            index = static_cast<std::uint32_t>(timers.size());
+            timers.emplace_back(Timer{0, none, none, 0, 0, 0, false});
+        }
+
+        auto &timer(timers[index]);
+        timer.expiry = tick + std::max(mSteps, std::uint64_t{1});
+        timer.tag = mTag;
+        timer.pending = true;
+        link(index);
+
+        return TimerHandle{index, timer.generation};
+    }
+
+    bool isPending(const TimerHandle &mHandle) const noexcept
+    {
+        return mHandle.index < timers.size() && timers[mHandle.index].generation == mHandle.generation &&
+               timers[mHandle.index].pending;
+    }
+
+    // Steps before `mHandle` expires, 0 when it isn't pending.
+    std::uint64_t getRemaining(const TimerHandle &mHandle) const noexcept
+    {
+        return isPending(mHandle) ? timers[mHandle.index].expiry - tick : 0;
+    }
+
+    void cancel(TimerHandle &mHandle) noexcept
+    {
+        if (isPending(mHandle))
+        {
+            unlink(mHandle.index);
+            release(mHandle.index);
+        }
+
+        mHandle = TimerHandle{};
+    }
+
+    // Go a step forward and call `mFunction(tag)` for the timers that
+    // expire, in the reverse order they were scheduled in. It can
+    // schedule and cancel timers.
+    template <typename TF>
+    void advance(TF &&mFunction)
+    {
+        ++tick;
+        for (std::size_t level{1}; level < levels && (tick & ((std::uint64_t{1} << (slotBits * level)) - 1)) == 0;
+             ++level)
+            cascade(level * slotCount + ((tick >> (slotBits * level)) & (slotCount - 1)));
+
+        auto &slot(slots[tick & (slotCount - 1)]);
+        while (slot != none)
+        {
+            const auto index(slot);
+            unlink(index);
+            const auto tag(timers[index].tag);
+            release(index);
+            mFunction(tag);
+        }
+    }
+
+    // Cancel every timer, the handles to them stop being pending.
+    void clear() noexcept
+    {
+        for (std::uint32_t i{0}; i < timers.size(); ++i)
+            if (timers[i].pending)
+                release(i);
+        slots.fill(none);
+    }
+};
+
+// What a sequence waits for before it goes on: a number of steps, an
+// event of the game, or nothing more once it is over.
+struct SequenceWait
+{
+    enum Kind : std::uint8_t
+    {
+        Steps,
+        Event,
+        Done
+    };
+
+    Kind kind;
+    std::uint32_t steps;
+    GameEvent::Type event;
+
+    static SequenceWait forSteps(std::uint32_t mSteps) noexcept { return {Steps, mSteps, GameEvent::ECount}; }
+    static SequenceWait until(GameEvent::Type mEvent) noexcept { return {Event, 0, mEvent}; }
+    static SequenceWait done() noexcept { return {Done, 0, GameEvent::ECount}; }
+};
+
+// A scripted sequence of level events. Without coroutines, it is written
+// as a state machine: `resume` picks up from `stage`, does what comes next
+// and returns what to wait for before it is resumed again.
+class Sequence
+{
+  protected:
+    int stage{0};
+
+  public:
+    virtual ~Sequence() {}
+    virtual SequenceWait resume(Game &mGame) = 0;
+};
+
+// Runs the sequences of a level, once per step. Only the sequences that
+// are due are resumed: the ones waiting for steps are on a heap ordered by
+// the step they wake up at, the ones waiting for an event on a list for
+// that type of event. Sequences due at the same step run in the order
+// they were started in, so replays and network games see the same.
+class Sequencer
+{
+  private:
+    struct Timer
+    {
+        std::uint64_t step;
+        std::uint32_t sequence;
+
+        // Reversed, `std::push_heap` keeps the largest first.
+        bool operator<(const Timer &mOther) const noexcept
+        {
+            return step != mOther.step ? step > mOther.step : sequence > mOther.sequence;
+        }
+    };
+
+    std::vector<std::unique_ptr<Sequence>> sequences;
+    std::vector<std::uint32_t> freeSlots;
+    std::vector<Timer> timers;
+    std::array<std::vector<std::uint32_t>, GameEvent::ECount> waiting;
+    // The list of an event being resumed, swapped with the one of `waiting`
+    // so that the sequences can wait for the same event again.
+    std::vector<std::uint32_t> resumed;
+    std::uint64_t step{0};
+
+    void wait(std::uint32_t mSequence, const SequenceWait &mWait)
+    {
+        switch (mWait.kind)
+        {
+            case SequenceWait::Steps:
+                // Waiting for no step is waiting for the next one.
+                timers.emplace_back(Timer{step + std::max(mWait.steps, std::uint32_t{1}), mSequence});
+                std::push_heap(std::begin(timers), std::end(timers));
+                break;
+            case SequenceWait::Event: waiting[mWait.event].emplace_back(mSequence); break;
+            case SequenceWait::Done:
+                sequences[mSequence].reset();
+                freeSlots.emplace_back(mSequence);
+                break;
+        }
+    }
+
+  public:
+    // `mSequence` is resumed for the first time at the next `update`.
+    void start(std::unique_ptr<Sequence> mSequence)
+    {
+        std::uint32_t slot;
+        if (freeSlots.empty())
+        {
+            slot = static_cast<std::uint32_t>(sequences.size());
+            sequences.emplace_back();
+        }
+        else
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+
+        sequences[slot] = std::move(mSequence);
+        wait(slot, SequenceWait::forSteps(1));
+    }
+
+    // At the start of every step, resume the sequences whose wait is over.
+    void update(Game &mGame)
+    {
+        ++step;
+        while (!timers.empty() && timers.front().step <= step)
+        {
+            const auto sequence(timers.front().sequence);
+            std::pop_heap(std::begin(timers), std::end(timers));
+            timers.pop_back();
+            wait(sequence, sequences[sequence]->resume(mGame));
+        }
+    }
+
+    // Once the events of the step are known, resume the sequences waiting
+    // for them. They are resumed once per type of event, and look at
+    // `mEvents` for how many there were.
+    void notify(const GameEvents &mEvents, Game &mGame)
+    {
+        std::bitset<GameEvent::ECount> seen;
+        for (const auto &event : mEvents)
+            seen.set(event.type);
+
+        for (std::size_t type{0}; type < GameEvent::ECount; ++type)
+        {
+            if (!seen[type] || waiting[type].empty())
+                continue;
+
+            resumed.swap(waiting[type]);
+            for (auto sequence : resumed)
+                wait(sequence, sequences[sequence]->resume(mGame));
+            resumed.clear();
+        }
+    }
+
+    void clear()
+    {
+        sequences.clear();
+        freeSlots.clear();
+        timers.clear();
+        for (auto &list : waiting)
+            list.clear();
+        step = 0;
+    }
+
+    std::size_t getCount() const noexcept { return sequences.size() - freeSlots.size(); }
+};
+
+// Creates the bricks of a `LevelWave` when its trigger comes.
+class WaveSequence : public Sequence
+{
+  private:
+    LevelWave wave;
+    std::uint32_t broken{0};
+
+  public:
+    explicit WaveSequence(const LevelWave &mWave) : wave(mWave) {}
+
+    SequenceWait resume(Game &mGame) override;
+};
+
+// Points, combo and lives, from the events of each step. Every brick
+// broken before the ball comes back to a paddle is worth more than the
+// previous one, a paddle hit ends the combo and a ball reaching the
+// bottom of the play area costs a life.
+struct Score
+{
+    static constexpr std::uint32_t pointsPerBrick{10}, startLives{3};
+
+    std::uint32_t points{0}, combo{0}, bestCombo{0}, lives{startLives};
+    // Of the whole game, for the statistics of batch runs.
+    std::uint32_t paddleHits{0}, ballsLost{0};
+
+    void process(const GameEvents &mEvents) noexcept
+    {
+        for (const auto &event : mEvents)
+            switch (event.type)
+            {
+                case GameEvent::EBrickBroken:
+                    ++combo;
+                    bestCombo = std::max(bestCombo, combo);
+                    points += pointsPerBrick * combo;
+                    break;
+                case GameEvent::EPaddleHit:
+                    combo = 0;
+                    ++paddleHits;
+                    break;
+                case GameEvent::EBallLost:
+                    combo = 0;
+                    ++ballsLost;
+                    if (lives > 0)
+                        --lives;
+                    break;
+                default: break;
+            }
+    }
+};
+
+// Set during static initialization, as close to the start of the process
+// as it gets, for the time to the first frame.
+const auto processStart(chrono::high_resolution_clock::now());
+
+struct Game
+{
+    enum ArkanoidGroup : std::size_t
+    {
+        GPaddle,
+        GBrick,
+        GBall,
+        GPowerup
+    };
+
+    // What the timers of `timers` are for.
+    enum GameTimer : std::uint32_t
+    {
+        TWidePaddle,
+        TSlowBall,
+        TLaser,
+        TCount
+    };
+
+    // A broken brick drops a powerup once in `powerupDropChance`, when one
+    // of the `maxPowerups` isn't already falling. Caught ones last
+    // `powerupDuration` milliseconds.
+    static constexpr std::size_t maxPowerups{16}, maxBalls{64};
+    static constexpr unsigned powerupDropChance{8};
+    static constexpr float powerupDuration{10000.f}, widePaddleScale{1.5f}, slowBallScale{0.5f};
+
+    // Every ball has its own speed, the length of its velocity. It starts
+    // at `startBallSpeed` and grows by `ballRampPerSecond` of it every
+    // second, and by `ballComboBoost` of it for every brick broken in a
+    // combo, up to `maxBallSpeedFactor` times the start.
+    static constexpr float startBallSpeed{ballVelocity * 1.41421356f};
+    static constexpr float ballRampPerSecond{0.01f}, ballComboBoost{0.02f}, maxBallSpeedFactor{2.f};
+
+    // Windowed games draw and read the keyboard. Headless games have no
+    // window at all and only simulate, for benchmarks and regression runs
+    // on machines without a display.
+    enum class Mode
+    {
+        Windowed,
+        Headless
+    };
+
+    Mode mode;
+    // Every random decision of the game must come from `random`, so that a
+    // session can be replayed from its seed.
+    std::uint32_t seed;
+    std::minstd_rand random;
+    // When set, the input of every step is recorded into it.
+    Replay *recording{nullptr};
+    // When set, the steps take their input from it instead, and the game
+    // stops once it is over.
+    Replay *playback{nullptr};
+    // When set, the steps and frames are recorded into it, for a crash.
+    FlightRecorder *flightRecorder{nullptr};
+    // When set, the time of every frame is appended to it.
+    std::vector<FrameTime> *frameTimes{nullptr};
+    // When set, measures the latency of the key transitions.
+    LatencyProbe *latencyProbe{nullptr};
+    // When set, the game is played over the network: the server runs the
+    // logic, the client only shows the states it receives.
+    NetServer *netServer{nullptr};
+    NetClient *netClient{nullptr};
+    // When set, the state goes to the spectators every frame.
+    NetBroadcast *netBroadcast{nullptr};
+    // When set, the game only shows a broadcast.
+    NetSpectator *netSpectator{nullptr};
+    // When set, publishes counters for monitoring.
+    StatsServer *statsServer{nullptr};
+    // When set, the score of every game over is posted to it, as `playerName`.
+    Leaderboard *leaderboard{nullptr};
+    std::string playerName{"player"};
+    // Input of every player for the step: the first one is `input`, the
+    // others come from the network.
+    std::array<InputSnapshot, maxPlayers> playerInputs;
+    float lastPaddleVelocity{0.f};
+    InputSnapshot lastInput;
+    std::unique_ptr<RenderWindow> window;
+    // Set by `startRenderThread`, then the window is only drawn from there.
+    // Declared after the window, so it is stopped before the window goes.
+    std::unique_ptr<RenderThread> renderThread;
+    // Accumulate the current frametime slice.
+    // If the game run fast, it will take some frames before
+    // currentSlice >= ftSlice.
+    // else if the game run slow, it will take a single frame for
+    // currentSlice >= ftSlice * n, where n >= 1.
+    // Both are game time, in doubles like `FrameClock` keeps it.
+    double lastFrametime{0.0}, currentSlice{0.0};
+    // Steps not run since the game started, see `dropSteps`.
+    std::size_t droppedSteps{0};
+    // Time scale of the slow motion F7 turns on, P pauses and F6 steps.
+    static constexpr double slowMotionScale{0.1};
+    // Real and game time of `run`, paused or scaled. Other loops, like
+    // replays and benchmarks, set `lastFrametime` themselves.
+    FrameClock frameClock;
+    // Milliseconds simulated by every logic step. It defaults to `ftSlice`,
+    // a coarser step does less physics work per frame and the drawn
+    // positions are interpolated so the motion stays smooth.
+    FrameTime timeStep{ftSlice};
+    // Atomic, so the game can be stopped from another thread.
+    std::atomic<bool> running{false};
+    // Input sampled by `inputPhase`, and the one the logic steps read.
+    SpscQueue<InputSnapshot, 16> inputQueue;
+    InputSnapshot input;
+    // Keys held down, kept up to date from the window events so no key
+    // is polled.
+    std::bitset<sf::Keyboard::KeyCount> keys;
+    // Horizontal stick position of the gamepad that moved last, from -1 to
+    // 1, also kept from the events.
+    float joystickX{0.f};
+    unsigned int joystickID{0};
+    // Part of the level in the window. Scrolling levels move it up by
+    // `scrollVelocity` pixels per millisecond, `view` follows it.
+    FloatRect playArea{0.f, 0.f, windowWidth, windowHeight};
+    View view{playArea};
+    // The view of the overlays, which don't scroll.
+    View screenView{FloatRect{0.f, 0.f, windowWidth, windowHeight}};
+    // Whatever the size of the window, the game is drawn at its own size,
+    // `windowWidth` by `windowHeight`, scaled to fit into this part of the
+    // window. Black bars fill the rest.
+    FloatRect viewport{0.f, 0.f, 1.f, 1.f};
+    // With a render scale other than 1, the game is drawn into a texture
+    // of its size times the scale, then stretched over the viewport: below
+    // 1 to spare weak GPUs, above 1 to supersample. The overlays are drawn
+    // at the size of the window.
+    float renderScale{1.f};
+    std::unique_ptr<RenderTexture> sceneTexture;
+    Sprite sceneSprite;
+    // Bloom and CRT effects, F3 and F4 turn them on and off. The game is
+    // drawn into `sceneTexture` while one of them is on, at any scale.
+    PostProcess postProcess;
+    // F8 shows the broad phase of the last step.
+    DebugDraw debugDraw;
+    // F12 takes a screenshot, F11 starts and stops recording frames,
+    // from frames drawn by `drawPhase`.
+    FrameCapture capture;
+    float scrollVelocity{0.f};
+    // Set for streamed levels.
+    std::unique_ptr<LevelStreamer> levelStreamer;
+    // The waves of the level. They are not part of the network states and
+    // snapshots, levels with waves are for local games.
+    Sequencer sequencer;
+    // When set, the next level starts once every brick is broken.
+    std::unique_ptr<Campaign> campaign;
+    // Bricks created by `loadLevel`, in the order of the level. Network
+    // states refer to the bricks by their index here.
+    std::vector<EntityHandle> levelBricks;
+    // Declared before the manager, so they outlive the rectangles and the
+    // sprites.
+    RectangleBatch rectangleBatch;
+    // With `brickFieldLevels`, the levels laid out on a grid get their
+    // bricks here instead of in the manager. Drawn as plain rectangles.
+    BrickField brickField;
+    bool brickFieldLevels{false};
+    // The sliding rows of the level, in any of the three. Not part of the
+    // network states either.
+    KinematicBricks kinematicBricks;
+    CircleMesh circleMesh;
+#ifdef ARKANOID_GL_INSTANCING
+    // Used by `drawPhase` instead of the batch and the mesh when available.
+    InstancedRenderer instancedRenderer;
+    std::vector<CircleInstance> circleInstances;
+#endif
+#ifdef ARKANOID_GPU_TIMERS
+    // Only for frames drawn by `drawPhase`, not by the render thread.
+    GpuTimers gpuTimers;
+#endif
+    AssetCache assets;
+    TextureAtlas atlas;
+    RectangleBatch spriteBatch;
+    // Atlas region of the bricks, they are plain rectangles without one.
+    std::size_t brickRegion{TextureAtlas::npos};
+    // Where the untextured bricks go: the static layer when the window
+    // has one, the rectangle batch otherwise.
+    StaticLayer staticLayer;
+    RectangleBatch *brickBatch{&rectangleBatch};
+    bool useStaticLayer{false};
+    // Quads of the textured bricks in view, gathered for drawing through
+    // the render queue. The others go into the static layer.
+    QuadList visibleBricks;
+    RenderQueue renderQueue;
+    // Counted while drawing the last frame, and since the game started.
+    RenderStats renderStats, renderTotals;
+    Manager manager;
+    BrickGrid brickGrid;
+    // The bricks of the levels the grid doesn't suit, see `loadLevel`.
+    // Set while those are created, so they skip the grid.
+    BrickTree brickTree;
+    bool bricksInTree{false};
+    SRectangleSync rectangleSync;
+    SSpriteSync spriteSync;
+    SCircleSync circleSync;
+
+    // Only windowed games get worker threads, headless runs are usually
+    // many games in parallel already.
+    std::unique_ptr<JobSystem> jobSystem;
+    // From this many balls the ball/brick contacts are gathered in parallel.
+    // Every thread keeps the contacts it finds in its own buffer, then they
+    // are merged into `brickContacts` in the order of the balls.
+    static constexpr std::size_t minParallelBalls{64};
+    std::vector<std::vector<BrickContact>> threadContacts;
+    std::vector<BrickContact> brickContacts;
+    // The groups tested against each other every step, see `createWorld`.
+    CollisionMatrix collisions;
+    // Balls only bounce off each other when `collisions` has them. Their
+    // positions are gathered every step to build `ballGrid`, or with
+    // `sweepBalls` their boxes for `ballSweep`.
+    bool sweepBalls{false};
+    // Scratch containers of a frame, reset at the top of every frame of
+    // `run`. Outside of it there are no frames, every step resets it.
+    FrameArena frameArena;
+    bool inFrameLoop{false};
+    // What the frames hand over to the render thread.
+    DoubleFrameArena publishArenas;
+    // Debris of the broken bricks, only in windowed games.
+    static constexpr std::size_t particlesPerBrick{24};
+    ParticleSystem particles;
+    VertexArray particleVertices{Quads};
+    // Only windowed games make sounds and play music.
+    std::unique_ptr<AudioEngine> audio;
+    std::unique_ptr<MusicPlayer> music;
+    BallGrid ballGrid;
+    SweepAndPrune ballSweep;
+
+    // Chaos mode bodies, they only bounce around the window.
+    PhysicsBodies chaosBodies;
+    VertexArray chaosVertices{Points};
+
+    // F1 toggles the profiler overlay, F2 dumps it to "profile.csv".
+    FrameProfiler profiler;
+    ProfilerOverlay profilerOverlay;
+    std::size_t framesSinceOverlayUpdate{0};
+    FramePacer pacer;
+
+    // F10 toggles the level editor, the game is paused meanwhile. Every
+    // edit only touches the brick it places or removes, in the grid, the
+    // batch and the static layer. `level` is what is played, kept as laid
+    // out so the editor saves it in the binary format to `editorPath`.
+    Level level;
+    bool editing{false};
+    BrickType editorType{BNormal};
+    std::string editorPath{"level.arkl"};
+
+    // F9 toggles the inspector, clicking an entity selects it.
+    Inspector inspector;
+    std::size_t framesSinceInspectorUpdate{0};
+    EntityHandle inspected{0, 0};
+    bool inspecting{false};
+
+    // Window title readout, refreshed at 4 Hz by default.
+    FrameTime titleUpdateInterval{250.f}, titleElapsed{0.f};
+    std::size_t titleFrames{0};
+    std::array<char, 64> titleBuffer;
+
+    // Pushed by the collisions of a step, handled at its end.
+    GameEvents events;
+    // Explosive bricks broken this step, in the order they blow up, and
+    // the ones of the brick field.
+    std::vector<Entity *> blasts;
+    std::vector<std::uint32_t> fieldBlasts, kinematicBlasts;
+    // Ends the caught powerups. The wheel is advanced once per step, so a
+    // step only pays for the timers that expire.
+    TimerWheel timers;
+    TimerHandle widePaddleTimer, slowBallTimer, laserTimer;
+    // While the laser powerup lasts, the paddles fire a bullet from each
+    // of their ends every `laserInterval` milliseconds.
+    static constexpr float laserInterval{250.f};
+    float laserCooldown{0.f};
+    Projectiles projectiles;
+    // The speed the balls leave the paddle at.
+    float ballSpeedScale{1.f};
+    // Factors of `ballVelocity` and `paddleVelocity` for this game alone,
+    // set by `tune`. The slow ball powerup scales the ball one further.
+    float ballSpeedTuning{1.f}, paddleSpeedTuning{1.f};
+    Tunables tunables;
+    // Read by `loadConfig`, then read again whenever its file changes.
+    Config config;
+    FileWatcher configWatcher;
+    // The level file played with `--level`, reloaded often enough for
+    // designers to see their edits almost at once.
+    FileWatcher levelWatcher{250.f};
+#ifdef ARKANOID_FIXED_POINT
+    // Speed the balls gain over several steps before it is added, see
+    // `rampBallSpeeds`.
+    float pendingRamp{0.f};
+#endif
+    Score score;
+    // Of every step so far, see `hashStep`.
+    StateHash stateHash;
+
+    // Only windowed games have it, the FPS is refreshed with the title.
+    Hud hud;
+    bool firstFrameShown{false};
+    std::size_t fpsNumber{0}, scoreNumber{0}, livesNumber{0};
+
+    Entity &createBall()
+    {
+        auto &entity(manager.addEntity());
+        entity.addComponent<CPosition>(Vector2f{windowWidth / 2, windowHeight / 2});
+        entity.addComponent<CPhysics>(Vector2f{tunables.ballRadius, tunables.ballRadius});
+        entity.addComponent<CCircle>(this, tunables.ballRadius);
+
+        auto &cPhysics(entity.getComponent<CPhysics>());
+        cPhysics.velocity = fromVector2f<PhysicsScalar>(Vector2f{-ballVelocity, -ballVelocity} * ballSpeedScale);
+        // Bounce back into the window.
+        cPhysics.onOutOfBounds = [](CPhysics &mPhysics, const Vector2f &mSide) {
+            if (mSide.x != 0.f)
+            {
+                mPhysics.velocity.x = absolute(mPhysics.velocity.x) * PhysicsScalar(mSide.x);
+            }
+
+            if (mSide.y != 0.f)
+            {
+                mPhysics.velocity.y = absolute(mPhysics.velocity.y) * PhysicsScalar(mSide.y);
+            }
+        };
+
+        entity.addGroup(ArkanoidGroup::GBall);
+
+        return entity;
+    }
+
+    // Bricks can be smaller than the default, but not bigger, or the brick
+    // grid could miss them. Only the bricks of the tree can be.
+    // Without hit points, the brick gets the ones of its type.
+    Entity &createBrick(const Vector2f &mPosition,
+                        const Vector2f &mHalfSize = Vector2f{blockWidth / 2.f, blockHeight / 2.f},
+                        const Color &mColor = Color::Red, std::uint8_t mHitPoints = 1, BrickType mType = BNormal)
+    {
+        auto &entity(manager.addEntity());
+        const std::uint8_t hitPoints(mHitPoints > 0 ? mHitPoints : brickTypes[mType].hitPoints);
+        const auto color(getBrickColor(mType, hitPoints, mColor));
+
+        entity.addComponent<CPosition>(mPosition);
+        entity.addComponent<CPhysics>(mHalfSize);
+        if (brickRegion != TextureAtlas::npos)
+            entity.addComponent<CSprite>(this, mHalfSize, brickRegion, color);
+        else
+            entity.addComponent<CRectangle>(this, mHalfSize, color, brickBatch);
+        entity.addComponent<CBrick>(mType, hitPoints);
+
+        entity.addGroup(ArkanoidGroup::GBrick);
+        if (!bricksInTree)
+            brickGrid.add(entity);
+
+        return entity;
+    }
+
+    // The whole pool of powerups, hidden until they drop.
+    void createPowerups()
+    {
+        timers.reserve(TCount);
+        manager.reserve(maxPowerups);
+        for (std::size_t i{0}; i < maxPowerups; ++i)
+        {
+            auto &entity(manager.addEntity());
+
+            entity.addComponent<CPosition>(Vector2f{});
+            entity.addComponent<CPhysics>(Vector2f{powerupWidth / 2.f, powerupHeight / 2.f});
+            entity.addComponent<CRectangle>(this, Vector2f{}, Color::White);
+            entity.addComponent<CPowerup>();
+
+            entity.addGroup(ArkanoidGroup::GPowerup);
+        }
+    }
+
+    Entity &createPaddle(std::size_t mPlayer = 0, float mX = windowWidth / 2)
+    {
+        Vector2f halfSize{tunables.paddleWidth / 2.f, tunables.paddleHeight / 2.f};
+        auto &entity(manager.addEntity());
+
+        entity.addComponent<CPosition>(Vector2f{mX, windowHeight - 60.f});
+        entity.addComponent<CPhysics>(halfSize);
+        entity.addComponent<CRectangle>(this, halfSize);
+        entity.addComponent<CPaddleControl>(mPlayer);
+
+        entity.addGroup(ArkanoidGroup::GPaddle);
+
+        return entity;
+    }
+
+    // The paddle of `mPlayer` plays by itself from now on.
+    void enableAutopilot(std::size_t mPlayer = 0)
+    {
+        for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+            if (paddle->getComponent<CPaddleControl>().player == mPlayer && !paddle->hasComponent<CAutopilot>())
+                paddle->addComponent<CAutopilot>(toFloat(paddle->getComponent<CPosition>().position.x));
+    }
+
+    // Two-player games share the bottom of the window, the first paddle
+    // makes room for the second one.
+    void addSecondPlayer()
+    {
+        for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+        {
+            auto &cPosition(paddle->getComponent<CPosition>());
+            cPosition.position.x = cPosition.previousPosition.x = PhysicsScalar(windowWidth / 3.f);
+            ++cPosition.version;
+        }
+
+        createPaddle(1, windowWidth * 2.f / 3.f);
+    }
+
+    Game(Mode mMode = Mode::Windowed, std::uint32_t mSeed = std::random_device{}())
+        : mode{mMode}, seed{mSeed}, random{mSeed}
+    {
+        if (mode != Mode::Windowed)
+        {
+            profiler.enabled = false;
+            createWorld();
+            return;
+        }
+
+        // Creating the window and its context is most of the startup, and
+        // it has to be done on this thread, the one that gets the events.
+        // Meanwhile everything that needs no context is set up on another
+        // one. The bricks go to the static layer before it is known
+        // whether there is one, they are made again when there isn't.
+#ifndef ARKANOID_GL_INSTANCING
+        brickBatch = &staticLayer.batch;
+#endif
+        std::thread startup{[this] {
+            ARKANOID_THREAD("startup");
+            jobSystem.reset(new JobSystem);
+            manager.setJobSystem(jobSystem.get());
+            particles.reserve();
+
+            // Optional, the assets are read from their files without it.
+            assets.mount("assets.arkp");
+            audio.reset(new AudioEngine{assets, "sounds"});
+            music.reset(new MusicPlayer);
+
+            createWorld();
+        }};
+
+        window.reset(new RenderWindow{{windowWidth, windowHeight}, "Simple Arkanoid"});
+        pacer.setMode(*window, FramePacer::Mode::Limit, 60.f);
+        circleMesh.build(Color::Red);
+#ifdef ARKANOID_GL_INSTANCING
+        instancedRenderer.init();
+        // The instanced path keeps the bricks on the GPU already.
+        useStaticLayer = !instancedRenderer.isAvailable() && staticLayer.create(windowWidth, windowHeight);
+#else
+        useStaticLayer = staticLayer.create(windowWidth, windowHeight);
+#endif
+#ifdef ARKANOID_GPU_TIMERS
+        if (gpuTimers.init())
+            renderQueue.timers = &gpuTimers;
+#endif
+
+        startup.join();
+        const auto bricks(useStaticLayer ? &staticLayer.batch : &rectangleBatch);
+        if (brickBatch != bricks)
+        {
+            brickBatch = bricks;
+            loadLevel(level);
+        }
+
+        // Seven segment digits until `loadFont`.
+        scoreNumber = hud.addNumber(Vector2f{8.f + 7 * 12.f, 8.f}, 7);
+        livesNumber = hud.addNumber(Vector2f{windowWidth / 2.f + 12.f, 8.f}, 2);
+        fpsNumber = hud.addNumber(Vector2f{windowWidth - 8.f, 8.f}, 4);
+        hud.set(livesNumber, score.lives);
+        if (!hud.build(nullptr))
+            cerr << "Can't build the HUD digits" << endl;
+        if (!inspector.build(GPowerup + 1, ComponentList::size))
+            cerr << "Can't build the inspector digits" << endl;
+    }
+
+    // The systems and the entities of a new game, on the default level.
+    // Windowed games do it while their window is being created.
+    void createWorld()
+    {
+        // Headless games have it too, replays drive it. The autopilot goes
+        // first, it moves the paddles through their input.
+        manager.addSystem<SAutopilot>(playerInputs.data(), manager.getEntitiesByGroup(GBall), playArea);
+        manager.addSystem<SPaddleControl>(playerInputs.data(), paddleSpeedTuning, tunables.paddleAcceleration);
+
+        manager.addSystem<SPhysics>(playArea);
+        projectiles.attach(rectangleBatch);
+
+        manager.addDestroyListener([this](Entity &mEntity) {
+            if (mEntity.hasGroup(GBrick) && !brickTree.remove(mEntity))
+                brickGrid.remove(mEntity);
+        });
+        manager.addRestoreListener([this](Entity &mEntity) {
+            if (mEntity.hasGroup(GBrick) && !brickTree.restore(mEntity))
+                brickGrid.add(mEntity);
+        });
+
+        // Balls against balls is optional, see `--multiball`.
+        collisions.enable(GBall, GPaddle);
+        collisions.enable(GBall, GBrick);
+        collisions.enable(GPowerup, GPaddle);
+
+        createPaddle();
+        createBall();
+        createPowerups();
+        loadLevel(Level::createDefault());
+    }
+
+    // Pack the images of `mDirectory` into the atlas. Only "brick.png" is
+    // used for now: when it is there the bricks are textured.
+    // The bricks created from now on are textured. The texture loads in
+    // the background meanwhile they are drawn as plain white quads, the
+    // first frames don't wait for it.
+    void loadTextures(const std::string &mDirectory)
+    {
+        brickRegion = atlas.add("brick", Image{});
+
+        const auto path(mDirectory + "/brick.png");
+        assets.onLoaded(assets.load<Image>(path), [this, path](const Image *mImage) {
+            if (mImage != nullptr)
+                atlas.setImage(brickRegion, *mImage);
+
+            if (mImage == nullptr || !atlas.build())
+            {
+                cerr << "Can't read the texture " << path << endl;
+                return;
+            }
+
+            spriteBatch.texture = &atlas.getTexture();
+            manager.forEach<CSprite>([this](Entity &, CSprite &mSprite) {
+                mSprite.textureRect = atlas.getTextureRect(mSprite.region);
+                mSprite.batch->set(mSprite.quad, mSprite.syncedPosition, mSprite.halfSize, mSprite.color,
+                                   mSprite.textureRect);
+            });
+        });
+    }
+
+    // Draw the HUD digits with a font. The seven segment ones stay until
+    // it is loaded, and when it can't be.
+    void loadFont(const std::string &mPath, unsigned mCharacterSize = 20)
+    {
+        assets.onLoaded(assets.load<Font>(mPath), [this, mPath, mCharacterSize](const Font *mFont) {
+            if (mFont == nullptr || !hud.build(mFont, mCharacterSize))
+            {
+                cerr << "Can't read the font " << mPath << endl;
+                hud.build(nullptr);
+            }
+        });
+    }
+
+    // Replace the bricks with the ones of `mLevel`. When `mPrepared` holds
+    // them already, it is swapped in, and gets the previous ones.
+    void loadLevel(const Level &mLevel, BrickField *mPrepared = nullptr)
+    {
+        if (&mLevel != &level)
+            level = mLevel;
+        for (auto &brick : manager.getEntitiesByGroup(GBrick))
+            brick->destroy();
+        manager.refresh();
+
+        const auto explosives(std::count_if(std::begin(mLevel.bricks), std::end(mLevel.bricks),
+                                            [](const LevelBrick &mBrick) { return brickTypes[mBrick.type].explosive; }));
+        levelBricks.clear();
+        brickField.clear();
+        brickTree.clear();
+        sequencer.clear();
+        kinematicBricks.build(mLevel.rows);
+        kinematicBlasts.reserve(kinematicBricks.size());
+        if (mPrepared != nullptr && mPrepared->size() == mLevel.bricks.size())
+        {
+            brickField.swap(*mPrepared);
+            brickField.attach(rectangleBatch);
+            fieldBlasts.reserve(explosives);
+            return;
+        }
+
+        if (brickFieldLevels && brickField.build(mLevel, rectangleBatch))
+        {
+            fieldBlasts.reserve(explosives);
+            return;
+        }
+
+        // The tree is built once all the bricks are there, and the ones
+        // created later go to the grid. Bricks bigger than a cell need the
+        // tree, even in a level that asks for the grid.
+        bricksInTree = mLevel.broadPhase == Level::BroadPhase::Tree || mLevel.findOversized(true) != nullptr;
+
+        manager.reserve(mLevel.bricks.size());
+        blasts.reserve(explosives);
+        for (const auto &brick : mLevel.bricks)
+            levelBricks.emplace_back(
+                createBrick(brick.position, brick.halfSize, brick.color, brick.hitPoints, brick.type).getHandle());
+
+        // The new bricks took the slots the old ones left, scattered.
+        manager.compact();
+
+        for (const auto &wave : mLevel.waves)
+            sequencer.start(std::unique_ptr<Sequence>{new WaveSequence{wave}});
+
+        if (bricksInTree)
+        {
+            brickTree.build(manager.getEntitiesByGroup(GBrick));
+            bricksInTree = false;
+        }
+    }
+
+    // Read the watched level file again and play it from the start. The
+    // window, the batches and the pools stay, only the state of the game
+    // is made again. A file that can't be read leaves the level as it is.
+    bool reloadLevel()
+    {
+        Level level;
+        if (!level.load(levelWatcher.getPath().c_str()) || level.bricks.empty())
+        {
+            cerr << "Can't reload level " << levelWatcher.getPath() << endl;
+            return false;
+        }
+
+        loadLevel(level);
+        restartPlay();
+        return true;
+    }
+
+    // Back to how a level starts: a single ball, no powerup and no points.
+    void restartPlay()
+    {
+        for (auto &ball : manager.getEntitiesByGroup(GBall))
+            ball->destroy();
+        for (auto &powerup : manager.getEntitiesByGroup(GPowerup))
+            hidePowerup(*powerup);
+
+        if (timers.isPending(widePaddleTimer))
+            scalePaddles(1.f / widePaddleScale);
+        if (timers.isPending(slowBallTimer))
+            setBallSpeedScale(ballSpeedTuning);
+        timers.cancel(widePaddleTimer);
+        timers.cancel(slowBallTimer);
+        timers.cancel(laserTimer);
+        projectiles.clear();
+
+        manager.refresh();
+        createBall();
+        score = Score{};
+        events.clear();
+    }
+
+    // Call `mFunction(brick)` for the bricks that may intersect the area,
+    // from the grid and from the tree.
+    template <typename TF>
+    void queryBricks(float mLeft, float mTop, float mRight, float mBottom, TF &&mFunction)
+    {
+        brickGrid.query(mLeft, mTop, mRight, mBottom, mFunction);
+        brickTree.query(mLeft, mTop, mRight, mBottom, mFunction);
+    }
+
+    // Switch to the level the campaign prepared, waiting for it if it
+    // isn't ready, then start preparing the one after it, and its music.
+    void nextLevel()
+    {
+        campaign->wait();
+        if (campaign->getLevel().bricks.empty())
+        {
+            // None of its levels could be read.
+            campaign.reset();
+            return;
+        }
+
+        loadLevel(campaign->getLevel(), campaign->getField());
+
+        const auto &track(campaign->getEntry().music);
+        const auto &following(campaign->getFollowingEntry().music);
+        if (music != nullptr && !track.empty())
+            music->play(track);
+
+        campaign->prepareNext();
+        if (music != nullptr && !following.empty())
+            music->prepare(following);
+    }
+
+    // Quantized state of the paddles, the balls and the level bricks.
+    void writeNetState(NetState &mState)
+    {
+        mState.paddles.clear();
+        for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+            mState.paddles.emplace_back(
+                Internal::quantizePosition(toVector2f(paddle->getComponent<CPosition>().position)));
+
+        mState.balls.clear();
+        for (auto &ball : manager.getEntitiesByGroup(GBall))
+            mState.balls.emplace_back(Internal::quantizePosition(toVector2f(ball->getComponent<CPosition>().position)));
+
+        mState.destroyedBricks.resize(levelBricks.size() + brickField.size());
+        for (std::size_t i{0}; i < levelBricks.size(); ++i)
+        {
+            auto brick(manager.getEntity(levelBricks[i]));
+            mState.destroyedBricks[i] = brick == nullptr || !brick->isAlive();
+        }
+
+        // A level is either in the field or in `levelBricks`, in the same
+        // order.
+        for (std::uint32_t i{0}; i < brickField.size(); ++i)
+            mState.destroyedBricks[i] = !brickField.isAlive(i);
+    }
+
+    // Show `mState` received from the server: balls are added or removed
+    // to match its count, and its destroyed bricks break here too. The
+    // paddle of `mPredictedPlayer` is left to the caller.
+    void applyNetState(const NetState &mState, std::size_t mPredictedPlayer)
+    {
+        auto &paddles(manager.getEntitiesByGroup(GPaddle));
+        for (std::size_t i{0}; i < paddles.size() && i < mState.paddles.size(); ++i)
+            if (paddles[i]->getComponent<CPaddleControl>().player != mPredictedPlayer)
+                moveTo(*paddles[i], Internal::dequantizePosition(mState.paddles[i]));
+
+        auto &balls(manager.getEntitiesByGroup(GBall));
+        while (balls.size() < mState.balls.size())
+            createBall();
+        for (std::size_t i{mState.balls.size()}; i < balls.size(); ++i)
+            balls[i]->destroy();
+        for (std::size_t i{0}; i < mState.balls.size(); ++i)
+            moveTo(*balls[i], Internal::dequantizePosition(mState.balls[i]));
+
+        for (std::size_t i{0}; i < levelBricks.size() && i < mState.destroyedBricks.size(); ++i)
+        {
+            auto brick(manager.getEntity(levelBricks[i]));
+            if (!mState.destroyedBricks[i] || brick == nullptr || !brick->isAlive())
+                continue;
+
+            pushEvent(GameEvent::EBrickBroken, *brick, nullptr);
+            brick->destroy();
+        }
+
+        for (std::uint32_t i{0}; i < brickField.size() && i < mState.destroyedBricks.size(); ++i)
+            if (mState.destroyedBricks[i] && brickField.isAlive(i))
+            {
+                pushFieldEvent(GameEvent::EBrickBroken, i, nullptr);
+                brickField.kill(i);
+            }
+
+        handleEvents();
+        manager.refresh();
+    }
+
+    // No interpolation, the entity is drawn where it is.
+    void moveTo(Entity &mEntity, const Vector2f &mPosition)
+    {
+        auto &cPosition(mEntity.getComponent<CPosition>());
+        cPosition.position = cPosition.previousPosition = fromVector2f<PhysicsScalar>(mPosition);
+        ++cPosition.version;
+    }
+
+    // Paddle of `mPlayer` and its index in the paddle group, the index
+    // is the size of the group when there is none.
+    std::size_t findPaddle(std::size_t mPlayer)
+    {
+        auto &paddles(manager.getEntitiesByGroup(GPaddle));
+        std::size_t i{0};
+        while (i < paddles.size() && paddles[i]->getComponent<CPaddleControl>().player != mPlayer)
+            ++i;
+
+        return i;
+    }
+
+    // A step of `SPaddleControl` and `SPhysics` for `mPaddle` alone, what
+    // the server does to it in `step`.
+    void stepPaddle(Entity &mPaddle, const InputSnapshot &mInput)
+    {
+        const float ft{tunables.ftStep * timeStep / ftSlice};
+        auto &cPosition(mPaddle.getComponent<CPosition>());
+        auto &cPhysics(mPaddle.getComponent<CPhysics>());
+
+        SPaddleControl::steer(cPhysics, mPaddle.getComponent<CPaddleControl>(), mInput,
+                              paddleVelocity * paddleSpeedTuning, tunables.paddleAcceleration, ft);
+        cPosition.previousPosition = cPosition.position;
+        cPosition.position += cPhysics.velocity * PhysicsScalar(ft);
+        ++cPosition.version;
+    }
+
+    void run()
+    {
+        running = true;
+        frameClock.restart();
+        inFrameLoop = true;
+
+        while (running)
+        {
+            frameArena.reset();
+
+            // Part of the frame, the same as the limit used to be.
+            if (window != nullptr)
+                pacer.wait();
+
+            {
+                ScopedTimer timer{profiler, PInput};
+                inputPhase();
+            }
+            {
+                ScopedTimer timer{profiler, PUpdate};
+                updatePhase();
+            }
+            {
+                ScopedTimer timer{profiler, PDraw};
+                if (renderThread != nullptr)
+                    publishPhase();
+                else
+                    drawPhase();
+            }
+
+            if (!firstFrameShown && window != nullptr)
+            {
+                firstFrameShown = true;
+                cout << "First frame after "
+                     << chrono::duration<float, milli>{chrono::high_resolution_clock::now() - processStart}.count()
+                     << " ms" << endl;
+            }
+
+            // The real milliseconds of this frame, the game time of it is
+            // simulated at the next one.
+            const auto ft(static_cast<FrameTime>(frameClock.tick()));
+            lastFrametime = frameClock.getGameDelta();
+
+            if (configWatcher.poll(ft) && config.load(configWatcher.getPath()))
+                applyTunables(config.tunables);
+            if (levelWatcher.poll(ft))
+                reloadLevel();
+
+            if (frameTimes != nullptr)
+                frameTimes->emplace_back(ft);
+
+            profiler.add(PFrame, ft);
+            profiler.endFrame();
+            if (flightRecorder != nullptr)
+                flightRecorder->recordFrame(profiler);
+
+            // Every 15 frames is enough for the overlay to be readable.
+            if (profilerOverlay.visible && ++framesSinceOverlayUpdate >= 15)
+            {
+                profilerOverlay.rebuild(profiler, renderStats);
+                framesSinceOverlayUpdate = 0;
+            }
+
+            if (inspector.visible && ++framesSinceInspectorUpdate >= 15)
+            {
+                rebuildInspector();
+                framesSinceInspectorUpdate = 0;
+            }
+
+            if (statsServer != nullptr)
+                statsServer->update(*this, ft);
+            if (leaderboard != nullptr)
+                reportLeaderboard();
+
+            updateTitle(ft);
+        }
+
+        inFrameLoop = false;
+    }
+
+    void reportLeaderboard()
+    {
+        Leaderboard::Result result;
+        while (leaderboard->poll(result))
+            if (result.outcome == Leaderboard::Result::Accepted)
+                cout << "Leaderboard: " << result.scores << " score(s) posted" << endl;
+            else
+                cerr << "Leaderboard: " << result.scores << " score(s) "
+                     << (result.outcome == Leaderboard::Result::Rejected ? "rejected" : "not posted")
+                     << ", status " << result.status << endl;
+    }
+
+    // Setting the title is a round-trip to the window manager, so the
+    // readout shows the average of the frames since the last update and
+    // is only refreshed every `titleUpdateInterval` milliseconds.
+    void updateTitle(FrameTime mFT)
+    {
+        titleElapsed += mFT;
+        ++titleFrames;
+
+        if (titleElapsed < titleUpdateInterval)
+            return;
+
+        auto ft(titleElapsed / titleFrames);
+        // We can approximate the fps by dividing 1.f by the elapsed seconds
+        // calculated by convert ft to seconds.
+        auto ftSeconds(ft / 1000.f);
+        auto fps(1.f / ftSeconds);
+
+        if (pacer.getRefreshRate() > 0.f)
+            std::snprintf(titleBuffer.data(), titleBuffer.size(), "FT: %f\t FPS: %f\t Display: %.0f Hz", ft, fps,
+                          pacer.getRefreshRate());
+        else
+            std::snprintf(titleBuffer.data(), titleBuffer.size(), "FT: %f\t FPS: %f", ft, fps);
+        window->setTitle(titleBuffer.data());
+        hud.set(fpsNumber, static_cast<std::uint32_t>(fps + 0.5f));
+
+        titleElapsed = 0.f;
+        titleFrames = 0;
+    }
+
+    void close()
+    {
+        running = false;
+        renderThread.reset();
+        window->close();
+    }
+
+    // Without the focus, on kiosks running other apps too, the game is
+    // paused and nothing is drawn: the thread sleeps in `waitEvent` until
+    // the window has the focus again. The time spent there isn't part of
+    // any frame, the game goes on from where it was. False when the window
+    // was closed meanwhile.
+    bool idle()
+    {
+        const bool paused{frameClock.isPaused()};
+        frameClock.setPaused(true);
+
+        sf::Event event;
+        while (window->waitEvent(event))
+        {
+            if (event.type == sf::Event::Closed)
+            {
+                close();
+                return false;
+            }
+
+            if (event.type == sf::Event::Resized)
+                fitViewport(event.size.width, event.size.height);
+
+            if (event.type == sf::Event::GainedFocus)
+                break;
+        }
+
+        frameClock.setPaused(paused);
+        frameClock.restart();
+        return window->isOpen();
+    }
+
+    void inputPhase()
+    {
+        // check all the window's events that were triggered since the last iteration of the loop
+        sf::Event event;
+        while (window->pollEvent(event))
+        {
+            // "close requested" event: we close the window
+            if (event.type == sf::Event::Closed)
+            {
+                close();
+                break;
+            }
+
+            if (event.type == sf::Event::Resized)
+                fitViewport(event.size.width, event.size.height);
+
+            // Released keys aren't reported to windows without focus.
+            if (event.type == sf::Event::LostFocus)
+            {
+                keys.reset();
+                if (config.idleUnfocused != 0 && netServer == nullptr && netClient == nullptr && !idle())
+                    break;
+            }
+
+            if (event.type == sf::Event::KeyReleased && event.key.code >= 0 && event.key.code < sf::Keyboard::KeyCount)
+                keys.reset(event.key.code);
+
+            if (event.type == sf::Event::JoystickMoved &&
+                (event.joystickMove.axis == sf::Joystick::X || event.joystickMove.axis == sf::Joystick::PovX))
+            {
+                joystickX = event.joystickMove.position / 100.f;
+                joystickID = event.joystickMove.joystickId;
+            }
+
+            if (event.type == sf::Event::JoystickDisconnected && event.joystickConnect.joystickId == joystickID)
+                joystickX = 0.f;
+
+            if (event.type == sf::Event::KeyPressed)
+            {
+                if (event.key.code >= 0 && event.key.code < sf::Keyboard::KeyCount)
+                    keys.set(event.key.code);
+
+                if (event.key.code == sf::Keyboard::Key::Escape)
+                    running = false;
+                else if (event.key.code == sf::Keyboard::Key::F1)
+                {
+                    profilerOverlay.visible = !profilerOverlay.visible;
+                    profilerOverlay.rebuild(profiler, renderStats);
+                }
+                else if (event.key.code == sf::Keyboard::Key::F2)
+                {
+                    std::ofstream file{"profile.csv"};
+                    profiler.dumpCSV(file);
+                }
+                else if (event.key.code == sf::Keyboard::Key::F3)
+                    setPostProcess(!postProcess.bloom, postProcess.crt);
+                else if (event.key.code == sf::Keyboard::Key::F4)
+                    setPostProcess(postProcess.bloom, !postProcess.crt);
+                else if (event.key.code == sf::Keyboard::Key::F11 && capture.isRecording())
+                    capture.stopRecording();
+                else if (event.key.code == sf::Keyboard::Key::F11)
+                    capture.startRecording("capture-");
+                else if (event.key.code == sf::Keyboard::Key::F12)
+                    capture.screenshot();
+                else if (event.key.code == sf::Keyboard::Key::F5 && levelWatcher.isWatching())
+                    reloadLevel();
+                else if (event.key.code == sf::Keyboard::Key::P || event.key.code == sf::Keyboard::Key::Pause)
+                    setPaused(!frameClock.isPaused());
+                else if (event.key.code == sf::Keyboard::Key::F6)
+                    stepPaused();
+                else if (event.key.code == sf::Keyboard::Key::F7)
+                    setSlowMotion(frameClock.getTimeScale() == 1.0);
+#ifdef ARKANOID_DEBUG_DRAW
+                else if (event.key.code == sf::Keyboard::Key::F8)
+                {
+                    debugDraw.enabled = !debugDraw.enabled;
+                    debugDraw.clear();
+                }
+#endif
+                else if (event.key.code == sf::Keyboard::Key::F9)
+                {
+                    inspector.visible = !inspector.visible;
+                    rebuildInspector();
+                }
+                else if (event.key.code == sf::Keyboard::Key::F10)
+                    setEditing(!editing);
+                else if (editing && event.key.code >= sf::Keyboard::Key::Num1 &&
+                         event.key.code < sf::Keyboard::Key::Num1 + BCount)
+                    editorType = static_cast<BrickType>(event.key.code - sf::Keyboard::Key::Num1);
+                else if (editing && event.key.code == sf::Keyboard::Key::S && !saveLevel())
+                    cerr << "Can't write level " << editorPath << endl;
+            }
+
+            if (event.type == sf::Event::MouseButtonPressed && editing)
+            {
+                const sf::Vector2i pixel{event.mouseButton.x, event.mouseButton.y};
+                if (event.mouseButton.button == sf::Mouse::Left)
+                    placeBrick(pixel);
+                else if (event.mouseButton.button == sf::Mouse::Right)
+                    removeBrick(pixel);
+            }
+            else if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left &&
+                     inspector.visible)
+            {
+                inspect(sf::Vector2i{event.mouseButton.x, event.mouseButton.y});
+                rebuildInspector();
+            }
+        }
+
+        InputSnapshot snapshot;
+        if (keys[sf::Keyboard::Key::Left])
+            snapshot.buttons |= InputSnapshot::BLeft;
+        if (keys[sf::Keyboard::Key::Right])
+            snapshot.buttons |= InputSnapshot::BRight;
+
+        // Resting sticks rarely report exactly zero.
+        if (std::abs(joystickX) > joystickDeadZone)
+            snapshot.axis = static_cast<std::int8_t>(std::max(-1.f, std::min(1.f, joystickX)) * 127.f);
+
+        if (latencyProbe != nullptr && snapshot != lastInput)
+            latencyProbe->keyChanged();
+        lastInput = snapshot;
+
+        inputQueue.push(snapshot);
+    }
+
+    void updatePhase()
+    {
+        // Use the newest input sampled since the last frame.
+        InputSnapshot snapshot;
+        while (inputQueue.pop(snapshot))
+            input = snapshot;
+
+        // Start accumulate frametime
+        currentSlice += lastFrametime;
+
+        // Debris is only for looks, it moves once per frame. While paused
+        // nothing moves and frames only draw.
+        if (lastFrametime > 0.0)
+            particles.update(lastFrametime);
+
+        if (music != nullptr)
+            music->update();
+
+        assets.update();
+
+        if (netClient != nullptr)
+        {
+            // The server runs the logic, only the paddle steps here.
+            std::uint16_t steps{0};
+            for (; currentSlice >= timeStep; currentSlice -= timeStep)
+                ++steps;
+
+            netClient->update(*this, steps);
+            return;
+        }
+
+        if (netSpectator != nullptr)
+        {
+            currentSlice = 0.0;
+            if (!netSpectator->update(*this))
+                running = false;
+            return;
+        }
+
+        if (netServer != nullptr)
+            netServer->receive();
+
+        // If currentSilice is grather or equal to ftSlice we update our game logic
+        // and decrease currentSlice until currentSlice becomes less than ftSlice.
+        // Ex. if currentSlice is three times as big as ftSlice, we update or
+        // game logic three times.
+        const auto maxSteps(tunables.maxSteps > 0 ? static_cast<std::size_t>(tunables.maxSteps)
+                                                  : std::numeric_limits<std::size_t>::max());
+        for (std::size_t steps{0}; currentSlice >= timeStep && steps < maxSteps; currentSlice -= timeStep, ++steps)
+            step();
+        dropSteps();
+
+        if (netServer != nullptr)
+            netServer->send(*this);
+        if (netBroadcast != nullptr)
+            netBroadcast->send(*this);
+    }
+
+    // Select the entity under the pixel `mPixel` of the window, the top
+    // one when several overlap. Clicking where there is none clears the
+    // selection.
+    void inspect(const sf::Vector2i &mPixel)
+    {
+        View framed{view};
+        framed.setViewport(viewport);
+        const auto point(window->mapPixelToCoords(mPixel, framed));
+
+        inspecting = false;
+        auto test([this, &point](Entity &mEntity) {
+            if (!mEntity.hasComponent<CPhysics>())
+                return;
+
+            const auto &cPhysics(mEntity.getComponent<CPhysics>());
+            if (point.x >= toFloat(cPhysics.left()) && point.x <= toFloat(cPhysics.right()) &&
+                point.y >= toFloat(cPhysics.top()) && point.y <= toFloat(cPhysics.bottom()))
+            {
+                inspected = mEntity.getHandle();
+                inspecting = true;
+            }
+        });
+
+        // Bricks are looked up through the broad phase, the moving
+        // entities are few enough to test them all, and they are drawn
+        // over the bricks.
+        queryBricks(point.x, point.y, point.x, point.y, test);
+        for (auto group : {GPowerup, GPaddle, GBall})
+            for (auto entity : manager.getEntitiesByGroup(group))
+                test(*entity);
+    }
+
+    // The levels made of brick fields, streamed or part of a campaign
+    // aren't `level`, they can't be edited.
+    bool setEditing(bool mEditing)
+    {
+        if (mEditing && (brickField.size() > 0 || levelStreamer != nullptr || campaign != nullptr ||
+                         netServer != nullptr || netClient != nullptr || netSpectator != nullptr))
+            return false;
+
+        editing = mEditing;
+        frameClock.setPaused(editing);
+        return true;
+    }
+
+    // Game coordinates of the pixel `mPixel` of the window.
+    Vector2f mapPixel(const sf::Vector2i &mPixel) const
+    {
+        View framed{view};
+        framed.setViewport(viewport);
+        return window->mapPixelToCoords(mPixel, framed);
+    }
+
+    // The alive brick at `mPoint`, if any.
+    Entity *findBrick(const Vector2f &mPoint)
+    {
+        Entity *found{nullptr};
+        queryBricks(mPoint.x, mPoint.y, mPoint.x, mPoint.y, [&](Entity &mBrick) {
+            const auto &cPhysics(mBrick.getComponent<CPhysics>());
+            if (mBrick.isAlive() && mPoint.x >= toFloat(cPhysics.left()) && mPoint.x <= toFloat(cPhysics.right()) &&
+                mPoint.y >= toFloat(cPhysics.top()) && mPoint.y <= toFloat(cPhysics.bottom()))
+                found = &mBrick;
+        });
+
+        return found;
+    }
+
+    // Where the static layer has to be drawn again for a brick at
+    // `mPosition`, a pixel more for the rounding.
+    void damageStaticLayer(const Vector2f &mPosition, const Vector2f &mHalfSize)
+    {
+        if (useStaticLayer)
+            staticLayer.damage(
+                FloatRect{mPosition - mHalfSize - Vector2f{1.f, 1.f}, mHalfSize * 2.f + Vector2f{2.f, 2.f}});
+    }
+
+    // A brick of `editorType` in the cell of the default layout under
+    // `mPixel`, unless there is one already.
+    void placeBrick(const sf::Vector2i &mPixel)
+    {
+        constexpr float pitchX{blockWidth + 3}, pitchY{blockHeight + 3};
+        const auto point(mapPixel(mPixel));
+        const Vector2f position{std::round((point.x - 22.f) / pitchX) * pitchX + 22.f,
+                                std::round(point.y / pitchY) * pitchY};
+        const Vector2f halfSize{blockWidth / 2.f, blockHeight / 2.f};
+        if (findBrick(position) != nullptr)
+            return;
+
+        level.bricks.emplace_back(LevelBrick{position, halfSize, Color::Red, 0, editorType});
+        levelBricks.emplace_back(createBrick(position, halfSize, Color::Red, 0, editorType).getHandle());
+        damageStaticLayer(position, halfSize);
+    }
+
+    // The brick of the level under `mPixel`, the ones of the waves aren't.
+    void removeBrick(const sf::Vector2i &mPixel)
+    {
+        auto brick(findBrick(mapPixel(mPixel)));
+        if (brick == nullptr)
+            return;
+
+        const auto handle(brick->getHandle());
+        const auto found(std::find_if(std::begin(levelBricks), std::end(levelBricks),
+                                      [&handle](const EntityHandle &mBrick) {
+                                          return mBrick.index == handle.index && mBrick.generation == handle.generation;
+                                      }));
+        if (found == std::end(levelBricks))
+            return;
+
+        const auto index(found - std::begin(levelBricks));
+        level.bricks.erase(std::begin(level.bricks) + index);
+        levelBricks.erase(found);
+
+        const auto &cPhysics(brick->getComponent<CPhysics>());
+        damageStaticLayer(Vector2f{toFloat(cPhysics.x()), toFloat(cPhysics.y())}, toVector2f(cPhysics.halfSize));
+        brick->destroy();
+        manager.refresh();
+    }
+
+    bool saveLevel() const { return level.saveBinary(editorPath.c_str()); }
+
+    void rebuildInspector()
+    {
+        inspector.rebuild(manager, inspecting ? manager.getEntity(inspected) : nullptr);
+    }
+
+    // Debug modes to look at a collision closely, the game keeps being
+    // drawn. A network game can't be paused or slowed down, the other
+    // side would go on.
+    void setPaused(bool mPaused)
+    {
+        if (netServer == nullptr && netClient == nullptr)
+            frameClock.setPaused(mPaused);
+    }
+
+    // A single step at the next frame, while paused.
+    void stepPaused()
+    {
+        if (frameClock.isPaused())
+            lastFrametime += timeStep;
+    }
+
+    void setSlowMotion(bool mSlow)
+    {
+        if (netServer == nullptr && netClient == nullptr)
+            frameClock.setTimeScale(mSlow ? double{slowMotionScale} : 1.0);
+    }
+
+    // A long frame, like one spent dragging the window, would run as many
+    // steps as it took and make the next frame long too, which would then
+    // run even more of them. The steps left over `Tunables::maxSteps` are
+    // dropped instead, or kept for the next frames up to `maxSteps` more.
+    void dropSteps()
+    {
+        if (tunables.maxSteps == 0)
+            return;
+
+        const double kept{tunables.catchUp != 0 ? tunables.maxSteps * double{timeStep} : 0.0};
+        if (currentSlice - kept < timeStep)
+            return;
+
+        const auto dropped(static_cast<std::size_t>((currentSlice - kept) / timeStep));
+        currentSlice -= dropped * double{timeStep};
+        droppedSteps += dropped;
+        profiler.addDroppedSteps(dropped);
+    }
+
+    // Advance the game logic by a single `timeStep`.
+    void step()
+    {
+        if (!inFrameLoop)
+            frameArena.reset();
+
+        if (recording != nullptr)
+            recording->record(input);
+
+        const bool played{playback != nullptr && playback->next(input)};
+        if (playback != nullptr && !played)
+            running = false;
+        if (flightRecorder != nullptr)
+            flightRecorder->recordInput(input);
+
+        playerInputs[0] = input;
+        if (netServer != nullptr)
+            netServer->nextInputs(playerInputs);
+
+        const float ft{tunables.ftStep * timeStep / ftSlice};
+
+        if (scrollVelocity != 0.f)
+            scroll(ft);
+        kinematicBricks.update(ft);
+
+        if (levelStreamer != nullptr)
+            levelStreamer->update(*this);
+        sequencer.update(*this);
+
+        // Headless games wait for the next level, so they run the same
+        // steps however slow the loader is.
+        if (campaign != nullptr && getBrickCount() == 0 && (campaign->isReady() || mode == Mode::Headless))
+            nextLevel();
+
+        {
+            ScopedTimer timer{profiler, PRefresh};
+            manager.refresh();
+        }
+        {
+            ScopedTimer timer{profiler, PLogic};
+            manager.update(ft);
+            chaosBodies.integrate(ft);
+        }
+
+        if (latencyProbe != nullptr)
+            for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+            {
+                if (paddle->getComponent<CPaddleControl>().player != 0)
+                    continue;
+
+                const float velocity{paddle->getComponent<CPhysics>().velocity.x};
+                if (velocity != lastPaddleVelocity)
+                    latencyProbe->velocityChanged();
+                lastPaddleVelocity = velocity;
+            }
+
+        ScopedTimer timer{profiler, PCollision};
+        ARKANOID_ZONE("collision");
+        auto &paddles(manager.getEntitiesByGroup(GPaddle));
+        auto &balls(manager.getEntitiesByGroup(GBall));
+
+        rampBallSpeeds(startBallSpeed * ballRampPerSecond * ft / 1000.f);
+        if (collisions.test(GBall, GPaddle))
+            bouncePaddles(balls, paddles);
+
+        // The bricks of the brick field and the sliding rows aren't
+        // entities, they are in the brick layer all the same.
+        if (collisions.test(GBall, GBrick))
+        {
+            // The contacts of every ball are gathered first, against the bricks
+            // as they were at the start of the step. The gathering only reads,
+            // so with many balls it runs in parallel, and since the contacts
+            // are merged in the order of the balls the result is the same on
+            // any number of threads.
+            threadContacts.resize(jobSystem != nullptr ? jobSystem->getThreadCount() : 1);
+            for (auto &buffer : threadContacts)
+            {
+                // Any thread may get every ball, reserved so none allocates.
+                buffer.clear();
+                buffer.reserve(balls.size());
+            }
+            brickContacts.reserve(balls.size());
+
+            auto gather([this, &balls](std::size_t mFirst, std::size_t mLast) {
+                auto &buffer(threadContacts[jobSystem != nullptr ? jobSystem->getThreadIndex() : 0]);
+                for (auto i(mFirst); i < mLast; ++i)
+                {
+                    BrickContact contact;
+                    gatherBrickContacts(*balls[i], contact);
+                    if (contact.count == 0)
+                        continue;
+
+                    contact.ball = static_cast<std::uint32_t>(i);
+                    buffer.emplace_back(contact);
+                }
+            });
+
+            if (jobSystem != nullptr && balls.size() >= minParallelBalls)
+                jobSystem->parallelFor(balls.size(), 16, gather);
+            else
+                gather(0, balls.size());
+
+            mergeBrickContacts();
+            if (debugDraw.enabled)
+                drawBroadPhase(balls);
+
+            resolveBrickContacts(balls);
+            propagateBlasts();
+        }
+
+        if (collisions.test(GBall, GBall))
+            collideBalls(balls);
+
+        updateProjectiles(paddles, ft);
+        findLostBalls(balls);
+        updatePowerups(ft);
+
+        hashStep();
+        if (recording != nullptr)
+            recording->recordHash(stateHash.get());
+        if (flightRecorder != nullptr)
+            flightRecorder->recordHash(stateHash.get());
+        if (played && !playback->verifyHash(stateHash.get()))
+            running = false;
+
+        handleEvents();
+    }
+
+    // Mix the state the step ended in into `stateHash`: everything that
+    // moves, and instead of every brick, the ones the events of the step
+    // hit or broke. Before `handleEvents`, that clears them.
+    void hashStep()
+    {
+        for (auto group : {GPaddle, GBall, GPowerup})
+        {
+            const auto &entities(manager.getEntitiesByGroup(group));
+            stateHash.add(static_cast<std::uint32_t>(entities.size()));
+            for (auto &entity : entities)
+            {
+                stateHash.add(entity->getComponent<CPosition>().position);
+                stateHash.add(entity->getComponent<CPhysics>().velocity);
+            }
+        }
+
+        stateHash.add(static_cast<std::uint32_t>(projectiles.size()));
+        for (std::size_t i{0}; i < projectiles.size(); ++i)
+        {
+            stateHash.add(projectiles.getX(i));
+            stateHash.add(projectiles.getY(i));
+        }
+
+        for (const auto &event : events)
+        {
+            stateHash.add(static_cast<std::uint32_t>(event.type));
+            stateHash.add(event.entity);
+        }
+    }
+
+    // The laser bullets only break the bricks of the grid: each one casts
+    // the part of its column it went through this step, so it can't skip
+    // a brick however fast it flies.
+    void updateProjectiles(const std::vector<Entity *> &mPaddles, float mFT)
+    {
+        if (timers.isPending(laserTimer))
+            for (laserCooldown -= mFT; laserCooldown <= 0.f; laserCooldown += laserInterval)
+                for (auto &paddle : mPaddles)
+                {
+                    const auto &cPhysics(paddle->getComponent<CPhysics>());
+                    const float top{toFloat(cPhysics.top()) - Projectiles::halfHeight};
+                    projectiles.fire(toFloat(cPhysics.left()) + Projectiles::halfWidth, top);
+                    projectiles.fire(toFloat(cPhysics.right()) - Projectiles::halfWidth, top);
+                }
+
+        projectiles.update(mFT, playArea.top, [this](float mX, float mFromY, float mToY) {
+            auto *brick(brickGrid.castUp(mX, mFromY, mToY));
+            if (brick == nullptr)
+                return false;
+
+            const bool broken{damageBrick(*brick)};
+            pushEvent(broken ? GameEvent::EBrickBroken : GameEvent::EBrickHit, *brick, nullptr);
+            if (broken && isExplosive(*brick))
+                blasts.emplace_back(brick);
+            return true;
+        });
+        propagateBlasts();
+    }
+
+    // Only the powerups are tested against the paddles, they never go
+    // into the brick grid.
+    void updatePowerups(float mFT)
+    {
+        const float bottom{playArea.top + playArea.height};
+        const bool catchesPowerups{collisions.test(GPowerup, GPaddle)};
+        for (auto &powerup : manager.getEntitiesByGroup(GPowerup))
+        {
+            auto &cPowerup(powerup->getComponent<CPowerup>());
+            if (!cPowerup.falling)
+                continue;
+
+            const auto &cPhysics(powerup->getComponent<CPhysics>());
+            const auto &paddles(manager.getEntitiesByGroup(GPaddle));
+            for (std::size_t i{0}; catchesPowerups && i < paddles.size(); ++i)
+                if (isIntersecting(paddles[i]->getComponent<CPhysics>(), cPhysics))
+                {
+                    pushEvent(GameEvent::EPowerupCaught, *powerup, nullptr);
+                    catchPowerup(cPowerup.kind, toVector2f(powerup->getComponent<CPosition>().position), mFT);
+                    hidePowerup(*powerup);
+                    break;
+                }
+
+            if (cPowerup.falling && toFloat(cPhysics.top()) > bottom)
+                hidePowerup(*powerup);
+        }
+
+        timers.advance([this](std::uint32_t mTimer) {
+            switch (mTimer)
+            {
+                case TWidePaddle: scalePaddles(1.f / widePaddleScale); break;
+                case TSlowBall: setBallSpeedScale(ballSpeedTuning); break;
+                default: break;
+            }
+        });
+    }
+
+    // Steps a powerup lasts for, `powerupDuration` milliseconds at the
+    // time steps are simulated at now.
+    std::uint64_t getPowerupSteps(float mFT) const noexcept
+    {
+        return static_cast<std::uint64_t>(std::ceil(powerupDuration / mFT));
+    }
+
+    // Take a powerup that isn't falling, if there is one, and drop it.
+    void dropPowerup(const Vector2f &mPosition, PowerupKind mKind)
+    {
+        for (auto &powerup : manager.getEntitiesByGroup(GPowerup))
+        {
+            auto &cPowerup(powerup->getComponent<CPowerup>());
+            if (cPowerup.falling)
+                continue;
+
+            cPowerup.kind = mKind;
+            cPowerup.falling = true;
+            moveTo(*powerup, mPosition);
+            powerup->getComponent<CPhysics>().velocity = fromVector2f<PhysicsScalar>(Vector2f{0.f, powerupVelocity});
+
+            static const Color colors[]{Color::Cyan, Color::Green, Color::Magenta, Color::Red};
+            auto &cRectangle(powerup->getComponent<CRectangle>());
+            cRectangle.color = colors[static_cast<std::size_t>(mKind)];
+            cRectangle.setHalfSize(Vector2f{powerupWidth / 2.f, powerupHeight / 2.f});
+            return;
+        }
+    }
+
+    void hidePowerup(Entity &mPowerup)
+    {
+        mPowerup.getComponent<CPowerup>().falling = false;
+        mPowerup.getComponent<CPhysics>().velocity = PhysicsVector{};
+        mPowerup.getComponent<CRectangle>().setHalfSize(Vector2f{});
+    }
+
+    void catchPowerup(PowerupKind mKind, const Vector2f &mPosition, float mFT)
+    {
+        switch (mKind)
+        {
+            case PowerupKind::WidePaddle:
+                if (!timers.isPending(widePaddleTimer))
+                    scalePaddles(widePaddleScale);
+                timers.cancel(widePaddleTimer);
+                widePaddleTimer = timers.schedule(getPowerupSteps(mFT), TWidePaddle);
+                break;
+            case PowerupKind::MultiBall:
+            {
+                const auto balls(manager.getEntitiesByGroup(GBall).size());
+                if (balls < maxBalls)
+                    spawnBalls(std::min<std::size_t>(2, maxBalls - balls), mPosition);
+                break;
+            }
+            case PowerupKind::SlowBall:
+                setBallSpeedScale(slowBallScale * ballSpeedTuning);
+                timers.cancel(slowBallTimer);
+                slowBallTimer = timers.schedule(getPowerupSteps(mFT), TSlowBall);
+                break;
+            case PowerupKind::Laser:
+                if (!timers.isPending(laserTimer))
+                    laserCooldown = 0.f;
+                timers.cancel(laserTimer);
+                laserTimer = timers.schedule(getPowerupSteps(mFT), TLaser);
+                break;
+            default: break;
+        }
+    }
+
+    void scalePaddles(float mScale)
+    {
+        for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+        {
+            auto &cPhysics(paddle->getComponent<CPhysics>());
+            cPhysics.halfSize.x *= PhysicsScalar(mScale);
+            paddle->getComponent<CRectangle>().setHalfSize(toVector2f(cPhysics.halfSize));
+        }
+    }
+
+    // Play with other ball and paddle speeds, as factors of the defaults.
+    void tune(float mBallSpeed, float mPaddleSpeed)
+    {
+        ballSpeedTuning = mBallSpeed;
+        paddleSpeedTuning = mPaddleSpeed;
+        setBallSpeedScale((timers.isPending(slowBallTimer) ? slowBallScale : 1.f) * ballSpeedTuning);
+    }
+
+    // The sizes and speeds of the paddles and balls in play change too.
+    void applyTunables(const Tunables &mTunables)
+    {
+        tunables = mTunables;
+        tune(tunables.ballVelocity / ballVelocity, tunables.paddleVelocity / paddleVelocity);
+
+        const float widthScale{timers.isPending(widePaddleTimer) ? widePaddleScale : 1.f};
+        const Vector2f paddleHalfSize{tunables.paddleWidth / 2.f * widthScale, tunables.paddleHeight / 2.f};
+        for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+        {
+            paddle->getComponent<CPhysics>().halfSize = fromVector2f<PhysicsScalar>(paddleHalfSize);
+            paddle->getComponent<CRectangle>().setHalfSize(paddleHalfSize);
+        }
+
+        for (auto &ball : manager.getEntitiesByGroup(GBall))
+        {
+            ball->getComponent<CPhysics>().halfSize =
+                fromVector2f<PhysicsScalar>(Vector2f{tunables.ballRadius, tunables.ballRadius});
+            ball->getComponent<CCircle>().instance.radius = tunables.ballRadius;
+        }
+    }
+
+    // Settings from `mPath`, before the game starts, and from then on its
+    // tunables whenever the file changes. A missing file leaves the
+    // defaults but is still watched, so it can be created later.
+    bool loadConfig(const std::string &mPath)
+    {
+        configWatcher.watch(mPath);
+        if (!config.load(mPath))
+            return false;
+
+        if (window != nullptr && (config.windowWidth != windowWidth || config.windowHeight != windowHeight))
+        {
+            window->setSize(Vector2u{config.windowWidth, config.windowHeight});
+            fitViewport(config.windowWidth, config.windowHeight);
+        }
+        if (config.renderScale != renderScale && !setRenderScale(config.renderScale))
+            cerr << "Can't render at a scale of " << config.renderScale << endl;
+        if (config.bricksX != countBlockX || config.bricksY != countBlockY)
+            loadLevel(Level::createDefault(config.bricksX, config.bricksY));
+
+        timeStep = config.ftSlice;
+        applyTunables(config.tunables);
+        return true;
+    }
+
+    // The balls in play keep their direction.
+    void setBallSpeedScale(float mScale)
+    {
+        for (auto &ball : manager.getEntitiesByGroup(GBall))
+            ball->getComponent<CPhysics>().velocity *= PhysicsScalar(mScale / ballSpeedScale);
+
+        ballSpeedScale = mScale;
+    }
+
+    // Add `mSpeed` to the speed of every ball, scaled like the balls are
+    // by the slow ball powerup.
+    void rampBallSpeeds(float mSpeed)
+    {
+#ifdef ARKANOID_FIXED_POINT
+        // A step of the ramp is below the last bit of a 16.16 speed, it is
+        // saved up until rounding the ratio to the new speed can't eat it.
+        pendingRamp += mSpeed;
+        if (pendingRamp * 1024.f < startBallSpeed)
+            return;
+
+        mSpeed = pendingRamp;
+        pendingRamp = 0.f;
+#endif
+
+        const PhysicsScalar maxSpeed(startBallSpeed * maxBallSpeedFactor * ballSpeedScale);
+        const PhysicsScalar ramp(mSpeed * ballSpeedScale);
+        for (auto &ball : manager.getEntitiesByGroup(GBall))
+        {
+            auto &velocity(ball->getComponent<CPhysics>().velocity);
+            const PhysicsScalar speed{squareRoot(velocity.x * velocity.x + velocity.y * velocity.y)};
+            if (speed > PhysicsScalar{})
+                velocity *= std::min(speed + ramp, maxSpeed) / speed;
+        }
+    }
+
+    // The contacts of every ball with the paddles are gathered first, then
+    // they are all reflected at once. Like against the bricks, the balls
+    // are swept along their last step, so a fast ball can't go through.
+    void bouncePaddles(const std::vector<Entity *> &mBalls, const std::vector<Entity *> &mPaddles)
+    {
+        // Sized for every ball, a contact doesn't grow it.
+        std::pmr::vector<PaddleContact> paddleContacts{frameArena.get()};
+        paddleContacts.reserve(mBalls.size());
+        for (auto &ball : mBalls)
+        {
+            auto &cpBall(ball->getComponent<CPhysics>());
+            for (auto &paddle : mPaddles)
+            {
+                const auto &cpPaddle(paddle->getComponent<CPhysics>());
+                if (!isIntersecting(cpPaddle, cpBall))
+                {
+                    // Stopped where it hit the top of the paddle.
+                    auto &cPosition(ball->getComponent<CPosition>());
+                    const PhysicsVector from{cPosition.previousPosition};
+                    SweepHit hit;
+                    if (!sweepAABB(from, cPosition.position - from, cpBall.halfSize, cpPaddle, hit) ||
+                        hit.normal.y >= PhysicsScalar{})
+                        continue;
+
+                    cPosition.position = from + (cPosition.position - from) * hit.time;
+                    ++cPosition.version;
+                }
+
+                // Only the first step of a bounce, the ball can still touch
+                // the paddle on its way up.
+                if (cpBall.velocity.y > PhysicsScalar{})
+                    pushEvent(GameEvent::EPaddleHit, *paddle, ball);
+
+                paddleContacts.emplace_back(PaddleContact{&cpBall, (cpBall.x() - cpPaddle.x()) / cpPaddle.halfSize.x});
+                break;
+            }
+        }
+
+        reflectOffPaddles(paddleContacts.data(), paddleContacts.size());
+    }
+
+    void pushEvent(GameEvent::Type mType, Entity &mEntity, const Entity *mBall) noexcept
+    {
+        Color color{Color::White};
+        if (mEntity.hasComponent<CRectangle>())
+            color = mEntity.getComponent<CRectangle>().color;
+        else if (mEntity.hasComponent<CSprite>())
+            color = mEntity.getComponent<CSprite>().color;
+
+        events.push(GameEvent{mType, static_cast<std::uint32_t>(mEntity.getHandle().index),
+                              mBall != nullptr ? static_cast<std::uint32_t>(mBall->getHandle().index)
+                                               : GameEvent::noEntity,
+                              toVector2f(mEntity.getComponent<CPosition>().position), color});
+    }
+
+    // Same for a brick of the field, its slot stands for the entity.
+    void pushFieldEvent(GameEvent::Type mType, std::uint32_t mSlot, const Entity *mBall)
+    {
+        events.push(GameEvent{mType, mSlot,
+                              mBall != nullptr ? static_cast<std::uint32_t>(mBall->getHandle().index)
+                                               : GameEvent::noEntity,
+                              toVector2f(brickField.getBox(mSlot).center), brickField.getColor(mSlot)});
+    }
+
+    // Same for a sliding brick, where it is this step.
+    void pushKinematicEvent(GameEvent::Type mType, std::uint32_t mSlot, const Entity *mBall)
+    {
+        events.push(GameEvent{mType, mSlot,
+                              mBall != nullptr ? static_cast<std::uint32_t>(mBall->getHandle().index)
+                                               : GameEvent::noEntity,
+                              toVector2f(kinematicBricks.getBox(mSlot).center), kinematicBricks.getColor(mSlot)});
+    }
+
+    // The bricks left, in the manager, in the field and in the rows.
+    std::size_t getBrickCount() const
+    {
+        return manager.getEntitiesByGroup(GBrick).size() + brickField.getAliveCount() +
+               kinematicBricks.getAliveCount();
+    }
+
+    // The balls bounce off the bottom of the play area like off the other
+    // sides, but crossing it this step costs a life.
+    void findLostBalls(const std::vector<Entity *> &mBalls)
+    {
+        const PhysicsScalar bottom(playArea.top + playArea.height);
+        for (auto &ball : mBalls)
+        {
+            const auto &cPosition(ball->getComponent<CPosition>());
+            const PhysicsScalar halfHeight{ball->getComponent<CPhysics>().halfSize.y};
+            if (cPosition.previousPosition.y + halfHeight <= bottom && cPosition.position.y + halfHeight > bottom)
+                pushEvent(GameEvent::EBallLost, *ball, ball);
+        }
+    }
+
+    // Every system that reacts to the step goes through its events here,
+    // in one batch, then they are gone.
+    void handleEvents()
+    {
+        const auto combo(score.combo);
+        const auto lives(score.lives);
+        score.process(events);
+        // Replays were already posted when they were played.
+        if (leaderboard != nullptr && playback == nullptr && lives > 0 && score.lives == 0)
+            leaderboard->submit(playerName, score.points, score.bestCombo);
+        // Only the bricks after the first one of a combo speed the balls up.
+        if (score.combo > std::max(combo, std::uint32_t{1}))
+            rampBallSpeeds(startBallSpeed * ballComboBoost * (score.combo - std::max(combo, std::uint32_t{1})));
+
+        constexpr auto powerupKinds(static_cast<unsigned>(PowerupKind::Count));
+        for (const auto &event : events)
+            if (event.type == GameEvent::EBrickBroken && random() % powerupDropChance == 0)
+                dropPowerup(event.position, static_cast<PowerupKind>(random() % powerupKinds));
+
+        if (mode == Mode::Windowed)
+        {
+            for (const auto &event : events)
+                switch (event.type)
+                {
+                    case GameEvent::EBrickHit: playSound(AudioEngine::SBrickHit); break;
+                    case GameEvent::EBrickBroken:
+                        playSound(AudioEngine::SBrickBreak);
+                        particles.spawn(event.position, event.color, particlesPerBrick);
+                        break;
+                    case GameEvent::EPaddleHit: playSound(AudioEngine::SPaddleHit); break;
+                    default: break;
+                }
+
+            hud.set(scoreNumber, score.points);
+            hud.set(livesNumber, score.lives);
+        }
+
+        sequencer.notify(events, *this);
+        events.clear();
+    }
+
+    // Elastic collisions between balls of the same mass: the velocity
+    // components along the line between the centers are exchanged.
+    void collideBalls(const std::vector<Entity *> &mBalls)
+    {
+        // The broad phase only pairs the balls up, the pairs are then
+        // tested on the positions themselves.
+        auto collide([this, &mBalls](std::uint32_t mI, std::uint32_t mJ) {
+            auto &cPhysicsI(mBalls[mI]->getComponent<CPhysics>());
+            auto &cPhysicsJ(mBalls[mJ]->getComponent<CPhysics>());
+            if (debugDraw.enabled)
+                debugDraw.line(toVector2f(mBalls[mI]->getComponent<CPosition>().position),
+                               toVector2f(mBalls[mJ]->getComponent<CPosition>().position), Color{255, 140, 0});
+
+            const PhysicsVector delta{mBalls[mJ]->getComponent<CPosition>().position -
+                                      mBalls[mI]->getComponent<CPosition>().position};
+            const PhysicsScalar distanceSquared{delta.x * delta.x + delta.y * delta.y};
+            const PhysicsScalar minDistance{cPhysicsI.halfSize.x + cPhysicsJ.halfSize.x};
+            if (distanceSquared >= minDistance * minDistance || distanceSquared == PhysicsScalar{})
+                return;
+
+            const PhysicsVector normal{delta / squareRoot(distanceSquared)};
+            const PhysicsVector relative{cPhysicsI.velocity - cPhysicsJ.velocity};
+            const PhysicsScalar approach{relative.x * normal.x + relative.y * normal.y};
+
+            // Already moving apart.
+            if (approach <= PhysicsScalar{})
+                return;
+
+            cPhysicsI.velocity -= normal * approach;
+            cPhysicsJ.velocity += normal * approach;
+        });
+
+        // The cells of the grid are only as large as the default balls.
+        if (sweepBalls || tunables.ballRadius > ballRadius)
+        {
+            std::pmr::vector<SweepAndPrune::Box> ballBoxes{frameArena.get()};
+            ballBoxes.reserve(mBalls.size());
+            for (auto &ball : mBalls)
+            {
+                const auto &cPhysics(ball->getComponent<CPhysics>());
+                ballBoxes.emplace_back(SweepAndPrune::Box{toFloat(cPhysics.left()), toFloat(cPhysics.top()),
+                                                          toFloat(cPhysics.right()), toFloat(cPhysics.bottom())});
+            }
+
+            ballSweep.update(ballBoxes);
+            if (debugDraw.enabled)
+                for (const auto &box : ballBoxes)
+                    debugDraw.rect(box.left, box.top, box.right, box.bottom, Color{0, 160, 0});
+            ballSweep.forEachPair(collide);
+            return;
+        }
+
+        std::pmr::vector<Vector2f> ballPositions{frameArena.get()};
+        ballPositions.reserve(mBalls.size());
+        for (auto &ball : mBalls)
+            ballPositions.emplace_back(toVector2f(ball->getComponent<CPosition>().position));
+
+        ballGrid.build(ballPositions);
+        if (debugDraw.enabled)
+            ballGrid.forEachOccupiedCell([this](float mLeft, float mTop, float mRight, float mBottom) {
+                debugDraw.rect(mLeft, mTop, mRight, mBottom, Color{0, 160, 0});
+            });
+        ballGrid.forEachPair(collide);
+    }
+
+    // Add `mCount` balls at `mOrigin`, spread over the upper half circle.
+    void spawnBalls(std::size_t mCount, const Vector2f &mOrigin)
+    {
+        manager.reserve(manager.getEntitiesByGroup(GBall).size() + mCount);
+
+        for (std::size_t i{0}; i < mCount; ++i)
+        {
+            const PhysicsScalar angle((i + 1) * 3.14159265f / (mCount + 1) + 3.14159265f);
+
+            auto &ball(createBall());
+            auto &cPosition(ball.getComponent<CPosition>());
+            cPosition.position = cPosition.previousPosition = fromVector2f<PhysicsScalar>(mOrigin);
+            ball.getComponent<CPhysics>().velocity =
+                PhysicsVector{cosine(angle), sine(angle)} * PhysicsScalar(ballVelocity * ballSpeedScale);
+        }
+    }
+
+    FloatRect getVisibleArea() const
+    {
+        return FloatRect{view.getCenter() - view.getSize() / 2.f, view.getSize()};
+    }
+
+    // Gather into `mVertices` the quads of the bricks drawn with a
+    // `TComponent` that can be seen in the view. The brick grid finds
+    // them, so the cost depends on what is in view instead of the level.
+    template <typename TComponent, typename TVertices>
+    void cullBricks(TVertices &mVertices)
+    {
+        cullBricks<TComponent>(mVertices, getVisibleArea());
+    }
+
+    template <typename TComponent, typename TVertices>
+    void cullBricks(TVertices &mVertices, const FloatRect &mArea)
+    {
+        mVertices.clear();
+
+        queryBricks(mArea.left, mArea.top, mArea.left + mArea.width, mArea.top + mArea.height, [&](Entity &mBrick) {
+            if (!mBrick.isAlive() || !mBrick.hasComponent<TComponent>())
+                return;
+
+            const auto &component(mBrick.getComponent<TComponent>());
+            const Vertex *quad(component.batch->getQuad(component.quad));
+            mVertices.insert(std::end(mVertices), quad, quad + 4);
+        });
+    }
+
+    // Move the play area and the view up, the paddle goes along. Its
+    // previous position too, so neither the paddle sweep nor the
+    // interpolation take the scroll for a movement of the paddle.
+    void scroll(float mFT)
+    {
+        const float offset{scrollVelocity * mFT};
+        playArea.top -= offset;
+        view.setCenter(view.getCenter().x, playArea.top + playArea.height / 2.f);
+
+        for (auto &paddle : manager.getEntitiesByGroup(GPaddle))
+        {
+            auto &cPosition(paddle->getComponent<CPosition>());
+            cPosition.position.y -= PhysicsScalar(offset);
+            cPosition.previousPosition.y -= PhysicsScalar(offset);
+            ++cPosition.version;
+        }
+    }
+
+    // Find the bricks `mBall` touches this step. The ball is swept along
+    // the movement of its last step, so it can't tunnel through bricks
+    // even with coarse time steps. At every hit the rest of the movement
+    // is swept again, reflected from the point of impact, up to
+    // `BrickContact::maxBricks` hits. Without a hit, the bricks it already
+    // overlapped are the contacts. Read-only, safe to run for several balls
+    // at the same time.
+    void gatherBrickContacts(Entity &mBall, BrickContact &mContact)
+    {
+        auto &cPosition(mBall.getComponent<CPosition>());
+        auto &cPhysics(mBall.getComponent<CPhysics>());
+
+        PhysicsVector from{cPosition.previousPosition};
+        PhysicsVector delta{cPosition.position - from};
+        const Vector2f halfSize{toVector2f(cPhysics.halfSize)};
+
+        // A brick is hit once per step, the ball leaves it reflected.
+        auto alreadyHit([&mContact](const Entity *mBrick, std::uint32_t mSlot) {
+            for (std::uint8_t j{0}; mContact.swept && j < mContact.count; ++j)
+                if (mContact.bricks[j] == mBrick && mContact.slots[j] == mSlot)
+                    return true;
+            return false;
+        });
+
+        for (std::uint8_t i{0}; i < BrickContact::maxBricks && (delta.x != PhysicsScalar{} || delta.y != PhysicsScalar{});
+             ++i)
+        {
+            const PhysicsVector to{from + delta};
+            SweepHit earliest{highest<PhysicsScalar>(), PhysicsVector{}};
+            Entity *hitBrick{nullptr};
+            std::uint32_t hitSlot{BrickField::noSlot};
+            // Overlaps only count before the ball moved.
+            const bool overlaps{i == 0};
+
+            // Only the bricks around the swept area are tested, the
+            // overlapped ones are found by the same query.
+            const Vector2f queryFrom{toVector2f(from)}, queryTo{toVector2f(to)};
+            const float left{std::min(queryFrom.x, queryTo.x) - halfSize.x};
+            const float top{std::min(queryFrom.y, queryTo.y) - halfSize.y};
+            const float right{std::max(queryFrom.x, queryTo.x) + halfSize.x};
+            const float bottom{std::max(queryFrom.y, queryTo.y) + halfSize.y};
+
+            queryBricks(left, top, right, bottom, [&](Entity &mBrick) {
+                if (!mBrick.isAlive() || alreadyHit(&mBrick, BrickField::noSlot))
+                    return;
+
+                auto &cpBrick(mBrick.getComponent<CPhysics>());
+                SweepHit hit;
+                if (sweepAABB(from, delta, cPhysics.halfSize, cpBrick, hit))
+                {
+                    if (hit.time < earliest.time)
+                    {
+                        earliest = hit;
+                        hitBrick = &mBrick;
+                        hitSlot = BrickField::noSlot;
+                    }
+                }
+                else if (overlaps && isIntersecting(cpBrick, cPhysics) && mContact.count < BrickContact::maxBricks)
+                {
+                    // The brick overlapped the most decides the response.
+                    const auto overlap(getOverlap(cpBrick, cPhysics));
+                    mContact.slots[mContact.count] = BrickField::noSlot;
+                    mContact.bricks[mContact.count++] = &mBrick;
+                    if (mContact.count == 1 || overlap.time > mContact.response.time)
+                        mContact.response = overlap;
+                }
+            });
+
+            // The same tests for the bricks of the field.
+            brickField.query(left, top, right, bottom, [&](std::uint32_t mSlot) {
+                if (alreadyHit(nullptr, mSlot))
+                    return;
+
+                const auto &box(brickField.getBox(mSlot));
+                SweepHit hit;
+                if (sweepAABB(from, delta, cPhysics.halfSize, box, hit))
+                {
+                    if (hit.time < earliest.time)
+                    {
+                        earliest = hit;
+                        hitBrick = nullptr;
+                        hitSlot = mSlot;
+                    }
+                }
+                else if (overlaps && isIntersecting(box, cPhysics) && mContact.count < BrickContact::maxBricks)
+                {
+                    const auto overlap(getOverlap(box, cPhysics));
+                    mContact.slots[mContact.count] = mSlot;
+                    mContact.bricks[mContact.count++] = nullptr;
+                    if (mContact.count == 1 || overlap.time > mContact.response.time)
+                        mContact.response = overlap;
+                }
+            });
+
+            // And for the sliding bricks, where their rows are this step.
+            kinematicBricks.query(left, top, right, bottom, [&](std::uint32_t mSlot) {
+                if (alreadyHit(nullptr, mSlot | KinematicBricks::slotFlag))
+                    return;
+
+                const auto box(kinematicBricks.getBox(mSlot));
+                SweepHit hit;
+                if (sweepAABB(from, delta, cPhysics.halfSize, box, hit))
+                {
+                    if (hit.time < earliest.time)
+                    {
+                        earliest = hit;
+                        hitBrick = nullptr;
+                        hitSlot = mSlot | KinematicBricks::slotFlag;
+                    }
+                }
+                else if (overlaps && isIntersecting(box, cPhysics) && mContact.count < BrickContact::maxBricks)
+                {
+                    const auto overlap(getOverlap(box, cPhysics));
+                    mContact.slots[mContact.count] = mSlot | KinematicBricks::slotFlag;
+                    mContact.bricks[mContact.count++] = nullptr;
+                    if (mContact.count == 1 || overlap.time > mContact.response.time)
+                        mContact.response = overlap;
+                }
+            });
+
+            if (hitBrick == nullptr && hitSlot == BrickField::noSlot)
+                break;
+
+            // The first hit replaces the overlaps, and is the one drawn by
+            // `drawBroadPhase`.
+            if (!mContact.swept)
+            {
+                mContact.count = 0;
+                mContact.swept = true;
+                mContact.response = earliest;
+            }
+
+            mContact.bricks[mContact.count] = hitBrick;
+            mContact.slots[mContact.count++] = hitSlot;
+
+            from += delta * earliest.time;
+            delta *= PhysicsScalar(1.f) - earliest.time;
+
+            if (earliest.normal.x != PhysicsScalar{})
+            {
+                delta.x = absolute(delta.x) * earliest.normal.x;
+                mContact.normal.x = earliest.normal.x;
+            }
+            else
+            {
+                delta.y = absolute(delta.y) * earliest.normal.y;
+                mContact.normal.y = earliest.normal.y;
+            }
+        }
+
+        if (mContact.swept)
+            mContact.end = from + delta;
+        else if (mContact.count != 0)
+            mContact.normal = mContact.response.normal;
+    }
+
+    // Every thread gathered the contacts of its ranges of balls, in order.
+    void mergeBrickContacts()
+    {
+        brickContacts.clear();
+        for (const auto &buffer : threadContacts)
+            brickContacts.insert(std::end(brickContacts), std::begin(buffer), std::end(buffer));
+
+        if (threadContacts.size() > 1)
+            std::sort(std::begin(brickContacts), std::end(brickContacts),
+                      [](const BrickContact &mA, const BrickContact &mB) { return mA.ball < mB.ball; });
+    }
+
+    // The structures of the last step and its contacts, before they were
+    // resolved. The ball pairs are added by `collideBalls`.
+    void drawBroadPhase(const std::vector<Entity *> &mBalls)
+    {
+        debugDraw.clear();
+        brickGrid.forEachOccupiedCell([this](float mLeft, float mTop, float mRight, float mBottom) {
+            debugDraw.rect(mLeft, mTop, mRight, mBottom, Color{70, 70, 140});
+        });
+        brickTree.forEachNode([this](float mLeft, float mTop, float mRight, float mBottom, bool mLeaf) {
+            debugDraw.rect(mLeft, mTop, mRight, mBottom, mLeaf ? Color{0, 200, 200} : Color{0, 90, 90});
+        });
+
+        for (const auto &contact : brickContacts)
+        {
+            const auto &cPosition(mBalls[contact.ball]->getComponent<CPosition>());
+            const Vector2f position{toVector2f(cPosition.position)};
+            for (std::uint8_t j{0}; j < contact.count; ++j)
+            {
+                Vector2f center, halfSize;
+                if (contact.bricks[j] != nullptr)
+                {
+                    const auto &cPhysics(contact.bricks[j]->getComponent<CPhysics>());
+                    center = Vector2f{toFloat(cPhysics.x()), toFloat(cPhysics.y())};
+                    halfSize = toVector2f(cPhysics.halfSize);
+                }
+                else
+                {
+                    const auto slot(contact.slots[j]);
+                    const auto box((slot & KinematicBricks::slotFlag) != 0
+                                       ? kinematicBricks.getBox(slot & ~KinematicBricks::slotFlag)
+                                       : brickField.getBox(slot));
+                    center = toVector2f(box.center);
+                    halfSize = toVector2f(box.halfSize);
+                }
+                debugDraw.rect(center.x - halfSize.x, center.y - halfSize.y, center.x + halfSize.x,
+                               center.y + halfSize.y, Color::Yellow);
+            }
+
+            // Where a swept ball hits, otherwise where it overlaps.
+            if (contact.swept)
+            {
+                const PhysicsVector from{cPosition.previousPosition};
+                const Vector2f impact{toVector2f(from + (cPosition.position - from) * contact.response.time)};
+                debugDraw.line(toVector2f(from), impact, Color::White);
+                debugDraw.cross(impact, 4.f, Color::Magenta);
+            }
+            else
+                debugDraw.cross(position, 4.f, Color::Magenta);
+        }
+    }
+
+    // One response per ball, then the bricks are damaged together, so a
+    // ball touching two bricks is reflected once and a brick touched by
+    // two balls loses two hit points.
+    void resolveBrickContacts(const std::vector<Entity *> &mBalls)
+    {
+        for (const auto &contact : brickContacts)
+        {
+            auto &cPosition(mBalls[contact.ball]->getComponent<CPosition>());
+            auto &cPhysics(mBalls[contact.ball]->getComponent<CPhysics>());
+            const auto &normal(contact.normal);
+
+            if (normal.x != PhysicsScalar{})
+                cPhysics.velocity.x = absolute(cPhysics.velocity.x) * normal.x;
+            if (normal.y != PhysicsScalar{})
+                cPhysics.velocity.y = absolute(cPhysics.velocity.y) * normal.y;
+
+            // A swept ball ends where the reflected sweeps took it.
+            if (!contact.swept)
+                continue;
+
+            cPosition.position = contact.end;
+            ++cPosition.version;
+        }
+
+        for (const auto &contact : brickContacts)
+        {
+            auto &ball(*mBalls[contact.ball]);
+            for (std::uint8_t j{0}; j < contact.count; ++j)
+            {
+                if (contact.bricks[j] == nullptr && (contact.slots[j] & KinematicBricks::slotFlag) != 0)
+                {
+                    damageKinematicBrick(contact.slots[j] & ~KinematicBricks::slotFlag, ball);
+                    continue;
+                }
+
+                if (contact.bricks[j] == nullptr)
+                {
+                    damageFieldBrick(contact.slots[j], ball);
+                    continue;
+                }
+
+                auto &brick(*contact.bricks[j]);
+                if (!brick.isAlive())
+                    continue;
+
+                const bool broken{damageBrick(brick)};
+                pushEvent(broken ? GameEvent::EBrickBroken : GameEvent::EBrickHit, brick, &ball);
+                if (broken && isExplosive(brick))
+                    blasts.emplace_back(&brick);
+            }
+        }
+    }
+
+    static bool isExplosive(const Entity &mBrick)
+    {
+        return mBrick.hasComponent<CBrick>() && brickTypes[mBrick.getComponent<CBrick>().type].explosive;
+    }
+
+    // The response to `mBall` touching a brick of the field.
+    void damageFieldBrick(std::uint32_t mSlot, const Entity &mBall)
+    {
+        if (!brickField.isAlive(mSlot))
+            return;
+
+        const bool broken{brickField.damage(mSlot)};
+        pushFieldEvent(broken ? GameEvent::EBrickBroken : GameEvent::EBrickHit, mSlot, &mBall);
+        if (broken && brickField.getType(mSlot).explosive)
+            fieldBlasts.emplace_back(mSlot);
+    }
+
+    void damageKinematicBrick(std::uint32_t mSlot, const Entity &mBall)
+    {
+        if (!kinematicBricks.isAlive(mSlot))
+            return;
+
+        const bool broken{kinematicBricks.damage(mSlot)};
+        pushKinematicEvent(broken ? GameEvent::EBrickBroken : GameEvent::EBrickHit, mSlot, &mBall);
+        if (broken && kinematicBricks.getType(mSlot).explosive)
+            kinematicBlasts.emplace_back(mSlot);
+    }
+
+    // An explosive brick breaks every brick around it but the
+    // indestructible ones, the explosive ones among them blow up in turn.
+    // Breadth first, from `blasts` used as a queue: every brick is found
+    // once through the grid, since `destroy` only marks it and the chain
+    // skips dead bricks. The whole chain is freed by the next `refresh`.
+    void propagateBlasts()
+    {
+        // How far past its box a blast reaches, enough for the neighbours
+        // on the diagonals too.
+        constexpr float blastReach{blockHeight / 2.f};
+
+        for (std::size_t i{0}; i < blasts.size(); ++i)
+        {
+            const auto &cPhysics(blasts[i]->getComponent<CPhysics>());
+            const float left{toFloat(cPhysics.left()) - blastReach}, right{toFloat(cPhysics.right()) + blastReach};
+            const float top{toFloat(cPhysics.top()) - blastReach}, bottom{toFloat(cPhysics.bottom()) + blastReach};
+
+            queryBricks(left, top, right, bottom, [&](Entity &mBrick) {
+                if (!mBrick.isAlive())
+                    return;
+
+                // The grid wraps its rows, only the bricks really in reach.
+                const auto &cpBrick(mBrick.getComponent<CPhysics>());
+                if (toFloat(cpBrick.right()) < left || toFloat(cpBrick.left()) > right ||
+                    toFloat(cpBrick.bottom()) < top || toFloat(cpBrick.top()) > bottom)
+                    return;
+
+                if (mBrick.hasComponent<CBrick>() && brickTypes[mBrick.getComponent<CBrick>().type].indestructible)
+                    return;
+
+                mBrick.destroy();
+                pushEvent(GameEvent::EBrickBroken, mBrick, nullptr);
+                if (isExplosive(mBrick))
+                    blasts.emplace_back(&mBrick);
+            });
+        }
+
+        blasts.clear();
+
+        // The field doesn't wrap, but its query is a cell wider.
+        for (std::size_t i{0}; i < fieldBlasts.size(); ++i)
+        {
+            const auto &box(brickField.getBox(fieldBlasts[i]));
+            const float left{toFloat(box.left()) - blastReach}, right{toFloat(box.right()) + blastReach};
+            const float top{toFloat(box.top()) - blastReach}, bottom{toFloat(box.bottom()) + blastReach};
+
+            brickField.query(left, top, right, bottom, [&](std::uint32_t mSlot) {
+                const auto &other(brickField.getBox(mSlot));
+                if (toFloat(other.right()) < left || toFloat(other.left()) > right || toFloat(other.bottom()) < top ||
+                    toFloat(other.top()) > bottom || brickField.getType(mSlot).indestructible)
+                    return;
+
+                brickField.kill(mSlot);
+                pushFieldEvent(GameEvent::EBrickBroken, mSlot, nullptr);
+                if (brickField.getType(mSlot).explosive)
+                    fieldBlasts.emplace_back(mSlot);
+            });
+        }
+
+        fieldBlasts.clear();
+
+        // The sliding rows only blow up among themselves, like the field.
+        for (std::size_t i{0}; i < kinematicBlasts.size(); ++i)
+        {
+            const auto box(kinematicBricks.getBox(kinematicBlasts[i]));
+            const float left{toFloat(box.left()) - blastReach}, right{toFloat(box.right()) + blastReach};
+            const float top{toFloat(box.top()) - blastReach}, bottom{toFloat(box.bottom()) + blastReach};
+
+            kinematicBricks.query(left, top, right, bottom, [&](std::uint32_t mSlot) {
+                const auto other(kinematicBricks.getBox(mSlot));
+                if (toFloat(other.right()) < left || toFloat(other.left()) > right || toFloat(other.bottom()) < top ||
+                    toFloat(other.top()) > bottom || kinematicBricks.getType(mSlot).indestructible)
+                    return;
+
+                kinematicBricks.kill(mSlot);
+                pushKinematicEvent(GameEvent::EBrickBroken, mSlot, nullptr);
+                if (kinematicBricks.getType(mSlot).explosive)
+                    kinematicBlasts.emplace_back(mSlot);
+            });
+        }
+
+        kinematicBlasts.clear();
+    }
+
+    void playSound(AudioEngine::SoundID mSound) noexcept
+    {
+        if (audio != nullptr)
+            audio->request(mSound);
+    }
+
+    // Spawn `mCount` chaos mode bodies from the center of the window,
+    // spread over every direction.
+    void spawnChaosBodies(std::size_t mCount)
+    {
+        const Vector2f center{windowWidth / 2.f, windowHeight / 2.f};
+
+        for (std::size_t i{0}; i < mCount; ++i)
+        {
+            const float angle{i * 2.f * 3.14159265f / mCount};
+            chaosBodies.add(center, Vector2f{std::cos(angle), std::sin(angle)} * ballVelocity, Vector2f{1.f, 1.f});
+        }
+    }
+
+    // Run the logic as fast as possible, without input nor drawing, until
+    // every brick is destroyed or `mMaxSteps` steps were simulated. A
+    // campaign goes on to its next level instead.
+    // Returns the number of steps run.
+    std::size_t simulate(std::size_t mMaxSteps)
+    {
+        std::size_t steps{0};
+
+        for (; steps < mMaxSteps; ++steps)
+        {
+            if (getBrickCount() == 0 && campaign == nullptr)
+                break;
+
+            step();
+        }
+
+        return steps;
+    }
+
+    // Run the steps of `mReplay` with its input. With a `mSpeed` above 0
+    // the playback is limited to `mSpeed` times the real time, otherwise it
+    // goes as fast as possible. Returns the number of steps run.
+    std::size_t play(Replay &mReplay, float mSpeed = 0.f)
+    {
+        timeStep = mReplay.getTimeStep();
+
+        std::size_t steps{0};
+        auto start(chrono::high_resolution_clock::now());
+
+        for (; mReplay.next(input); ++steps)
+        {
+            // The same path as a frame, one step worth of time at a time.
+            lastFrametime = timeStep;
+            updatePhase();
+            if (!mReplay.verifyHash(stateHash.get()))
+                break;
+
+            if (mSpeed > 0.f)
+                std::this_thread::sleep_until(start + chrono::duration_cast<chrono::high_resolution_clock::duration>(
+                                                          chrono::duration<float, milli>{steps * timeStep / mSpeed}));
+        }
+
+        return steps;
+    }
+
+    // Fit the game into a window of `mWidth` by `mHeight` pixels, as large
+    // as it can be without changing its shape.
+    void fitViewport(unsigned mWidth, unsigned mHeight)
+    {
+        if (mWidth == 0 || mHeight == 0)
+            return;
+
+        const float scale{std::min(static_cast<float>(mWidth) / windowWidth, static_cast<float>(mHeight) / windowHeight)};
+        const float width{windowWidth * scale / mWidth}, height{windowHeight * scale / mHeight};
+        viewport = FloatRect{(1.f - width) / 2.f, (1.f - height) / 2.f, width, height};
+    }
+
+    // Returns false, drawing at full size, when the texture can't be made.
+    bool setRenderScale(float mScale)
+    {
+        renderScale = mScale;
+        if (createSceneTexture())
+            return true;
+
+        renderScale = 1.f;
+        createSceneTexture();
+        return false;
+    }
+
+    // Turns the post-process effects on and off, false when they can't be
+    // used, then they are all off.
+    bool setPostProcess(bool mBloom, bool mCRT)
+    {
+        postProcess.bloom = mBloom;
+        postProcess.crt = mCRT;
+        if (createSceneTexture())
+            return true;
+
+        postProcess.bloom = postProcess.crt = false;
+        createSceneTexture();
+        return false;
+    }
+
+    // The scene texture of the render scale, only there when the game isn't
+    // drawn straight into the window.
+    bool createSceneTexture()
+    {
+        const bool post{postProcess.bloom || postProcess.crt};
+        if (window == nullptr || (renderScale == 1.f && !post))
+        {
+            sceneTexture.reset();
+            return true;
+        }
+
+        const auto width(static_cast<unsigned>(windowWidth * renderScale + 0.5f));
+        const auto height(static_cast<unsigned>(windowHeight * renderScale + 0.5f));
+        if (width == 0 || height == 0)
+            return false;
+
+        if (sceneTexture == nullptr || sceneTexture->getSize() != Vector2u{width, height})
+        {
+            sceneTexture.reset();
+            std::unique_ptr<RenderTexture> texture{new RenderTexture};
+            if (!texture->create(width, height))
+                return false;
+
+            texture->setSmooth(true);
+            sceneSprite.setTexture(texture->getTexture(), true);
+            sceneSprite.setScale(1.f / renderScale, 1.f / renderScale);
+            sceneTexture = std::move(texture);
+        }
+
+        return !post || postProcess.create(width, height);
+    }
+
+    void drawPhase()
+    {
+        MemoryScope memoryScope{MRender};
+        ARKANOID_ZONE("drawPhase");
+
+        renderStats = RenderStats{};
+#ifdef ARKANOID_GPU_TIMERS
+        gpuTimers.newFrame();
+        for (std::size_t pass{0}; pass < GpuPassCount; ++pass)
+            profiler.add(static_cast<ProfilePhase>(PGpuBalls + pass),
+                         gpuTimers.getMilliseconds(static_cast<GpuPass>(pass)));
+#endif
+
+        // Clear window, for some reason I need to do this after events in MacOS.
+        window->clear(Color::Black);
+        if (sceneTexture != nullptr)
+            sceneTexture->clear(Color::Black);
+
+        // How far we are between the last step and the next one.
+        const auto alpha(static_cast<float>(currentSlice / timeStep));
+        rectangleSync.update(manager, alpha);
+        spriteSync.update(manager, alpha);
+        circleSync.update(manager, alpha);
+
+#ifdef ARKANOID_GL_INSTANCING
+        // It draws straight into the window.
+        if (instancedRenderer.isAvailable() && sceneTexture == nullptr)
+        {
+            circleInstances.clear();
+            manager.forEach<CCircle>(
+                [this](Entity &, CCircle &mCircle) { circleInstances.emplace_back(mCircle.instance); });
+
+            View framed{view};
+            framed.setViewport(viewport);
+            window->setView(framed);
+#ifdef ARKANOID_GPU_TIMERS
+            // Balls and bricks in the same pass.
+            gpuTimers.begin(GpuBricks);
+            instancedRenderer.draw(rectangleBatch, circleInstances, Color::Red, view);
+            gpuTimers.end();
+#else
+            instancedRenderer.draw(rectangleBatch, circleInstances, Color::Red, view);
+#endif
+            window->resetGLStates();
+            // A unit quad per instance.
+            renderStats.draw(4, rectangleBatch.getQuadCount());
+            renderStats.draw(4, circleInstances.size());
+        }
+        else
+            submitShapes();
+#else
+        submitShapes();
+#endif
+        // A call per sliding row, translated by the row, the static
+        // layer doesn't see them.
+        kinematicBricks.sync(alpha);
+        const auto &kinematicLayer(kinematicBricks.layer);
+        for (std::size_t i{0}; i < kinematicLayer.batches.size(); ++i)
+        {
+            const auto quads(kinematicLayer.batches[i].getQuadCount());
+            renderQueue.submit(LRectangles, kinematicLayer.batches[i],
+                               kinematicLayer.getStates(i, RenderStates::Default), view, quads * 4, quads);
+        }
+
+        if (brickRegion != TextureAtlas::npos)
+        {
+            // The sprite batch only holds bricks.
+            cullBricks<CSprite>(visibleBricks.vertices);
+            renderQueue.submit(LBricks, visibleBricks, RenderStates{spriteBatch.texture}, view,
+                               visibleBricks.vertices.size(), visibleBricks.vertices.size() / 4);
+        }
+
+        if (useStaticLayer)
+        {
+            // While editing, nothing else changes the bricks, so only
+            // the edited ones are drawn again.
+            std::pmr::vector<Vertex> visibleVertices{frameArena.get()};
+            if (editing && staticLayer.canPatch(view))
+                staticLayer.patch(view, [this, &visibleVertices](const FloatRect &mArea) -> const auto & {
+                    cullBricks<CRectangle>(visibleVertices, mArea);
+                    return visibleVertices;
+                });
+            else if (staticLayer.needsUpdate(view))
+            {
+                cullBricks<CRectangle>(visibleVertices);
+                staticLayer.update(view, visibleVertices);
+            }
+
+            renderQueue.submit(LStaticLayer, staticLayer, RenderStates::Default, screenView, 4,
+                               staticLayer.batch.getQuadCount());
+        }
+
+        if (chaosBodies.size() > 0)
+        {
+            chaosBodies.writeVertices(chaosVertices, Color::Yellow);
+            renderQueue.submit(LEffects, chaosVertices, RenderStates::Default, view, chaosVertices.getVertexCount(),
+                               chaosVertices.getVertexCount());
+        }
+
+        if (particles.size() > 0)
+        {
+            particles.writeVertices(particleVertices);
+            renderQueue.submit(LEffects, particleVertices, RenderStates::Default, view, particleVertices.getVertexCount(),
+                               particleVertices.getVertexCount() / 4);
+        }
+
+        // The game so far goes into its texture, then the texture into the
+        // window, under the overlays.
+        if (sceneTexture != nullptr)
+        {
+            renderQueue.flush(*sceneTexture, renderStats);
+            sceneTexture->display();
+
+            View framed{screenView};
+            framed.setViewport(viewport);
+            window->setView(framed);
+            if (postProcess.isEnabled())
+            {
+#ifdef ARKANOID_GPU_TIMERS
+                gpuTimers.begin(GpuPost);
+                postProcess.apply(sceneSprite, *window, profiler, renderStats);
+                gpuTimers.end();
+#else
+                postProcess.apply(sceneSprite, *window, profiler, renderStats);
+#endif
+            }
+            else
+            {
+                window->draw(sceneSprite);
+                renderStats.draw(4, 1);
+            }
+        }
+
+#ifdef ARKANOID_DEBUG_DRAW
+        // Over the game, it scrolls with it.
+        if (debugDraw.enabled && debugDraw.getVertexCount() > 0)
+            renderQueue.submit(LOverlay, debugDraw, RenderStates::Default, view, debugDraw.getVertexCount());
+#endif
+
+        // The overlay stays in place when the view scrolls.
+        if (profilerOverlay.visible)
+            renderQueue.submit(LOverlay, profilerOverlay, RenderStates::Default, screenView,
+                               profilerOverlay.getVertexCount());
+
+        if (inspector.visible)
+        {
+            auto submitNumbers([this](const Hud &mNumbers) {
+                if (mNumbers.isBuilt())
+                    renderQueue.submit(LOverlay, mNumbers.getQuads(), RenderStates{mNumbers.getQuads().texture},
+                                       screenView, mNumbers.getQuads().getQuadCount() * 4,
+                                       mNumbers.getQuads().getQuadCount());
+            });
+
+            renderQueue.submit(LOverlay, inspector, RenderStates::Default, screenView, inspector.getVertexCount());
+            submitNumbers(inspector.getNumbers());
+            if (inspector.hasSelection())
+                submitNumbers(inspector.getSelectionNumbers());
+        }
+
+        if (hud.isBuilt())
+            renderQueue.submit(LOverlay, hud.getQuads(), RenderStates{hud.getQuads().texture}, screenView,
+                               hud.getQuads().getQuadCount() * 4, hud.getQuads().getQuadCount());
+
+        renderQueue.flush(*window, renderStats, viewport);
+        renderTotals.add(renderStats);
+
+        capture.update(*window);
+
+        // Displaying the window.
+        auto inputTransition(latencyProbe != nullptr ? latencyProbe->takeApplied() : LatencyProbe::Clock::time_point{});
+        {
+            ARKANOID_ZONE("display");
+            window->display();
+        }
+        pacer.frameDisplayed();
+
+        if (latencyProbe != nullptr)
+            latencyProbe->displayed(inputTransition);
+    }
+
+    // Balls in the view and the rectangle batch, when they aren't drawn
+    // by the instanced renderer.
+    void submitShapes()
+    {
+        const auto area(getVisibleArea());
+        manager.forEach<CCircle>([this, &area](Entity &, CCircle &mCircle) {
+            const auto &instance(mCircle.instance);
+            if (instance.position.x + instance.radius < area.left ||
+                instance.position.x - instance.radius > area.left + area.width ||
+                instance.position.y + instance.radius < area.top ||
+                instance.position.y - instance.radius > area.top + area.height)
+                return;
+
+            renderQueue.submit(LBalls, circleMesh, instance.getStates(RenderStates::Default), view,
+                               circleMesh.getVertexCount());
+        });
+
+        renderQueue.submit(LRectangles, rectangleBatch, RenderStates::Default, view, rectangleBatch.getQuadCount() * 4,
+                           rectangleBatch.getQuadCount());
+    }
+
+    void render(const Drawable &mDrawable, const RenderStates &mStates = RenderStates::Default)
+    {
+        window->draw(mDrawable, mStates);
+        ++renderStats.drawCalls;
+    }
+
+    // Draw from a dedicated thread from now on, the simulation is then no
+    // longer throttled by vsync or the frame limit.
+    void startRenderThread()
+    {
+        renderThread.reset(new RenderThread{*window});
+    }
+
+    // Render thread counterpart of `drawPhase`: copy what would be drawn
+    // into the back frame and hand it over.
+    void publishPhase()
+    {
+        MemoryScope memoryScope{MRender};
+        ARKANOID_ZONE("publishPhase");
+        auto &frame(renderThread->getBackFrame());
+
+        const auto alpha(static_cast<float>(currentSlice / timeStep));
+        rectangleSync.update(manager, alpha);
+        spriteSync.update(manager, alpha);
+        circleSync.update(manager, alpha);
+
+        // Room for every circle, the view may list fewer.
+        auto &arena(publishArenas.flip());
+        auto circles(arena.allocate<CircleInstance>(manager.getPoolStats(getComponentTypeID<CCircle>()).count));
+        frame.circleMesh = &circleMesh;
+        frame.circles = circles;
+        frame.circleCount = 0;
+        manager.forEach<CCircle>([&frame, circles](Entity &, CCircle &mCircle) {
+            new (circles + frame.circleCount++) CircleInstance(mCircle.instance);
+        });
+
+        frame.rectangles = rectangleBatch;
+        frame.sprites = spriteBatch;
+        // The static layer texture belongs to this thread, the render
+        // thread draws the bricks themselves.
+        frame.bricks = staticLayer.batch;
+        kinematicBricks.sync(alpha);
+        frame.kinematicBricks = kinematicBricks.layer;
+
+        if (chaosBodies.size() > 0)
+            chaosBodies.writeVertices(frame.chaosVertices, Color::Yellow);
+
+        particles.writeVertices(frame.particleVertices);
+
+        frame.profilerOverlay = profilerOverlay;
+        frame.hud = hud.getQuads();
+        renderStats = RenderStats{};
+        frame.count(renderStats);
+        renderTotals.add(renderStats);
+        frame.view = view;
+        frame.screenView = screenView;
+        frame.viewport = viewport;
+        frame.latencyProbe = latencyProbe;
+        frame.inputTransition =
+            latencyProbe != nullptr ? latencyProbe->takeApplied() : LatencyProbe::Clock::time_point{};
+
+        renderThread->publish();
+
+        // Nothing new can be drawn before the next step, so don't spin.
+        std::this_thread::sleep_for(chrono::duration<float, milli>{timeStep});
+    }
+};
+
+void CRectangle::init()
+{
+    MemoryScope memoryScope{MRender};
+    if (batch == nullptr)
+        batch = &game->rectangleBatch;
+    quad = batch->add();
+
+    syncedPosition = toVector2f(entity->getComponent<CPosition>().position);
+    batch->set(quad, syncedPosition, halfSize, color);
+}
+
+CRectangle::~CRectangle()
+{
+    batch->remove(quad);
+}
+
+void CSprite::init()
+{
+    MemoryScope memoryScope{MRender};
+    batch = &game->spriteBatch;
+    quad = batch->add();
+    textureRect = game->atlas.getTextureRect(region);
+
+    syncedPosition = toVector2f(entity->getComponent<CPosition>().position);
+    batch->set(quad, syncedPosition, halfSize, color, textureRect);
+}
+
+CSprite::~CSprite()
+{
+    batch->remove(quad);
+}
+
+SequenceWait WaveSequence::resume(Game &mGame)
+{
+    switch (stage)
+    {
+        case 0:
+            stage = 1;
+            if (wave.trigger == LevelWave::After)
+                return SequenceWait::forSteps(wave.value);
+            return SequenceWait::until(GameEvent::EBrickBroken);
+        case 1:
+            if (wave.trigger == LevelWave::Broken)
+            {
+                broken += static_cast<std::uint32_t>(
+                    std::count_if(std::begin(mGame.events), std::end(mGame.events),
+                                  [](const GameEvent &mEvent) { return mEvent.type == GameEvent::EBrickBroken; }));
+                if (broken < wave.value)
+                    return SequenceWait::until(GameEvent::EBrickBroken);
+            }
+
+            for (const auto &brick : wave.bricks)
+                mGame.createBrick(brick.position, brick.halfSize, brick.color, brick.hitPoints, brick.type);
+            break;
+    }
+
+    return SequenceWait::done();
+}
+
+void LevelStreamer::update(Game &mGame)
+{
+    const auto &area(mGame.playArea);
+    const int first{std::max(0, chunkAt(area.top - chunkHeight))};
+    const int last{std::min(static_cast<int>(chunks.size()) - 1, chunkAt(area.top + area.height + chunkHeight))};
+
+    bool requested{false};
+    for (int i{first}; i <= last; ++i)
+    {
+        auto &chunk(chunks[i]);
+        if (chunk.state != ChunkState::Unloaded)
+            continue;
+
+        chunk.state = ChunkState::Loading;
+        if (!requests.push(i))
+        {
+            chunk.state = ChunkState::Unloaded;
+            break;
+        }
+
+        requested = true;
+    }
+
+    if (requested)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        wakeUp.notify_one();
+    }
+
+    std::size_t index;
+    while (results.pop(index))
+    {
+        auto &chunk(chunks[index]);
+        for (auto i : chunk.toSpawn)
+        {
+            const auto &brick(level.bricks[chunk.first + i]);
+            auto &entity(mGame.createBrick(brick.position, brick.halfSize, brick.color, brick.hitPoints, brick.type));
+            chunk.spawned.emplace_back(i, entity.getHandle());
+        }
+
+        chunk.state = ChunkState::Loaded;
+        loadedChunks.emplace_back(index);
+    }
+
+    // Remember which bricks were broken while the chunk was in.
+    for (auto it(std::begin(loadedChunks)); it != std::end(loadedChunks);)
+    {
+        if (static_cast<int>(*it) >= first && static_cast<int>(*it) <= last)
+        {
+            ++it;
+            continue;
+        }
+
+        auto &chunk(chunks[*it]);
+        for (const auto &spawned : chunk.spawned)
+        {
+            auto entity(mGame.manager.getEntity(spawned.second));
+            if (entity == nullptr || !entity->isAlive())
+                chunk.broken[spawned.first] = true;
+            else
+                entity->destroy();
+        }
+
+        chunk.spawned.clear();
+        chunk.state = ChunkState::Unloaded;
+
+        *it = loadedChunks.back();
+        loadedChunks.pop_back();
+    }
+}
+
+void StatsServer::sample(const Game &mGame)
+{
+    const auto frame(mGame.profiler.getStats(PFrame));
+    const auto &manager(mGame.manager);
+    length = 0;
+    auto append([this](int mWritten) {
+        if (mWritten > 0)
+            length = std::min(length + mWritten, text.size() - 1);
+    });
+    auto add([&](const char *mName, float mMilliseconds) {
+        append(std::snprintf(text.data() + length, text.size() - length, "%s %.3f\n", mName, mMilliseconds));
+    });
+    auto addCount([&](const char *mName, std::size_t mCount) {
+        append(std::snprintf(text.data() + length, text.size() - length, "%s %zu\n", mName, mCount));
+    });
+
+    add("frame_ms_min", frame.min);
+    add("frame_ms_avg", frame.avg);
+    add("frame_ms_p50", frame.p50);
+    add("frame_ms_p99", frame.p99);
+    addCount("entities", manager.getEntityCount());
+    addCount("entities_paddle", manager.getEntitiesByGroup(Game::GPaddle).size());
+    addCount("entities_brick", manager.getEntitiesByGroup(Game::GBrick).size());
+    addCount("entities_ball", manager.getEntitiesByGroup(Game::GBall).size());
+    addCount("field_bricks", mGame.brickField.getAliveCount());
+    addCount("score", mGame.score.points);
+    addCount("lives", mGame.score.lives);
+    addCount("events_dropped", mGame.events.getDropped());
+    addCount("draw_calls", mGame.renderStats.drawCalls);
+    addCount("vertices", mGame.renderStats.vertices);
+    addCount("texture_switches", mGame.renderStats.textureSwitches);
+    addCount("shader_switches", mGame.renderStats.shaderSwitches);
+    addCount("batched_objects", mGame.renderStats.batchedObjects);
+    if (countingAllocations)
+        addCount("allocations_last_frame", mGame.profiler.getLastAllocations());
+    addCount("dropped_steps", mGame.droppedSteps);
+    if (countingAllocations)
+        addCount("allocations_total", allocationCount.load(std::memory_order_relaxed));
+#ifdef ARKANOID_MEMORY_TRACKING
+    char name[64];
+    for (auto i(0u); i < MCount; ++i)
+    {
+        std::snprintf(name, sizeof(name), "heap_live_bytes_%s", memoryTagNames[i]);
+        addCount(name, memoryCounters[i].live.load(std::memory_order_relaxed));
+        std::snprintf(name, sizeof(name), "heap_peak_bytes_%s", memoryTagNames[i]);
+        addCount(name, memoryCounters[i].peak.load(std::memory_order_relaxed));
+    }
+#endif
+}
+
+void NetServer::receive()
+{
+    IpAddress address;
+    unsigned short port;
+    while (socket.receive(packet, address, port) == Socket::Done)
+    {
+        Uint32 protocol, ack;
+        Uint8 count;
+        if (!(packet >> protocol >> ack >> count) || protocol != netProtocol)
+            continue;
+
+        // A new client takes the first free player, once the game is full
+        // the others are ignored.
+        auto client(std::find_if(std::begin(clients), std::end(clients), [&](const Client &mClient) {
+            return mClient.address == address && mClient.port == port;
+        }));
+        if (client == std::end(clients))
+        {
+            client = std::find_if(std::begin(clients), std::end(clients),
+                                  [](const Client &mClient) { return mClient.address == IpAddress::None; });
+            if (client == std::end(clients))
+                continue;
+
+            client->address = address;
+            client->port = port;
+        }
+
+        client->acknowledged = std::max(client->acknowledged, ack);
+
+        // Oldest first, the ones already queued are repeats. Packets can
+        // arrive out of order, older ones have nothing new.
+        for (Uint8 i{0}; i < count; ++i)
+        {
+            NetInput input;
+            if (!(packet >> input.sequence >> input.steps >> input.input.buttons >> input.input.axis))
+                break;
+
+            if (input.sequence <= client->queuedSequence || input.steps == 0)
+                continue;
+
+            client->queuedSequence = input.sequence;
+            client->pendingInputs.emplace_back(input);
+            if (client->pendingInputs.size() > maxPendingInputs)
+                client->pendingInputs.pop_front();
+        }
+    }
+}
+
+void NetServer::send(Game &mGame)
+{
+    auto &state(history.store(++sequence));
+    mGame.writeNetState(state);
+
+    for (std::size_t i{0}; i < clients.size(); ++i)
+    {
+        const auto &client(clients[i]);
+        if (client.address == IpAddress::None)
+            continue;
+
+        state.player = static_cast<std::uint32_t>(firstPlayer + i);
+        state.inputSequence = client.appliedSequence;
+        state.inputSteps = client.appliedSteps;
+
+        // The baseline is missing when the client fell too far behind,
+        // then the whole state is sent again.
+        packet.clear();
+        writeNetState(packet, state, history.find(client.acknowledged));
+        if (socket.send(packet, client.address, client.port) == Socket::Done)
+        {
+            ++snapshotsSent;
+            bytesSent += packet.getDataSize();
+        }
+    }
+}
+
+void NetClient::update(Game &mGame, std::uint16_t mSteps)
+{
+    IpAddress address;
+    unsigned short port;
+    const auto previous(latest);
+    while (socket.receive(packet, address, port) == Socket::Done)
+    {
+        if (address != serverAddress || port != serverPort || !readNetState(packet, history, received) ||
+            received.sequence <= latest)
+            continue;
+
+        latest = received.sequence;
+        history.store(latest) = received;
+    }
+
+    // The states say which player plays here. Until the first one comes
+    // there is no paddle to move, the packets only tell the server about
+    // this client.
+    auto &paddles(mGame.manager.getEntitiesByGroup(Game::GPaddle));
+    const auto state(history.find(latest));
+    const auto paddleIndex(state != nullptr ? mGame.findPaddle(state->player) : paddles.size());
+
+    if (latest != previous)
+    {
+        mGame.applyNetState(*state, state->player);
+        if (paddleIndex < paddles.size() && paddleIndex < state->paddles.size())
+            reconcile(mGame, *paddles[paddleIndex], state->paddles[paddleIndex], *state);
+    }
+
+    if (mSteps > 0 && paddleIndex < paddles.size())
+    {
+        auto &paddle(*paddles[paddleIndex]);
+        auto &prediction(predictions[++inputSequence % maxPredictions]);
+        prediction.input = NetInput{inputSequence, mSteps, mGame.input};
+        prediction.start = paddle.getComponent<CPosition>().position;
+        prediction.startSpeed = paddle.getComponent<CPaddleControl>().speed;
+        for (std::uint16_t i{0}; i < mSteps; ++i)
+            mGame.stepPaddle(paddle, mGame.input);
+    }
+
+    packet.clear();
+    const auto count(static_cast<Uint8>(std::min<std::uint32_t>(inputRepeats, inputSequence)));
+    packet << netProtocol << latest << count;
+    for (auto sequence(inputSequence - count + 1); sequence <= inputSequence; ++sequence)
+    {
+        const auto &input(predictions[sequence % maxPredictions].input);
+        packet << input.sequence << input.steps << input.input.buttons << input.input.axis;
+    }
+
+    socket.send(packet, serverAddress, serverPort);
+}
+
+void NetClient::reconcile(Game &mGame, Entity &mPaddle, const Vector2i &mConfirmed, const NetState &mState)
+{
+    auto &cPosition(mPaddle.getComponent<CPosition>());
+    auto &cPhysics(mPaddle.getComponent<CPhysics>());
+    auto &cControl(mPaddle.getComponent<CPaddleControl>());
+    auto confirmed(findPrediction(mState.inputSequence));
+    // The states only have positions, the speed the server has is the one
+    // predicted for the steps it applied.
+    float confirmedSpeed{cControl.speed};
+
+    if (confirmed != nullptr)
+    {
+        // Where the prediction had the paddle after the steps the server
+        // applied, the paddle is put back where it is afterwards.
+        const PhysicsVector position{cPosition.position}, previousPosition{cPosition.previousPosition};
+        const PhysicsVector velocity{cPhysics.velocity};
+        const float speed{cControl.speed};
+
+        cPosition.position = confirmed->start;
+        cControl.speed = confirmed->startSpeed;
+        for (std::uint32_t i{0}; i < mState.inputSteps; ++i)
+            mGame.stepPaddle(mPaddle, confirmed->input.input);
+
+        const bool predicted{Internal::quantizePosition(toVector2f(cPosition.position)) == mConfirmed};
+        confirmedSpeed = cControl.speed;
+        cPosition.position = position;
+        cPosition.previousPosition = previousPosition;
+        cPhysics.velocity = velocity;
+        cControl.speed = speed;
+        if (predicted)
+            return;
+    }
+    else if (mState.inputSequence == 0 && Internal::quantizePosition(toVector2f(cPosition.position)) == mConfirmed)
+    {
+        // Nothing played yet and the paddle is where the level put it on
+        // the server too. Rolling back would only round its position off.
+        return;
+    }
+
+    // Mispredicted, roll back to the server's paddle and play the inputs
+    // again from there: the rest of the one being applied, then the
+    // ones the server didn't get to.
+    ++rollbacks;
+    mGame.moveTo(mPaddle, Internal::dequantizePosition(mConfirmed));
+    cControl.speed = confirmedSpeed;
+
+    if (confirmed != nullptr)
+        for (auto i(mState.inputSteps); i < confirmed->input.steps; ++i)
+            mGame.stepPaddle(mPaddle, confirmed->input.input);
+
+    for (auto sequence(mState.inputSequence + 1); sequence <= inputSequence; ++sequence)
+    {
+        auto prediction(findPrediction(sequence));
+        if (prediction == nullptr)
+            continue;
+
+        prediction->start = cPosition.position;
+        prediction->startSpeed = cControl.speed;
+        for (std::uint16_t i{0}; i < prediction->input.steps; ++i)
+            mGame.stepPaddle(mPaddle, prediction->input.input);
+    }
+}
+
+void NetBroadcast::send(Game &mGame)
+{
+    poll();
+
+    // The state of the spectators isn't any player's, nothing of the
+    // players' inputs is in it.
+    auto &state(history.store(++sequence));
+    mGame.writeNetState(state);
+    state.player = maxPlayers;
+    state.inputSequence = state.inputSteps = 0;
+
+    const bool keyframe{sequence % keyframeInterval == 1};
+    packet.clear();
+    writeNetState(packet, state, keyframe ? nullptr : history.find(sequence - 1));
+
+    const auto size(static_cast<Uint32>(packet.getDataSize()));
+    auto frame(std::make_shared<std::vector<char>>(sizeof(size) + size));
+    for (std::size_t i{0}; i < sizeof(size); ++i)
+        (*frame)[i] = static_cast<char>(size >> (8 * (sizeof(size) - 1 - i)));
+    std::memcpy(frame->data() + sizeof(size), packet.getData(), size);
+    ++framesEncoded;
+    bytesEncoded += frame->size();
+
+    if (keyframe)
+        sinceKeyframe.clear();
+    sinceKeyframe.emplace_back(frame);
+
+    for (auto &spectator : spectators)
+    {
+        if (spectator.queued.size() >= maxQueued)
+        {
+            // Only the part of a frame already on its way must go on.
+            spectator.queued.resize(spectator.offset > 0 ? 1 : 0);
+            spectator.waitingKeyframe = true;
+        }
+
+        spectator.waitingKeyframe = spectator.waitingKeyframe && !keyframe;
+        if (!spectator.waitingKeyframe)
+            spectator.queued.emplace_back(frame);
+    }
+
+    spectators.erase(std::remove_if(std::begin(spectators), std::end(spectators),
+                                    [this](Spectator &mSpectator) {
+                                        if (flush(mSpectator))
+                                            return false;
+
+                                        selector.remove(*mSpectator.socket);
+                                        return true;
+                                    }),
+                     std::end(spectators));
+}
+
+bool NetSpectator::update(Game &mGame)
+{
+    const auto previous(latest);
+    Socket::Status status;
+    while ((status = socket.receive(packet)) == Socket::Done)
+    {
+        // Keyframes come with no baseline, the frames after them are
+        // deltas against the frame before.
+        if (!readNetState(packet, history, received) || received.sequence <= latest)
+            continue;
+
+        latest = received.sequence;
+        history.store(latest) = received;
+    }
+
+    if (latest != previous)
+    {
+        // The broadcast game may have one player or two.
+        const auto &state(*history.find(latest));
+        if (state.paddles.size() > mGame.manager.getEntitiesByGroup(Game::GPaddle).size())
+            mGame.addSecondPlayer();
+        mGame.applyNetState(state, maxPlayers);
+    }
+
+    return status != Socket::Disconnected && status != Socket::Error;
+}
+} // namespace CompositionArkanoid
+
+// Simulate `mGames` headless games of at most `mMaxSteps` steps each and
+// report how fast they ran, and the hash of their states. Returns 1 when
+// `mExpectedHash`, in hexadecimal, is given and isn't that hash. With
+// `mAutopilot` the paddles play, otherwise they stand still.
+int runHeadless(std::size_t mGames, std::size_t mMaxSteps, const char *mExpectedHash, bool mBrickField,
+                bool mAutopilot)
+{
+    using CompositionArkanoid::Game;
+
+    std::size_t totalSteps{0};
+    // Of the hashes of every game: an optimization that changes how the
+    // games play changes it.
+    CompositionArkanoid::StateHash hash;
+    auto timePoint1(chrono::high_resolution_clock::now());
+
+    // Seeded by their numbers, the same games every run.
+    for (std::size_t i{0}; i < mGames; ++i)
+    {
+        Game game{Game::Mode::Headless, static_cast<std::uint32_t>(i + 1)};
+        if (mBrickField)
+        {
+            game.brickFieldLevels = true;
+            game.loadLevel(CompositionArkanoid::Level::createDefault());
+        }
+        if (mAutopilot)
+            game.enableAutopilot();
+
+        totalSteps += game.simulate(mMaxSteps);
+        hash.add(game.stateHash.get());
+    }
+
+    auto timePoint2(chrono::high_resolution_clock::now());
+    auto seconds(chrono::duration_cast<chrono::duration<double>>(timePoint2 - timePoint1).count());
+
+    cout << mGames << " games, " << totalSteps << " steps in " << seconds * 1000.0 << " ms ("
+         << mGames / seconds << " games/s, " << totalSteps / seconds << " steps/s), state hash " << std::hex
+         << hash.get() << std::dec << endl;
+#ifdef ARKANOID_MEMORY_TRACKING
+    printMemoryUsage(cout);
+#endif
+
+    if (mExpectedHash != nullptr && std::strtoul(mExpectedHash, nullptr, 16) != hash.get())
+    {
+        cerr << "State hash " << std::hex << hash.get() << " instead of " << mExpectedHash << std::dec << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Parameter grid of a batch run, from a text file of lines like
+//     ball 0.8 1 1.25     factors of `ballVelocity` to try
+//     paddle 1 1.5        factors of `paddleVelocity` to try
+//     level default levels/wide.txt
+//     games 500           games per combination, seeded 1 to 500
+//     steps 120000        steps a game may last at most
+// with `#` comments. Every combination of the values is played.
+struct BatchGrid
+{
+    std::vector<float> ballSpeeds, paddleSpeeds;
+    std::vector<std::string> levelNames;
+    std::vector<CompositionArkanoid::Level> levels;
+    std::size_t games{100}, steps{60000};
+
+    bool load(const char *mPath)
+    {
+        std::ifstream file{mPath};
+        if (!file)
+            return false;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto comment(line.find('#'));
+            if (comment != std::string::npos)
+                line.resize(comment);
+
+            std::istringstream fields{line};
+            std::string key;
+            if (!(fields >> key))
+                continue;
+
+            float speed;
+            std::string name;
+            if (key == "ball")
+                while (fields >> speed)
+                    ballSpeeds.emplace_back(speed);
+            else if (key == "paddle")
+                while (fields >> speed)
+                    paddleSpeeds.emplace_back(speed);
+            else if (key == "level")
+                while (fields >> name)
+                    levelNames.emplace_back(name);
+            else if (key == "games")
+                fields >> games;
+            else if (key == "steps")
+                fields >> steps;
+            else
+                cerr << "Unknown batch setting " << key << endl;
+        }
+
+        if (ballSpeeds.empty())
+            ballSpeeds.emplace_back(1.f);
+        if (paddleSpeeds.empty())
+            paddleSpeeds.emplace_back(1.f);
+        if (levelNames.empty())
+            levelNames.emplace_back("default");
+
+        // Read once, the games only copy them.
+        for (const auto &levelName : levelNames)
+        {
+            levels.emplace_back(CompositionArkanoid::Level::createDefault());
+            if (levelName != "default" && !levels.back().load(levelName.c_str()))
+            {
+                cerr << "Can't load level " << levelName << endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::size_t getCombinations() const noexcept { return ballSpeeds.size() * paddleSpeeds.size() * levels.size(); }
+};
+
+// Play the games of every combination of `mGridPath` across `mThreads`
+// threads, all of them with 0, and write the statistics of each
+// combination to the CSV file `mOutputPath`. Every game is its own `Game`
+// and writes only its own result, so the run scales with the cores.
+int runBatch(const char *mGridPath, const char *mOutputPath, std::size_t mThreads)
+{
+    using namespace CompositionArkanoid;
+
+    BatchGrid grid;
+    if (!grid.load(mGridPath))
+    {
+        cerr << "Can't load the batch grid " << mGridPath << endl;
+        return 1;
+    }
+
+    std::ofstream output{mOutputPath};
+    if (!output)
+    {
+        cerr << "Can't write " << mOutputPath << endl;
+        return 1;
+    }
+
+    struct Result
+    {
+        std::size_t steps{0};
+        bool cleared{false};
+        std::uint32_t paddleHits{0}, ballsLost{0}, points{0};
+    };
+
+    // Registered before the games are made on several threads at once.
+    registerComponentTypes(ComponentList{});
+
+    const auto games(grid.getCombinations() * grid.games);
+    std::vector<Result> results(games);
+    JobSystem jobs{mThreads != 0 ? mThreads : std::max(1u, std::thread::hardware_concurrency())};
+    const FrameTime timeStep{ftSlice};
+
+    auto timePoint1(chrono::high_resolution_clock::now());
+    jobs.parallelFor(games, 1, [&grid, &results](std::size_t mFirst, std::size_t mLast) {
+        for (auto i(mFirst); i < mLast; ++i)
+        {
+            // Combinations vary the ball speed fastest, then the paddle
+            // speed, then the level. Their games have the same seeds.
+            const auto combination(i / grid.games);
+            const auto ballSpeed(grid.ballSpeeds[combination % grid.ballSpeeds.size()]);
+            const auto paddleSpeed(grid.paddleSpeeds[combination / grid.ballSpeeds.size() % grid.paddleSpeeds.size()]);
+            const auto &level(grid.levels[combination / (grid.ballSpeeds.size() * grid.paddleSpeeds.size())]);
+
+            Game game{Game::Mode::Headless, static_cast<std::uint32_t>(i % grid.games + 1)};
+            game.loadLevel(level);
+            game.tune(ballSpeed, paddleSpeed);
+            game.enableAutopilot();
+
+            auto &result(results[i]);
+            result.steps = game.simulate(grid.steps);
+
+            result.cleared = game.getBrickCount() == 0;
+            result.paddleHits = game.score.paddleHits;
+            result.ballsLost = game.score.ballsLost;
+            result.points = game.score.points;
+        }
+    });
+    auto timePoint2(chrono::high_resolution_clock::now());
+    auto seconds(chrono::duration_cast<chrono::duration<double>>(timePoint2 - timePoint1).count());
+
+    output << "ball_speed,paddle_speed,level,games,cleared,mean_clear_seconds,mean_paddle_bounces,"
+              "balls_lost_per_minute,mean_points\n";
+
+    std::size_t totalSteps{0};
+    for (std::size_t combination{0}; combination < grid.getCombinations(); ++combination)
+    {
+        std::size_t cleared{0}, clearSteps{0}, steps{0}, paddleHits{0}, ballsLost{0}, points{0};
+        for (auto i(combination * grid.games); i < (combination + 1) * grid.games; ++i)
+        {
+            const auto &result(results[i]);
+            steps += result.steps;
+            if (result.cleared)
+            {
+                ++cleared;
+                clearSteps += result.steps;
+            }
+            paddleHits += result.paddleHits;
+            ballsLost += result.ballsLost;
+            points += result.points;
+        }
+        totalSteps += steps;
+
+        const double stepSeconds{timeStep / 1000.0};
+        const auto perGame([&grid](std::size_t mTotal) { return static_cast<double>(mTotal) / grid.games; });
+        output << grid.ballSpeeds[combination % grid.ballSpeeds.size()] << ','
+               << grid.paddleSpeeds[combination / grid.ballSpeeds.size() % grid.paddleSpeeds.size()] << ','
+               << grid.levelNames[combination / (grid.ballSpeeds.size() * grid.paddleSpeeds.size())] << ','
+               << grid.games << ',' << cleared << ','
+               << (cleared != 0 ? clearSteps * stepSeconds / cleared : 0.0) << ',' << perGame(paddleHits) << ','
+               << (steps != 0 ? ballsLost / (steps * stepSeconds / 60.0) : 0.0) << ',' << perGame(points)
+               << '\n';
+    }
+
+    cout << games << " games of " << grid.getCombinations() << " combinations, " << totalSteps << " steps in "
+         << seconds * 1000.0 << " ms on " << jobs.getThreadCount() << " threads (" << games / seconds
+         << " games/s), written to " << mOutputPath << endl;
+    return 0;
+}
+
+// A steady frame must not touch the heap: once `mWarmUp` steps of a
+// headless game grew its pools and buffers, none of the next `mSteps` may
+// allocate. Returns 1, for scripts, when one did.
+int checkAllocations(std::size_t mSteps, std::size_t mWarmUp)
+{
+    using CompositionArkanoid::Game;
+
+    if (!countingAllocations)
+    {
+        cerr << "Allocations are only counted in builds with ARKANOID_COUNT_ALLOCATIONS" << endl;
+        return 1;
+    }
+
+    Game game{Game::Mode::Headless};
+    game.simulate(mWarmUp);
+
+    std::size_t steps{0}, failedSteps{0};
+    for (; steps < mSteps; ++steps)
+    {
+        const auto before(allocationCount.load(std::memory_order_relaxed));
+        if (game.simulate(1) == 0)
+            break;
+
+        const auto allocations(allocationCount.load(std::memory_order_relaxed) - before);
+        if (allocations != 0 && ++failedSteps <= 10)
+            cerr << "Step " << mWarmUp + steps << " allocated " << allocations << " times" << endl;
+    }
+
+    if (failedSteps != 0)
+    {
+        cerr << failedSteps << " of " << steps << " steps allocated" << endl;
+        return 1;
+    }
+
+    cout << steps << " steps after " << mWarmUp << " warm-up steps, no allocation" << endl;
+    return 0;
+}
+
+// Bodies out through both borders of an axis at once, four of them for
+// the SIMD kernel and one more for the scalar one: every body must bounce
+// the same way, as the state hash of lockstep and replays depends on it.
+bool testBounceTieBreak()
+{
+    CompositionArkanoid::PhysicsBodies bodies;
+    for (int i{0}; i < 5; ++i)
+        bodies.add(Vector2f{windowWidth / 2.f, windowHeight / 2.f}, Vector2f{-3.f, 5.f},
+                   Vector2f{static_cast<float>(windowWidth), static_cast<float>(windowHeight)});
+
+    bodies.integrate(1.f);
+
+    for (std::size_t i{0}; i < 4; ++i)
+        if (bodies.getVelocity(i).x != bodies.getVelocity(4).x || bodies.getVelocity(i).y != bodies.getVelocity(4).y)
+            return false;
+
+    // The low border wins.
+    return bodies.getVelocity(4).x == 3.f && bodies.getVelocity(4).y == 5.f;
+}
+
+// A ball fast enough to cross two bricks in one step: it bounces off the
+// first one, and the rest of its movement, reflected, must hit the
+// second one instead of going through it.
+bool testTwoBricksInOneStep()
+{
+    using namespace CompositionArkanoid;
+
+    Game game{Game::Mode::Headless, 1};
+    Level level;
+    const Vector2f halfSize{blockWidth / 2.f, blockHeight / 2.f};
+    level.bricks.emplace_back(LevelBrick{Vector2f{300.f, 300.f}, halfSize, Color::Red, 1, BNormal});
+    level.bricks.emplace_back(LevelBrick{Vector2f{120.f, 300.f}, halfSize, Color::Red, 1, BNormal});
+    game.loadLevel(level);
+
+    // From 200 to 400 along x: it hits the first brick at 260, then the
+    // second one at 160 on the way back and ends at 200.
+    auto &ball(*game.manager.getEntitiesByGroup(Game::GBall).front());
+    auto &cPosition(ball.getComponent<CPosition>());
+    cPosition.previousPosition = fromVector2f<PhysicsScalar>(Vector2f{200.f, 300.f});
+    cPosition.position = fromVector2f<PhysicsScalar>(Vector2f{400.f, 300.f});
+
+    BrickContact contact;
+    game.gatherBrickContacts(ball, contact);
+
+    const Vector2f end{toVector2f(contact.end)};
+    return contact.swept && contact.count == 2 && std::abs(end.x - 200.f) < 0.05f && std::abs(end.y - 300.f) < 0.05f &&
+           contact.normal.x > PhysicsScalar{};
+}
+
+// The default level with waves and rows, through the compact format and
+// back.
+bool testCompactRoundTrip()
+{
+    using namespace CompositionArkanoid;
+
+    auto level(Level::createDefault());
+    level.broadPhase = Level::BroadPhase::Grid;
+    level.bricks[1].type = BHard;
+    level.bricks[2].type = BExplosive;
+    level.waves.emplace_back(LevelWave{LevelWave::Broken, 10, {level.bricks[0], level.bricks[5]}});
+    level.waves.emplace_back(LevelWave{LevelWave::After, 600, {}});
+    level.rows.emplace_back(LevelRow{0.1f, 60.f, LevelRow::noParent, {level.bricks[1], level.bricks[2]}});
+    level.rows.emplace_back(LevelRow{-0.2f, 30.f, 0, {level.bricks[3]}});
+
+    std::vector<char> data;
+    Level loaded;
+    if (!level.saveCompact(data) || !loaded.loadCompact(data.data(), data.size()))
+        return false;
+
+    auto same([](const std::vector<LevelBrick> &mA, const std::vector<LevelBrick> &mB) {
+        return std::equal(std::begin(mA), std::end(mA), std::begin(mB), std::end(mB),
+                          [](const LevelBrick &mBrickA, const LevelBrick &mBrickB) {
+                              return mBrickA.position == mBrickB.position && mBrickA.halfSize == mBrickB.halfSize &&
+                                     mBrickA.color == mBrickB.color && mBrickA.hitPoints == mBrickB.hitPoints &&
+                                     mBrickA.type == mBrickB.type;
+                          });
+    });
+
+    if (loaded.broadPhase != level.broadPhase || !same(loaded.bricks, level.bricks) ||
+        loaded.waves.size() != level.waves.size() || loaded.rows.size() != level.rows.size())
+        return false;
+
+    for (std::size_t i{0}; i < level.waves.size(); ++i)
+        if (loaded.waves[i].trigger != level.waves[i].trigger || loaded.waves[i].value != level.waves[i].value ||
+            !same(loaded.waves[i].bricks, level.waves[i].bricks))
+            return false;
+
+    for (std::size_t i{0}; i < level.rows.size(); ++i)
+        if (loaded.rows[i].speed != level.rows[i].speed || loaded.rows[i].distance != level.rows[i].distance ||
+            loaded.rows[i].parent != level.rows[i].parent || !same(loaded.rows[i].bricks, level.rows[i].bricks))
+            return false;
+
+    return true;
+}
+
+// Compact files made to ask for more bricks than a level may have, or
+// cut short: they must fail, and without allocating for what they claim.
+bool testCompactHostileInput()
+{
+    using namespace CompositionArkanoid;
+
+    auto varint([](std::vector<char> &mData, std::uint64_t mValue) {
+        for (; mValue >= 0x80; mValue >>= 7)
+            mData.emplace_back(static_cast<char>((mValue & 0x7f) | 0x80));
+        mData.emplace_back(static_cast<char>(mValue));
+    });
+    // A list of one style with a run of `mLength` bricks, all of them in
+    // its types, which `mCount` must hold.
+    auto list([&varint](std::vector<char> &mData, std::uint64_t mCount, std::uint64_t mLength) {
+        varint(mData, mCount);
+        varint(mData, 1);
+        const float halfSize[2]{blockWidth / 2.f, blockHeight / 2.f};
+        mData.insert(std::end(mData), reinterpret_cast<const char *>(halfSize),
+                     reinterpret_cast<const char *>(halfSize) + sizeof(halfSize));
+        mData.insert(std::end(mData), {'\xff', '\0', '\0', '\xff', '\1'});
+        // Style 0 at 0, 0, and a step of 0, 0 for longer runs.
+        mData.insert(std::end(mData), {'\0', '\0', '\0'});
+        varint(mData, mLength);
+        if (mLength > 1)
+            mData.insert(std::end(mData), {'\0', '\0'});
+        varint(mData, mLength);
+        mData.emplace_back(static_cast<char>(BNormal));
+    });
+    // Version 1 with the grid, as `Level::saveCompact` writes it.
+    auto file([](const std::vector<char> &mRaw, std::uint32_t mRawSize) {
+        std::vector<char> data{'A', 'R', 'K', 'Z', '\1', '\0', '\0', '\0'};
+        data.insert(std::end(data), reinterpret_cast<const char *>(&mRawSize),
+                    reinterpret_cast<const char *>(&mRawSize) + sizeof(mRawSize));
+        LZ4Block::compress(mRaw.data(), mRaw.size(), data);
+        return data;
+    });
+
+    // A run far longer than its list.
+    std::vector<char> longRun;
+    list(longRun, 1, std::uint64_t{1} << 40);
+    varint(longRun, 0);
+    varint(longRun, 0);
+
+    // A list of one brick, then a wave of all the bricks a whole file may
+    // have: valid on its own, too many with the brick before.
+    std::vector<char> overBudget;
+    list(overBudget, 1, 1);
+    varint(overBudget, 1);
+    overBudget.insert(std::end(overBudget), {'\0', '\0'});
+    list(overBudget, std::uint64_t{1} << 24, std::uint64_t{1} << 24);
+    varint(overBudget, 0);
+
+    std::vector<char> valid;
+    if (!Level::createDefault().saveCompact(valid))
+        return false;
+
+    const std::vector<std::vector<char>> files{
+        file(longRun, static_cast<std::uint32_t>(longRun.size())),
+        file(overBudget, static_cast<std::uint32_t>(overBudget.size())),
+        // The LZ4 block cut short, and one that claims far more than its
+        // bytes can make.
+        std::vector<char>(std::begin(valid), std::end(valid) - 4),
+        file(valid, 1u << 27)};
+
+    // Without ARKANOID_COUNT_ALLOCATIONS nothing is counted, failing has
+    // to do.
+    const auto before(allocatedBytes.load(std::memory_order_relaxed));
+    for (const auto &data : files)
+    {
+        Level level;
+        if (level.loadCompact(data.data(), data.size()))
+            return false;
+    }
+
+    return allocatedBytes.load(std::memory_order_relaxed) - before < (std::size_t{1} << 20);
+}
+
+// Checks that need no window, for CTest. Returns 1, for scripts, when one
+// of them failed.
+int runSelfTests()
+{
+    std::size_t failures{0};
+    auto check([&failures](const char *mName, bool mPassed) {
+        cout << (mPassed ? "ok      " : "FAILED  ") << mName << endl;
+        failures += mPassed ? 0 : 1;
+    });
+
+    check("bounce tie-break, SIMD and scalar", testBounceTieBreak());
+    check("two bricks in one step", testTwoBricksInOneStep());
+    check("compact level round trip", testCompactRoundTrip());
+    check("compact level hostile input", testCompactHostileInput());
+
+    return failures != 0 ? 1 : 0;
+}
+
+// Dedicated server: `mMatches` independent two-player games without a
+// window nor a local player, on the ports from `mPort` on. Every tick the
+// frame of each match runs as its own task of the job system, the
+// matches share nothing. Runs for `mTicks` ticks, forever with 0, and
+// reports how long the ticks took every five seconds.
+int runServer(std::size_t mMatches, unsigned short mPort, std::size_t mTicks)
+{
+    using namespace CompositionArkanoid;
+
+    struct Match
+    {
+        Game game{Game::Mode::Headless};
+        NetServer server{0};
+    };
+
+    // Same IDs as any other run.
+    registerComponentTypes(ComponentList{});
+
+    std::vector<std::unique_ptr<Match>> matches;
+    matches.reserve(mMatches);
+    const auto bytesBefore(allocatedBytes.load());
+
+    for (std::size_t i{0}; i < mMatches; ++i)
+    {
+        matches.emplace_back(new Match);
+        auto &match(*matches.back());
+        if (!match.server.listen(static_cast<unsigned short>(mPort + i)))
+        {
+            cerr << "Can't listen on port " << mPort + i << endl;
+            return 1;
+        }
+
+        match.game.addSecondPlayer();
+        match.game.netServer = &match.server;
+    }
+
+    const auto bytesPerMatch((allocatedBytes.load() - bytesBefore) / std::max<std::size_t>(1, mMatches));
+    cout << mMatches << " matches on ports " << mPort << " to " << mPort + mMatches - 1;
+    if (countingAllocations)
+        cout << ", " << bytesPerMatch / 1024 << " KiB allocated per match";
+    cout << endl;
+
+    JobSystem jobs;
+    const FrameTime tick{1000.f / 60.f};
+    const std::size_t ticksPerReport{300};
+    const auto tickDuration(chrono::duration_cast<chrono::high_resolution_clock::duration>(
+        chrono::duration<float, milli>{tick}));
+
+    FrameTime totalTime{0.f}, worstTime{0.f};
+    std::size_t bytesReported{0};
+    auto nextTick(chrono::high_resolution_clock::now());
+
+    for (std::size_t t{1}; mTicks == 0 || t <= mTicks; ++t)
+    {
+        auto timePoint1(chrono::high_resolution_clock::now());
+        jobs.parallelFor(matches.size(), 1, [&matches, tick](std::size_t mFirst, std::size_t mLast) {
+            for (auto i(mFirst); i < mLast; ++i)
+            {
+                auto &game(matches[i]->game);
+                game.lastFrametime = tick;
+                game.updatePhase();
+            }
+        });
+        auto timePoint2(chrono::high_resolution_clock::now());
+
+        const FrameTime ft{chrono::duration_cast<chrono::duration<float, milli>>(timePoint2 - timePoint1).count()};
+        totalTime += ft;
+        worstTime = std::max(worstTime, ft);
+
+        if (t % ticksPerReport == 0)
+        {
+            std::size_t bytesSent{0};
+            for (const auto &match : matches)
+                bytesSent += match->server.getBytesSent();
+
+            const float seconds{ticksPerReport * tick / 1000.f};
+            std::printf("tick %.3f ms average, %.3f ms worst, %.1f KiB/s sent\n", totalTime / ticksPerReport,
+                        worstTime, (bytesSent - bytesReported) / 1024.f / seconds);
+
+            totalTime = worstTime = 0.f;
+            bytesReported = bytesSent;
+        }
+
+        // Late ticks aren't caught up, the matches just run slower.
+        nextTick = std::max(nextTick + tickDuration, chrono::high_resolution_clock::now());
+        std::this_thread::sleep_until(nextTick);
+    }
+
+    return 0;
+}
+
+// End to end benchmark: a windowed game without frame limit on a crowded
+// level of 100x60 small bricks with 50 balls, for `mSeconds` seconds. The
+// paddle input comes from the replay at `mReplayPath` when there is one.
+// Prints the percentiles and a histogram of the frame times.
+int runScenario(const char *mReplayPath, float mSeconds)
+{
+    using namespace CompositionArkanoid;
+
+    Replay replay;
+    if (mReplayPath != nullptr && !replay.load(mReplayPath))
+    {
+        cerr << "Can't read replay " << mReplayPath << endl;
+        return 1;
+    }
+
+    Game game{Game::Mode::Windowed, mReplayPath != nullptr ? replay.getSeed() : 0};
+    game.pacer.setMode(*game.window, FramePacer::Mode::Uncapped);
+
+    constexpr int columns{100}, rows{60};
+    const Vector2f halfSize{windowWidth / (columns * 2.f), windowHeight / (rows * 4.f)};
+
+    Level level;
+    for (int iX{0}; iX < columns; ++iX)
+        for (int iY{0}; iY < rows; ++iY)
+            level.bricks.emplace_back(
+                LevelBrick{Vector2f{(iX * 2 + 1) * halfSize.x, (iY * 2 + 1) * halfSize.y}, halfSize, Color::Red, 1,
+                           BNormal});
+    game.loadLevel(level);
+
+    game.spawnBalls(49, Vector2f{windowWidth / 2.f, windowHeight / 2.f});
+
+    if (mReplayPath != nullptr)
+    {
+        game.timeStep = replay.getTimeStep();
+        // Only the input is played back, on another level.
+        replay.dropHashes();
+        game.playback = &replay;
+    }
+
+    std::vector<FrameTime> frameTimes;
+    frameTimes.reserve(static_cast<std::size_t>(mSeconds * 2000));
+    game.frameTimes = &frameTimes;
+
+    // Stop after `mSeconds` from another thread, `run` only returns once
+    // `running` is cleared.
+    std::atomic<bool> done{false};
+    std::thread timer{[&game, &done, mSeconds] {
+        auto end(chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                                                     chrono::duration<float>{mSeconds}));
+        while (!done && chrono::steady_clock::now() < end)
+            std::this_thread::sleep_for(chrono::milliseconds{10});
+
+        game.running = false;
+    }};
+
+    game.run();
+    done = true;
+    timer.join();
+
+    if (frameTimes.empty())
+        return 1;
+
+    std::vector<FrameTime> sorted(frameTimes);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile([&sorted](float mPercent) { return sorted[static_cast<std::size_t>(mPercent * (sorted.size() - 1))]; });
+
+    std::printf("%zu frames, p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n", sorted.size(), percentile(0.5f),
+                percentile(0.95f), percentile(0.99f), sorted.back());
+
+    const auto &totals(game.renderTotals);
+    const double frames(sorted.size());
+    std::printf("per frame: %.1f draw calls, %.0f vertices, %.1f texture and %.1f shader switches, %.0f batched\n",
+                totals.drawCalls / frames, totals.vertices / frames, totals.textureSwitches / frames,
+                totals.shaderSwitches / frames, totals.batchedObjects / frames);
+
+    // One bucket per millisecond, everything from 32 ms goes in the last.
+    std::array<std::size_t, 33> histogram{};
+    for (auto ft : frameTimes)
+        ++histogram[std::min<std::size_t>(histogram.size() - 1, static_cast<std::size_t>(ft))];
+
+    for (auto i(0u); i < histogram.size(); ++i)
+        if (histogram[i] > 0)
+            std::printf("%2u%s ms %8zu\n", i, i + 1 == histogram.size() ? "+" : " ", histogram[i]);
+
+    return 0;
+}
+
+// What the performance gate measures of a scenario: the step time
+// percentiles in milliseconds and the allocations per step.
+struct PerfResult
+{
+    double p50{0.0}, p99{0.0}, allocationsPerStep{0.0};
+};
+
+// Baselines of the performance gate, a JSON object with one object per
+// scenario, e.g.
+//     {
+//       "crowded": {"p50_ms": 0.2104, "p99_ms": 0.4812, "allocations_per_step": 0},
+//       ...
+//     }
+// Only that shape is read back, the one `save` writes. Unknown keys are
+// skipped, so baselines of newer builds still load.
+class PerfBaselines
+{
+  private:
+    std::vector<std::pair<std::string, PerfResult>> scenarios;
+
+  public:
+    const PerfResult *find(const std::string &mName) const
+    {
+        for (const auto &scenario : scenarios)
+            if (scenario.first == mName)
+                return &scenario.second;
+
+        return nullptr;
+    }
+
+    PerfResult &set(const std::string &mName, const PerfResult &mResult)
+    {
+        for (auto &scenario : scenarios)
+            if (scenario.first == mName)
+                return scenario.second = mResult;
+
+        scenarios.emplace_back(mName, mResult);
+        return scenarios.back().second;
+    }
+
+    bool load(const char *mPath)
+    {
+        std::ifstream file{mPath};
+        if (!file)
+            return false;
+
+        const std::string text{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        int depth{0};
+        std::string key;
+        PerfResult *result{nullptr};
+        for (std::size_t i{0}; i < text.size();)
+        {
+            const char c{text[i]};
+            if (c == '{' || c == '}')
+            {
+                depth += c == '{' ? 1 : -1;
+                ++i;
+            }
+            else if (c == '"')
+            {
+                const auto end(text.find('"', i + 1));
+                if (end == std::string::npos)
+                    return false;
+
+                key = text.substr(i + 1, end - i - 1);
+                i = end + 1;
+                if (depth == 1)
+                    result = &set(key, PerfResult{});
+            }
+            else if (c == '-' || std::isdigit(static_cast<unsigned char>(c)) != 0)
+            {
+                char *end;
+                const double value{std::strtod(&text[i], &end)};
+                i = static_cast<std::size_t>(end - text.data());
+                if (depth != 2 || result == nullptr)
+                    return false;
+
+                if (key == "p50_ms")
+                    result->p50 = value;
+                else if (key == "p99_ms")
+                    result->p99 = value;
+                else if (key == "allocations_per_step")
+                    result->allocationsPerStep = value;
+            }
+            else
+                ++i;
+        }
+
+        return depth == 0;
+    }
+
+    bool save(const char *mPath) const
+    {
+        std::ofstream file{mPath};
+        file << "{\n";
+        for (std::size_t i{0}; i < scenarios.size(); ++i)
+        {
+            const auto &result(scenarios[i].second);
+            char line[256];
+            std::snprintf(line, sizeof(line),
+                          "  \"%s\": {\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"allocations_per_step\": %.3f}%s\n",
+                          scenarios[i].first.c_str(), result.p50, result.p99, result.allocationsPerStep,
+                          i + 1 < scenarios.size() ? "," : "");
+            file << line;
+        }
+        file << "}\n";
+        return static_cast<bool>(file);
+    }
+};
+
+// One scenario of the gate: `mGame` is stepped `mSteps` times after
+// `mWarmUp` steps, every step timed on its own, `mRuns` times over from
+// `mCreate`, and the best run of each number is kept, the noise of the
+// machine only ever makes a run slower. Replays end the runs early.
+template <typename TF>
+PerfResult measurePerfScenario(TF &&mCreate, std::size_t mWarmUp, std::size_t mSteps, std::size_t mRuns)
+{
+    PerfResult best{std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                    std::numeric_limits<double>::max()};
+    std::vector<double> stepTimes;
+    stepTimes.reserve(mSteps);
+
+    for (std::size_t run{0}; run < mRuns; ++run)
+    {
+        // A replay that ends clears `running`.
+        auto game(mCreate());
+        game->running = true;
+        game->simulate(mWarmUp);
+
+        stepTimes.clear();
+        const auto allocationsBefore(allocationCount.load(std::memory_order_relaxed));
+        for (std::size_t i{0}; i < mSteps && game->running; ++i)
+        {
+            auto timePoint1(chrono::high_resolution_clock::now());
+            if (game->simulate(1) == 0)
+                break;
+            auto timePoint2(chrono::high_resolution_clock::now());
+            stepTimes.emplace_back(chrono::duration_cast<chrono::duration<double, milli>>(timePoint2 - timePoint1).count());
+        }
+        const auto allocations(allocationCount.load(std::memory_order_relaxed) - allocationsBefore);
+
+        if (stepTimes.empty())
+            continue;
+
+        std::sort(stepTimes.begin(), stepTimes.end());
+        best.p50 = std::min(best.p50, stepTimes[stepTimes.size() / 2]);
+        best.p99 = std::min(best.p99, stepTimes[static_cast<std::size_t>(0.99 * (stepTimes.size() - 1))]);
+        best.allocationsPerStep = std::min(best.allocationsPerStep, static_cast<double>(allocations) / stepTimes.size());
+    }
+
+    return best;
+}
+
+// Performance regression gate: plays the headless scenarios, the built-in
+// ones and one per replay of `mReplays`, and compares them against the
+// baselines of `mBaselinePath`. A step time more than `mThreshold` (0.15
+// for 15%) over its baseline or any allocation more per step fails the
+// gate, and so returns 1. With `mUpdate` the results become the new
+// baselines instead, so do scenarios without a baseline yet.
+int runPerfGate(const char *mBaselinePath, double mThreshold, bool mUpdate, const std::vector<const char *> &mReplays)
+{
+    using namespace CompositionArkanoid;
+
+    if (!countingAllocations)
+    {
+        cerr << "The gate compares allocations, build with ARKANOID_COUNT_ALLOCATIONS" << endl;
+        return 1;
+    }
+
+    constexpr std::size_t warmUp{120}, steps{3000}, runs{3};
+
+    // The crowded level of `runScenario`, 100x60 small bricks and 50 balls.
+    auto createCrowded([](bool mCollide) {
+        std::unique_ptr<Game> game{new Game{Game::Mode::Headless, 1}};
+        constexpr int columns{100}, rows{60};
+        const Vector2f halfSize{windowWidth / (columns * 2.f), windowHeight / (rows * 4.f)};
+
+        Level level;
+        for (int iX{0}; iX < columns; ++iX)
+            for (int iY{0}; iY < rows; ++iY)
+                level.bricks.emplace_back(LevelBrick{
+                    Vector2f{(iX * 2 + 1) * halfSize.x, (iY * 2 + 1) * halfSize.y}, halfSize, Color::Red, 1, BNormal});
+        game->loadLevel(level);
+        game->spawnBalls(49, Vector2f{windowWidth / 2.f, windowHeight / 2.f});
+        if (mCollide)
+            game->collisions.enable(Game::GBall, Game::GBall);
+        game->enableAutopilot();
+        return game;
+    });
+
+    std::vector<std::pair<std::string, std::function<std::unique_ptr<Game>()>>> scenarios{
+        {"default",
+         [] {
+             std::unique_ptr<Game> game{new Game{Game::Mode::Headless, 1}};
+             game->enableAutopilot();
+             return game;
+         }},
+        {"brick-field",
+         [] {
+             std::unique_ptr<Game> game{new Game{Game::Mode::Headless, 1}};
+             game->brickFieldLevels = true;
+             game->loadLevel(Level::createDefault());
+             game->enableAutopilot();
+             return game;
+         }},
+        {"crowded", [createCrowded] { return createCrowded(false); }},
+        {"crowded-collide", [createCrowded] { return createCrowded(true); }}};
+
+    // Replays are read once, every run plays a copy.
+    std::vector<Replay> replays(mReplays.size());
+    for (std::size_t i{0}; i < mReplays.size(); ++i)
+    {
+        if (!replays[i].load(mReplays[i]))
+        {
+            cerr << "Can't read replay " << mReplays[i] << endl;
+            return 1;
+        }
+
+        // A run's game is gone before the next one is created, they can
+        // all play the same copy.
+        auto playback(std::make_shared<Replay>());
+        scenarios.emplace_back(std::string{"replay:"} + mReplays[i], [&replays, i, playback] {
+            *playback = replays[i];
+            std::unique_ptr<Game> game{new Game{Game::Mode::Headless, replays[i].getSeed()}};
+            game->timeStep = replays[i].getTimeStep();
+            game->playback = playback.get();
+            return game;
+        });
+    }
+
+    PerfBaselines baselines;
+    const bool loaded{baselines.load(mBaselinePath)};
+    if (!loaded && !mUpdate)
+        cerr << "No baselines in " << mBaselinePath << ", they are recorded now" << endl;
+
+    std::size_t regressions{0};
+    bool recorded{false};
+    std::printf("%-28s %10s %10s %10s %8s\n", "scenario", "p50 ms", "p99 ms", "allocs", "");
+    for (const auto &scenario : scenarios)
+    {
+        const auto result(measurePerfScenario(scenario.second, warmUp, steps, runs));
+        const auto *baseline(baselines.find(scenario.first));
+
+        const char *verdict{"new"};
+        if (baseline != nullptr && !mUpdate)
+        {
+            const bool slower{result.p50 > baseline->p50 * (1.0 + mThreshold) ||
+                              result.p99 > baseline->p99 * (1.0 + mThreshold)};
+            const bool allocates{result.allocationsPerStep > baseline->allocationsPerStep};
+            verdict = slower || allocates ? "FAIL" : "ok";
+            if (slower || allocates)
+                ++regressions;
+
+            std::printf("%-28s %10.4f %10.4f %10.3f %8s\n", scenario.first.c_str(), result.p50, result.p99,
+                        result.allocationsPerStep, verdict);
+            std::printf("%-28s %10.4f %10.4f %10.3f\n", "  baseline", baseline->p50, baseline->p99,
+                        baseline->allocationsPerStep);
+            continue;
+        }
+
+        baselines.set(scenario.first, result);
+        recorded = true;
+        std::printf("%-28s %10.4f %10.4f %10.3f %8s\n", scenario.first.c_str(), result.p50, result.p99,
+                    result.allocationsPerStep, verdict);
+    }
+
+    if (recorded && !baselines.save(mBaselinePath))
+    {
+        cerr << "Can't write baselines " << mBaselinePath << endl;
+        return 1;
+    }
+
+    if (regressions != 0)
+    {
+        cerr << regressions << " of " << scenarios.size() << " scenarios regressed by more than "
+             << mThreshold * 100.0 << "%" << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Hardware counters of the calling thread, from perf_event on Linux.
+// Elsewhere, or for the counters the kernel doesn't allow
+// (perf_event_paranoid, containers) or the CPU doesn't have (most
+// virtual machines), `isAvailable` is false and the count is 0. The CPU
+// has fewer counters than events on some machines, the kernel then
+// multiplexes them and the counts are scaled up from the time each one
+// really ran.
+class HardwareCounters
+{
+  public:
+    enum Counter : std::size_t
+    {
+        HCycles,
+        HInstructions,
+        HL1Misses,
+        HLLCMisses,
+        HBranchMisses,
+        HCount
+    };
+
+    using Counts = std::array<std::uint64_t, HCount>;
+
+  private:
+    std::array<int, HCount> fds;
+
+  public:
+    HardwareCounters()
+    {
+        fds.fill(-1);
+#ifdef ARKANOID_PERF_EVENTS
+        const std::pair<std::uint32_t, std::uint64_t> events[HCount]{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+        for (std::size_t i{0}; i < HCount; ++i)
+        {
+            perf_event_attr attributes{};
+            attributes.type = events[i].first;
+            attributes.size = sizeof(attributes);
+            attributes.config = events[i].second;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    HardwareCounters(const HardwareCounters &) = delete;
+    HardwareCounters &operator=(const HardwareCounters &) = delete;
+
+    ~HardwareCounters()
+    {
+#ifdef ARKANOID_PERF_EVENTS
+        for (auto fd : fds)
+            if (fd >= 0)
+                close(fd);
+#endif
+    }
+
+    bool isAvailable(Counter mCounter) const noexcept { return fds[mCounter] >= 0; }
+
+    bool isAnyAvailable() const noexcept
+    {
+        return std::any_of(fds.begin(), fds.end(), [](int mFd) { return mFd >= 0; });
+    }
+
+    // Counts since the counters were opened.
+    Counts read() const noexcept
+    {
+        Counts counts{};
+#ifdef ARKANOID_PERF_EVENTS
+        for (std::size_t i{0}; i < HCount; ++i)
+        {
+            // The count, then the times the event was enabled and running.
+            std::uint64_t values[3];
+            if (fds[i] < 0 || ::read(fds[i], values, sizeof(values)) != sizeof(values) || values[2] == 0)
+                continue;
+
+            counts[i] = values[2] == values[1]
+                            ? values[0]
+                            : static_cast<std::uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+        }
+#endif
+        return counts;
+    }
+};
+
+// Accumulates the time and the allocations of the measured sections only,
+// so the setup of every repetition is left out. With `counters` set, the
+// hardware counters of the sections too, read outside of the timed part.
+class BenchmarkTimer
+{
+  private:
+    chrono::high_resolution_clock::time_point startTime;
+    std::size_t startAllocations{0};
+    double nanoseconds{0.0};
+    std::size_t allocations{0};
+    HardwareCounters::Counts startCounts{}, counts{};
+
+  public:
+    // Shared by every timer, set by `runBenchmarks` when asked for.
+    static inline const HardwareCounters *counters{nullptr};
+
+    void start()
+    {
+        if (counters != nullptr)
+            startCounts = counters->read();
+        startAllocations = allocationCount.load(std::memory_order_relaxed);
+        startTime = chrono::high_resolution_clock::now();
+    }
+
+    void stop()
+    {
+        auto endTime(chrono::high_resolution_clock::now());
+        nanoseconds += chrono::duration_cast<chrono::duration<double, nano>>(endTime - startTime).count();
+        allocations += allocationCount.load(std::memory_order_relaxed) - startAllocations;
+        if (counters == nullptr)
+            return;
+
+        const auto endCounts(counters->read());
+        for (std::size_t i{0}; i < counts.size(); ++i)
+            counts[i] += endCounts[i] - startCounts[i];
+    }
+
+    double getNanoseconds() const noexcept { return nanoseconds; }
+    std::uint64_t getCount(HardwareCounters::Counter mCounter) const noexcept { return counts[mCounter]; }
+
+    // The column titles `report` fills.
+    static void printHeader()
+    {
+        std::printf("%-24s %8s %12s %12s", "benchmark", "entities", "ns/op", "allocs/op");
+        if (counters != nullptr)
+            std::printf(" %10s %10s %10s %6s", "L1/op", "LLC/op", "br-miss/op", "IPC");
+        std::printf("\n");
+    }
+
+    void report(const char *mName, std::size_t mEntities, std::size_t mOperations) const
+    {
+        std::printf("%-24s %8zu %12.2f", mName, mEntities, nanoseconds / mOperations);
+        if (countingAllocations)
+            std::printf(" %12.4f", static_cast<double>(allocations) / mOperations);
+        else
+            std::printf(" %12s", "n/a");
+
+        if (counters != nullptr)
+        {
+            using H = HardwareCounters;
+            for (auto counter : {H::HL1Misses, H::HLLCMisses, H::HBranchMisses})
+                if (counters->isAvailable(counter))
+                    std::printf(" %10.4f", static_cast<double>(counts[counter]) / mOperations);
+                else
+                    std::printf(" %10s", "n/a");
+
+            if (counters->isAvailable(H::HCycles) && counters->isAvailable(H::HInstructions) && counts[H::HCycles] != 0)
+                std::printf(" %6.2f", static_cast<double>(counts[H::HInstructions]) / counts[H::HCycles]);
+            else
+                std::printf(" %6s", "n/a");
+        }
+        std::printf("\n");
+    }
+};
+
+// Fill `mManager` with `mCount` entities with a position and physics, the
+// same components the balls and bricks have, and keep them in `mEntities`
+// (which should already have room for them).
+void addBenchmarkEntities(CompositionArkanoid::Manager &mManager, std::size_t mCount,
+                          std::vector<CompositionArkanoid::Entity *> &mEntities)
+{
+    using namespace CompositionArkanoid;
+
+    for (std::size_t i{0}; i < mCount; ++i)
+    {
+        auto &entity(mManager.addEntity());
+        mEntities.emplace_back(&entity);
+        entity.addComponent<CPosition>(Vector2f(i % 1000 * 8.f, i / 1000 * 8.f));
+        entity.addComponent<CPhysics>(Vector2f{2.f, 2.f}).velocity = fromVector2f<PhysicsScalar>(Vector2f{0.1f, 0.1f});
+    }
+}
+
+// Micro-benchmarks of the entity and collision hot paths, each one repeated
+// until about a million operations were measured. With `mCounters`, the
+// cache misses, branch mispredicts and instructions per cycle of each one
+// too, see `HardwareCounters`.
+int runBenchmarks(bool mCounters)
+{
+    using namespace CompositionArkanoid;
+
+    // Keeps the lookups from being optimized away.
+    volatile float sink{0.f};
+
+    HardwareCounters counters;
+    if (mCounters && !counters.isAnyAvailable())
+        cerr << "No hardware counters, perf_event may need sysctl kernel.perf_event_paranoid=1" << endl;
+    BenchmarkTimer::counters = mCounters ? &counters : nullptr;
+
+    std::printf("%zu bytes per entity\n", sizeof(Entity));
+    BenchmarkTimer::printHeader();
+
+    for (std::size_t count : {std::size_t{10}, std::size_t{1000}, std::size_t{10000}, std::size_t{100000}})
+    {
+        const std::size_t repetitions{std::max<std::size_t>(1, 1000000 / count)};
+        std::vector<Entity *> entities;
+        entities.reserve(count);
+
+        {
+            BenchmarkTimer timer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                Manager manager;
+                entities.clear();
+                timer.start();
+                addBenchmarkEntities(manager, count, entities);
+                timer.stop();
+            }
+            timer.report("addEntity+addComponent", count, count * repetitions);
+        }
+
+        {
+            // A tenth of the entities die before every refresh.
+            BenchmarkTimer timer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                Manager manager;
+                entities.clear();
+                addBenchmarkEntities(manager, count, entities);
+                manager.refresh();
+
+                for (std::size_t i{0}; i < entities.size(); i += 10)
+                    entities[i]->destroy();
+
+                timer.start();
+                manager.refresh();
+                timer.stop();
+            }
+            timer.report("refresh", count, count * repetitions);
+        }
+
+        {
+            // Every entity dies at once, as when a level is left, then the
+            // manager goes with as many new ones, as on exit.
+            BenchmarkTimer refreshTimer, destroyTimer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                std::unique_ptr<Manager> manager{new Manager};
+                entities.clear();
+                addBenchmarkEntities(*manager, count, entities);
+                manager->refresh();
+
+                for (auto entity : entities)
+                    entity->destroy();
+
+                refreshTimer.start();
+                manager->refresh();
+                refreshTimer.stop();
+
+                entities.clear();
+                addBenchmarkEntities(*manager, count, entities);
+                destroyTimer.start();
+                manager.reset();
+                destroyTimer.stop();
+            }
+            refreshTimer.report("refresh all dead", count, count * repetitions);
+            destroyTimer.report("~Manager", count, count * repetitions);
+        }
+
+        {
+            // One entity in a hundred matches, the view only visits those.
+            Manager manager;
+            entities.clear();
+            addBenchmarkEntities(manager, count, entities);
+            for (std::size_t i{0}; i < entities.size(); i += 100)
+                entities[i]->addComponent<CBrick>(BNormal, std::uint8_t{1});
+            manager.refresh();
+
+            BenchmarkTimer timer;
+            timer.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+                manager.forEach<CPosition, CBrick>(
+                    [&sink](Entity &, CPosition &mPosition, CBrick &) { sink = sink + toFloat(mPosition.x()); });
+            timer.stop();
+            timer.report("view 1%", count, count * repetitions);
+        }
+
+        {
+            // Half the entities die and as many are added again, in the
+            // free slots: the pools end up in a different order than the
+            // entities. Then the same world compacted.
+            Manager manager;
+            const FloatRect bounds{0.f, 0.f, windowWidth, windowHeight};
+            manager.addSystem<SPhysics>(bounds);
+            entities.clear();
+            addBenchmarkEntities(manager, count, entities);
+            std::minstd_rand random{1};
+            for (auto entity : entities)
+                if (random() % 2 == 0)
+                    entity->destroy();
+            manager.refresh();
+            addBenchmarkEntities(manager, count / 2, entities);
+            manager.refresh();
+
+            BenchmarkTimer scattered, compacted;
+            scattered.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+                manager.update(ftStep);
+            scattered.stop();
+            scattered.report("update scattered", count, count * repetitions);
+
+            manager.compact();
+            compacted.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+                manager.update(ftStep);
+            compacted.stop();
+            compacted.report("update compacted", count, count * repetitions);
+        }
+
+        Manager manager;
+        const FloatRect bounds{0.f, 0.f, windowWidth, windowHeight};
+        manager.addSystem<SPhysics>(bounds);
+        entities.clear();
+        addBenchmarkEntities(manager, count, entities);
+        manager.refresh();
+
+        {
+            BenchmarkTimer timer;
+            timer.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+                manager.update(ftStep);
+            timer.stop();
+            timer.report("update", count, count * repetitions);
+        }
+
+        {
+            BenchmarkTimer timer;
+            timer.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+                for (auto &entity : entities)
+                    sink = sink + toFloat(entity->getComponent<CPhysics>().velocity.x);
+            timer.stop();
+            timer.report("getComponent", count, count * repetitions);
+        }
+
+        {
+            // Every entity loses its physics and gets it back, the pool
+            // only moves components around.
+            BenchmarkTimer timer;
+            timer.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                for (auto &entity : entities)
+                    entity->removeComponent<CPhysics>();
+                for (auto &entity : entities)
+                    entity->addComponent<CPhysics>(Vector2f{2.f, 2.f});
+                manager.refresh();
+            }
+            timer.stop();
+            timer.report("remove+addComponent", count, count * repetitions);
+        }
+
+        {
+            ManagerSnapshot snapshot;
+            BenchmarkTimer timer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                timer.start();
+                manager.save(snapshot);
+                timer.stop();
+            }
+            timer.report("snapshot save", count, count * repetitions);
+
+            BenchmarkTimer restoreTimer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                manager.update(ftStep);
+                restoreTimer.start();
+                manager.restore(snapshot);
+                restoreTimer.stop();
+            }
+            restoreTimer.report("snapshot restore", count, count * repetitions);
+
+            // A tenth of the entities died since the snapshot, they are
+            // created again. `entities` still points at the same slots.
+            BenchmarkTimer recreateTimer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                for (std::size_t i{0}; i < entities.size(); i += 10)
+                    entities[i]->destroy();
+                manager.refresh();
+
+                recreateTimer.start();
+                manager.restore(snapshot);
+                recreateTimer.stop();
+            }
+            recreateTimer.report("snapshot restore+create", count, count * repetitions);
+        }
+
+        {
+            // The ball is away from every brick, like most of the tests.
+            Manager balls;
+            auto &ball(balls.addEntity());
+            ball.addComponent<CPosition>(Vector2f{-100.f, -100.f});
+            ball.addComponent<CPhysics>(Vector2f{ballRadius, ballRadius});
+
+            BenchmarkTimer timer;
+            timer.start();
+            for (std::size_t r{0}; r < repetitions; ++r)
+                for (auto &entity : entities)
+                    testCollisionBB(*entity, ball);
+            timer.stop();
+            timer.report("testCollisionBB", count, count * repetitions);
+        }
+
+        {
+            // Every brick of a level breaks, as entities that are destroyed
+            // and refreshed away, then in a brick field.
+            Level level;
+            for (std::size_t i{0}; i < count; ++i)
+                level.bricks.push_back({Vector2f(i % 1000 * 8.f, i / 1000 * 8.f), Vector2f{2.f, 2.f},
+                                        Color::White, std::uint8_t{1}, BNormal});
+
+            BenchmarkTimer entityTimer, fieldTimer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                Manager manager;
+                entities.clear();
+                addBenchmarkEntities(manager, count, entities);
+                for (auto entity : entities)
+                    entity->addComponent<CBrick>(BNormal, std::uint8_t{1});
+                manager.refresh();
+
+                entityTimer.start();
+                for (auto entity : entities)
+                    entity->destroy();
+                manager.refresh();
+                entityTimer.stop();
+
+                RectangleBatch batch;
+                BrickField field;
+                field.build(level, batch);
+
+                fieldTimer.start();
+                for (std::uint32_t slot{0}; slot < field.size(); ++slot)
+                    field.kill(slot);
+                fieldTimer.stop();
+            }
+            entityTimer.report("brick break entity", count, count * repetitions);
+            fieldTimer.report("brick break field", count, count * repetitions);
+        }
+
+        {
+            // Ball sized areas over the window, against a wall of bricks of
+            // the default size going down from the top, like the levels the
+            // grid was made for (past a window height its rows wrap), and
+            // against bricks of every size packed in a few clusters. Every
+            // candidate gets the exact test.
+            std::minstd_rand random{1};
+            std::vector<FloatRect> areas;
+            for (std::size_t i{0}; i < 256; ++i)
+                areas.emplace_back(static_cast<float>(random() % windowWidth),
+                                   static_cast<float>(random() % windowHeight), ballRadius * 2.f, ballRadius * 2.f);
+
+            for (bool clustered : {false, true})
+            {
+                Manager manager;
+                BrickGrid grid;
+                BrickTree tree;
+                entities.clear();
+
+                const std::size_t columns{static_cast<std::size_t>(windowWidth / (blockWidth + 3))};
+                for (std::size_t i{0}; i < count; ++i)
+                {
+                    Vector2f position{(i % columns + 0.5f) * (blockWidth + 3), (i / columns + 0.5f) * (blockHeight + 3)};
+                    Vector2f halfSize{blockWidth / 2.f, blockHeight / 2.f};
+                    if (clustered)
+                    {
+                        const auto cluster(random() % 8);
+                        position = Vector2f{100.f + cluster % 4 * 200.f + random() % 80 - 40.f,
+                                            150.f + cluster / 4 * 300.f + random() % 80 - 40.f};
+                        halfSize = Vector2f{1.f + random() % 29, 1.f + random() % 9};
+                    }
+
+                    auto &entity(manager.addEntity());
+                    entity.addComponent<CPosition>(position);
+                    entity.addComponent<CPhysics>(halfSize);
+                    entities.emplace_back(&entity);
+                }
+
+                // Built once, like at a level load.
+                BenchmarkTimer gridBuildTimer, treeBuildTimer;
+                gridBuildTimer.start();
+                for (auto entity : entities)
+                    grid.add(*entity);
+                gridBuildTimer.stop();
+                treeBuildTimer.start();
+                tree.build(entities);
+                treeBuildTimer.stop();
+
+                std::size_t hits{0};
+                auto test([&hits](const FloatRect &mArea) {
+                    return [&hits, &mArea](Entity &mBrick) {
+                        const auto &cPhysics(mBrick.getComponent<CPhysics>());
+                        if (toFloat(cPhysics.right()) >= mArea.left &&
+                            toFloat(cPhysics.left()) <= mArea.left + mArea.width &&
+                            toFloat(cPhysics.bottom()) >= mArea.top && toFloat(cPhysics.top()) <= mArea.top + mArea.height)
+                            ++hits;
+                    };
+                });
+
+                BenchmarkTimer gridTimer, treeTimer;
+                gridTimer.start();
+                for (std::size_t r{0}; r < repetitions; ++r)
+                    for (const auto &area : areas)
+                        grid.query(area.left, area.top, area.left + area.width, area.top + area.height, test(area));
+                gridTimer.stop();
+
+                treeTimer.start();
+                for (std::size_t r{0}; r < repetitions; ++r)
+                    for (const auto &area : areas)
+                        tree.query(area.left, area.top, area.left + area.width, area.top + area.height, test(area));
+                treeTimer.stop();
+                sink = sink + hits;
+
+                // Then every brick breaks.
+                BenchmarkTimer gridRemoveTimer, treeRemoveTimer;
+                gridRemoveTimer.start();
+                for (auto entity : entities)
+                    grid.remove(*entity);
+                gridRemoveTimer.stop();
+                treeRemoveTimer.start();
+                for (auto entity : entities)
+                    tree.remove(*entity);
+                treeRemoveTimer.stop();
+
+                gridBuildTimer.report(clustered ? "build grid clustered" : "build grid wall", count, count);
+                treeBuildTimer.report(clustered ? "build tree clustered" : "build tree wall", count, count);
+                gridTimer.report(clustered ? "query grid clustered" : "query grid wall", count,
+                                 areas.size() * repetitions);
+                treeTimer.report(clustered ? "query tree clustered" : "query tree wall", count,
+                                 areas.size() * repetitions);
+                gridRemoveTimer.report(clustered ? "remove grid clustered" : "remove grid wall", count, count);
+                treeRemoveTimer.report(clustered ? "remove tree clustered" : "remove tree wall", count, count);
+            }
+        }
+
+        if (count <= 10000)
+        {
+            // Balls spread over the window move a little every step, the
+            // grid is rebuilt and the sweep sorted again for their pairs.
+            std::minstd_rand random{1};
+            std::vector<Vector2f> positions, velocities;
+            for (std::size_t i{0}; i < count; ++i)
+            {
+                positions.emplace_back(static_cast<float>(random() % windowWidth),
+                                       static_cast<float>(random() % windowHeight));
+                velocities.emplace_back((random() % 101 - 50.f) / 50.f, (random() % 101 - 50.f) / 50.f);
+            }
+
+            BallGrid grid;
+            SweepAndPrune sweep;
+            std::vector<SweepAndPrune::Box> boxes;
+            std::size_t pairs{0};
+            auto countPair([&pairs, &positions](std::uint32_t mI, std::uint32_t mJ) {
+                const auto delta(positions[mJ] - positions[mI]);
+                if (delta.x * delta.x + delta.y * delta.y < 4.f * ballRadius * ballRadius)
+                    ++pairs;
+            });
+
+            BenchmarkTimer gridTimer, sweepTimer;
+            for (std::size_t r{0}; r < repetitions; ++r)
+            {
+                for (std::size_t i{0}; i < count; ++i)
+                {
+                    positions[i] += velocities[i];
+                    if (positions[i].x < 0.f || positions[i].x > windowWidth)
+                        velocities[i].x = -velocities[i].x;
+                    if (positions[i].y < 0.f || positions[i].y > windowHeight)
+                        velocities[i].y = -velocities[i].y;
+                }
+
+                gridTimer.start();
+                grid.build(positions);
+                grid.forEachPair(countPair);
+                gridTimer.stop();
+
+                sweepTimer.start();
+                boxes.clear();
+                for (const auto &position : positions)
+                    boxes.emplace_back(SweepAndPrune::Box{position.x - ballRadius, position.y - ballRadius,
+                                                          position.x + ballRadius, position.y + ballRadius});
+                sweep.update(boxes);
+                sweep.forEachPair(countPair);
+                sweepTimer.stop();
+            }
+            sink = sink + pairs;
+
+            gridTimer.report("ball pairs grid", count, count * repetitions);
+            sweepTimer.report("ball pairs sweep", count, count * repetitions);
+        }
+    }
+
+    return 0;
+}
+
+// Three ways to lay out the components of the same entities, compared by
+// `--bench-layouts` on the work a step does with them:
+//   pointers    every component is its own heap object, found through an
+//               array in its entity, the layout this game started with
+//   pools       a packed array per component type and an index per
+//               entity, the way `Manager` stores them
+//   archetypes  the entities with the same components kept together, with
+//               an array per component for every such group
+// They all offer the same `add` and `for` functions, the workloads are
+// written once against those.
+namespace LayoutBenchmark
+{
+struct Position
+{
+    Vector2f value;
+};
+
+struct Body
+{
+    Vector2f velocity, halfSize;
+};
+
+struct Quad
+{
+    Color color;
+    std::uint32_t index;
+};
+
+struct Hits
+{
+    std::uint8_t left;
+};
+
+enum ComponentType : std::size_t
+{
+    TPosition,
+    TBody,
+    TQuad,
+    THits,
+    TCount
+};
+
+template <typename T>
+struct TypeOf;
+template <>
+struct TypeOf<Position> : std::integral_constant<std::size_t, TPosition>
+{
+};
+template <>
+struct TypeOf<Body> : std::integral_constant<std::size_t, TBody>
+{
+};
+template <>
+struct TypeOf<Quad> : std::integral_constant<std::size_t, TQuad>
+{
+};
+template <>
+struct TypeOf<Hits> : std::integral_constant<std::size_t, THits>
+{
+};
+
+class PointerLayout
+{
+  private:
+    struct Component
+    {
+        virtual ~Component() = default;
+    };
+
+    template <typename T>
+    struct Boxed : Component
+    {
+        T value;
+        Boxed(const T &mValue) : value(mValue) {}
+    };
+
+    struct Entity
+    {
+        std::vector<std::unique_ptr<Component>> components;
+        std::array<Component *, TCount> lookup{};
+
+        template <typename T>
+        void add(const T &mValue)
+        {
+            components.emplace_back(new Boxed<T>{mValue});
+            lookup[TypeOf<T>::value] = components.back().get();
+        }
+
+        template <typename T>
+        T *get() const noexcept
+        {
+            auto component(lookup[TypeOf<T>::value]);
+            return component != nullptr ? &static_cast<Boxed<T> *>(component)->value : nullptr;
+        }
+    };
+
+    std::vector<std::unique_ptr<Entity>> entities;
+
+  public:
+    static constexpr const char *name{"pointers"};
+
+    void addBrick(const Vector2f &mPosition, const Vector2f &mHalfSize, std::uint32_t mQuad)
+    {
+        entities.emplace_back(new Entity);
+        auto &entity(*entities.back());
+        entity.add(Position{mPosition});
+        entity.add(Body{Vector2f{}, mHalfSize});
+        entity.add(Quad{Color::Red, mQuad});
+        entity.add(Hits{1});
+    }
+
+    void addBall(const Vector2f &mPosition, const Vector2f &mVelocity, std::uint32_t mQuad)
+    {
+        entities.emplace_back(new Entity);
+        auto &entity(*entities.back());
+        entity.add(Position{mPosition});
+        entity.add(Body{mVelocity, Vector2f{ballRadius, ballRadius}});
+        entity.add(Quad{Color::White, mQuad});
+    }
+
+    template <typename TF>
+    void forBodies(TF &&mFunction)
+    {
+        for (auto &entity : entities)
+        {
+            auto position(entity->get<Position>());
+            auto body(entity->get<Body>());
+            if (position != nullptr && body != nullptr)
+                mFunction(*position, *body);
+        }
+    }
+
+    template <typename TF>
+    void forBricks(TF &&mFunction)
+    {
+        for (auto &entity : entities)
+        {
+            auto position(entity->get<Position>());
+            auto body(entity->get<Body>());
+            auto hits(entity->get<Hits>());
+            if (position != nullptr && body != nullptr && hits != nullptr)
+                mFunction(*position, *body, *hits);
+        }
+    }
+
+    template <typename TF>
+    void forQuads(TF &&mFunction)
+    {
+        for (auto &entity : entities)
+        {
+            auto position(entity->get<Position>());
+            auto quad(entity->get<Quad>());
+            if (position != nullptr && quad != nullptr)
+                mFunction(*position, *quad);
+        }
+    }
+};
+
+class PoolLayout
+{
+  private:
+    static constexpr std::uint32_t none{std::numeric_limits<std::uint32_t>::max()};
+
+    template <typename T>
+    struct Pool
+    {
+        std::vector<T> values;
+        std::vector<std::uint32_t> owners;
+    };
+
+    std::tuple<Pool<Position>, Pool<Body>, Pool<Quad>, Pool<Hits>> pools;
+    // Index of every component of an entity in its pool.
+    std::vector<std::array<std::uint32_t, TCount>> indices;
+
+    template <typename T>
+    Pool<T> &pool() noexcept
+    {
+        return std::get<TypeOf<T>::value>(pools);
+    }
+
+    template <typename T>
+    void add(std::uint32_t mEntity, const T &mValue)
+    {
+        auto &values(pool<T>());
+        indices[mEntity][TypeOf<T>::value] = static_cast<std::uint32_t>(values.values.size());
+        values.values.emplace_back(mValue);
+        values.owners.emplace_back(mEntity);
+    }
+
+    template <typename T>
+    T *get(std::uint32_t mEntity) noexcept
+    {
+        const auto index(indices[mEntity][TypeOf<T>::value]);
+        return index != none ? &pool<T>().values[index] : nullptr;
+    }
+
+    std::uint32_t addEntity()
+    {
+        std::array<std::uint32_t, TCount> entityIndices;
+        entityIndices.fill(none);
+        indices.emplace_back(entityIndices);
+        return static_cast<std::uint32_t>(indices.size() - 1);
+    }
+
+  public:
+    static constexpr const char *name{"pools"};
+
+    void addBrick(const Vector2f &mPosition, const Vector2f &mHalfSize, std::uint32_t mQuad)
+    {
+        const auto entity(addEntity());
+        add(entity, Position{mPosition});
+        add(entity, Body{Vector2f{}, mHalfSize});
+        add(entity, Quad{Color::Red, mQuad});
+        add(entity, Hits{1});
+    }
+
+    void addBall(const Vector2f &mPosition, const Vector2f &mVelocity, std::uint32_t mQuad)
+    {
+        const auto entity(addEntity());
+        add(entity, Position{mPosition});
+        add(entity, Body{mVelocity, Vector2f{ballRadius, ballRadius}});
+        add(entity, Quad{Color::White, mQuad});
+    }
+
+    // Like `Manager::forEach`, over the pool of the rarest component, the
+    // others looked up through the entity.
+    template <typename TF>
+    void forBodies(TF &&mFunction)
+    {
+        auto &bodies(pool<Body>());
+        for (std::size_t i{0}; i < bodies.values.size(); ++i)
+        {
+            auto position(get<Position>(bodies.owners[i]));
+            if (position != nullptr)
+                mFunction(*position, bodies.values[i]);
+        }
+    }
+
+    template <typename TF>
+    void forBricks(TF &&mFunction)
+    {
+        auto &hits(pool<Hits>());
+        for (std::size_t i{0}; i < hits.values.size(); ++i)
+        {
+            auto position(get<Position>(hits.owners[i]));
+            auto body(get<Body>(hits.owners[i]));
+            if (position != nullptr && body != nullptr)
+                mFunction(*position, *body, hits.values[i]);
+        }
+    }
+
+    template <typename TF>
+    void forQuads(TF &&mFunction)
+    {
+        auto &quads(pool<Quad>());
+        for (std::size_t i{0}; i < quads.values.size(); ++i)
+        {
+            auto position(get<Position>(quads.owners[i]));
+            if (position != nullptr)
+                mFunction(*position, quads.values[i]);
+        }
+    }
+};
+
+class ArchetypeLayout
+{
+  private:
+    using Signature = std::bitset<TCount>;
+
+    // The columns of the components the archetype doesn't have stay empty.
+    struct Archetype
+    {
+        Signature signature;
+        std::vector<Position> positions;
+        std::vector<Body> bodies;
+        std::vector<Quad> quads;
+        std::vector<Hits> hits;
 
-  public:
-    void update(float mFT)
+        std::size_t size() const noexcept { return positions.size(); }
+    };
+
+    std::vector<Archetype> archetypes;
+
+    Archetype &find(const Signature &mSignature)
     {
-        // Clean up dead entities
-        entities.erase(remove_if(begin(entities), end(entities),
-                                 [](const std::unique_ptr<Entity> &mEntity) {
-                                     return !mEntity->isAlive();
-                                 }),
-                       end(entities));
+        for (auto &archetype : archetypes)
+            if (archetype.signature == mSignature)
+                return archetype;
 
-        for (auto &entity : entities)
-            entity->update(mFT);
+        archetypes.emplace_back();
+        archetypes.back().signature = mSignature;
+        return archetypes.back();
     }
 
-    void draw()
+    template <typename TF>
+    void forMatching(const Signature &mSignature, TF &&mFunction)
     {
-        for (auto &entity : entities)
-            entity->draw();
+        for (auto &archetype : archetypes)
+            if ((archetype.signature & mSignature) == mSignature)
+                mFunction(archetype);
     }
 
-    void addToGroup(Entity *mEntity, Group mGroup)
+  public:
+    static constexpr const char *name{"archetypes"};
+
+    void addBrick(const Vector2f &mPosition, const Vector2f &mHalfSize, std::uint32_t mQuad)
     {
-        groupedEntities[mGroup].emplace_back(mEntity);
+        auto &archetype(find(Signature{}.set(TPosition).set(TBody).set(TQuad).set(THits)));
+        archetype.positions.emplace_back(Position{mPosition});
+        archetype.bodies.emplace_back(Body{Vector2f{}, mHalfSize});
+        archetype.quads.emplace_back(Quad{Color::Red, mQuad});
+        archetype.hits.emplace_back(Hits{1});
     }
 
-    std::vector<Entity *> &getEntitiesByGroup(Group mGroup)
+    void addBall(const Vector2f &mPosition, const Vector2f &mVelocity, std::uint32_t mQuad)
     {
-        return groupedEntities[mGroup];
+        auto &archetype(find(Signature{}.set(TPosition).set(TBody).set(TQuad)));
+        archetype.positions.emplace_back(Position{mPosition});
+        archetype.bodies.emplace_back(Body{mVelocity, Vector2f{ballRadius, ballRadius}});
+        archetype.quads.emplace_back(Quad{Color::White, mQuad});
     }
 
-    void refresh()
+    template <typename TF>
+    void forBodies(TF &&mFunction)
     {
-        for (auto i(0u); i < maxGroups; i++)
-        {
-            auto &v(groupedEntities[i]);
-
-            v.erase(
-                std::remove_if(std::begin(v), std::end(v),
-                               [i](Entity *mEntity) {
-                                   return !mEntity->isAlive() || !mEntity->hasGroup(i);
-                               }),
-                std::end(v));
-        }
+        forMatching(Signature{}.set(TPosition).set(TBody), [&mFunction](Archetype &mArchetype) {
+            for (std::size_t i{0}; i < mArchetype.size(); ++i)
+                mFunction(mArchetype.positions[i], mArchetype.bodies[i]);
+        });
+    }
 
-        entities.erase(
-            std::remove_if(std::begin(entities), std::end(entities),
-                           [](const std::unique_ptr<Entity> &mEntity) {
-                               return !mEntity->isAlive();
-                           }),
-            std::end(entities));
+    template <typename TF>
+    void forBricks(TF &&mFunction)
+    {
+        forMatching(Signature{}.set(TPosition).set(TBody).set(THits), [&mFunction](Archetype &mArchetype) {
+            for (std::size_t i{0}; i < mArchetype.size(); ++i)
+                mFunction(mArchetype.positions[i], mArchetype.bodies[i], mArchetype.hits[i]);
+        });
     }
 
-    Entity &addEntity()
+    template <typename TF>
+    void forQuads(TF &&mFunction)
     {
-        Entity *e{new Entity{*this}};
-        std::unique_ptr<Entity> uPtr{e};
-        entities.emplace_back(std::move(uPtr));
-        return *e;
+        forMatching(Signature{}.set(TPosition).set(TQuad), [&mFunction](Archetype &mArchetype) {
+            for (std::size_t i{0}; i < mArchetype.size(); ++i)
+                mFunction(mArchetype.positions[i], mArchetype.quads[i]);
+        });
     }
 };
 
-void Entity::addGroup(Group mGroup) noexcept
+// The level of the workloads: bricks on a grid, and a ball for every ten
+// of them, created in that order like the game spawns them.
+template <typename TLayout>
+void populate(TLayout &mLayout, std::size_t mCount)
 {
-    groupBitset[mGroup] = true;
-    manager.addToGroup(this, mGroup);
+    std::uint32_t quad{0};
+    for (std::size_t i{0}; i < mCount; ++i)
+    {
+        const Vector2f position(i % 1000 * 8.f, i / 1000 * 8.f);
+        if (i % 10 == 9)
+            mLayout.addBall(position, Vector2f{ballVelocity, -ballVelocity}, quad++);
+        else
+            mLayout.addBrick(position, Vector2f{3.f, 3.f}, quad++);
+    }
 }
 
-// Position of the entities in the world
-struct CPosition : Component
+// `SPhysics`: everything moves, and bounces off the sides.
+template <typename TLayout>
+void integrate(TLayout &mLayout, float mFt)
 {
-    Vector2f position;
-
-    CPosition() = default;
-    CPosition(const Vector2f &mPosition) : position(mPosition) {}
-
-    float x() const noexcept { return position.x; }
-    float y() const noexcept { return position.y; }
-};
+    mLayout.forBodies([mFt](Position &mPosition, Body &mBody) {
+        mPosition.value += mBody.velocity * mFt;
+        if (mPosition.value.x < 0.f || mPosition.value.x > 8000.f)
+            mBody.velocity.x = -mBody.velocity.x;
+    });
+}
 
-struct CPhysics : Component
+// `testCollisionBB`: every brick against a ball, away from most of them.
+template <typename TLayout>
+std::size_t collide(TLayout &mLayout, const Vector2f &mBall)
 {
-    CPosition *cPosition{nullptr};
-    Vector2f velocity, halfSize;
-
-    std::function<void(const Vector2f &)> onOutOfBounds;
-    CPhysics(const Vector2f &mHalfSize) : halfSize{mHalfSize} {}
+    std::size_t hits{0};
+    mLayout.forBricks([&mBall, &hits](const Position &mPosition, const Body &mBody, Hits &mHits) {
+        if (std::abs(mPosition.value.x - mBall.x) < mBody.halfSize.x + ballRadius &&
+            std::abs(mPosition.value.y - mBall.y) < mBody.halfSize.y + ballRadius && mHits.left > 0)
+        {
+            --mHits.left;
+            ++hits;
+        }
+    });
+    return hits;
+}
 
-    void init() override
-    {
-        cPosition = &entity->getComponent<CPosition>();
-    }
+// `SRectangleSync`: the quad of everything drawn follows its position.
+template <typename TLayout>
+void sync(TLayout &mLayout, std::vector<Vertex> &mVertices)
+{
+    mLayout.forQuads([&mVertices](const Position &mPosition, const Quad &mQuad) {
+        static const Vector2f corners[4]{{-3.f, -3.f}, {3.f, -3.f}, {3.f, 3.f}, {-3.f, 3.f}};
 
-    void update(float mFT) override
-    {
-        cPosition->position += velocity * mFT;
+        auto vertex(&mVertices[mQuad.index * 4]);
+        for (std::size_t i{0}; i < 4; ++i)
+        {
+            vertex[i].position = mPosition.value + corners[i];
+            vertex[i].color = mQuad.color;
+        }
+    });
+}
 
-        if (onOutOfBounds == nullptr)
-            return;
+template <typename TLayout>
+void run(std::size_t mCount, volatile float &mSink)
+{
+    const std::size_t repetitions{std::max<std::size_t>(1, 1000000 / mCount)};
+    TLayout layout;
+    populate(layout, mCount);
+    std::vector<Vertex> vertices(mCount * 4);
+    HardwareCounters counters;
 
-        if (left() < 0)
-            onOutOfBounds(Vector2f{1.f, 0.f});
-        else if (right() > windowWidth)
-            onOutOfBounds(Vector2f{-1.f, 0.f});
+    auto measure([&](const char *mWorkload, const std::function<void()> &mFunction) {
+        BenchmarkTimer timer;
+        const auto firstMisses(counters.read()[HardwareCounters::HLLCMisses]);
+        timer.start();
+        for (std::size_t r{0}; r < repetitions; ++r)
+            mFunction();
+        timer.stop();
+        const auto operations(static_cast<double>(mCount * repetitions));
 
-        if (top() < 0)
-            onOutOfBounds(Vector2f{0.f, 1.0f});
-        else if (bottom() > windowHeight)
-            onOutOfBounds(Vector2f{0.f, -1.f});
-    }
+        std::printf("%-12s %-10s %8zu %10.2f ", TLayout::name, mWorkload, mCount,
+                    timer.getNanoseconds() / operations);
+        if (counters.isAvailable(HardwareCounters::HLLCMisses))
+            std::printf("%12.4f\n", (counters.read()[HardwareCounters::HLLCMisses] - firstMisses) / operations);
+        else
+            std::printf("%12s\n", "n/a");
+    });
 
-    float x() const noexcept { return cPosition->x(); }
-    float y() const noexcept { return cPosition->y(); }
-    float left() const noexcept { return x() - halfSize.x; }
-    float right() const noexcept { return x() + halfSize.x; }
-    float top() const noexcept { return y() - halfSize.y; }
-    float bottom() const noexcept { return y() + halfSize.y; }
-};
+    measure("integrate", [&layout] { integrate(layout, ftStep); });
+    measure("collide", [&layout, &mSink] { mSink = mSink + collide(layout, Vector2f{-100.f, -100.f}); });
+    measure("sync", [&layout, &vertices] { sync(layout, vertices); });
+    mSink = mSink + vertices[4].position.x;
+}
+} // namespace LayoutBenchmark
 
-struct CCircle : Component
+// Run the same integration, collision and render sync over the component
+// layouts above. `bench-layouts.sh` keeps its output in
+// benchmarks/layouts.txt.
+int runLayoutBenchmarks()
 {
-    Game *game{nullptr};
-    CPosition *cPosition{nullptr};
-    CircleShape shape;
-    float radius;
-
-    CCircle(Game *mGame, float mRadius) : game{mGame}, radius{mRadius} {}
+    using namespace LayoutBenchmark;
 
-    void init() override
-    {
-        cPosition = &entity->getComponent<CPosition>();
-
-        shape.setRadius(radius);
-        shape.setFillColor(Color::Red);
-        shape.setOrigin(radius, radius);
-    }
+    volatile float sink{0.f};
 
-    void update(float mFT) override
+    std::printf("%-12s %-10s %8s %10s %12s\n", "layout", "workload", "entities", "ns/entity", "misses/entity");
+    for (std::size_t count : {std::size_t{1000}, std::size_t{10000}, std::size_t{100000}, std::size_t{1000000}})
     {
-        shape.setPosition(cPosition->position);
+        run<PointerLayout>(count, sink);
+        run<PoolLayout>(count, sink);
+        run<ArchetypeLayout>(count, sink);
     }
 
-    void draw() override;
-};
+    return 0;
+}
 
-struct CRectangle : Component
+// Usage:
+//   SimpleArkanoid                               play the game
+//   SimpleArkanoid --headless [games] [steps] [hash] simulate without a window, fail on another state hash
+//   SimpleArkanoid --batch grid csv [threads]   tuning statistics of many games, see `BatchGrid`
+//   SimpleArkanoid --check-allocations [steps] [warm-up] fail when a steady step allocates
+//   SimpleArkanoid --self-test                   checks that need no window, run by ctest
+//   SimpleArkanoid --chaos [bodies]              play with extra bouncing bodies
+//   SimpleArkanoid --record file                 play and record the input
+//   SimpleArkanoid --replay file [speed]         replay a recording without a window
+//   SimpleArkanoid --flight-log file             the last seconds of a flight recorder dump, as CSV
+//   SimpleArkanoid --bench [--counters]          run the micro-benchmarks, with cache and branch misses
+//   SimpleArkanoid --bench-layouts               compare component memory layouts, see bench-layouts.sh
+//   SimpleArkanoid --perf-gate file [percent] [--update] [replays...] fail on slower scenarios than the baselines
+//   SimpleArkanoid --level file                  play a level, text or binary, reloaded when it changes
+//   SimpleArkanoid --edit file                   edit a level, S saves it to the file
+//   SimpleArkanoid --campaign file               play the levels of a list, loaded in the background
+//   SimpleArkanoid --convert-level in out        write a level in the binary format
+//   SimpleArkanoid --stream file [speed]         play a tall level that scrolls up
+//   SimpleArkanoid ... --textures directory      textured bricks, from directory/brick.png
+//   SimpleArkanoid ... --font file               HUD digits from a font instead of segments
+//   SimpleArkanoid ... --brick-field             grid levels in a brick field instead of entities
+//   SimpleArkanoid ... --autopilot               the paddle plays by itself
+//   SimpleArkanoid ... --config file             settings instead of arkanoid.cfg, see `Config`
+//   SimpleArkanoid ... --render-scale factor     draw at a lower or higher resolution than the window
+//   SimpleArkanoid ... --render-thread           draw on a thread of its own, as the last argument
+//   SimpleArkanoid ... --post bloom|crt|bloom,crt full-screen effects, F3 and F4 toggle them
+//   SimpleArkanoid ... --capture prefix          record every frame as PNG files, F11 toggles, F12 screenshots
+//   SimpleArkanoid --scenario [seconds] [replay] frame time benchmark on a crowded level
+//   SimpleArkanoid --multiball balls [collide|sweep] play with extra balls, sweep and prune for sweep
+//   SimpleArkanoid --pack archive files...       pack asset files into an archive
+//   SimpleArkanoid ... --music file [frames]     stream and loop a music track
+//   SimpleArkanoid ... --pace vsync|uncapped|fps frame pacing
+//   SimpleArkanoid ... --latency                 report the input to display latency
+//   SimpleArkanoid ... --trace file              where the timeline goes, with ARKANOID_TRACE
+//   SimpleArkanoid ... --stats [port]            serve counters for monitoring on a local port
+//   SimpleArkanoid ... --leaderboard url [name]  post the score of every game over to a leaderboard
+//   SimpleArkanoid ... --flight file [seconds]   write the session there on a crash, replayable
+//   SimpleArkanoid --serve [port]                host a two-player game over the network
+//   SimpleArkanoid --connect host [port]         join a two-player game
+//   SimpleArkanoid ... --broadcast [port]        let spectators watch the game
+//   SimpleArkanoid --spectate host [port]        watch a broadcast game
+//   SimpleArkanoid --server [matches] [port] [ticks] host many two-player games without a window
+int main(int argc, char *argv[])
 {
-    Game *game{nullptr};
-    CPosition *cPosition{nullptr};
-    RectangleShape shape;
-    Vector2f size;
+#ifdef ARKANOID_TRACE
+    // "--trace file" anywhere, the trace goes to trace.json otherwise.
+    for (int i{1}; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--trace") == 0)
+            CompositionArkanoid::Trace::get().setPath(argv[i + 1]);
+#endif
+    ARKANOID_THREAD("main");
+
+    if (argc > 1 && std::strcmp(argv[1], "--scenario") == 0)
+        return runScenario(argc > 3 ? argv[3] : nullptr, argc > 2 ? std::strtof(argv[2], nullptr) : 10.f);
 
-    CRectangle(Game *mGame, const Vector2f &mHalfSize) : game{mGame}, size{mHalfSize * 2.f} {}
+    // "--bench [--counters]", with the hardware counters of every benchmark.
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0)
+        return runBenchmarks(argc > 2 && std::strcmp(argv[2], "--counters") == 0);
 
-    void init() override
+    if (argc > 1 && std::strcmp(argv[1], "--bench-layouts") == 0)
+        return runLayoutBenchmarks();
+
+    // "--perf-gate baselines [threshold] [--update] [replays...]", the
+    // threshold in percent, 15 by default.
+    if (argc > 2 && std::strcmp(argv[1], "--perf-gate") == 0)
     {
-        cPosition = &entity->getComponent<CPosition>();
+        double threshold{15.0};
+        bool update{false};
+        std::vector<const char *> replays;
+        for (int i{3}; i < argc; ++i)
+            if (std::strcmp(argv[i], "--update") == 0)
+                update = true;
+            else if (i == 3 && std::isdigit(static_cast<unsigned char>(argv[i][0])) != 0)
+                threshold = std::strtod(argv[i], nullptr);
+            else
+                replays.emplace_back(argv[i]);
 
-        shape.setSize(size);
-        shape.setFillColor(Color::Red);
-        shape.setOrigin(size.x / 2.f, size.y / 2.f);
+        return runPerfGate(argv[2], threshold / 100.0, update, replays);
     }
 
-    void update(float mFT) override
+    // "--pack <archive> <files...>", e.g. --pack assets.arkp sounds/*.wav
+    if (argc > 2 && std::strcmp(argv[1], "--pack") == 0)
     {
-        shape.setPosition(cPosition->position);
-    }
+        if (!CompositionArkanoid::AssetArchive::pack(argv[2], std::vector<std::string>(argv + 3, argv + argc)))
+        {
+            cerr << "Can't write archive " << argv[2] << endl;
+            return 1;
+        }
 
-    void draw() override;
-};
+        return 0;
+    }
 
-struct CPaddleControl : Component
-{
-    CPhysics *cPhysics{nullptr};
+    // The level is read while the game creates its window, `levelRead`
+    // is checked once the game is there.
+    CompositionArkanoid::Level level;
+    std::future<bool> levelRead;
+    if (argc > 2 &&
+        (std::strcmp(argv[1], "--level") == 0 || std::strcmp(argv[1], "--convert-level") == 0 ||
+         std::strcmp(argv[1], "--stream") == 0))
+        levelRead = std::async(std::launch::async, [&level, argv] { return level.load(argv[2]); });
 
-    void init() override
+    // "--convert-level <in> <out>", to the compact format when the output
+    // ends with .arkz, to the binary one otherwise.
+    if (argc > 3 && std::strcmp(argv[1], "--convert-level") == 0)
     {
-        cPhysics = &entity->getComponent<CPhysics>();
+        if (!levelRead.get())
+        {
+            cerr << "Can't read level " << argv[2] << endl;
+            return 1;
+        }
+
+        const std::string out{argv[3]};
+        const bool compact{out.size() >= 5 && out.compare(out.size() - 5, 5, ".arkz") == 0};
+        if (compact ? level.saveCompact(argv[3]) : level.saveBinary(argv[3]))
+            return 0;
+
+        cerr << "Can't write level " << argv[3] << endl;
+        return 1;
     }
 
-    void update(float mFT) override
+    if (argc > 2 && std::strcmp(argv[1], "--replay") == 0)
     {
-        if (Keyboard::isKeyPressed(Keyboard::Key::Left) && cPhysics->left() > 0)
+        using CompositionArkanoid::Game;
+
+        CompositionArkanoid::Replay replay;
+        if (!replay.load(argv[2]))
         {
-            cPhysics->velocity.x = -paddleVelocity;
+            cerr << "Can't read replay " << argv[2] << endl;
+            return 1;
         }
-        else if (Keyboard::isKeyPressed(Keyboard::Key::Right) && cPhysics->right() < windowWidth)
+
+        Game game{Game::Mode::Headless, replay.getSeed()};
+
+        auto timePoint1(chrono::high_resolution_clock::now());
+        auto steps(game.play(replay, argc > 3 ? std::strtof(argv[3], nullptr) : 0.f));
+        auto timePoint2(chrono::high_resolution_clock::now());
+        auto seconds(chrono::duration_cast<chrono::duration<double>>(timePoint2 - timePoint1).count());
+
+        if (replay.getDivergedStep() != CompositionArkanoid::Replay::noStep)
         {
-            cPhysics->velocity.x = paddleVelocity;
+            cerr << "Replay diverged by step " << replay.getDivergedStep() << endl;
+            return 1;
         }
-        else
+
+        cout << steps << " steps in " << seconds * 1000.0 << " ms, "
+             << game.getBrickCount() << " bricks left, state hash " << std::hex
+             << game.stateHash.get() << std::dec << endl;
+        return 0;
+    }
+
+    if (argc > 2 && std::strcmp(argv[1], "--flight-log") == 0)
+    {
+        if (!CompositionArkanoid::FlightRecorder::printLog(argv[2], cout))
         {
-            cPhysics->velocity.x = 0;
+            cerr << "Can't read flight recorder dump " << argv[2] << endl;
+            return 1;
         }
+
+        return 0;
     }
-};
 
-// Using to check the colliding of two shapes.
-template <class T1, class T2>
-bool isIntersecting(T1 &mA, T2 &mB)
-{
-    return mA.right() >= mB.left() && mA.left() <= mB.right() && mA.bottom() >= mB.top() && mA.top() <= mB.bottom();
-}
+    if (argc > 1 && std::strcmp(argv[1], "--server") == 0)
+    {
+        std::size_t matches{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100};
+        const auto port(argc > 3 ? static_cast<unsigned short>(std::strtoul(argv[3], nullptr, 10))
+                                 : CompositionArkanoid::netDefaultPort);
+        std::size_t ticks{argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0};
+        return runServer(matches, port, ticks);
+    }
 
-// Testing the paddle and ball collision
-void testCollisionPB(Entity &mPaddle, Entity &mBall)
-{
-    auto &cpPaddle(mPaddle.getComponent<CPhysics>());
-    auto &cpBall(mBall.getComponent<CPhysics>());
+    if (argc > 3 && std::strcmp(argv[1], "--batch") == 0)
+        return runBatch(argv[2], argv[3], argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 0);
 
-    // If not collision, return.
-    if (!isIntersecting(cpPaddle, cpBall))
-        return;
+    if (argc > 1 && std::strcmp(argv[1], "--headless") == 0)
+    {
+        std::size_t games{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000};
+        std::size_t steps{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 10000};
+        // "--brick-field" and "--autopilot" after the numbers, in any order.
+        auto hasFlag([argc, argv](const char *mFlag) {
+            return std::find_if(argv + 2, argv + argc, [mFlag](const char *mArgument) {
+                       return std::strcmp(mArgument, mFlag) == 0;
+                   }) != argv + argc;
+        });
+        return runHeadless(games, steps, argc > 4 && argv[4][0] != '-' ? argv[4] : nullptr, hasFlag("--brick-field"),
+                           hasFlag("--autopilot"));
+    }
 
-    // Otherwise change velocity (push ball to upwards).
-    cpBall.velocity.y = -ballVelocity;
+    if (argc > 1 && std::strcmp(argv[1], "--self-test") == 0)
+        return runSelfTests();
 
-    // and dependes of the paddle position.
-    if (cpBall.x() < cpPaddle.x())
-        cpBall.velocity.x = -ballVelocity;
-    else
-        cpBall.velocity.x = ballVelocity;
-}
+    if (argc > 1 && std::strcmp(argv[1], "--check-allocations") == 0)
+    {
+        std::size_t steps{argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000};
+        std::size_t warmUp{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 120};
+        return checkAllocations(steps, warmUp);
+    }
 
-// Overriding testCollision method for bricks and ball
-void testCollisionBB(Entity &mBrick, Entity &mBall)
-{
-    auto &cpBrick(mBrick.getComponent<CPhysics>());
-    auto &cpBall(mBall.getComponent<CPhysics>());
+    CompositionArkanoid::Game game;
+    if (levelRead.valid() && !levelRead.get())
+    {
+        cerr << "Can't read level " << argv[2] << endl;
+        return 1;
+    }
 
-    // If not collision, return.
-    if (!isIntersecting(cpBrick, cpBall))
-        return;
+    // "--config file" anywhere, arkanoid.cfg otherwise.
+    const char *configPath{"arkanoid.cfg"};
+    for (int i{1}; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--config") == 0)
+            configPath = argv[i + 1];
+    if (!game.loadConfig(configPath) && std::strcmp(configPath, "arkanoid.cfg") != 0)
+        cerr << "Can't read config " << configPath << endl;
 
-    // Otherwise destroy the brick!
-    mBrick.destroy();
+    // Can be combined with the modes below.
+    for (int i{1}; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--textures") != 0)
+            continue;
 
-    // Calculate intersections
-    float overlapLeft{cpBall.right() - cpBrick.left()};
-    float overlapRight{cpBrick.right() - cpBall.left()};
-    float overlapTop{cpBall.bottom() - cpBrick.top()};
-    float overlapBottom{cpBrick.bottom() - cpBall.top()};
+        game.loadTextures(argv[i + 1]);
+        game.loadLevel(CompositionArkanoid::Level::createDefault());
+    }
 
-    bool ballFromLeft(abs(overlapLeft) < abs(overlapRight));
-    bool ballFromTop(abs(overlapTop) < abs(overlapBottom));
+    for (int i{1}; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--font") == 0)
+            game.loadFont(argv[i + 1]);
 
-    float minOverlapX{ballFromLeft ? overlapLeft : overlapRight};
-    float minOverlapY{ballFromTop ? overlapTop : overlapBottom};
+    for (int i{1}; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--brick-field") != 0)
+            continue;
 
-    if (abs(minOverlapX) < abs(minOverlapY))
-        cpBall.velocity.x = ballFromLeft ? -ballVelocity : ballVelocity;
-    else
-        cpBall.velocity.y = ballFromTop ? -ballFromTop : ballVelocity;
-}
+        game.brickFieldLevels = true;
+        game.loadLevel(CompositionArkanoid::Level::createDefault());
+    }
 
-struct Game
-{
-    enum ArkanoidGroup : std::size_t
-    {
-        GPaddle,
-        GBrick,
-        GBall
-    };
+    // "--render-scale <factor>", 0.5 draws the game at half the resolution.
+    for (int i{1}; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--render-scale") == 0 && !game.setRenderScale(std::strtof(argv[i + 1], nullptr)))
+            cerr << "Can't render at a scale of " << argv[i + 1] << endl;
 
-    RenderWindow window{{windowWidth, windowHeight}, "Simple Arkanoid"};
-    // Accumulate the current frametime slice.
-    // If the game run fast, it will take some frames before
-    // currentSlice >= ftSlice.
-    // else if the game run slow, it will take a single frame for
-    // currentSlice >= ftSlice * n, where n >= 1.
-    FrameTime lastFrametime{0.f}, currentSlice{0.f};
-    bool running{false};
-    Manager manager;
+    // "--capture <prefix>", every frame as <prefix>000000.png and on.
+    for (int i{1}; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--capture") == 0)
+            game.capture.startRecording(argv[i + 1]);
 
-    Entity &createBall()
-    {
-        auto &entity(manager.addEntity());
-        entity.addComponent<CPosition>(Vector2f{windowWidth / 2, windowHeight / 2});
-        entity.addComponent<CPhysics>(Vector2f{ballRadius, ballRadius});
-        entity.addComponent<CCircle>(this, ballRadius);
+    // "--post <effects>", bloom, crt or both as "bloom,crt".
+    for (int i{1}; i + 1 < argc; ++i)
+        if (std::strcmp(argv[i], "--post") == 0 &&
+            !game.setPostProcess(std::strstr(argv[i + 1], "bloom") != nullptr, std::strstr(argv[i + 1], "crt") != nullptr))
+            cerr << "Can't use the effects " << argv[i + 1] << endl;
 
-        auto &cPhysics(entity.getComponent<CPhysics>());
-        cPhysics.velocity = Vector2f{-ballVelocity, -ballVelocity};
-        cPhysics.onOutOfBounds = [&cPhysics](const Vector2f &mSide) {
-            if (mSide.x != 0.f)
-            {
-                cPhysics.velocity.x = std::abs(cPhysics.velocity.x) * mSide.x;
-            }
+    // For soak tests, the paddle plays by itself.
+    for (int i{1}; i < argc; ++i)
+        if (std::strcmp(argv[i], "--autopilot") == 0)
+            game.enableAutopilot();
 
-            if (mSide.y != 0.f)
-            {
-                cPhysics.velocity.y = std::abs(cPhysics.velocity.y) * mSide.y;
-            }
-        };
+    // "--music <file> [buffer frames]", streamed and looped.
+    for (int i{1}; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--music") != 0)
+            continue;
 
-        entity.addGroup(ArkanoidGroup::GBall);
+        if (i + 2 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 2][0])))
+            game.music->setBufferFrames(std::strtoul(argv[i + 2], nullptr, 10));
 
-        return entity;
+        game.music->queue(argv[i + 1]);
     }
 
-    Entity &createBrick(const Vector2f &mPosition)
+    // "--pace vsync", "--pace uncapped" or "--pace <frames per second>".
+    for (int i{1}; i + 1 < argc; ++i)
     {
-        Vector2f halfSize{blockWidth / 2.f, blockHeight / 2.f};
-        auto &entity(manager.addEntity());
-
-        entity.addComponent<CPosition>(mPosition);
-        entity.addComponent<CPhysics>(halfSize);
-        entity.addComponent<CRectangle>(this, halfSize);
+        using CompositionArkanoid::FramePacer;
 
-        entity.addGroup(ArkanoidGroup::GBrick);
+        if (std::strcmp(argv[i], "--pace") != 0)
+            continue;
 
-        return entity;
+        if (std::strcmp(argv[i + 1], "vsync") == 0)
+            game.pacer.setMode(*game.window, FramePacer::Mode::VSync);
+        else if (std::strcmp(argv[i + 1], "uncapped") == 0)
+            game.pacer.setMode(*game.window, FramePacer::Mode::Uncapped);
+        else
+            game.pacer.setMode(*game.window, FramePacer::Mode::Limit, std::strtof(argv[i + 1], nullptr));
     }
 
-    Entity &createPaddle()
+    // "--stats [port]" anywhere, counters for monitoring on a local port.
+    CompositionArkanoid::StatsServer statsServer;
+    for (int i{1}; i < argc; ++i)
     {
-        Vector2f halfSize{paddleWidth / 2.f, paddleHeight / 2.f};
-        auto &entity(manager.addEntity());
+        if (std::strcmp(argv[i], "--stats") != 0)
+            continue;
 
-        entity.addComponent<CPosition>(Vector2f{windowWidth / 2, windowHeight - 60.f});
-        entity.addComponent<CPhysics>(halfSize);
-        entity.addComponent<CRectangle>(this, halfSize);
-        entity.addComponent<CPaddleControl>();
+        const auto port(i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))
+                            ? static_cast<unsigned short>(std::strtoul(argv[i + 1], nullptr, 10))
+                            : CompositionArkanoid::statsDefaultPort);
+        if (!statsServer.listen(port))
+        {
+            cerr << "Can't listen on port " << port << endl;
+            return 1;
+        }
 
-        entity.addGroup(ArkanoidGroup::GPaddle);
+        game.statsServer = &statsServer;
+    }
 
-        return entity;
+    // "--leaderboard <url> [name]" anywhere, e.g. --leaderboard
+    // http://scores.example.com:8080/arkanoid alice
+    CompositionArkanoid::Leaderboard leaderboard;
+    for (int i{1}; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--leaderboard") != 0)
+            continue;
+
+        if (!leaderboard.open(argv[i + 1]))
+        {
+            cerr << "Can't use leaderboard " << argv[i + 1] << endl;
+            return 1;
+        }
+
+        game.leaderboard = &leaderboard;
+        if (i + 2 < argc && argv[i + 2][0] != '-')
+            game.playerName = argv[i + 2];
     }
 
-    Game()
+    // "--broadcast [port]" anywhere, spectators can watch the game.
+    CompositionArkanoid::NetBroadcast netBroadcast;
+    for (int i{1}; i < argc; ++i)
     {
-        window.setFramerateLimit(60);
-        createPaddle();
-        createBall();
-        for (int iX{0}; iX < countBlockX; ++iX)
+        if (std::strcmp(argv[i], "--broadcast") != 0)
+            continue;
+
+        const auto port(i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))
+                            ? static_cast<unsigned short>(std::strtoul(argv[i + 1], nullptr, 10))
+                            : CompositionArkanoid::broadcastDefaultPort);
+        if (!netBroadcast.listen(port))
         {
-            for (int iY{0}; iY < countBlockY; ++iY)
-            {
-                createBrick(Vector2f{(iX + 1) * (blockWidth + 3) + 22, (iY + 2) * (blockHeight + 3)});
-            }
+            cerr << "Can't listen on port " << port << endl;
+            return 1;
         }
+
+        game.netBroadcast = &netBroadcast;
     }
 
-    void run()
+    // "--flight <file> [seconds]" anywhere, the session goes to the file
+    // when the game crashes, with the last 30 seconds by default.
+    std::unique_ptr<CompositionArkanoid::FlightRecorder> flightRecorder;
+    for (int i{1}; i + 1 < argc; ++i)
     {
-        running = true;
+        if (std::strcmp(argv[i], "--flight") != 0)
+            continue;
 
-        while (running)
+        const float seconds{i + 2 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 2][0]))
+                                ? std::strtof(argv[i + 2], nullptr)
+                                : 30.f};
+        flightRecorder.reset(new CompositionArkanoid::FlightRecorder{game.seed, game.timeStep, seconds});
+        if (!flightRecorder->install(argv[i + 1]))
         {
-            // Start of time interval
-            auto timePoint1(chrono::high_resolution_clock::now());
+            cerr << "Can't record the flight into " << argv[i + 1] << endl;
+            return 1;
+        }
 
-            inputPhase();
-            updatePhase();
-            drawPhase();
+        game.flightRecorder = flightRecorder.get();
+    }
 
-            // End of interval
-            auto timePoint2(chrono::high_resolution_clock::now());
+    if (argc > 1 && std::strcmp(argv[1], "--chaos") == 0)
+        game.spawnChaosBodies(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000);
 
-            // Calculate the elapsed time in milliseconds
-            // substract two std::chrono::time_point objects
-            // return a std::chrono::duration object, wich
-            // represent a period.
-            auto elapsedTime(timePoint2 - timePoint1);
+    // "--multiball <balls> [collide|sweep]", add balls as a stress test,
+    // they bounce off each other with "collide", or "sweep" to pair them
+    // up with sweep and prune instead of the grid.
+    if (argc > 2 && std::strcmp(argv[1], "--multiball") == 0)
+    {
+        game.spawnBalls(std::strtoul(argv[2], nullptr, 10), Vector2f{windowWidth / 2.f, windowHeight * 0.75f});
+        game.sweepBalls = argc > 3 && std::strcmp(argv[3], "sweep") == 0;
+        if (game.sweepBalls || (argc > 3 && std::strcmp(argv[3], "collide") == 0))
+            game.collisions.enable(CompositionArkanoid::Game::GBall, CompositionArkanoid::Game::GBall);
+    }
 
-            // Convert a duration to float using
-            // the safe cast function chrono::duration_cast
-            FrameTime ft{chrono::duration_cast<chrono::duration<float, milli>>(elapsedTime).count()};
+    // Edits of the file show up in the running game, F5 reloads it too.
+    if (argc > 2 && std::strcmp(argv[1], "--level") == 0)
+    {
+        game.loadLevel(level);
+        game.levelWatcher.watch(argv[2]);
+    }
 
-            lastFrametime = ft;
-            // We can approximate the fps by dividing 1.f by the elapsed seconds
-            // calculated by convert ft to seconds.
-            auto ftSeconds(ft / 1000.f);
-            auto fps(1.f / ftSeconds);
+    // "--edit <file>", start in the editor on the level of the file, or
+    // on the default one when there is none yet. S saves it there.
+    if (argc > 2 && std::strcmp(argv[1], "--edit") == 0)
+    {
+        if (level.load(argv[2]))
+            game.loadLevel(level);
+        game.editorPath = argv[2];
+        game.setEditing(true);
+    }
 
-            window.setTitle("FT: " + to_string(ft) + "\t FPS: " + to_string(fps));
+    // "--campaign <file>", its levels one after the other.
+    if (argc > 2 && std::strcmp(argv[1], "--campaign") == 0)
+    {
+        game.campaign.reset(new CompositionArkanoid::Campaign);
+        if (!game.campaign->load(argv[2]))
+        {
+            cerr << "Can't read campaign " << argv[2] << endl;
+            return 1;
         }
+
+        // The levels on a grid are swapped in whole, not created brick by
+        // brick.
+        game.brickFieldLevels = true;
+        game.nextLevel();
     }
 
-    void inputPhase()
+    if (argc > 2 && std::strcmp(argv[1], "--stream") == 0)
     {
-        // check all the window's events that were triggered since the last iteration of the loop
-        sf::Event event;
-        while (window.pollEvent(event))
+        // The bricks come in as the level scrolls, into the grid.
+        if (level.findOversized(true) != nullptr)
         {
-            // "close requested" event: we close the window
-            if (event.type == sf::Event::Closed)
-            {
-                running = false;
-                window.close();
-                break;
-            }
+            cerr << "Bricks of a streamed level must fit a cell of the brick grid" << endl;
+            return 1;
         }
 
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Escape))
+        game.loadLevel(CompositionArkanoid::Level{});
+        game.levelStreamer.reset(new CompositionArkanoid::LevelStreamer{std::move(level)});
+        game.scrollVelocity = argc > 3 ? std::strtof(argv[3], nullptr) : 0.02f;
+    }
+
+    // "--serve [port]" and "--connect <host> [port]", a two-player game
+    // over the network on the default level.
+    CompositionArkanoid::NetServer netServer;
+    CompositionArkanoid::NetClient netClient;
+    if (argc > 1 && std::strcmp(argv[1], "--serve") == 0)
+    {
+        const auto port(argc > 2 ? static_cast<unsigned short>(std::strtoul(argv[2], nullptr, 10))
+                                 : CompositionArkanoid::netDefaultPort);
+        if (!netServer.listen(port))
         {
-            running = false;
+            cerr << "Can't listen on port " << port << endl;
+            return 1;
         }
+
+        game.addSecondPlayer();
+        game.netServer = &netServer;
+        game.run();
+        netServer.report();
+        return 0;
     }
 
-    void updatePhase()
+    if (argc > 2 && std::strcmp(argv[1], "--connect") == 0)
     {
-        // Start accumulate frametime
-        currentSlice += lastFrametime;
-
-        // If currentSilice is grather or equal to ftSlice we update our game logic
-        // and decrease currentSlice until currentSlice becomes less than ftSlice.
-        // Ex. if currentSlice is three times as big as ftSlice, we update or
-        // game logic three times.
-        for (; currentSlice >= ftSlice; currentSlice -= ftSlice)
+        const auto port(argc > 3 ? static_cast<unsigned short>(std::strtoul(argv[3], nullptr, 10))
+                                 : CompositionArkanoid::netDefaultPort);
+        if (!netClient.connect(argv[2], port))
         {
-            /* // Update the ball position every loop.
-            ball.Update(ftStep);
-            // Update the paddle.
-            paddle.Update(ftStep);*/
-            manager.refresh();
-            manager.update(ftStep);
+            cerr << "Can't connect to " << argv[2] << endl;
+            return 1;
+        }
 
-            auto &paddles(manager.getEntitiesByGroup(GPaddle));
-            auto &bricks(manager.getEntitiesByGroup(GBrick));
-            auto &balls(manager.getEntitiesByGroup(GBall));
+        game.addSecondPlayer();
+        game.netClient = &netClient;
+        game.run();
+        cout << netClient.getRollbackCount() << " paddle rollbacks" << endl;
+        return 0;
+    }
 
-            for (auto &b : balls)
-            {
-                for (auto &p : paddles)
-                    testCollisionPB(*p, *b);
-                for (auto &br : bricks)
-                    testCollisionBB(*br, *b);
-            }
+    // "--spectate <host> [port]", on the default level like the players.
+    if (argc > 2 && std::strcmp(argv[1], "--spectate") == 0)
+    {
+        const auto port(argc > 3 ? static_cast<unsigned short>(std::strtoul(argv[3], nullptr, 10))
+                                 : CompositionArkanoid::broadcastDefaultPort);
+        CompositionArkanoid::NetSpectator netSpectator;
+        if (!netSpectator.connect(argv[2], port))
+        {
+            cerr << "Can't connect to " << argv[2] << endl;
+            return 1;
         }
+
+        game.netSpectator = &netSpectator;
+        game.run();
+        return 0;
     }
 
-    void drawPhase()
+    // Can be combined with the modes above, as the last argument.
+    if (argc > 1 && std::strcmp(argv[argc - 1], "--render-thread") == 0)
+        game.startRenderThread();
+
+    // Can be combined with the modes above and with recording.
+    CompositionArkanoid::LatencyProbe latencyProbe;
+    const bool measureLatency{std::find_if(argv + 1, argv + argc, [](const char *mArgument) {
+                                  return std::strcmp(mArgument, "--latency") == 0;
+                              }) != argv + argc};
+    if (measureLatency)
+        game.latencyProbe = &latencyProbe;
+
+    if (argc > 2 && std::strcmp(argv[1], "--record") == 0)
     {
-        // Clear window, for some reason I need to do this after events in MacOS.
-        window.clear(Color::Black);
+        CompositionArkanoid::Replay replay{game.seed, game.timeStep};
+        game.recording = &replay;
+        game.run();
+        game.recording = nullptr;
 
-        manager.draw();
+        if (measureLatency)
+        {
+            game.renderThread.reset();
+            latencyProbe.report();
+        }
 
-        // Displaying the window.
-        window.display();
-    }
+        if (!replay.save(argv[2]))
+        {
+            cerr << "Can't write replay " << argv[2] << endl;
+            return 1;
+        }
 
-    void render(const Drawable &mDrawable)
-    {
-        window.draw(mDrawable);
+        return 0;
     }
-};
 
-void CCircle::draw()
-{
-    game->render(shape);
-}
+    game.run();
 
-void CRectangle::draw()
-{
-    game->render(shape);
-}
-} // namespace CompositionArkanoid
+    if (measureLatency)
+    {
+        // The render thread may still be displaying frames.
+        game.renderThread.reset();
+        latencyProbe.report();
+    }
 
-int main()
-{
-    CompositionArkanoid::Game{}.run();
     return 0;
 }
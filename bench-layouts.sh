@@ -0,0 +1,19 @@
+#!/bin/bash
+# Component layout benchmark: builds a Release binary in build-bench and
+# keeps the --bench-layouts table in benchmarks/layouts.txt, with the
+# machine it ran on. Extra arguments are passed to cmake, e.g. -DSFML_DIR=...
+# The cache misses need perf_event, e.g. sysctl kernel.perf_event_paranoid=1,
+# the column says n/a without it.
+set -e
+
+cmake -S . -B build-bench -DCMAKE_BUILD_TYPE=Release "$@"
+cmake --build build-bench
+
+cpu="$(sysctl -n machdep.cpu.brand_string 2>/dev/null || grep -m1 'model name' /proc/cpuinfo | cut -d: -f2 | sed 's/^ //')"
+mkdir -p benchmarks
+{
+    echo "# SimpleArkanoid --bench-layouts, $(date -u +%Y-%m-%d)"
+    echo "# $(uname -sm), $cpu"
+    ./build-bench/SimpleArkanoid --bench-layouts
+} > benchmarks/layouts.txt
+cat benchmarks/layouts.txt
@@ -1,7 +1,9 @@
 #!bin/bash
 echo "Building and linking SimpleArkanoid"
-clang++ SimpleArkanoid.cpp -o build/SimpleArkanoid -std=c++11 -stdlib=libc++ -mmacosx-version-min=10.11 \
-         -Wl,-rpath,. -L./lib/ -lsfml-window -lsfml-graphics -lsfml-system
+# Quick macOS build against the bundled SFML, see CMakeLists.txt for the others.
+# Extra arguments are passed to the compiler, e.g. -DARKANOID_STATIC_COMPONENT_IDS
+clang++ SimpleArkanoid.cpp -o build/SimpleArkanoid -std=c++17 -O2 -stdlib=libc++ -mmacosx-version-min=14.0 \
+         -Wl,-rpath,. -L./lib/ -lsfml-audio -lsfml-network -lsfml-window -lsfml-graphics -lsfml-system "$@"
 cd lib
 echo "Copying libs"
 cp -r ./ ../build
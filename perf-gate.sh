@@ -0,0 +1,22 @@
+#!/bin/bash
+# Performance regression gate: builds a Release binary in build-bench and
+# plays the headless scenarios against benchmarks/baselines.json, failing
+# when one got slower than its baseline by more than $THRESHOLD percent
+# (15 by default) or allocates more per step. Replays given as arguments
+# are scenarios too. With --update as first argument the results become
+# the new baselines, to commit along with the change that moved them.
+# Baselines only compare on the machine they were recorded on.
+# Extra cmake arguments go in $CMAKE_ARGS, e.g. CMAKE_ARGS=-DSFML_DIR=...
+set -e
+
+update=""
+if [ "$1" = "--update" ]; then
+    update="--update"
+    shift
+fi
+
+cmake -S . -B build-bench -DCMAKE_BUILD_TYPE=Release -DARKANOID_COUNT_ALLOCATIONS=ON $CMAKE_ARGS
+cmake --build build-bench
+
+mkdir -p benchmarks
+./build-bench/SimpleArkanoid --perf-gate benchmarks/baselines.json "${THRESHOLD:-15}" $update "$@"
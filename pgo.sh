@@ -0,0 +1,34 @@
+#!/bin/bash
+# Profile guided optimization build:
+#   1. build an instrumented binary in build-pgo/generate
+#   2. train it with a headless run, or with the replay given as first argument
+#   3. rebuild in build-pgo/use with the profile applied
+# Extra arguments after the replay are passed to cmake, e.g. -DSFML_DIR=...
+set -e
+
+replay="$1"
+shift || true
+pgoDir="$(pwd)/build-pgo/profile"
+rm -rf "$pgoDir"
+mkdir -p "$pgoDir"
+
+echo "Building the instrumented binary"
+cmake -S . -B build-pgo/generate -DCMAKE_BUILD_TYPE=Release -DARKANOID_PGO=generate -DARKANOID_PGO_DIR="$pgoDir" "$@"
+cmake --build build-pgo/generate
+
+echo "Training"
+if [ -n "$replay" ]; then
+    ./build-pgo/generate/SimpleArkanoid --replay "$replay"
+else
+    ./build-pgo/generate/SimpleArkanoid --headless 200 20000
+fi
+
+# Clang needs the raw profiles merged, GCC reads its .gcda files directly.
+if ls "$pgoDir"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$pgoDir/arkanoid.profdata" "$pgoDir"/*.profraw
+fi
+
+echo "Building with the profile"
+cmake -S . -B build-pgo/use -DCMAKE_BUILD_TYPE=Release -DARKANOID_PGO=use -DARKANOID_PGO_DIR="$pgoDir" "$@"
+cmake --build build-pgo/use
+echo "Ready: build-pgo/use/SimpleArkanoid"
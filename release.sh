@@ -0,0 +1,55 @@
+#!/bin/bash
+# Static release build: builds the same Release binary linked against the
+# shared SFML in build-release/shared and statically, with the unused
+# sections dropped, in build-release/static, then keeps their sizes and
+# startup times in benchmarks/release.txt. The static one is the one to
+# ship, it needs no lib/ folder next to it.
+# Extra arguments are passed to cmake, e.g. -DSFML_DIR=... for an SFML
+# built with static libraries (cmake -DBUILD_SHARED_LIBS=OFF).
+# Startup is the wall time of a one step headless game, process start and
+# library loading included. With a display, the time to the first frame
+# printed by a windowed run is kept too.
+set -e
+
+runs=20
+
+cmake -S . -B build-release/shared -DCMAKE_BUILD_TYPE=Release "$@"
+cmake --build build-release/shared
+cmake -S . -B build-release/static -DCMAKE_BUILD_TYPE=Release -DARKANOID_STATIC=ON "$@"
+cmake --build build-release/static
+
+# Milliseconds, the best of the runs: the others measure the machine.
+startup() {
+    best=""
+    for _ in $(seq "$runs"); do
+        start=$(date +%s%N)
+        "$1" --headless 1 1 > /dev/null
+        elapsed=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+            best=$elapsed
+        fi
+    done
+    echo "$best"
+}
+
+firstFrame() {
+    if [ -z "$DISPLAY" ] && [ "$(uname -s)" != "Darwin" ]; then
+        echo "n/a"
+        return
+    fi
+
+    # A tenth of a second of the scenario, its window closes by itself.
+    "$1" --scenario 0.1 2> /dev/null | sed -n 's/^First frame after \(.*\) ms$/\1/p' | head -n1
+}
+
+mkdir -p benchmarks
+{
+    echo "# Static release, $(date -u +%Y-%m-%d)"
+    echo "# $(uname -sm)"
+    echo "# build   size (bytes)   headless startup (ms, best of $runs)   first frame (ms)"
+    for build in shared static; do
+        binary="build-release/$build/SimpleArkanoid"
+        echo "$build   $(wc -c < "$binary" | tr -d ' ')   $(startup "$binary")   $(firstFrame "$binary")"
+    done
+} > benchmarks/release.txt
+cat benchmarks/release.txt